@@ -7,6 +7,15 @@ layout( location = 4 ) in vec3 iDiffuse;
 layout( location = 5 ) in vec3 iSpecular;
 layout( location = 6 ) in float iShininess;
 layout( location = 7 ) in float iAlpha;
+layout( location = 8 ) in uint iDrawId; // multi-draw only, see StaticGeometry
+//per-instance data (see InstancedMesh); identity/white when not instanced
+layout( location = 9 ) in vec4 iInstanceRow0;
+layout( location = 10 ) in vec4 iInstanceRow1;
+layout( location = 11 ) in vec4 iInstanceRow2;
+layout( location = 12 ) in vec3 iInstanceNormalRow0;
+layout( location = 13 ) in vec3 iInstanceNormalRow1;
+layout( location = 14 ) in vec3 iInstanceNormalRow2;
+layout( location = 15 ) in vec4 iInstanceTint;
 
 
 layout( location = 0 ) uniform mat4 uProjection;
@@ -17,6 +26,19 @@ layout( location = 6 ) uniform mat4 uView;
 layout( location = 7 ) uniform float isTex;
 layout( location = 8 ) uniform float isEmi;
 layout( location = 9 ) uniform float isMulti;
+layout( location = 10 ) uniform float isBatched;
+
+//per-draw data for multi-draws (see MultiDrawBatch); rows of the matrices
+struct DrawRecord
+{
+	vec4 model[4];
+	vec4 normal[3];
+	vec4 flags; //isTex, isEmi, isMulti
+};
+layout( std430, binding = 0 ) readonly buffer DrawRecords
+{
+	DrawRecord uDraws[];
+};
 
 out vec3 v2fNormal;
 out vec3 v2fPos;
@@ -36,17 +58,35 @@ out float oMulti;
 void main()
 {
 	//send values to fragment shader
-	uAmbient = iAmbient;
-	uDiffuse = iDiffuse;
-	uSpecular = iSpecular;
+	uAmbient = iAmbient * iInstanceTint.rgb;
+	uDiffuse = iDiffuse * iInstanceTint.rgb;
+	uSpecular = iSpecular * iInstanceTint.rgb;
 	uShininess = iShininess;
-	uAlpha = iAlpha;
+	uAlpha = iAlpha * iInstanceTint.a;
 	v2fTexCoord = iTexCoord;
-	oTex = isTex;
-	oEmi = isEmi;
-	oMulti = isMulti;
-	v2fNormal = normalize(uNormalMatrix * iNormal);
-	v2fPos = vec3(uModel * vec4(iPosition,1.0));
 	v2fView = vec3(uCamPos);
-	gl_Position = (uProjection * uView  * uModel * vec4( iPosition, 1.0 )); //calculate projcamworld.
+
+	//instance transform is applied first
+	vec4 pos = vec4(dot(iInstanceRow0, vec4(iPosition, 1.0)), dot(iInstanceRow1, vec4(iPosition, 1.0)), dot(iInstanceRow2, vec4(iPosition, 1.0)), 1.0);
+	vec3 normal = vec3(dot(iInstanceNormalRow0, iNormal), dot(iInstanceNormalRow1, iNormal), dot(iInstanceNormalRow2, iNormal));
+
+	vec4 worldPos;
+	if (isBatched > 0.5) {
+		DrawRecord draw = uDraws[iDrawId];
+		worldPos = vec4(dot(draw.model[0], pos), dot(draw.model[1], pos), dot(draw.model[2], pos), dot(draw.model[3], pos));
+		v2fNormal = normalize(vec3(dot(draw.normal[0].xyz, normal), dot(draw.normal[1].xyz, normal), dot(draw.normal[2].xyz, normal)));
+		oTex = draw.flags.x;
+		oEmi = draw.flags.y;
+		oMulti = draw.flags.z;
+	}
+	else {
+		worldPos = uModel * pos;
+		v2fNormal = normalize(uNormalMatrix * normal);
+		oTex = isTex;
+		oEmi = isEmi;
+		oMulti = isMulti;
+	}
+
+	v2fPos = vec3(worldPos);
+	gl_Position = (uProjection * uView * worldPos); //calculate projcamworld.
 }
@@ -0,0 +1,268 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+#include "../support/error.hpp"
+
+namespace
+{
+	constexpr float kPi_ = 3.1415926f;
+
+	// Length of the camera path (seconds); it repeats after that.
+	constexpr float kPathDuration_ = 20.f;
+
+	// The rocket launches kLaunchStart_ seconds into the benchmark
+	constexpr float kLaunchStart_ = 5.f;
+
+	constexpr std::size_t kNoFrame_ = ~std::size_t(0);
+
+	char const* const kPhaseNames_[kBenchmarkPhaseCount] = {
+		"update", "culling", "ui", "snapshot", "draw", "swap"
+	};
+
+	struct Stats_
+	{
+		float min, avg, p50, p95, p99, max;
+	};
+
+	// Nearest-rank percentiles
+	Stats_ compute_stats_( std::vector<float> aValues )
+	{
+		if( aValues.empty() )
+			return Stats_{};
+
+		std::sort( aValues.begin(), aValues.end() );
+
+		auto const percentile = [&] ( float aP ) {
+			auto const rank = std::size_t(std::ceil( aP / 100.f * aValues.size() ));
+			return aValues[std::min( aValues.size(), std::max<std::size_t>( rank, 1 ) ) - 1];
+		};
+
+		double sum = 0.0;
+		for( auto const v : aValues )
+			sum += v;
+
+		return Stats_{
+			aValues.front(),
+			float(sum / aValues.size()),
+			percentile( 50.f ),
+			percentile( 95.f ),
+			percentile( 99.f ),
+			aValues.back()
+		};
+	}
+
+	void write_stats_( std::FILE* aFile, char const* aName, Stats_ const& aStats, bool aLast )
+	{
+		std::fprintf( aFile, "\t\t\"%s\": { \"min\": %.4f, \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+			aName, aStats.min, aStats.avg, aStats.p50, aStats.p95, aStats.p99, aStats.max, aLast ? "" : ","
+		);
+	}
+}
+
+SceneCamera benchmark_camera( SceneCamera const& aStart, float aTime ) noexcept
+{
+	// Smooth, periodic offsets from the start position, so that the path
+	// begins and ends there: pan around the pad, move in and out, and tilt
+	// the camera up and down a little.
+	float const s = 2.f * kPi_ * std::fmod( aTime, kPathDuration_ ) / kPathDuration_;
+
+	auto ret = aStart;
+	ret.phi = aStart.phi + 0.6f * std::sin( s );
+	ret.theta = aStart.theta + 0.15f * (1.f - std::cos( 2.f * s ));
+	ret.radius = aStart.radius - 6.f * (1.f - std::cos( s ));
+	ret.y = aStart.y - 1.5f * (1.f - std::cos( s ));
+	return ret;
+}
+
+bool benchmark_launch( float aTime ) noexcept
+{
+	return aTime >= kLaunchStart_;
+}
+
+
+BenchmarkRecorder::BenchmarkRecorder( std::size_t aFrames, std::size_t aWarmupFrames )
+	: mFrames( aFrames )
+	, mWarmupFrames( aWarmupFrames )
+{
+	std::fill( std::begin( mQueryFrame ), std::end( mQueryFrame ), kNoFrame_ );
+
+	mTimerQueries = 0 != GLAD_GL_VERSION_3_3;
+	if( mTimerQueries )
+		glGenQueries( GLsizei(kQueryLatency_), mQueries );
+
+	mRecorded.reserve( aFrames );
+}
+
+BenchmarkRecorder::~BenchmarkRecorder()
+{
+	if( mTimerQueries )
+		glDeleteQueries( GLsizei(kQueryLatency_), mQueries );
+}
+
+void BenchmarkRecorder::begin_frame()
+{
+	auto const slot = mFrameIndex % kQueryLatency_;
+	if( mTimerQueries )
+	{
+		// The query in this slot was issued kQueryLatency_ frames ago
+		collect_( slot );
+
+		glBeginQuery( GL_TIME_ELAPSED, mQueries[slot] );
+		mQueryFrame[slot] = mFrameIndex;
+	}
+
+	mCurrent = Frame_{};
+	mCurrent.gpu = -1.f;
+	mFrameStart = mLastMark = Clock::now();
+}
+
+void BenchmarkRecorder::mark( BenchmarkPhase aPhase )
+{
+	assert( aPhase < kBenchmarkPhaseCount );
+
+	auto const now = Clock::now();
+	mCurrent.phases[aPhase] += 1000.f * std::chrono::duration_cast<Secondsf>( now - mLastMark ).count();
+	mLastMark = now;
+}
+
+void BenchmarkRecorder::end_frame()
+{
+	if( mTimerQueries )
+		glEndQuery( GL_TIME_ELAPSED );
+
+	mCurrent.cpu = 1000.f * std::chrono::duration_cast<Secondsf>( Clock::now() - mFrameStart ).count();
+
+	if( mFrameIndex >= mWarmupFrames && mRecorded.size() < mFrames )
+		mRecorded.emplace_back( mCurrent );
+
+	++mFrameIndex;
+}
+
+void BenchmarkRecorder::finish()
+{
+	if( !mTimerQueries )
+		return;
+
+	for( std::size_t i = 0; i < kQueryLatency_; ++i )
+		collect_( i );
+}
+
+bool BenchmarkRecorder::done() const noexcept
+{
+	return mRecorded.size() >= mFrames;
+}
+
+float BenchmarkRecorder::time() const noexcept
+{
+	return float(mFrameIndex) * kBenchmarkTimestep;
+}
+
+void BenchmarkRecorder::write_csv( char const* aPath ) const
+{
+	assert( aPath );
+
+	std::FILE* fout = std::fopen( aPath, "w" );
+	if( !fout )
+		throw Error( "Unable to open '%s' for writing", aPath );
+
+	std::fprintf( fout, "frame,cpu_ms,gpu_ms" );
+	for( auto const* name : kPhaseNames_ )
+		std::fprintf( fout, ",%s_ms", name );
+	std::fprintf( fout, "\n" );
+
+	for( std::size_t i = 0; i < mRecorded.size(); ++i )
+	{
+		auto const& frame = mRecorded[i];
+		std::fprintf( fout, "%zu,%.4f,", i, frame.cpu );
+		if( frame.gpu >= 0.f )
+			std::fprintf( fout, "%.4f", frame.gpu );
+		for( auto const phase : frame.phases )
+			std::fprintf( fout, ",%.4f", phase );
+		std::fprintf( fout, "\n" );
+	}
+
+	std::fclose( fout );
+}
+
+void BenchmarkRecorder::write_json( char const* aPath ) const
+{
+	assert( aPath );
+
+	std::vector<float> cpu, gpu;
+	std::vector<float> phases[kBenchmarkPhaseCount];
+	for( auto const& frame : mRecorded )
+	{
+		cpu.emplace_back( frame.cpu );
+		if( frame.gpu >= 0.f )
+			gpu.emplace_back( frame.gpu );
+		for( std::size_t i = 0; i < kBenchmarkPhaseCount; ++i )
+			phases[i].emplace_back( frame.phases[i] );
+	}
+
+	std::FILE* fout = std::fopen( aPath, "w" );
+	if( !fout )
+		throw Error( "Unable to open '%s' for writing", aPath );
+
+	std::fprintf( fout, "{\n" );
+	std::fprintf( fout, "\t\"frames\": %zu,\n", mRecorded.size() );
+	std::fprintf( fout, "\t\"warmup_frames\": %zu,\n", mWarmupFrames );
+	std::fprintf( fout, "\t\"timestep_s\": %.6f,\n", kBenchmarkTimestep );
+	std::fprintf( fout, "\t\"renderer\": \"%s\",\n", reinterpret_cast<char const*>(glGetString( GL_RENDERER )) );
+	std::fprintf( fout, "\t\"frame_ms\": {\n" );
+	write_stats_( fout, "cpu", compute_stats_( cpu ), gpu.empty() );
+	if( !gpu.empty() )
+		write_stats_( fout, "gpu", compute_stats_( gpu ), true );
+	std::fprintf( fout, "\t},\n" );
+	std::fprintf( fout, "\t\"phase_ms\": {\n" );
+	for( std::size_t i = 0; i < kBenchmarkPhaseCount; ++i )
+		write_stats_( fout, kPhaseNames_[i], compute_stats_( phases[i] ), i+1 == kBenchmarkPhaseCount );
+	std::fprintf( fout, "\t}\n" );
+	std::fprintf( fout, "}\n" );
+
+	std::fclose( fout );
+}
+
+void BenchmarkRecorder::print_summary() const
+{
+	std::vector<float> cpu, gpu;
+	for( auto const& frame : mRecorded )
+	{
+		cpu.emplace_back( frame.cpu );
+		if( frame.gpu >= 0.f )
+			gpu.emplace_back( frame.gpu );
+	}
+
+	auto const print = [] ( char const* aName, Stats_ const& aStats ) {
+		std::printf( "%s: min %.2f avg %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f ms\n",
+			aName, aStats.min, aStats.avg, aStats.p50, aStats.p95, aStats.p99, aStats.max
+		);
+	};
+
+	std::printf( "Benchmark: %zu frames\n", mRecorded.size() );
+	print( "CPU frame", compute_stats_( cpu ) );
+	if( !gpu.empty() )
+		print( "GPU frame", compute_stats_( gpu ) );
+}
+
+
+void BenchmarkRecorder::collect_( std::size_t aSlot )
+{
+	auto const frame = mQueryFrame[aSlot];
+	if( kNoFrame_ == frame )
+		return;
+
+	GLuint64 ns = 0;
+	glGetQueryObjectui64v( mQueries[aSlot], GL_QUERY_RESULT, &ns );
+	mQueryFrame[aSlot] = kNoFrame_;
+
+	// Frames before mWarmupFrames were not recorded
+	if( frame < mWarmupFrames || frame - mWarmupFrames >= mRecorded.size() )
+		return;
+
+	mRecorded[frame - mWarmupFrames].gpu = float(ns) / 1e6f;
+}
@@ -0,0 +1,110 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+// Headless benchmark support: a scripted camera path and a recorder for
+// per-frame CPU/GPU times. See --benchmark in main().
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdlib>
+
+#include "defaults.hpp"
+#include "scene_description.hpp"
+
+// Simulation time step in benchmark mode (seconds)
+constexpr float kBenchmarkTimestep = 1.f / 60.f;
+
+// Phases of a frame, in the order in which they are marked
+enum BenchmarkPhase : std::size_t
+{
+	kBenchmarkUpdate = 0, // animation, scene graph, transforms, LOD selection
+	kBenchmarkCulling,    // frustum and occlusion culling
+	kBenchmarkUi,         // building the ImGui frame
+	kBenchmarkSnapshot,   // filling the FrameSnapshot (render lists)
+	kBenchmarkDraw,       // GL submission: scene, UI, captures
+	kBenchmarkSwap,       // glfwSwapBuffers()
+
+	kBenchmarkPhaseCount
+};
+
+// Camera for the scripted fly-through at time aTime (seconds). The path
+// starts and ends at aStart and sweeps around the launch pad in between.
+SceneCamera benchmark_camera( SceneCamera const& aStart, float aTime ) noexcept;
+
+// True if the rocket should be launching at time aTime.
+bool benchmark_launch( float aTime ) noexcept;
+
+/** BenchmarkRecorder: per-frame timings
+ *
+ * Usage, per frame:
+ *   rec.begin_frame();
+ *   ...; rec.mark( kBenchmarkUpdate );
+ *   ...; rec.mark( kBenchmarkCulling );
+ *   ...
+ *   rec.end_frame();
+ *
+ * CPU times are wall-clock times between marks. The GPU time of a frame is
+ * measured with a GL_TIME_ELAPSED query around the whole frame. Queries are
+ * read back a few frames later, so that the CPU does not wait for the GPU.
+ * The first few frames are warm-up and are not recorded.
+ */
+class BenchmarkRecorder final
+{
+	public:
+		explicit BenchmarkRecorder( std::size_t aFrames, std::size_t aWarmupFrames = 30 );
+		~BenchmarkRecorder();
+
+		BenchmarkRecorder( BenchmarkRecorder const& ) = delete;
+		BenchmarkRecorder& operator= (BenchmarkRecorder const&) = delete;
+
+	public:
+		void begin_frame();
+		void mark( BenchmarkPhase );
+		void end_frame();
+
+		// Read back all outstanding queries. Call after the last frame.
+		void finish();
+
+		bool done() const noexcept;
+
+		// Simulation time of the current frame (frame index * time step),
+		// including warm-up.
+		float time() const noexcept;
+
+	public:
+		// One row per recorded frame, times in milliseconds.
+		void write_csv( char const* aPath ) const;
+
+		// min/avg/p50/p95/p99/max of the frame times and of each phase.
+		void write_json( char const* aPath ) const;
+
+		void print_summary() const;
+
+	private:
+		struct Frame_
+		{
+			float cpu; // ms
+			float gpu; // ms, negative if not available
+			float phases[kBenchmarkPhaseCount];
+		};
+
+		void collect_( std::size_t aSlot );
+
+	private:
+		std::size_t mFrames, mWarmupFrames;
+		std::size_t mFrameIndex = 0; // including warm-up
+
+		Clock::time_point mFrameStart, mLastMark;
+		Frame_ mCurrent{};
+
+		static constexpr std::size_t kQueryLatency_ = 4;
+		GLuint mQueries[kQueryLatency_] = {};
+		std::size_t mQueryFrame[kQueryLatency_]; // frame that used the query, or ~0
+		bool mTimerQueries = false;
+
+		std::vector<Frame_> mRecorded;
+};
+
+#endif // BENCHMARK_HPP
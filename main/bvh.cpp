@@ -0,0 +1,552 @@
+#include "bvh.hpp"
+
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#if defined(__AVX__)
+#	include <immintrin.h>
+#endif
+
+#include "../support/profiler.hpp"
+
+namespace
+{
+	// Number of SAH bins per split
+	constexpr std::size_t kBinCount_ = 16;
+
+	// Maximum number of triangles in a leaf (one block)
+	constexpr std::size_t kLeafSize_ = 8;
+
+	// Subtrees with more triangles than this are built in separate jobs
+	constexpr std::size_t kParallelThreshold_ = 8192;
+
+	// Below this depth, splits fall back to the median, which bounds the
+	// depth of the tree (and thereby the traversal stack)
+	constexpr std::size_t kMaxSahDepth_ = 48;
+	constexpr std::size_t kStackSize_ = 128;
+
+	struct Aabb_
+	{
+		float bmin[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		float bmax[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+		void grow( float const aMin[3], float const aMax[3] ) noexcept
+		{
+			for( std::size_t i = 0; i < 3; ++i )
+			{
+				bmin[i] = std::min( bmin[i], aMin[i] );
+				bmax[i] = std::max( bmax[i], aMax[i] );
+			}
+		}
+		void grow( float const aPoint[3] ) noexcept
+		{
+			grow( aPoint, aPoint );
+		}
+
+		float half_area() const noexcept
+		{
+			float const dx = bmax[0]-bmin[0], dy = bmax[1]-bmin[1], dz = bmax[2]-bmin[2];
+			if( dx < 0.f )
+				return 0.f; // empty
+			return dx*dy + dy*dz + dz*dx;
+		}
+	};
+
+	// Slab test; returns the entry distance, or infinity on a miss.
+	template< typename tNode >
+	float intersect_node_( tNode const& aNode, Vec3f aOrigin, float const aInvDir[3], float aMaxT ) noexcept
+	{
+		float const o[3] = { aOrigin.x, aOrigin.y, aOrigin.z };
+
+		float tmin = 0.f, tmax = aMaxT;
+		for( std::size_t i = 0; i < 3; ++i )
+		{
+			float const t0 = (aNode.bmin[i] - o[i]) * aInvDir[i];
+			float const t1 = (aNode.bmax[i] - o[i]) * aInvDir[i];
+			tmin = std::max( tmin, std::min( t0, t1 ) );
+			tmax = std::min( tmax, std::max( t0, t1 ) );
+		}
+
+		return tmin <= tmax ? tmin : std::numeric_limits<float>::infinity();
+	}
+
+	// Möller-Trumbore for one lane of a block. Returns t, or infinity.
+	template< typename tBlock >
+	float intersect_lane_( tBlock const& aBlock, std::size_t aLane, Vec3f aOrigin, Vec3f aDir, float& aU, float& aV ) noexcept
+	{
+		Vec3f const v0{ aBlock.v0[0][aLane], aBlock.v0[1][aLane], aBlock.v0[2][aLane] };
+		Vec3f const e1{ aBlock.e1[0][aLane], aBlock.e1[1][aLane], aBlock.e1[2][aLane] };
+		Vec3f const e2{ aBlock.e2[0][aLane], aBlock.e2[1][aLane], aBlock.e2[2][aLane] };
+
+		auto const p = cross( aDir, e2 );
+		float const det = dot( e1, p );
+		if( 0.f == det )
+			return std::numeric_limits<float>::infinity();
+
+		float const inv = 1.f / det;
+		auto const s = aOrigin - v0;
+		float const u = dot( s, p ) * inv;
+		if( u < 0.f || u > 1.f )
+			return std::numeric_limits<float>::infinity();
+
+		auto const q = cross( s, e1 );
+		float const v = dot( aDir, q ) * inv;
+		if( v < 0.f || u + v > 1.f )
+			return std::numeric_limits<float>::infinity();
+
+		aU = u;
+		aV = v;
+		return dot( e2, q ) * inv;
+	}
+}
+
+struct Bvh::Builder_
+{
+	struct Prim
+	{
+		float bmin[3], bmax[3], centroid[3];
+	};
+
+	std::vector<Vec3f> const& soup;
+	JobSystem& jobs;
+
+	std::vector<Prim> prims;
+	std::vector<std::uint32_t> order; // partitioned in place by build()
+
+	std::vector<Node_>& nodes;
+	std::vector<Block_>& blocks;
+
+	std::atomic<std::uint32_t> nodeCount{ 1 };
+	std::atomic<std::uint32_t> blockCount{ 0 };
+
+	JobCounter counter;
+
+	void build( std::uint32_t aNode, std::size_t aBegin, std::size_t aEnd, std::size_t aDepth )
+	{
+		assert( aEnd > aBegin );
+
+		Aabb_ bounds, centroids;
+		for( auto i = aBegin; i < aEnd; ++i )
+		{
+			auto const& prim = prims[order[i]];
+			bounds.grow( prim.bmin, prim.bmax );
+			centroids.grow( prim.centroid );
+		}
+
+		auto& node = nodes[aNode];
+		for( std::size_t i = 0; i < 3; ++i )
+		{
+			node.bmin[i] = bounds.bmin[i];
+			node.bmax[i] = bounds.bmax[i];
+		}
+
+		auto const count = aEnd - aBegin;
+		if( count <= kLeafSize_ )
+		{
+			make_leaf( aNode, aBegin, aEnd );
+			return;
+		}
+
+		// Axis of largest centroid extent
+		std::size_t axis = 0;
+		for( std::size_t i = 1; i < 3; ++i )
+		{
+			if( centroids.bmax[i]-centroids.bmin[i] > centroids.bmax[axis]-centroids.bmin[axis] )
+				axis = i;
+		}
+
+		float const extent = centroids.bmax[axis] - centroids.bmin[axis];
+
+		std::size_t mid = aBegin;
+		if( extent > 0.f && aDepth < kMaxSahDepth_ )
+		{
+			float const scale = kBinCount_ / extent;
+			auto const bin_of = [&] ( Prim const& aPrim ) {
+				auto const b = std::size_t((aPrim.centroid[axis] - centroids.bmin[axis]) * scale);
+				return std::min( b, kBinCount_-1 );
+			};
+
+			Aabb_ binBounds[kBinCount_];
+			std::size_t binCounts[kBinCount_] = {};
+			for( auto i = aBegin; i < aEnd; ++i )
+			{
+				auto const& prim = prims[order[i]];
+				auto const b = bin_of( prim );
+				binBounds[b].grow( prim.bmin, prim.bmax );
+				++binCounts[b];
+			}
+
+			// Sweep from the right, then from the left, evaluating the SAH
+			// for the split after each bin
+			float rightCost[kBinCount_];
+			Aabb_ acc;
+			std::size_t accCount = 0;
+			for( std::size_t b = kBinCount_-1; b > 0; --b )
+			{
+				acc.grow( binBounds[b].bmin, binBounds[b].bmax );
+				accCount += binCounts[b];
+				rightCost[b] = acc.half_area() * float(accCount);
+			}
+
+			float bestCost = std::numeric_limits<float>::max();
+			std::size_t bestSplit = 0;
+
+			acc = Aabb_{};
+			accCount = 0;
+			for( std::size_t b = 0; b+1 < kBinCount_; ++b )
+			{
+				acc.grow( binBounds[b].bmin, binBounds[b].bmax );
+				accCount += binCounts[b];
+
+				float const cost = acc.half_area() * float(accCount) + rightCost[b+1];
+				if( accCount > 0 && accCount < count && cost < bestCost )
+				{
+					bestCost = cost;
+					bestSplit = b+1;
+				}
+			}
+
+			if( bestSplit > 0 )
+			{
+				auto const it = std::partition( order.begin()+aBegin, order.begin()+aEnd, [&] ( std::uint32_t aPrim ) {
+					return bin_of( prims[aPrim] ) < bestSplit;
+				} );
+				mid = std::size_t(it - order.begin());
+			}
+		}
+
+		// Median split if the SAH did not find anything (e.g., all centroids
+		// in the same bin)
+		if( mid == aBegin || mid == aEnd )
+		{
+			mid = aBegin + count/2;
+			std::nth_element( order.begin()+aBegin, order.begin()+mid, order.begin()+aEnd, [&] ( std::uint32_t aX, std::uint32_t aY ) {
+				return prims[aX].centroid[axis] < prims[aY].centroid[axis];
+			} );
+		}
+
+		auto const children = nodeCount.fetch_add( 2, std::memory_order_relaxed );
+		node.index = children;
+		node.count = 0;
+
+		if( count > kParallelThreshold_ )
+		{
+			jobs.run( [this, children, aBegin, mid, aDepth] {
+				build( children, aBegin, mid, aDepth+1 );
+			}, &counter );
+		}
+		else
+		{
+			build( children, aBegin, mid, aDepth+1 );
+		}
+
+		build( children+1, mid, aEnd, aDepth+1 );
+	}
+
+	void make_leaf( std::uint32_t aNode, std::size_t aBegin, std::size_t aEnd )
+	{
+		auto const index = blockCount.fetch_add( 1, std::memory_order_relaxed );
+		auto& block = blocks[index];
+		block = Block_{}; // unused lanes: zero edges, never hit
+
+		for( auto i = aBegin; i < aEnd; ++i )
+		{
+			auto const lane = i - aBegin;
+			auto const tri = order[i];
+			auto const& a = soup[3*tri+0];
+			auto const& b = soup[3*tri+1];
+			auto const& c = soup[3*tri+2];
+
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				block.v0[k][lane] = a[k];
+				block.e1[k][lane] = b[k] - a[k];
+				block.e2[k][lane] = c[k] - a[k];
+			}
+			block.id[lane] = tri;
+		}
+
+		nodes[aNode].index = index;
+		nodes[aNode].count = std::uint32_t(aEnd - aBegin);
+	}
+};
+
+Bvh::Bvh( std::vector<Vec3f> const& aTriangleSoup, JobSystem& aJobs )
+	: mTriangleCount( aTriangleSoup.size() / 3 )
+{
+	PROFILE_ZONE( "build BVH" );
+
+	if( 0 == mTriangleCount )
+		return;
+
+	Builder_ builder{ aTriangleSoup, aJobs, {}, {}, mNodes, mBlocks };
+
+	builder.prims.resize( mTriangleCount );
+	builder.order.resize( mTriangleCount );
+	aJobs.parallel_for( 0, mTriangleCount, 16384, [&] ( std::size_t aBegin, std::size_t aEnd ) {
+		for( auto i = aBegin; i < aEnd; ++i )
+		{
+			auto& prim = builder.prims[i];
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				auto const a = aTriangleSoup[3*i+0][k];
+				auto const b = aTriangleSoup[3*i+1][k];
+				auto const c = aTriangleSoup[3*i+2][k];
+				prim.bmin[k] = std::min( a, std::min( b, c ) );
+				prim.bmax[k] = std::max( a, std::max( b, c ) );
+				prim.centroid[k] = 0.5f * (prim.bmin[k] + prim.bmax[k]);
+			}
+			builder.order[i] = std::uint32_t(i);
+		}
+	} );
+
+	// Upper bounds; each leaf holds at least one triangle
+	mNodes.resize( 2*mTriangleCount );
+	mBlocks.resize( mTriangleCount );
+
+	builder.build( 0, 0, mTriangleCount, 0 );
+	aJobs.wait( builder.counter );
+
+	mBlocks.resize( builder.blockCount.load() );
+
+	// Subtrees were allocated in whatever order the jobs ran. Rewrite the
+	// nodes in depth-first order, keeping siblings together.
+	std::vector<Node_> ordered;
+	ordered.reserve( builder.nodeCount.load() );
+	ordered.emplace_back( mNodes[0] );
+
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> stack; // old, new
+	stack.emplace_back( 0, 0 );
+	while( !stack.empty() )
+	{
+		auto const [from, to] = stack.back();
+		stack.pop_back();
+
+		auto const& node = mNodes[from];
+		if( node.count )
+			continue;
+
+		auto const first = std::uint32_t(ordered.size());
+		ordered.emplace_back( mNodes[node.index] );
+		ordered.emplace_back( mNodes[node.index+1] );
+		ordered[to].index = first;
+
+		stack.emplace_back( node.index+1, first+1 );
+		stack.emplace_back( node.index, first );
+	}
+
+	mNodes = std::move(ordered);
+}
+
+bool Bvh::raycast( Vec3f aOrigin, Vec3f aDirection, float aMaxT, BvhHit& aHit ) const noexcept
+{
+	return traverse_<false,true>( aOrigin, aDirection, aMaxT, &aHit );
+}
+bool Bvh::raycast_scalar( Vec3f aOrigin, Vec3f aDirection, float aMaxT, BvhHit& aHit ) const noexcept
+{
+	return traverse_<false,false>( aOrigin, aDirection, aMaxT, &aHit );
+}
+
+bool Bvh::occluded( Vec3f aOrigin, Vec3f aDirection, float aMaxT ) const noexcept
+{
+	return traverse_<true,true>( aOrigin, aDirection, aMaxT, nullptr );
+}
+
+bool Bvh::intersects_segment( Vec3f aFrom, Vec3f aTo ) const noexcept
+{
+	return occluded( aFrom, aTo - aFrom, 1.f );
+}
+
+bool Bvh::simd() noexcept
+{
+#	if defined(__AVX__)
+	return true;
+#	else
+	return false;
+#	endif
+}
+
+bool Bvh::empty() const noexcept
+{
+	return mNodes.empty();
+}
+
+std::size_t Bvh::triangle_count() const noexcept
+{
+	return mTriangleCount;
+}
+std::size_t Bvh::node_count() const noexcept
+{
+	return mNodes.size();
+}
+
+Vec3f Bvh::bounds_min() const noexcept
+{
+	assert( !mNodes.empty() );
+	return Vec3f{ mNodes[0].bmin[0], mNodes[0].bmin[1], mNodes[0].bmin[2] };
+}
+Vec3f Bvh::bounds_max() const noexcept
+{
+	assert( !mNodes.empty() );
+	return Vec3f{ mNodes[0].bmax[0], mNodes[0].bmax[1], mNodes[0].bmax[2] };
+}
+
+template< bool tAnyHit, bool tSimd >
+bool Bvh::traverse_( Vec3f aOrigin, Vec3f aDirection, float aMaxT, BvhHit* aHit ) const noexcept
+{
+	if( mNodes.empty() )
+		return false;
+
+	float const invDir[3] = { 1.f / aDirection.x, 1.f / aDirection.y, 1.f / aDirection.z };
+
+	float best = aMaxT;
+	bool found = false;
+
+	if( std::isinf( intersect_node_( mNodes[0], aOrigin, invDir, best ) ) )
+		return false;
+
+#	if defined(__AVX__)
+	__m256 const ox = _mm256_set1_ps( aOrigin.x ), oy = _mm256_set1_ps( aOrigin.y ), oz = _mm256_set1_ps( aOrigin.z );
+	__m256 const dx = _mm256_set1_ps( aDirection.x ), dy = _mm256_set1_ps( aDirection.y ), dz = _mm256_set1_ps( aDirection.z );
+	__m256 const zero = _mm256_setzero_ps(), one = _mm256_set1_ps( 1.f );
+#	endif
+
+	struct Entry_ { std::uint32_t node; float t; };
+	Entry_ stack[kStackSize_];
+	std::size_t sp = 0;
+
+	std::uint32_t current = 0;
+	for( ;; )
+	{
+		auto const& node = mNodes[current];
+		if( node.count )
+		{
+			auto const& block = mBlocks[node.index];
+
+#			if defined(__AVX__)
+			if constexpr( tSimd )
+			{
+				__m256 const e1x = _mm256_load_ps( block.e1[0] ), e1y = _mm256_load_ps( block.e1[1] ), e1z = _mm256_load_ps( block.e1[2] );
+				__m256 const e2x = _mm256_load_ps( block.e2[0] ), e2y = _mm256_load_ps( block.e2[1] ), e2z = _mm256_load_ps( block.e2[2] );
+
+				// p = d x e2
+				__m256 const px = _mm256_sub_ps( _mm256_mul_ps( dy, e2z ), _mm256_mul_ps( dz, e2y ) );
+				__m256 const py = _mm256_sub_ps( _mm256_mul_ps( dz, e2x ), _mm256_mul_ps( dx, e2z ) );
+				__m256 const pz = _mm256_sub_ps( _mm256_mul_ps( dx, e2y ), _mm256_mul_ps( dy, e2x ) );
+
+				__m256 const det = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( e1x, px ), _mm256_mul_ps( e1y, py ) ), _mm256_mul_ps( e1z, pz ) );
+				__m256 const inv = _mm256_div_ps( one, det );
+
+				// s = o - v0
+				__m256 const sx = _mm256_sub_ps( ox, _mm256_load_ps( block.v0[0] ) );
+				__m256 const sy = _mm256_sub_ps( oy, _mm256_load_ps( block.v0[1] ) );
+				__m256 const sz = _mm256_sub_ps( oz, _mm256_load_ps( block.v0[2] ) );
+
+				__m256 const u = _mm256_mul_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( sx, px ), _mm256_mul_ps( sy, py ) ), _mm256_mul_ps( sz, pz ) ), inv );
+
+				// q = s x e1
+				__m256 const qx = _mm256_sub_ps( _mm256_mul_ps( sy, e1z ), _mm256_mul_ps( sz, e1y ) );
+				__m256 const qy = _mm256_sub_ps( _mm256_mul_ps( sz, e1x ), _mm256_mul_ps( sx, e1z ) );
+				__m256 const qz = _mm256_sub_ps( _mm256_mul_ps( sx, e1y ), _mm256_mul_ps( sy, e1x ) );
+
+				__m256 const v = _mm256_mul_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, qx ), _mm256_mul_ps( dy, qy ) ), _mm256_mul_ps( dz, qz ) ), inv );
+				__m256 const t = _mm256_mul_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( e2x, qx ), _mm256_mul_ps( e2y, qy ) ), _mm256_mul_ps( e2z, qz ) ), inv );
+
+				// Ordered comparisons are false for NaN (det = 0)
+				__m256 mask = _mm256_cmp_ps( det, zero, _CMP_NEQ_OQ );
+				mask = _mm256_and_ps( mask, _mm256_cmp_ps( u, zero, _CMP_GE_OQ ) );
+				mask = _mm256_and_ps( mask, _mm256_cmp_ps( v, zero, _CMP_GE_OQ ) );
+				mask = _mm256_and_ps( mask, _mm256_cmp_ps( _mm256_add_ps( u, v ), one, _CMP_LE_OQ ) );
+				mask = _mm256_and_ps( mask, _mm256_cmp_ps( t, zero, _CMP_GT_OQ ) );
+				mask = _mm256_and_ps( mask, _mm256_cmp_ps( t, _mm256_set1_ps( best ), _CMP_LT_OQ ) );
+
+				int bits = _mm256_movemask_ps( mask );
+				if( bits )
+				{
+					if( tAnyHit )
+						return true;
+
+					alignas(32) float ts[8], us[8], vs[8];
+					_mm256_store_ps( ts, t );
+					_mm256_store_ps( us, u );
+					_mm256_store_ps( vs, v );
+
+					for( ; bits; bits &= bits-1 )
+					{
+						int lane = 0;
+						while( !(bits & (1 << lane)) )
+							++lane;
+
+						if( ts[lane] < best )
+						{
+							best = ts[lane];
+							aHit->t = ts[lane];
+							aHit->u = us[lane];
+							aHit->v = vs[lane];
+							aHit->triangle = block.id[lane];
+							found = true;
+						}
+					}
+				}
+			}
+			else
+#			endif // ~ __AVX__
+			for( std::size_t lane = 0; lane < node.count; ++lane )
+			{
+				float u = 0.f, v = 0.f;
+				float const t = intersect_lane_( block, lane, aOrigin, aDirection, u, v );
+				if( t > 0.f && t < best )
+				{
+					if( tAnyHit )
+						return true;
+
+					best = t;
+					aHit->t = t;
+					aHit->u = u;
+					aHit->v = v;
+					aHit->triangle = block.id[lane];
+					found = true;
+				}
+			}
+		}
+		else
+		{
+			float const t0 = intersect_node_( mNodes[node.index], aOrigin, invDir, best );
+			float const t1 = intersect_node_( mNodes[node.index+1], aOrigin, invDir, best );
+
+			bool const hit0 = !std::isinf( t0 ), hit1 = !std::isinf( t1 );
+			if( hit0 && hit1 )
+			{
+				// Visit the nearer child first
+				bool const swap = t1 < t0;
+				assert( sp < kStackSize_ );
+				stack[sp++] = Entry_{ node.index + (swap ? 0u : 1u), swap ? t0 : t1 };
+				current = node.index + (swap ? 1u : 0u);
+				continue;
+			}
+			if( hit0 || hit1 )
+			{
+				current = node.index + (hit0 ? 0u : 1u);
+				continue;
+			}
+		}
+
+		// Pop, skipping nodes that are behind the current closest hit
+		for( ;; )
+		{
+			if( 0 == sp )
+				return found;
+
+			auto const entry = stack[--sp];
+			if( entry.t < best )
+			{
+				current = entry.node;
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+// Bounding volume hierarchy over triangles for ray queries (picking, line of
+// sight, collision). Like culling.hpp, this only depends on vmlib (and the
+// job system) and makes no OpenGL calls.
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec3.hpp"
+
+#include "../support/jobs.hpp"
+
+struct BvhHit
+{
+	float t; // hit point = origin + t * direction
+	float u, v; // barycentric coordinates (of vertices 1 and 2)
+	std::uint32_t triangle; // index of the triangle in the input
+};
+
+/** Bvh: binary BVH over a triangle soup
+ *
+ * The tree is built with the surface area heuristic, evaluated over a fixed
+ * number of bins along the axis of largest centroid extent. Subtrees above a
+ * certain size are built as separate jobs.
+ *
+ * Nodes are 32 bytes and stored in a single array in depth-first order; the
+ * two children of a node are always adjacent. Leaves hold up to eight
+ * triangles, stored precomputed for Möller-Trumbore (vertex and two edges)
+ * in structure-of-arrays layout, so that a leaf is tested with a single
+ * eight-wide AVX test if available (with a scalar fallback otherwise).
+ *
+ * Triangles are double-sided. Ray directions do not need to be normalized;
+ * t is in units of the direction's length. This means that a ray can be
+ * transformed into object space with the (affine) inverse world matrix
+ * without changing t.
+ */
+class Bvh final
+{
+	public:
+		Bvh() = default;
+
+		// aTriangleSoup as in SimpleMeshData::positions (three vertices per
+		// triangle).
+		Bvh( std::vector<Vec3f> const& aTriangleSoup, JobSystem& );
+
+	public:
+		// Closest hit with t in (0, aMaxT).
+		bool raycast( Vec3f aOrigin, Vec3f aDirection, float aMaxT, BvhHit& aHit ) const noexcept;
+
+		// As raycast(), but always tests leaves with the scalar code path.
+		// Apart from rounding, the results are the same as raycast()'s.
+		bool raycast_scalar( Vec3f aOrigin, Vec3f aDirection, float aMaxT, BvhHit& aHit ) const noexcept;
+
+		// Any hit with t in (0, aMaxT). Faster than raycast().
+		bool occluded( Vec3f aOrigin, Vec3f aDirection, float aMaxT ) const noexcept;
+
+		// True if the segment from aFrom to aTo intersects any triangle.
+		bool intersects_segment( Vec3f aFrom, Vec3f aTo ) const noexcept;
+
+	public:
+		// True if raycast() and occluded() test leaves with AVX.
+		static bool simd() noexcept;
+
+		bool empty() const noexcept;
+
+		std::size_t triangle_count() const noexcept;
+		std::size_t node_count() const noexcept;
+
+		Vec3f bounds_min() const noexcept;
+		Vec3f bounds_max() const noexcept;
+
+	private:
+		struct Node_
+		{
+			float bmin[3];
+			std::uint32_t index; // first child (interior) or block (leaf)
+			float bmax[3];
+			std::uint32_t count; // 0 for interior nodes, else triangles
+		};
+
+		static_assert( sizeof(Node_) == 32, "Node_ should be 32 bytes" );
+
+		// Up to eight triangles. Unused lanes are degenerate (and never hit).
+		struct alignas(32) Block_
+		{
+			float v0[3][8];
+			float e1[3][8];
+			float e2[3][8];
+			std::uint32_t id[8];
+		};
+
+		struct Builder_;
+
+		template< bool tAnyHit, bool tSimd >
+		bool traverse_( Vec3f aOrigin, Vec3f aDirection, float aMaxT, BvhHit* aHit ) const noexcept;
+
+	private:
+		std::vector<Node_> mNodes;
+		std::vector<Block_> mBlocks;
+		std::size_t mTriangleCount = 0;
+};
+
+#endif // BVH_HPP
@@ -0,0 +1,137 @@
+#ifndef COMPONENTS_HPP
+#define COMPONENTS_HPP
+
+#include <glad.h>
+
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat33.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "scene_graph.hpp"
+#include "mesh_arena.hpp"
+#include "static_geometry.hpp"
+#include "instanced_mesh.hpp"
+#include "occlusion.hpp"
+#include "bvh.hpp"
+
+// Components used by the entity-component system (see ecs.hpp). These are
+// plain data; the systems that operate on them are in systems.hpp.
+
+// Object placement. Entities with a SceneLink copy their matrices from the
+// scene graph instead, and ignore translation/rotation/scale.
+struct Transform
+{
+	Vec3f translation{ 0.f, 0.f, 0.f };
+	Vec3f rotation{ 0.f, 0.f, 0.f }; // Euler angles, same convention as SceneGraph
+	Vec3f scale{ 1.f, 1.f, 1.f };
+
+	Mat44f world = kIdentity44f;
+	Mat33f normal = kIdentity33f;
+
+	bool dirty = true;
+};
+
+// Links an entity to a scene graph node. The entity is placed at offset
+// relative to the node.
+struct SceneLink
+{
+	SceneGraph::NodeId node;
+	Mat44f offset = kIdentity44f;
+};
+
+// Geometry in a MeshArena. range is a copy of the arena's draw_range(); it
+// goes stale when the arena moves meshes (see refresh_mesh_refs()).
+struct MeshRef
+{
+	MeshArena::MeshId mesh = 0;
+	MeshArena::DrawRange range{};
+};
+
+// Geometry in the shared StaticGeometry buffers. Drawn with multi-draw
+// indirect; the Material must not be emissive.
+struct StaticMeshRef
+{
+	StaticGeometry::MeshId mesh = 0;
+	std::uint32_t lod = 0; // current level of detail, see select_lods()
+};
+
+// The entity is one instance of an InstancedMesh. All instances of a mesh are
+// drawn together, using the Material of one of them; tint is the per-instance
+// variation.
+struct Instance
+{
+	InstancedMesh* mesh = nullptr;
+	Vec4f tint{ 1.f, 1.f, 1.f, 1.f };
+};
+
+// The entity occludes other objects (see OcclusionBuffer). The mesh is
+// usually a simplified version of the entity's geometry.
+struct Occluder
+{
+	OccluderMesh const* mesh = nullptr;
+};
+
+// The entity can be hit by ray queries (see pick()). The BVH is in object
+// space, usually built over the entity's mesh.
+struct Collider
+{
+	Bvh const* bvh = nullptr;
+};
+
+// Per-object render state for default.vert/default.frag.
+struct Material
+{
+	enum class ColorSelect : std::int8_t
+	{
+		none = -1,
+		interior = 0, // "colorSel"
+		launchpad1 = 1, // "colorSel1"
+		launchpad2 = 2 // "colorSel2"
+	};
+
+	GLuint textures[2] = { 0, 0 }; // texture units 0 and 1
+
+	bool textured = false;
+	bool multiTextured = false;
+	bool emissive = false;
+
+	Vec3f emissiveColor{ 0.f, 0.f, 0.f };
+	ColorSelect colorSelect = ColorSelect::none;
+
+	bool cullFace = true;
+	bool blend = false;
+};
+
+// Object-space bounding box and bounding sphere (see compute_bounds()).
+struct Bounds
+{
+	Vec3f min{ 0.f, 0.f, 0.f };
+	Vec3f max{ 0.f, 0.f, 0.f };
+
+	Vec3f center{ 0.f, 0.f, 0.f };
+	float radius = 0.f;
+};
+
+// Result of culling (see cull_renderables()). Invisible entities are skipped
+// by collect_renderables().
+struct Visibility
+{
+	bool visible = true;
+};
+
+// Simple looping motion: the entity moves with a constant velocity and spins
+// with a constant angular velocity. Once it has moved further than range from
+// its origin, it restarts at the origin.
+struct Animator
+{
+	Vec3f velocity{ 0.f, 0.f, 0.f };
+	Vec3f angularVelocity{ 0.f, 0.f, 0.f };
+
+	Vec3f origin{ 0.f, 0.f, 0.f };
+	float range = 0.f; // 0 = never restart
+};
+
+#endif // COMPONENTS_HPP
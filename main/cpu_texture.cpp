@@ -0,0 +1,147 @@
+#include "cpu_texture.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <stb_image.h>
+
+#include "../support/error.hpp"
+
+namespace
+{
+	float srgb_to_linear_( float aValue ) noexcept
+	{
+		return aValue <= 0.04045f ? aValue / 12.92f : std::pow( (aValue + 0.055f) / 1.055f, 2.4f );
+	}
+}
+
+CpuTexture::CpuTexture( char const* aPath, bool aSrgb, bool aFlipVertically )
+{
+	assert( aPath );
+
+	// The OpenGL loaders change the global flip flag, so override it for
+	// this thread only. Rows are flipped below if requested.
+	stbi_set_flip_vertically_on_load_thread( 0 );
+
+	int w, h, channels;
+	stbi_uc* ptr = stbi_load( aPath, &w, &h, &channels, 4 );
+	if( !ptr )
+		throw Error( "Unable to load image '%s': %s", aPath, stbi_failure_reason() );
+
+	float lut[256];
+	for( int i = 0; i < 256; ++i )
+		lut[i] = aSrgb ? srgb_to_linear_( i / 255.f ) : i / 255.f;
+
+	mWidth = std::size_t(w);
+	mHeight = std::size_t(h);
+	mTexels.resize( mWidth * mHeight );
+
+	for( std::size_t y = 0; y < mHeight; ++y )
+	{
+		auto const srcRow = aFlipVertically ? mHeight-1-y : y;
+		stbi_uc const* src = ptr + srcRow * mWidth * 4;
+		for( std::size_t x = 0; x < mWidth; ++x, src += 4 )
+			mTexels[y*mWidth + x] = Vec4f{ lut[src[0]], lut[src[1]], lut[src[2]], src[3] / 255.f };
+	}
+
+	stbi_image_free( ptr );
+}
+
+Vec4f CpuTexture::sample( Vec2f aTexcoord ) const noexcept
+{
+	assert( !mTexels.empty() );
+
+	// Texel centers are at half-integer coordinates
+	float const fx = std::clamp( aTexcoord.x * mWidth - 0.5f, 0.f, float(mWidth-1) );
+	float const fy = std::clamp( aTexcoord.y * mHeight - 0.5f, 0.f, float(mHeight-1) );
+
+	auto const x0 = std::size_t(fx), y0 = std::size_t(fy);
+	auto const x1 = std::min( x0+1, mWidth-1 ), y1 = std::min( y0+1, mHeight-1 );
+	float const ax = fx - x0, ay = fy - y0;
+
+	auto const top = (1.f-ax) * mTexels[y0*mWidth + x0] + ax * mTexels[y0*mWidth + x1];
+	auto const bottom = (1.f-ax) * mTexels[y1*mWidth + x0] + ax * mTexels[y1*mWidth + x1];
+	return (1.f-ay) * top + ay * bottom;
+}
+
+Vec4f CpuTexture::texel( std::size_t aX, std::size_t aY ) const noexcept
+{
+	assert( aX < mWidth && aY < mHeight );
+	return mTexels[aY*mWidth + aX];
+}
+
+bool CpuTexture::empty() const noexcept
+{
+	return mTexels.empty();
+}
+
+std::size_t CpuTexture::width() const noexcept
+{
+	return mWidth;
+}
+std::size_t CpuTexture::height() const noexcept
+{
+	return mHeight;
+}
+
+
+CpuCubemap::CpuCubemap( std::vector<std::string> const& aFaces, bool aSrgb )
+{
+	if( 6 != aFaces.size() )
+		throw Error( "Cube map requires 6 faces, got %zu", aFaces.size() );
+
+	for( std::size_t i = 0; i < 6; ++i )
+		mFaces[i] = CpuTexture( aFaces[i].c_str(), aSrgb, false );
+}
+
+Vec3f CpuCubemap::sample( Vec3f aDirection ) const noexcept
+{
+	assert( !empty() );
+
+	float const ax = std::abs( aDirection.x ), ay = std::abs( aDirection.y ), az = std::abs( aDirection.z );
+
+	std::size_t face;
+	float sc, tc, ma;
+	if( ax >= ay && ax >= az )
+	{
+		face = aDirection.x >= 0.f ? 0 : 1;
+		sc = aDirection.x >= 0.f ? -aDirection.z : aDirection.z;
+		tc = -aDirection.y;
+		ma = ax;
+	}
+	else if( ay >= az )
+	{
+		face = aDirection.y >= 0.f ? 2 : 3;
+		sc = aDirection.x;
+		tc = aDirection.y >= 0.f ? aDirection.z : -aDirection.z;
+		ma = ay;
+	}
+	else
+	{
+		face = aDirection.z >= 0.f ? 4 : 5;
+		sc = aDirection.z >= 0.f ? aDirection.x : -aDirection.x;
+		tc = -aDirection.y;
+		ma = az;
+	}
+
+	if( ma <= 0.f )
+		return Vec3f{ 0.f, 0.f, 0.f };
+
+	auto const c = mFaces[face].sample( Vec2f{ 0.5f * (sc / ma + 1.f), 0.5f * (tc / ma + 1.f) } );
+	return Vec3f{ c.x, c.y, c.z };
+}
+
+bool CpuCubemap::empty() const noexcept
+{
+	return mFaces[0].empty();
+}
+
+
+unsigned char linear_to_srgb8( float aValue ) noexcept
+{
+	float const v = std::clamp( aValue, 0.f, 1.f );
+	float const s = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow( v, 1.f/2.4f ) - 0.055f;
+	return (unsigned char)(s * 255.f + 0.5f);
+}
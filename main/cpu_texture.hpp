@@ -0,0 +1,77 @@
+#ifndef CPU_TEXTURE_HPP
+#define CPU_TEXTURE_HPP
+
+// Textures for the CPU renderers. Images are loaded with stb_image and
+// sampled like the corresponding OpenGL textures (see load_texture_2d() and
+// load_cubemap()). No OpenGL dependencies.
+
+#include <string>
+#include <vector>
+
+#include <cstdlib>
+
+#include "../vmlib/vec2.hpp"
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/vec4.hpp"
+
+/** CpuTexture: RGBA image in linear floating point
+ *
+ * sRGB images are converted to linear on load. Sampling is bilinear with
+ * clamp-to-edge addressing.
+ *
+ * Row 0 is at t = 0. OpenGL 2D textures loaded by load_texture_2d() are
+ * flipped so that t = 0 is the bottom of the image file (aFlipVertically);
+ * cube map faces are not.
+ */
+class CpuTexture final
+{
+	public:
+		CpuTexture() = default;
+
+		// Throws Error if the image cannot be loaded.
+		explicit CpuTexture( char const* aPath, bool aSrgb = true, bool aFlipVertically = true );
+
+	public:
+		Vec4f sample( Vec2f aTexcoord ) const noexcept;
+
+		Vec4f texel( std::size_t aX, std::size_t aY ) const noexcept;
+
+	public:
+		bool empty() const noexcept;
+
+		std::size_t width() const noexcept;
+		std::size_t height() const noexcept;
+
+	private:
+		std::size_t mWidth = 0, mHeight = 0;
+		std::vector<Vec4f> mTexels;
+};
+
+/** CpuCubemap: six CpuTextures, sampled by direction
+ *
+ * Faces are in the order +X, -X, +Y, -Y, +Z, -Z, as for load_cubemap(). The
+ * face and face coordinates are selected as described in the OpenGL
+ * specification (section 8.13, "Cube Map Texture Selection").
+ */
+class CpuCubemap final
+{
+	public:
+		CpuCubemap() = default;
+
+		// The viewer uploads the skybox as linear (non-sRGB) data, so aSrgb
+		// defaults to false here to match its output.
+		explicit CpuCubemap( std::vector<std::string> const& aFaces, bool aSrgb = false );
+
+	public:
+		Vec3f sample( Vec3f aDirection ) const noexcept;
+
+		bool empty() const noexcept;
+
+	private:
+		CpuTexture mFaces[6];
+};
+
+// sRGB encoding of a linear value in [0,1] (values outside are clamped).
+unsigned char linear_to_srgb8( float ) noexcept;
+
+#endif // CPU_TEXTURE_HPP
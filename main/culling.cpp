@@ -0,0 +1,182 @@
+#include "culling.hpp"
+
+#include <bitset>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#if defined(__AVX__)
+#	include <immintrin.h>
+#endif
+
+namespace
+{
+	Vec4f normalize_plane_( Vec4f aPlane ) noexcept
+	{
+		float const len = std::sqrt( aPlane.x*aPlane.x + aPlane.y*aPlane.y + aPlane.z*aPlane.z );
+		if( len <= 0.f )
+			return aPlane;
+
+		return Vec4f{ aPlane.x/len, aPlane.y/len, aPlane.z/len, aPlane.w/len };
+	}
+
+	Vec4f row_( Mat44f const& aM, std::size_t aRow ) noexcept
+	{
+		return Vec4f{ aM( aRow, 0 ), aM( aRow, 1 ), aM( aRow, 2 ), aM( aRow, 3 ) };
+	}
+
+	bool sphere_visible_( Frustum const& aFrustum, float aX, float aY, float aZ, float aRadius ) noexcept
+	{
+		for( auto const& p : aFrustum.planes )
+		{
+			if( p.x*aX + p.y*aY + p.z*aZ + p.w < -aRadius )
+				return false;
+		}
+		return true;
+	}
+}
+
+Frustum extract_frustum_planes( Mat44f const& aViewProj ) noexcept
+{
+	// Mat44f is row-major and transforms column vectors, so clip = M * p and
+	// e.g. -w <= x  <=>  dot(row3 + row0, p) >= 0.
+	auto const r0 = row_( aViewProj, 0 );
+	auto const r1 = row_( aViewProj, 1 );
+	auto const r2 = row_( aViewProj, 2 );
+	auto const r3 = row_( aViewProj, 3 );
+
+	Frustum ret{};
+	ret.planes[0] = normalize_plane_( r3 + r0 ); // left
+	ret.planes[1] = normalize_plane_( r3 - r0 ); // right
+	ret.planes[2] = normalize_plane_( r3 + r1 ); // bottom
+	ret.planes[3] = normalize_plane_( r3 - r1 ); // top
+	ret.planes[4] = normalize_plane_( r3 + r2 ); // near
+	ret.planes[5] = normalize_plane_( r3 - r2 ); // far
+	return ret;
+}
+
+
+void SphereSoA::clear() noexcept
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+}
+
+void SphereSoA::reserve( std::size_t aCount )
+{
+	x.reserve( aCount );
+	y.reserve( aCount );
+	z.reserve( aCount );
+	radius.reserve( aCount );
+}
+
+void SphereSoA::push_back( Vec3f aCenter, float aRadius )
+{
+	x.emplace_back( aCenter.x );
+	y.emplace_back( aCenter.y );
+	z.emplace_back( aCenter.z );
+	radius.emplace_back( aRadius );
+}
+
+std::size_t SphereSoA::size() const noexcept
+{
+	return x.size();
+}
+
+
+void transform_sphere( Mat44f const& aWorld, Vec3f aCenter, float aRadius, Vec3f& aOutCenter, float& aOutRadius ) noexcept
+{
+	auto const c = aWorld * Vec4f{ aCenter.x, aCenter.y, aCenter.z, 1.f };
+	aOutCenter = Vec3f{ c.x, c.y, c.z };
+
+	float maxScale2 = 0.f;
+	for( std::size_t j = 0; j < 3; ++j )
+	{
+		float const s2 = aWorld(0,j)*aWorld(0,j) + aWorld(1,j)*aWorld(1,j) + aWorld(2,j)*aWorld(2,j);
+		maxScale2 = std::max( maxScale2, s2 );
+	}
+
+	aOutRadius = aRadius * std::sqrt( maxScale2 );
+}
+
+
+std::size_t cull_spheres_scalar( Frustum const& aFrustum, SphereSoA const& aSpheres, std::size_t aBegin, std::size_t aEnd, std::uint8_t* aVisible ) noexcept
+{
+	assert( aEnd <= aSpheres.size() );
+
+	std::size_t visible = 0;
+	for( auto i = aBegin; i < aEnd; ++i )
+	{
+		bool const vis = sphere_visible_( aFrustum, aSpheres.x[i], aSpheres.y[i], aSpheres.z[i], aSpheres.radius[i] );
+		aVisible[i] = vis ? 1 : 0;
+		visible += vis;
+	}
+
+	return visible;
+}
+
+#if defined(__AVX__)
+std::size_t cull_spheres( Frustum const& aFrustum, SphereSoA const& aSpheres, std::size_t aBegin, std::size_t aEnd, std::uint8_t* aVisible ) noexcept
+{
+	assert( aEnd <= aSpheres.size() );
+
+	__m256 px[6], py[6], pz[6], pw[6];
+	for( std::size_t p = 0; p < 6; ++p )
+	{
+		px[p] = _mm256_set1_ps( aFrustum.planes[p].x );
+		py[p] = _mm256_set1_ps( aFrustum.planes[p].y );
+		pz[p] = _mm256_set1_ps( aFrustum.planes[p].z );
+		pw[p] = _mm256_set1_ps( aFrustum.planes[p].w );
+	}
+
+	__m256 const zero = _mm256_setzero_ps();
+
+	std::size_t visible = 0;
+	std::size_t i = aBegin;
+	for( ; i + 8 <= aEnd; i += 8 )
+	{
+		__m256 const x = _mm256_loadu_ps( aSpheres.x.data() + i );
+		__m256 const y = _mm256_loadu_ps( aSpheres.y.data() + i );
+		__m256 const z = _mm256_loadu_ps( aSpheres.z.data() + i );
+		__m256 const negR = _mm256_sub_ps( zero, _mm256_loadu_ps( aSpheres.radius.data() + i ) );
+
+		// Visible unless outside of one of the planes: dist < -r
+		__m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+		for( std::size_t p = 0; p < 6; ++p )
+		{
+			__m256 dist = _mm256_mul_ps( px[p], x );
+			dist = _mm256_add_ps( dist, _mm256_mul_ps( py[p], y ) );
+			dist = _mm256_add_ps( dist, _mm256_mul_ps( pz[p], z ) );
+			dist = _mm256_add_ps( dist, pw[p] );
+
+			inside = _mm256_and_ps( inside, _mm256_cmp_ps( dist, negR, _CMP_GE_OQ ) );
+		}
+
+		auto const mask = unsigned(_mm256_movemask_ps( inside ));
+		for( std::size_t j = 0; j < 8; ++j )
+			aVisible[i+j] = std::uint8_t((mask >> j) & 1u);
+
+		visible += std::bitset<8>( mask ).count();
+	}
+
+	return visible + cull_spheres_scalar( aFrustum, aSpheres, i, aEnd, aVisible );
+}
+
+bool cull_spheres_simd() noexcept
+{
+	return true;
+}
+#else // !__AVX__
+std::size_t cull_spheres( Frustum const& aFrustum, SphereSoA const& aSpheres, std::size_t aBegin, std::size_t aEnd, std::uint8_t* aVisible ) noexcept
+{
+	return cull_spheres_scalar( aFrustum, aSpheres, aBegin, aEnd, aVisible );
+}
+
+bool cull_spheres_simd() noexcept
+{
+	return false;
+}
+#endif // ~ __AVX__
@@ -0,0 +1,67 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+// View-frustum culling of bounding spheres. This file (and culling.cpp) only
+// depends on vmlib, and does not make any OpenGL calls.
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat44.hpp"
+
+// Frustum planes (left, right, bottom, top, near, far). Each plane is stored
+// as (nx, ny, nz, d) with a unit-length normal pointing into the frustum, so
+// that a point p is inside when dot(n,p) + d >= 0.
+struct Frustum
+{
+	Vec4f planes[6];
+};
+
+// Extract the planes from a view-projection matrix (projection * world2camera)
+// following Gribb & Hartmann. The planes are in the space that the matrix
+// transforms from (i.e., world space for projection * world2camera).
+Frustum extract_frustum_planes( Mat44f const& aViewProj ) noexcept;
+
+// Bounding spheres in structure-of-arrays layout.
+struct SphereSoA
+{
+	std::vector<float> x, y, z, radius;
+
+	void clear() noexcept;
+	void reserve( std::size_t );
+	void push_back( Vec3f aCenter, float aRadius );
+
+	std::size_t size() const noexcept;
+};
+
+// Transform an object-space bounding sphere by aWorld. The radius is scaled
+// by the largest axis scale, so the result is conservative under non-uniform
+// scaling.
+void transform_sphere( Mat44f const& aWorld, Vec3f aCenter, float aRadius, Vec3f& aOutCenter, float& aOutRadius ) noexcept;
+
+// Test the spheres [aBegin, aEnd) against the frustum. aVisible[i] is set to
+// 1 if sphere i intersects the frustum and to 0 otherwise. Returns the number
+// of visible spheres in the range.
+//
+// cull_spheres() processes spheres in batches of eight with AVX, if the
+// compiler targets it (-march=native on a machine with AVX), and falls back
+// to cull_spheres_scalar() otherwise (and for the remainder of the range).
+// Both produce the same results.
+std::size_t cull_spheres( Frustum const&, SphereSoA const&, std::size_t aBegin, std::size_t aEnd, std::uint8_t* aVisible ) noexcept;
+std::size_t cull_spheres_scalar( Frustum const&, SphereSoA const&, std::size_t aBegin, std::size_t aEnd, std::uint8_t* aVisible ) noexcept;
+
+// True if cull_spheres() uses the AVX code path.
+bool cull_spheres_simd() noexcept;
+
+struct CullStats
+{
+	std::size_t tested = 0;
+	std::size_t visible = 0; // after frustum culling
+	std::size_t occluded = 0; // of the visible ones, see OcclusionBuffer
+};
+
+#endif // CULLING_HPP
@@ -0,0 +1,291 @@
+#ifndef ECS_HPP
+#define ECS_HPP
+
+#include <tuple>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <typeinfo>
+#include <typeindex>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+
+#include "../support/jobs.hpp"
+
+/** Minimal entity-component system
+ *
+ * Entities are 32-bit handles: the lower 24 bits index into the registry, the
+ * upper 8 bits are a version that is bumped whenever the slot is recycled, so
+ * that stale handles can be detected.
+ *
+ * Each component type is stored in its own sparse set. The component values
+ * are packed densely in a std::vector<T> (one array per component type), so
+ * systems that walk a component type touch memory linearly. The sparse array
+ * maps an entity index to the position in the dense array.
+ *
+ * Example:
+ *    Registry reg;
+ *    Entity e = reg.create();
+ *    reg.emplace<Transform>( e, Transform{} );
+ *    reg.each<Transform, Animator>( []( Entity, Transform& t, Animator& a ) { ... } );
+ */
+using Entity = std::uint32_t;
+
+constexpr Entity kNullEntity = ~Entity(0);
+
+constexpr std::uint32_t kEntityIndexBits = 24;
+constexpr std::uint32_t kEntityIndexMask = (1u << kEntityIndexBits) - 1;
+
+constexpr
+std::uint32_t entity_index( Entity aEntity ) noexcept
+{
+	return aEntity & kEntityIndexMask;
+}
+constexpr
+std::uint32_t entity_version( Entity aEntity ) noexcept
+{
+	return aEntity >> kEntityIndexBits;
+}
+
+class ComponentPoolBase
+{
+	public:
+		virtual ~ComponentPoolBase() = default;
+
+		virtual void remove( Entity ) = 0;
+		virtual bool contains( Entity ) const noexcept = 0;
+		virtual std::size_t size() const noexcept = 0;
+};
+
+template< typename tComponent >
+class ComponentPool final : public ComponentPoolBase
+{
+	public:
+		static constexpr std::uint32_t kAbsent = ~std::uint32_t(0);
+
+	public:
+		tComponent& emplace( Entity aEntity, tComponent aValue )
+		{
+			auto const idx = entity_index( aEntity );
+			if( idx >= mSparse.size() )
+				mSparse.resize( idx+1, kAbsent );
+
+			if( kAbsent != mSparse[idx] )
+				return mData[mSparse[idx]] = std::move(aValue);
+
+			mSparse[idx] = std::uint32_t(mDense.size());
+			mDense.emplace_back( aEntity );
+			mData.emplace_back( std::move(aValue) );
+			return mData.back();
+		}
+
+		void remove( Entity aEntity ) override
+		{
+			if( !contains( aEntity ) )
+				return;
+
+			// Swap-and-pop keeps the dense arrays packed.
+			auto const idx = entity_index( aEntity );
+			auto const pos = mSparse[idx];
+			auto const last = std::uint32_t(mDense.size()-1);
+
+			if( pos != last )
+			{
+				mDense[pos] = mDense[last];
+				mData[pos] = std::move(mData[last]);
+				mSparse[entity_index(mDense[pos])] = pos;
+			}
+
+			mDense.pop_back();
+			mData.pop_back();
+			mSparse[idx] = kAbsent;
+		}
+
+		bool contains( Entity aEntity ) const noexcept override
+		{
+			auto const idx = entity_index( aEntity );
+			return idx < mSparse.size() && kAbsent != mSparse[idx] && mDense[mSparse[idx]] == aEntity;
+		}
+
+		std::size_t size() const noexcept override
+		{
+			return mDense.size();
+		}
+
+		tComponent& get( Entity aEntity ) noexcept
+		{
+			assert( contains( aEntity ) );
+			return mData[mSparse[entity_index(aEntity)]];
+		}
+		tComponent const& get( Entity aEntity ) const noexcept
+		{
+			assert( contains( aEntity ) );
+			return mData[mSparse[entity_index(aEntity)]];
+		}
+
+		tComponent* find( Entity aEntity ) noexcept
+		{
+			return contains( aEntity ) ? &mData[mSparse[entity_index(aEntity)]] : nullptr;
+		}
+
+		std::vector<Entity> const& entities() const noexcept { return mDense; }
+		std::vector<tComponent>& data() noexcept { return mData; }
+		std::vector<tComponent> const& data() const noexcept { return mData; }
+
+	private:
+		std::vector<std::uint32_t> mSparse;
+		std::vector<Entity> mDense;
+		std::vector<tComponent> mData;
+};
+
+class Registry
+{
+	public:
+		Entity create()
+		{
+			if( !mFree.empty() )
+			{
+				auto const idx = mFree.back();
+				mFree.pop_back();
+				return mSlots[idx] = (mSlots[idx] & ~kEntityIndexMask) | idx;
+			}
+
+			auto const idx = std::uint32_t(mSlots.size());
+			assert( idx <= kEntityIndexMask );
+			mSlots.emplace_back( idx );
+			return idx;
+		}
+
+		void destroy( Entity aEntity )
+		{
+			if( !valid( aEntity ) )
+				return;
+
+			for( auto& pool : mPools )
+				pool.second->remove( aEntity );
+
+			auto const idx = entity_index( aEntity );
+			auto const version = (entity_version( aEntity ) + 1) & 0xffu;
+			mSlots[idx] = (version << kEntityIndexBits) | kEntityIndexMask;
+			mFree.emplace_back( idx );
+		}
+
+		bool valid( Entity aEntity ) const noexcept
+		{
+			auto const idx = entity_index( aEntity );
+			return idx < mSlots.size() && mSlots[idx] == aEntity;
+		}
+
+		std::size_t alive() const noexcept
+		{
+			return mSlots.size() - mFree.size();
+		}
+
+	public:
+		template< typename tComponent >
+		tComponent& emplace( Entity aEntity, tComponent aValue = {} )
+		{
+			assert( valid( aEntity ) );
+			return pool<tComponent>().emplace( aEntity, std::move(aValue) );
+		}
+
+		template< typename tComponent >
+		void remove( Entity aEntity )
+		{
+			pool<tComponent>().remove( aEntity );
+		}
+
+		template< typename tComponent >
+		bool has( Entity aEntity ) const noexcept
+		{
+			auto const* p = find_pool_<tComponent>();
+			return p && p->contains( aEntity );
+		}
+
+		template< typename tComponent >
+		tComponent& get( Entity aEntity ) noexcept
+		{
+			return pool<tComponent>().get( aEntity );
+		}
+
+		template< typename tComponent >
+		ComponentPool<tComponent>& pool()
+		{
+			auto& slot = mPools[std::type_index(typeid(tComponent))];
+			if( !slot )
+				slot = std::make_unique<ComponentPool<tComponent>>();
+
+			return static_cast<ComponentPool<tComponent>&>(*slot);
+		}
+
+	public:
+		// Call aFunc( Entity, tFirst&, tRest&... ) for each entity that has all
+		// of the listed components. Iteration follows the dense array of the
+		// first component, so list the most selective component first.
+		template< typename tFirst, typename... tRest, typename tFunc >
+		void each( tFunc&& aFunc )
+		{
+			auto& first = pool<tFirst>();
+			auto rest = std::forward_as_tuple( pool<tRest>()... );
+			(void)rest; // unused when tRest is empty
+
+			auto const& entities = first.entities();
+			auto& data = first.data();
+			for( std::size_t i = 0; i < entities.size(); ++i )
+			{
+				auto const e = entities[i];
+				if( !(std::get<ComponentPool<tRest>&>(rest).contains( e ) && ...) )
+					continue;
+
+				aFunc( e, data[i], std::get<ComponentPool<tRest>&>(rest).get( e )... );
+			}
+		}
+
+		// As each(), but splits the dense array of the first component into
+		// chunks of aGrain entities that are processed by the job system.
+		// aFunc must only modify the components it is handed.
+		template< typename tFirst, typename... tRest, typename tFunc >
+		void each_parallel( JobSystem& aJobs, tFunc&& aFunc, std::size_t aGrain = 1024 )
+		{
+			auto& first = pool<tFirst>();
+			auto rest = std::forward_as_tuple( pool<tRest>()... );
+			(void)rest; // unused when tRest is empty
+
+			auto const& entities = first.entities();
+			auto& data = first.data();
+
+			aJobs.parallel_for( 0, entities.size(), aGrain, [&] ( std::size_t aBegin, std::size_t aEnd ) {
+				for( std::size_t i = aBegin; i < aEnd; ++i )
+				{
+					auto const e = entities[i];
+					if( !(std::get<ComponentPool<tRest>&>(rest).contains( e ) && ...) )
+						continue;
+
+					aFunc( e, data[i], std::get<ComponentPool<tRest>&>(rest).get( e )... );
+				}
+			} );
+		}
+
+	private:
+		template< typename tComponent >
+		ComponentPool<tComponent> const* find_pool_() const noexcept
+		{
+			auto const it = mPools.find( std::type_index(typeid(tComponent)) );
+			if( mPools.end() == it )
+				return nullptr;
+
+			return static_cast<ComponentPool<tComponent> const*>(it->second.get());
+		}
+
+	private:
+		std::vector<Entity> mSlots;
+		std::vector<std::uint32_t> mFree;
+
+		std::unordered_map<std::type_index, std::unique_ptr<ComponentPoolBase>> mPools;
+};
+
+#endif // ECS_HPP
@@ -0,0 +1,35 @@
+#include "frame_snapshot.hpp"
+
+UiDrawData::~UiDrawData()
+{
+	for( auto* list : mLists )
+		IM_DELETE( list );
+}
+
+void UiDrawData::assign( ImDrawData const& aData )
+{
+	auto const count = std::size_t(aData.CmdListsCount);
+	while( mLists.size() < count )
+		mLists.emplace_back( IM_NEW(ImDrawList)( nullptr ) );
+
+	// Only the output of the lists is needed for rendering (as in
+	// ImDrawList::CloneOutput())
+	for( std::size_t i = 0; i < count; ++i )
+	{
+		auto const* src = aData.CmdLists[i];
+		auto* dst = mLists[i];
+
+		dst->CmdBuffer = src->CmdBuffer;
+		dst->IdxBuffer = src->IdxBuffer;
+		dst->VtxBuffer = src->VtxBuffer;
+		dst->Flags = src->Flags;
+	}
+
+	mData = aData;
+	mData.CmdLists = mLists.data();
+}
+
+ImDrawData* UiDrawData::draw_data() const noexcept
+{
+	return mData.Valid ? &mData : nullptr;
+}
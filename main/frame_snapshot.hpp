@@ -0,0 +1,114 @@
+#ifndef FRAME_SNAPSHOT_HPP
+#define FRAME_SNAPSHOT_HPP
+
+#include <glad.h>
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../third_party/imgui/imgui.h"
+
+#include "../support/gpu_profiler.hpp"
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "systems.hpp"
+#include "culling.hpp"
+#include "multi_draw.hpp"
+#include "render_stats.hpp"
+#include "image_writer.hpp"
+
+/** UiDrawData: a copy of ImGui's draw data
+ *
+ * ImGui::Render() produces draw lists that are owned by the ImGui context
+ * and overwritten by the next frame. The copy can be rendered (with
+ * ImGui_ImplOpenGL3_RenderDrawData()) on another thread while the next frame
+ * is being built. The copied draw lists are kept and reused.
+ */
+class UiDrawData final
+{
+	public:
+		UiDrawData() = default;
+		~UiDrawData();
+
+		UiDrawData( UiDrawData const& ) = delete;
+		UiDrawData& operator= (UiDrawData const&) = delete;
+
+	public:
+		void assign( ImDrawData const& );
+
+		// Null if nothing was assigned yet. The ImGui renderer takes a
+		// non-const pointer, but does not modify the draw data.
+		ImDrawData* draw_data() const noexcept;
+
+	private:
+		std::vector<ImDrawList*> mLists;
+		mutable ImDrawData mData;
+};
+
+/** FrameSnapshot: everything that is needed to render one frame
+ *
+ * Produced by the main thread (events, simulation, culling, UI) and consumed
+ * by the render thread, which makes all GL calls (see RenderThread). It only
+ * holds copies, so that the main thread can update the Registry and build the
+ * UI for the next frame while this one is being drawn.
+ */
+struct FrameSnapshot
+{
+	std::uint64_t frame = 0;
+	GLsizei width = 0, height = 0; // framebuffer
+
+	// Camera
+	Mat44f projection = kIdentity44f;
+	Mat44f world2camera = kIdentity44f;
+	Mat44f cameraTranslation = kIdentity44f;
+	Vec3f cameraPosition{ 0.f, 0.f, 0.f };
+	float fovY = 1.f;
+
+	// Meshlet culling; disabled together with frustum culling
+	bool meshletCulling = false;
+	Frustum frustum{};
+
+	// Light settings, see lighting() in main.cpp
+	float colorBool[3] = {};
+	float color[4] = {}, color1[4] = {}, color2[4] = {};
+	float lightBrightness[3] = {};
+
+	RenderList renderables; // visible entities only
+	CullStats cullStats;
+
+	UiDrawData ui;
+
+	// Requests from the UI and key bindings
+	ImageFormat imageFormat = ImageFormat::png; // screenshots and recordings
+	bool screenshot = false;
+	bool toggleRecording = false;
+	bool reloadShaders = false;
+
+	// Poster capture (F11): the scene is drawn again at the poster resolution,
+	// with LODs selected for it and without culling.
+	bool poster = false;
+	std::string posterPath;
+	Mat44f posterProjection = kIdentity44f;
+	RenderList posterRenderables;
+};
+
+// Results of the render thread that are shown in the UI. Render stats are
+// kept per frame, so that the log on the main thread sees every frame.
+struct RenderFeedback
+{
+	std::vector<RenderStats> frames; // rendered since the main thread last looked
+	GpuProfiler::Results gpu;
+	MultiDrawBatch::MeshletStats meshlets;
+
+	bool recording = false;
+	std::string recordingPath;
+	std::size_t recordedFrames = 0;
+	std::size_t recordingStalls = 0;
+};
+
+#endif // FRAME_SNAPSHOT_HPP
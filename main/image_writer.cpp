@@ -0,0 +1,790 @@
+#include "image_writer.hpp"
+
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <utility>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../support/error.hpp"
+#include "../support/jobs.hpp"
+#include "../support/profiler.hpp"
+
+#include "defaults.hpp"
+
+namespace
+{
+	using Bytes_ = std::vector<unsigned char>;
+
+	char const* const kFormatNames_[kImageFormatCount] = { "png", "png-mt", "qoi", "ppm" };
+	char const* const kFormatExtensions_[kImageFormatCount] = { ".png", ".png", ".qoi", ".ppm" };
+
+	void put_u32_be_( Bytes_& aOut, std::uint32_t aValue )
+	{
+		aOut.push_back( static_cast<unsigned char>(aValue >> 24) );
+		aOut.push_back( static_cast<unsigned char>(aValue >> 16) );
+		aOut.push_back( static_cast<unsigned char>(aValue >> 8) );
+		aOut.push_back( static_cast<unsigned char>(aValue) );
+	}
+
+
+	// PPM
+	void ppm_header_( Bytes_& aOut, std::size_t aWidth, std::size_t aHeight )
+	{
+		char header[64];
+		auto const len = std::snprintf( header, sizeof(header), "P6\n%zu %zu\n255\n", aWidth, aHeight );
+		aOut.insert( aOut.end(), header, header + len );
+	}
+
+	Bytes_ encode_ppm_( std::size_t aWidth, std::size_t aHeight, unsigned char const* aRgb )
+	{
+		Bytes_ out;
+		out.reserve( 64 + aWidth * aHeight * 3 );
+		ppm_header_( out, aWidth, aHeight );
+		out.insert( out.end(), aRgb, aRgb + aWidth * aHeight * 3 );
+		return out;
+	}
+
+
+	// QOI, see https://qoiformat.org/qoi-specification.pdf
+	struct QoiRgb_
+	{
+		unsigned char r, g, b;
+	};
+
+	struct QoiState_
+	{
+		QoiRgb_ index[64] = {};
+		bool indexValid[64] = {}; // the index starts out as {0,0,0,0}, which never matches an RGB pixel
+
+		QoiRgb_ prev{ 0, 0, 0 };
+		unsigned run = 0;
+	};
+
+	void qoi_header_( Bytes_& aOut, std::size_t aWidth, std::size_t aHeight )
+	{
+		aOut.insert( aOut.end(), { 'q', 'o', 'i', 'f' } );
+		put_u32_be_( aOut, std::uint32_t(aWidth) );
+		put_u32_be_( aOut, std::uint32_t(aHeight) );
+		aOut.push_back( 3 ); // channels
+		aOut.push_back( 0 ); // sRGB
+	}
+
+	// aEndOfImage: these are the last pixels of the image (ends a run)
+	void qoi_pixels_( QoiState_& aState, Bytes_& aOut, unsigned char const* aRgb, std::size_t aCount, bool aEndOfImage )
+	{
+		constexpr unsigned char kOpIndex = 0x00, kOpDiff = 0x40, kOpLuma = 0x80, kOpRun = 0xc0, kOpRgb = 0xfe;
+
+		aOut.reserve( aOut.size() + aCount * 4 + 8 ); // worst case
+
+		auto& index = aState.index;
+		auto& prev = aState.prev;
+		auto& run = aState.run;
+
+		for( std::size_t i = 0; i < aCount; ++i )
+		{
+			QoiRgb_ const px{ aRgb[3*i+0], aRgb[3*i+1], aRgb[3*i+2] };
+
+			if( px.r == prev.r && px.g == prev.g && px.b == prev.b )
+			{
+				++run;
+				if( 62 == run || (aEndOfImage && aCount-1 == i) )
+				{
+					aOut.push_back( static_cast<unsigned char>(kOpRun | (run-1)) );
+					run = 0;
+				}
+				continue;
+			}
+
+			if( run )
+			{
+				aOut.push_back( static_cast<unsigned char>(kOpRun | (run-1)) );
+				run = 0;
+			}
+
+			auto const hash = (px.r*3 + px.g*5 + px.b*7 + 255*11) % 64;
+			if( aState.indexValid[hash] && index[hash].r == px.r && index[hash].g == px.g && index[hash].b == px.b )
+			{
+				aOut.push_back( static_cast<unsigned char>(kOpIndex | hash) );
+			}
+			else
+			{
+				index[hash] = px;
+				aState.indexValid[hash] = true;
+
+				auto const dr = static_cast<signed char>(px.r - prev.r);
+				auto const dg = static_cast<signed char>(px.g - prev.g);
+				auto const db = static_cast<signed char>(px.b - prev.b);
+				auto const drg = dr - dg;
+				auto const dbg = db - dg;
+
+				if( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 )
+				{
+					aOut.push_back( static_cast<unsigned char>(kOpDiff | (dr+2) << 4 | (dg+2) << 2 | (db+2)) );
+				}
+				else if( dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7 )
+				{
+					aOut.push_back( static_cast<unsigned char>(kOpLuma | (dg+32)) );
+					aOut.push_back( static_cast<unsigned char>((drg+8) << 4 | (dbg+8)) );
+				}
+				else
+				{
+					aOut.insert( aOut.end(), { kOpRgb, px.r, px.g, px.b } );
+				}
+			}
+
+			prev = px;
+		}
+	}
+
+	void qoi_trailer_( Bytes_& aOut )
+	{
+		aOut.insert( aOut.end(), { 0, 0, 0, 0, 0, 0, 0, 1 } );
+	}
+
+	Bytes_ encode_qoi_( std::size_t aWidth, std::size_t aHeight, unsigned char const* aRgb )
+	{
+		Bytes_ out;
+		QoiState_ state;
+		qoi_header_( out, aWidth, aHeight );
+		qoi_pixels_( state, out, aRgb, aWidth * aHeight, true );
+		qoi_trailer_( out );
+		return out;
+	}
+
+
+	// PNG via stb_image_write
+	Bytes_ encode_png_stb_( std::size_t aWidth, std::size_t aHeight, unsigned char const* aRgb )
+	{
+		Bytes_ out;
+		auto const append = [] (void* aContext, void* aData, int aSize) {
+			auto& bytes = *static_cast<Bytes_*>(aContext);
+			auto const* data = static_cast<unsigned char const*>(aData);
+			bytes.insert( bytes.end(), data, data + aSize );
+		};
+
+		if( !stbi_write_png_to_func( append, &out, int(aWidth), int(aHeight), 3, aRgb, 0 ) )
+			throw Error( "stbi_write_png_to_func() failed (%zu x %zu)", aWidth, aHeight );
+
+		return out;
+	}
+
+
+	// PNG with parallel deflate
+	constexpr std::size_t kMinStripRows_ = 32;
+
+	constexpr unsigned kHashBits_ = 15;
+	constexpr std::size_t kWindow_ = 32768;
+	constexpr unsigned kMaxChain_ = 8;
+	constexpr unsigned kMinMatch_ = 3, kMaxMatch_ = 258;
+
+	constexpr std::uint32_t kAdlerBase_ = 65521;
+
+	std::uint32_t const* crc_table_()
+	{
+		static auto const table = [] {
+			std::vector<std::uint32_t> t( 256 );
+			for( std::uint32_t n = 0; n < 256; ++n )
+			{
+				auto c = n;
+				for( int k = 0; k < 8; ++k )
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+		return table.data();
+	}
+
+	std::uint32_t crc32_( std::uint32_t aCrc, unsigned char const* aData, std::size_t aSize )
+	{
+		auto const* table = crc_table_();
+		auto c = ~aCrc;
+		for( std::size_t i = 0; i < aSize; ++i )
+			c = table[(c ^ aData[i]) & 0xff] ^ (c >> 8);
+		return ~c;
+	}
+
+	std::uint32_t adler32_( unsigned char const* aData, std::size_t aSize )
+	{
+		std::uint32_t a = 1, b = 0;
+		while( aSize )
+		{
+			// 5552 is the largest n such that b does not overflow
+			auto const n = std::min<std::size_t>( aSize, 5552 );
+			for( std::size_t i = 0; i < n; ++i )
+			{
+				a += aData[i];
+				b += a;
+			}
+			a %= kAdlerBase_;
+			b %= kAdlerBase_;
+			aData += n;
+			aSize -= n;
+		}
+		return b << 16 | a;
+	}
+
+	// Checksum of A followed by B, given the checksums of each (as zlib's
+	// adler32_combine())
+	std::uint32_t adler32_combine_( std::uint32_t aAdlerA, std::uint32_t aAdlerB, std::size_t aSizeB )
+	{
+		auto const rem = std::uint32_t(aSizeB % kAdlerBase_);
+		auto sum1 = aAdlerA & 0xffff;
+		auto sum2 = std::uint32_t((std::uint64_t(rem) * sum1) % kAdlerBase_);
+		sum1 += (aAdlerB & 0xffff) + kAdlerBase_ - 1;
+		sum2 += (aAdlerA >> 16) + (aAdlerB >> 16) + kAdlerBase_ - rem;
+		if( sum1 >= kAdlerBase_ ) sum1 -= kAdlerBase_;
+		if( sum1 >= kAdlerBase_ ) sum1 -= kAdlerBase_;
+		if( sum2 >= 2*kAdlerBase_ ) sum2 -= 2*kAdlerBase_;
+		if( sum2 >= kAdlerBase_ ) sum2 -= kAdlerBase_;
+		return sum2 << 16 | sum1;
+	}
+
+	class BitWriter_
+	{
+		public:
+			explicit BitWriter_( Bytes_& aOut )
+				: mOut( aOut )
+			{}
+
+			// LSB first, at most 32 bits
+			void put( std::uint32_t aBits, unsigned aCount )
+			{
+				mAccum |= std::uint64_t(aBits) << mCount;
+				mCount += aCount;
+				if( mCount >= 32 )
+				{
+					auto const size = mOut.size();
+					mOut.resize( size + 4 );
+					for( int i = 0; i < 4; ++i )
+						mOut[size+i] = static_cast<unsigned char>(mAccum >> (8*i));
+					mAccum >>= 32;
+					mCount -= 32;
+				}
+			}
+
+			void align()
+			{
+				while( mCount )
+				{
+					mOut.push_back( static_cast<unsigned char>(mAccum) );
+					mAccum >>= 8;
+					mCount = mCount > 8 ? mCount - 8 : 0;
+				}
+				mAccum = 0;
+			}
+
+		private:
+			Bytes_& mOut;
+			std::uint64_t mAccum = 0;
+			unsigned mCount = 0;
+	};
+
+	// Fixed Huffman codes (RFC 1951, 3.2.6), bit-reversed for the LSB-first
+	// writer. Length and distance codes include their extra bits.
+	struct Code_
+	{
+		std::uint32_t bits;
+		unsigned count;
+	};
+
+	struct FixedCodes_
+	{
+		Code_ literals[286];
+		Code_ lengths[kMaxMatch_ + 1];
+		Code_ distances[kWindow_ + 1];
+
+		FixedCodes_() noexcept
+		{
+			auto const reverse = [] (std::uint32_t aCode, unsigned aLength) {
+				std::uint32_t ret = 0;
+				for( unsigned i = 0; i < aLength; ++i )
+					ret |= ((aCode >> i) & 1) << (aLength-1-i);
+				return ret;
+			};
+
+			for( unsigned sym = 0; sym < 286; ++sym )
+			{
+				if( sym <= 143 ) literals[sym] = { reverse( 0x30 + sym, 8 ), 8 };
+				else if( sym <= 255 ) literals[sym] = { reverse( 0x190 + sym - 144, 9 ), 9 };
+				else if( sym <= 279 ) literals[sym] = { reverse( sym - 256, 7 ), 7 };
+				else literals[sym] = { reverse( 0xc0 + sym - 280, 8 ), 8 };
+			}
+
+			static constexpr unsigned short kLengthBase[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+			static constexpr unsigned char kLengthExtra[] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+			static constexpr unsigned short kDistBase[] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+			static constexpr unsigned char kDistExtra[] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+			unsigned lc = 0;
+			for( unsigned len = kMinMatch_; len <= kMaxMatch_; ++len )
+			{
+				while( lc+1 < std::size(kLengthBase) && kLengthBase[lc+1] <= len )
+					++lc;
+				auto const& sym = literals[257 + lc];
+				lengths[len] = { sym.bits | (len - kLengthBase[lc]) << sym.count, sym.count + kLengthExtra[lc] };
+			}
+
+			unsigned dc = 0;
+			for( unsigned dist = 1; dist <= kWindow_; ++dist )
+			{
+				while( dc+1 < std::size(kDistBase) && kDistBase[dc+1] <= dist )
+					++dc;
+				distances[dist] = { reverse( dc, 5 ) | (dist - kDistBase[dc]) << 5, 5u + kDistExtra[dc] };
+			}
+		}
+	};
+
+	FixedCodes_ const& fixed_codes_()
+	{
+		static FixedCodes_ const codes;
+		return codes;
+	}
+
+	// Compress aData into one fixed-Huffman block. A final block is padded to
+	// a byte boundary; otherwise an empty stored block (a "sync flush")
+	// follows, which also ends on a byte boundary. The next strip's blocks
+	// can therefore simply be appended.
+	void deflate_strip_( Bytes_& aOut, unsigned char const* aData, std::size_t aSize, bool aFinal )
+	{
+		auto const& codes = fixed_codes_();
+
+		BitWriter_ bits( aOut );
+		bits.put( aFinal ? 1 : 0, 1 );
+		bits.put( 1, 2 ); // fixed Huffman codes
+
+		std::vector<std::int32_t> head( std::size_t(1) << kHashBits_, -1 );
+		std::vector<std::int32_t> prev( kWindow_, -1 );
+
+		auto const hash = [aData] (std::size_t aPos) {
+			std::uint32_t const v = std::uint32_t(aData[aPos]) << 16 | std::uint32_t(aData[aPos+1]) << 8 | aData[aPos+2];
+			return (v * 2654435761u) >> (32 - kHashBits_);
+		};
+		auto const insert = [&] (std::size_t aPos) {
+			auto const h = hash( aPos );
+			prev[aPos % kWindow_] = head[h];
+			head[h] = std::int32_t(aPos);
+		};
+
+		std::size_t pos = 0;
+		while( pos < aSize )
+		{
+			unsigned bestLength = 0, bestDistance = 0;
+			if( pos + kMinMatch_ <= aSize )
+			{
+				auto const maxLength = unsigned(std::min<std::size_t>( kMaxMatch_, aSize - pos ));
+				auto candidate = head[hash( pos )];
+				for( unsigned chain = 0; chain < kMaxChain_ && candidate >= 0; ++chain )
+				{
+					auto const distance = pos - std::size_t(candidate);
+					if( distance > kWindow_ )
+						break;
+
+					// Cannot beat the best match unless it matches at bestLength
+					unsigned length = 0;
+					if( aData[std::size_t(candidate) + bestLength] == aData[pos + bestLength] )
+					{
+						while( length < maxLength && aData[std::size_t(candidate) + length] == aData[pos + length] )
+							++length;
+					}
+
+					if( length > bestLength )
+					{
+						bestLength = length;
+						bestDistance = unsigned(distance);
+						if( length == maxLength )
+							break;
+					}
+
+					auto const next = prev[std::size_t(candidate) % kWindow_];
+					if( next >= candidate )
+						break; // slot was overwritten by a newer position
+					candidate = next;
+				}
+			}
+
+			if( bestLength >= kMinMatch_ )
+			{
+				bits.put( codes.lengths[bestLength].bits, codes.lengths[bestLength].count );
+				bits.put( codes.distances[bestDistance].bits, codes.distances[bestDistance].count );
+				for( std::size_t i = 0; i < bestLength; ++i, ++pos )
+				{
+					if( pos + kMinMatch_ <= aSize )
+						insert( pos );
+				}
+			}
+			else
+			{
+				bits.put( codes.literals[aData[pos]].bits, codes.literals[aData[pos]].count );
+				if( pos + kMinMatch_ <= aSize )
+					insert( pos );
+				++pos;
+			}
+		}
+
+		bits.put( codes.literals[256].bits, codes.literals[256].count ); // end of block
+
+		if( !aFinal )
+		{
+			bits.put( 0, 3 ); // stored, not final
+			bits.align();
+			bits.put( 0x0000, 16 );
+			bits.put( 0xffff, 16 );
+		}
+		bits.align();
+	}
+
+	unsigned char paeth_( int aA, int aB, int aC ) noexcept
+	{
+		auto const p = aA + aB - aC;
+		auto const pa = std::abs( p - aA ), pb = std::abs( p - aB ), pc = std::abs( p - aC );
+		if( pa <= pb && pa <= pc ) return static_cast<unsigned char>(aA);
+		if( pb <= pc ) return static_cast<unsigned char>(aB);
+		return static_cast<unsigned char>(aC);
+	}
+
+	// Filter one row; picks the filter with the smallest sum of absolute
+	// (signed) residuals, like most encoders.
+	void filter_row_( unsigned char* aOut, unsigned char const* aRow, unsigned char const* aAbove, std::size_t aRowBytes )
+	{
+		constexpr std::size_t bpp = 3;
+
+		thread_local Bytes_ scratch;
+		scratch.resize( aRowBytes );
+
+		std::size_t bestCost = ~std::size_t(0);
+
+		auto const consider = [&] (int aFilter, auto&& aPredict) {
+			std::size_t cost = 0;
+			for( std::size_t i = 0; i < aRowBytes; ++i )
+			{
+				auto const residual = static_cast<unsigned char>(aRow[i] - aPredict( i ));
+				scratch[i] = residual;
+				cost += std::size_t(std::abs( int(static_cast<signed char>(residual)) ));
+			}
+
+			if( cost < bestCost )
+			{
+				bestCost = cost;
+				aOut[0] = static_cast<unsigned char>(aFilter);
+				std::memcpy( aOut + 1, scratch.data(), aRowBytes );
+			}
+		};
+
+		auto const left = [aRow] (std::size_t i) -> int { return i >= bpp ? aRow[i-bpp] : 0; };
+
+		consider( 0, [] (std::size_t) { return 0; } );
+		consider( 1, left );
+		if( aAbove )
+		{
+			consider( 2, [aAbove] (std::size_t i) -> int { return aAbove[i]; } );
+			consider( 3, [&] (std::size_t i) { return (left( i ) + aAbove[i]) / 2; } );
+			consider( 4, [&] (std::size_t i) -> int {
+				return paeth_( left( i ), aAbove[i], i >= bpp ? aAbove[i-bpp] : 0 );
+			} );
+		}
+		else
+		{
+			consider( 3, [&] (std::size_t i) { return left( i ) / 2; } );
+		}
+	}
+
+	struct Strip_
+	{
+		std::size_t rowBegin, rowEnd;
+		Bytes_ deflated;
+		std::uint32_t adler;
+		std::size_t filteredBytes;
+	};
+
+	// aAbove is the row before aRgb (nullptr at the top of the image)
+	void encode_strip_( Strip_& aStrip, std::size_t aWidth, unsigned char const* aRgb, unsigned char const* aAbove, bool aFinal )
+	{
+		PROFILE_ZONE( "deflate strip" );
+
+		auto const rowBytes = aWidth * 3;
+		auto const rows = aStrip.rowEnd - aStrip.rowBegin;
+
+		Bytes_ filtered( rows * (rowBytes + 1) );
+		for( std::size_t y = aStrip.rowBegin; y < aStrip.rowEnd; ++y )
+		{
+			auto const* row = aRgb + y * rowBytes;
+			auto const* above = y ? row - rowBytes : aAbove;
+			filter_row_( filtered.data() + (y - aStrip.rowBegin) * (rowBytes + 1), row, above, rowBytes );
+		}
+
+		aStrip.adler = adler32_( filtered.data(), filtered.size() );
+		aStrip.filteredBytes = filtered.size();
+
+		aStrip.deflated.reserve( filtered.size() / 2 );
+		deflate_strip_( aStrip.deflated, filtered.data(), filtered.size(), aFinal );
+	}
+
+	void put_chunk_( Bytes_& aOut, char const* aType, unsigned char const* aData, std::size_t aSize )
+	{
+		put_u32_be_( aOut, std::uint32_t(aSize) );
+		auto const start = aOut.size();
+		aOut.insert( aOut.end(), aType, aType + 4 );
+		aOut.insert( aOut.end(), aData, aData + aSize );
+		put_u32_be_( aOut, crc32_( 0, aOut.data() + start, aOut.size() - start ) );
+	}
+
+	void png_header_( Bytes_& aOut, std::size_t aWidth, std::size_t aHeight )
+	{
+		aOut.insert( aOut.end(), { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' } );
+
+		Bytes_ ihdr;
+		put_u32_be_( ihdr, std::uint32_t(aWidth) );
+		put_u32_be_( ihdr, std::uint32_t(aHeight) );
+		ihdr.insert( ihdr.end(), { 8, 2, 0, 0, 0 } ); // 8 bit, RGB, deflate, adaptive filtering, no interlace
+		put_chunk_( aOut, "IHDR", ihdr.data(), ihdr.size() );
+	}
+
+	// One IDAT chunk with aRows rows. The zlib stream is continued across
+	// calls: aFirst adds the zlib header, aLast ends the deflate stream.
+	// aAdler accumulates the checksum (start with 1).
+	void png_rows_( Bytes_& aOut, std::size_t aWidth, unsigned char const* aRgb, std::size_t aRows, unsigned char const* aAbove, bool aFirst, bool aLast, std::uint32_t& aAdler, JobSystem* aJobs )
+	{
+		// A few strips per thread evens out differences in compressibility
+		auto const threads = aJobs ? aJobs->thread_count() : 1;
+		auto const stripRows = std::max( kMinStripRows_, (aRows + 4*threads - 1) / (4*threads) );
+
+		std::vector<Strip_> strips;
+		for( std::size_t y = 0; y < aRows; y += stripRows )
+			strips.push_back( Strip_{ y, std::min( aRows, y + stripRows ), {}, 0, 0 } );
+
+		auto const encode = [&] (std::size_t aIndex) {
+			encode_strip_( strips[aIndex], aWidth, aRgb, aAbove, aLast && strips.size()-1 == aIndex );
+		};
+
+		if( aJobs )
+		{
+			aJobs->parallel_for( 0, strips.size(), 1, [&] (std::size_t aBegin, std::size_t aEnd) {
+				for( auto i = aBegin; i < aEnd; ++i )
+					encode( i );
+			} );
+		}
+		else
+		{
+			for( std::size_t i = 0; i < strips.size(); ++i )
+				encode( i );
+		}
+
+		Bytes_ zlib;
+		if( aFirst )
+			zlib.insert( zlib.end(), { 0x78, 0x01 } );
+
+		for( auto const& strip : strips )
+		{
+			zlib.insert( zlib.end(), strip.deflated.begin(), strip.deflated.end() );
+			aAdler = adler32_combine_( aAdler, strip.adler, strip.filteredBytes );
+		}
+
+		put_chunk_( aOut, "IDAT", zlib.data(), zlib.size() );
+	}
+
+	void png_trailer_( Bytes_& aOut, std::uint32_t aAdler )
+	{
+		Bytes_ adler;
+		put_u32_be_( adler, aAdler );
+		put_chunk_( aOut, "IDAT", adler.data(), adler.size() );
+		put_chunk_( aOut, "IEND", nullptr, 0 );
+	}
+
+	Bytes_ encode_png_parallel_( std::size_t aWidth, std::size_t aHeight, unsigned char const* aRgb, JobSystem* aJobs )
+	{
+		Bytes_ out;
+		std::uint32_t adler = 1;
+		png_header_( out, aWidth, aHeight );
+		png_rows_( out, aWidth, aRgb, aHeight, nullptr, true, true, adler, aJobs );
+		png_trailer_( out, adler );
+		return out;
+	}
+
+	double seconds_since_( Clock::time_point aStart )
+	{
+		return std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - aStart).count();
+	}
+}
+
+double ImageWriteStats::throughput_mbps() const noexcept
+{
+	return encodeSeconds > 0.0 ? double(pixelBytes) / encodeSeconds * 1e-6 : 0.0;
+}
+
+char const* image_format_name( ImageFormat aFormat ) noexcept
+{
+	return kFormatNames_[std::size_t(aFormat)];
+}
+char const* image_format_extension( ImageFormat aFormat ) noexcept
+{
+	return kFormatExtensions_[std::size_t(aFormat)];
+}
+
+bool parse_image_format( char const* aName, ImageFormat& aFormat ) noexcept
+{
+	for( std::size_t i = 0; i < kImageFormatCount; ++i )
+	{
+		if( 0 == std::strcmp( aName, kFormatNames_[i] ) )
+		{
+			aFormat = ImageFormat(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+ImageWriteStats write_image( char const* aPath, ImageFormat aFormat, std::size_t aWidth, std::size_t aHeight, unsigned char const* aRgb, JobSystem* aJobs )
+{
+	PROFILE_ZONE_TEXT( "write image", aPath );
+
+	ImageWriteStats stats;
+	stats.pixelBytes = aWidth * aHeight * 3;
+
+	auto const start = Clock::now();
+
+	Bytes_ encoded;
+	switch( aFormat )
+	{
+		case ImageFormat::png: encoded = encode_png_stb_( aWidth, aHeight, aRgb ); break;
+		case ImageFormat::pngParallel: encoded = encode_png_parallel_( aWidth, aHeight, aRgb, aJobs ); break;
+		case ImageFormat::qoi: encoded = encode_qoi_( aWidth, aHeight, aRgb ); break;
+		case ImageFormat::ppm: encoded = encode_ppm_( aWidth, aHeight, aRgb ); break;
+	}
+
+	stats.encodeSeconds = seconds_since_( start );
+	stats.fileBytes = encoded.size();
+
+	std::FILE* file = std::fopen( aPath, "wb" );
+	if( !file )
+		throw Error( "Unable to open '%s' for writing", aPath );
+
+	auto const written = std::fwrite( encoded.data(), 1, encoded.size(), file );
+	if( 0 != std::fclose( file ) || written != encoded.size() )
+		throw Error( "Unable to write '%s'", aPath );
+
+	return stats;
+}
+
+
+struct ImageStreamWriter::State_
+{
+	std::FILE* file = nullptr;
+	std::string path;
+
+	ImageFormat format;
+	std::size_t width, height;
+	std::size_t rows = 0; // written so far
+	JobSystem* jobs;
+
+	ImageWriteStats stats;
+
+	Bytes_ lastRow; // PNG filters refer to the row above
+	std::uint32_t adler = 1;
+
+	QoiState_ qoi;
+
+	void write( Bytes_ const& aBytes )
+	{
+		if( std::fwrite( aBytes.data(), 1, aBytes.size(), file ) != aBytes.size() )
+			throw Error( "Unable to write '%s'", path.c_str() );
+		stats.fileBytes += aBytes.size();
+	}
+};
+
+ImageStreamWriter::ImageStreamWriter( char const* aPath, ImageFormat aFormat, std::size_t aWidth, std::size_t aHeight, JobSystem* aJobs )
+	: mState( std::make_unique<State_>() )
+{
+	auto& state = *mState;
+	state.path = aPath;
+	state.format = ImageFormat::png == aFormat ? ImageFormat::pngParallel : aFormat;
+	state.width = aWidth;
+	state.height = aHeight;
+	state.jobs = aJobs;
+	state.stats.pixelBytes = aWidth * aHeight * 3;
+
+	state.file = std::fopen( aPath, "wb" );
+	if( !state.file )
+		throw Error( "Unable to open '%s' for writing", aPath );
+
+	Bytes_ header;
+	switch( state.format )
+	{
+		case ImageFormat::png:
+		case ImageFormat::pngParallel: png_header_( header, aWidth, aHeight ); break;
+		case ImageFormat::qoi: qoi_header_( header, aWidth, aHeight ); break;
+		case ImageFormat::ppm: ppm_header_( header, aWidth, aHeight ); break;
+	}
+	state.write( header );
+}
+
+ImageStreamWriter::~ImageStreamWriter()
+{
+	if( mState->file )
+		std::fclose( mState->file );
+}
+
+void ImageStreamWriter::write_rows( unsigned char const* aRgb, std::size_t aRows )
+{
+	auto& state = *mState;
+	if( state.rows + aRows > state.height )
+		throw Error( "'%s': %zu rows written, image has %zu", state.path.c_str(), state.rows + aRows, state.height );
+	if( 0 == aRows )
+		return;
+
+	PROFILE_ZONE_TEXT( "write image rows", state.path.c_str() );
+
+	auto const rowBytes = state.width * 3;
+	bool const first = 0 == state.rows;
+	bool const last = state.rows + aRows == state.height;
+
+	auto const start = Clock::now();
+
+	Bytes_ encoded;
+	switch( state.format )
+	{
+		case ImageFormat::png:
+		case ImageFormat::pngParallel:
+			png_rows_( encoded, state.width, aRgb, aRows, first ? nullptr : state.lastRow.data(), first, last, state.adler, state.jobs );
+			state.lastRow.assign( aRgb + (aRows-1) * rowBytes, aRgb + aRows * rowBytes );
+			if( last )
+				png_trailer_( encoded, state.adler );
+			break;
+
+		case ImageFormat::qoi:
+			qoi_pixels_( state.qoi, encoded, aRgb, aRows * state.width, last );
+			if( last )
+				qoi_trailer_( encoded );
+			break;
+
+		case ImageFormat::ppm:
+			encoded.assign( aRgb, aRgb + aRows * rowBytes );
+			break;
+	}
+
+	state.stats.encodeSeconds += seconds_since_( start );
+	state.rows += aRows;
+
+	state.write( encoded );
+}
+
+ImageWriteStats ImageStreamWriter::finish()
+{
+	auto& state = *mState;
+	if( state.rows != state.height )
+		throw Error( "'%s': only %zu of %zu rows written", state.path.c_str(), state.rows, state.height );
+
+	auto* file = std::exchange( state.file, nullptr );
+	if( 0 != std::fclose( file ) )
+		throw Error( "Unable to write '%s'", state.path.c_str() );
+
+	return state.stats;
+}
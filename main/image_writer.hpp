@@ -0,0 +1,79 @@
+#ifndef IMAGE_WRITER_HPP
+#define IMAGE_WRITER_HPP
+
+#include <memory>
+
+#include <cstddef>
+
+class JobSystem;
+
+/* Image file encoders for captured frames
+ *
+ * All encoders take a top-down, tightly packed 8-bit RGB image:
+ *  - png: stb_image_write (single threaded, smallest files)
+ *  - png-mt: PNG whose image data is filtered and deflated in horizontal
+ *    strips in parallel. Each strip is compressed independently (fixed
+ *    Huffman codes, greedy LZ77) and ends on a byte boundary, so the strips
+ *    are simply concatenated into one zlib stream.
+ *  - qoi: "Quite OK Image" format, https://qoiformat.org/
+ *  - ppm: binary PPM (P6), i.e., uncompressed
+ *
+ * For bulk capture, encode throughput matters more than file size.
+ */
+enum class ImageFormat
+{
+	png,
+	pngParallel,
+	qoi,
+	ppm
+};
+
+constexpr std::size_t kImageFormatCount = 4;
+
+struct ImageWriteStats
+{
+	std::size_t pixelBytes = 0; // input
+	std::size_t fileBytes = 0;
+	double encodeSeconds = 0.0; // excludes writing the file
+
+	double throughput_mbps() const noexcept; // input MB/s
+};
+
+char const* image_format_name( ImageFormat ) noexcept; // "png", "png-mt", "qoi", "ppm"
+char const* image_format_extension( ImageFormat ) noexcept; // ".png", ...
+
+// Returns false if the name is unknown
+bool parse_image_format( char const* aName, ImageFormat& aFormat ) noexcept;
+
+// Encode and write aPath. Throws Error. aJobs is used by png-mt; without it,
+// the strips are compressed one after another.
+ImageWriteStats write_image( char const* aPath, ImageFormat, std::size_t aWidth, std::size_t aHeight, unsigned char const* aRgb, JobSystem* aJobs = nullptr );
+
+/** ImageStreamWriter: write an image a few rows at a time
+ *
+ * For images that are too large to hold in memory at once. Rows are given
+ * top-down; each call encodes them and appends them to the file. The png
+ * format is written as png-mt, since stb_image_write cannot stream. All
+ * functions throw Error.
+ */
+class ImageStreamWriter final
+{
+	public:
+		ImageStreamWriter( char const* aPath, ImageFormat, std::size_t aWidth, std::size_t aHeight, JobSystem* aJobs = nullptr );
+		~ImageStreamWriter();
+
+		ImageStreamWriter( ImageStreamWriter const& ) = delete;
+		ImageStreamWriter& operator= (ImageStreamWriter const&) = delete;
+
+	public:
+		void write_rows( unsigned char const* aRgb, std::size_t aRows );
+
+		// Call after all rows have been written
+		ImageWriteStats finish();
+
+	private:
+		struct State_;
+		std::unique_ptr<State_> mState;
+};
+
+#endif // IMAGE_WRITER_HPP
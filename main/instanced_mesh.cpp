@@ -0,0 +1,169 @@
+#include "instanced_mesh.hpp"
+
+#include <cassert>
+#include <cstddef>
+
+#include "../support/gl_state.hpp"
+
+#include "static_geometry.hpp"
+
+namespace
+{
+	constexpr GLuint kModelLocation_ = 9;   // three rows, 9-11
+	constexpr GLuint kNormalLocation_ = 12; // three rows, 12-14
+	constexpr GLuint kTintLocation_ = 15;
+}
+
+InstanceData make_instance_data( Mat44f const& aModel, Vec4f aTint ) noexcept
+{
+	return make_instance_data( aModel, mat44_to_mat33( transpose( invert( aModel ) ) ), aTint );
+}
+
+InstanceData make_instance_data( Mat44f const& aModel, Mat33f const& aNormal, Vec4f aTint ) noexcept
+{
+	InstanceData ret{};
+	for( std::size_t i = 0; i < 3; ++i )
+	{
+		for( std::size_t j = 0; j < 4; ++j )
+			ret.model[i*4+j] = aModel( i, j );
+
+		for( std::size_t j = 0; j < 3; ++j )
+			ret.normal[i*4+j] = aNormal( i, j );
+		ret.normal[i*4+3] = 0.f;
+	}
+
+	ret.tint[0] = aTint.x;
+	ret.tint[1] = aTint.y;
+	ret.tint[2] = aTint.z;
+	ret.tint[3] = aTint.w;
+	return ret;
+}
+
+
+InstancedMesh::InstancedMesh( SimpleMeshData const& aMesh )
+{
+	std::vector<StaticVertex> vertices;
+	std::vector<GLuint> indices;
+	build_indexed_mesh( aMesh, vertices, indices );
+
+	mIndexCount = GLsizei(indices.size());
+
+	glGenVertexArrays( 1, &mVao );
+	glGenBuffers( 1, &mVertexBuffer );
+	glGenBuffers( 1, &mIndexBuffer );
+
+	glstate::bind_vertex_array( mVao );
+
+	glBindBuffer( GL_ARRAY_BUFFER, mVertexBuffer );
+	glBufferData( GL_ARRAY_BUFFER, vertices.size() * sizeof(StaticVertex), vertices.data(), GL_STATIC_DRAW );
+	setup_static_vertex_attributes();
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW );
+
+	// The instance attributes are pointed at the stream buffer in upload()
+	for( GLuint i = 0; i < 3; ++i )
+	{
+		glVertexAttribDivisor( kModelLocation_+i, 1 );
+		glVertexAttribDivisor( kNormalLocation_+i, 1 );
+	}
+	glVertexAttribDivisor( kTintLocation_, 1 );
+
+	glstate::bind_vertex_array( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+InstancedMesh::~InstancedMesh()
+{
+	glstate::forget_vertex_array( mVao );
+	glDeleteVertexArrays( 1, &mVao );
+	glDeleteBuffers( 1, &mVertexBuffer );
+	glDeleteBuffers( 1, &mIndexBuffer );
+}
+
+void InstancedMesh::add( InstanceData const& aInstance )
+{
+	mInstances.emplace_back( aInstance );
+}
+
+void InstancedMesh::add( InstanceData const* aInstances, std::size_t aCount )
+{
+	mInstances.insert( mInstances.end(), aInstances, aInstances + aCount );
+}
+
+void InstancedMesh::clear() noexcept
+{
+	mInstances.clear();
+}
+
+void InstancedMesh::upload( StreamBuffer& aStream )
+{
+	mUploadedCount = mInstances.size();
+	if( 0 == mUploadedCount )
+		return;
+
+	// Aligned to the element size, so that the range starts at an instance
+	// index; the attributes then always point at the start of the buffer.
+	auto const range = aStream.upload( mInstances.data(), mInstances.size() * sizeof(InstanceData), sizeof(InstanceData) );
+	mBaseInstance = GLuint(range.offset / GLintptr(sizeof(InstanceData)));
+
+	if( range.buffer == mInstanceBuffer )
+		return;
+
+	// First upload, or the stream buffer was replaced
+	mInstanceBuffer = range.buffer;
+
+	glstate::bind_vertex_array( mVao );
+	glBindBuffer( GL_ARRAY_BUFFER, mInstanceBuffer );
+	for( GLuint i = 0; i < 3; ++i )
+	{
+		glVertexAttribPointer( kModelLocation_+i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void const*>(offsetof(InstanceData, model) + i*4*sizeof(float)) );
+		glEnableVertexAttribArray( kModelLocation_+i );
+
+		glVertexAttribPointer( kNormalLocation_+i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void const*>(offsetof(InstanceData, normal) + i*4*sizeof(float)) );
+		glEnableVertexAttribArray( kNormalLocation_+i );
+	}
+
+	glVertexAttribPointer( kTintLocation_, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void const*>(offsetof(InstanceData, tint)) );
+	glEnableVertexAttribArray( kTintLocation_ );
+
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+void InstancedMesh::draw() const
+{
+	if( 0 == mUploadedCount )
+		return;
+
+	glstate::bind_vertex_array( mVao );
+	glDrawElementsInstancedBaseInstance( GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, nullptr, GLsizei(mUploadedCount), mBaseInstance );
+}
+
+std::size_t InstancedMesh::size() const noexcept
+{
+	return mInstances.size();
+}
+std::size_t InstancedMesh::uploaded_count() const noexcept
+{
+	return mUploadedCount;
+}
+
+GLsizei InstancedMesh::index_count() const noexcept
+{
+	return mIndexCount;
+}
+
+
+void set_default_instance_attributes()
+{
+	glVertexAttrib4f( kModelLocation_+0, 1.f, 0.f, 0.f, 0.f );
+	glVertexAttrib4f( kModelLocation_+1, 0.f, 1.f, 0.f, 0.f );
+	glVertexAttrib4f( kModelLocation_+2, 0.f, 0.f, 1.f, 0.f );
+
+	glVertexAttrib3f( kNormalLocation_+0, 1.f, 0.f, 0.f );
+	glVertexAttrib3f( kNormalLocation_+1, 0.f, 1.f, 0.f );
+	glVertexAttrib3f( kNormalLocation_+2, 0.f, 0.f, 1.f );
+
+	glVertexAttrib4f( kTintLocation_, 1.f, 1.f, 1.f, 1.f );
+}
@@ -0,0 +1,92 @@
+#ifndef INSTANCED_MESH_HPP
+#define INSTANCED_MESH_HPP
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdlib>
+
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat33.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/stream_buffer.hpp"
+
+#include "simple_mesh.hpp"
+
+// Per-instance attributes, as read by default.vert (locations 9-15). The
+// model matrix is affine; only its first three rows are stored. The normal
+// matrix rows are padded to four floats.
+struct InstanceData
+{
+	float model[12];
+	float normal[12];
+	float tint[4]; // multiplies the material colors/alpha
+};
+
+static_assert( sizeof(InstanceData) == 28*sizeof(float), "InstanceData must not contain padding" );
+
+InstanceData make_instance_data( Mat44f const& aModel, Vec4f aTint = { 1.f, 1.f, 1.f, 1.f } ) noexcept;
+InstanceData make_instance_data( Mat44f const& aModel, Mat33f const& aNormal, Vec4f aTint = { 1.f, 1.f, 1.f, 1.f } ) noexcept;
+
+/** InstancedMesh: a mesh that is drawn many times with a single draw call
+ *
+ * Holds an indexed copy of a SimpleMeshData (ideally a unit mesh, i.e.,
+ * created without a pretransform). Instances are staged with add() and
+ * written to a StreamBuffer with upload(); draw() then issues a single
+ * glDrawElementsInstancedBaseInstance(), with the base instance selecting
+ * the uploaded range. The range is only valid for the current StreamBuffer
+ * frame, so upload again each frame before drawing.
+ *
+ * The instance transform is applied before the model matrix (uniform 5);
+ * leave that at identity when the instances hold world-space transforms.
+ */
+class InstancedMesh final
+{
+	public:
+		explicit InstancedMesh( SimpleMeshData const& );
+		~InstancedMesh();
+
+		InstancedMesh( InstancedMesh const& ) = delete;
+		InstancedMesh& operator= (InstancedMesh const&) = delete;
+
+	public:
+		void add( InstanceData const& );
+		void add( InstanceData const* aInstances, std::size_t aCount );
+		void clear() noexcept;
+
+		// Upload the staged instances.
+		void upload( StreamBuffer& );
+
+		void draw() const;
+
+	public:
+		// Number of staged instances
+		std::size_t size() const noexcept;
+
+		// Number of instances drawn by draw()
+		std::size_t uploaded_count() const noexcept;
+
+		GLsizei index_count() const noexcept;
+
+	private:
+		GLuint mVao = 0;
+		GLuint mVertexBuffer = 0;
+		GLuint mIndexBuffer = 0;
+		GLuint mInstanceBuffer = 0; // owned by the StreamBuffer
+
+		GLsizei mIndexCount = 0;
+
+		std::vector<InstanceData> mInstances;
+		std::size_t mUploadedCount = 0;
+		GLuint mBaseInstance = 0;
+};
+
+// Set the current (generic) values of the instance attributes to an identity
+// transform and a white tint. Draws from VAOs without instance data (e.g.,
+// from create_vao()) then behave as before. These values are context state
+// and need to be set once after context creation.
+void set_default_instance_attributes();
+
+#endif // INSTANCED_MESH_HPP
@@ -3,9 +3,12 @@
 #include <iostream>
 
 #include "../support/error.hpp"
+#include "../support/profiler.hpp"
 
 SimpleMeshData load_wavefront_obj( char const* aPath, Mat44f aPreTransform)
 {
+	PROFILE_ZONE_TEXT( "load OBJ", aPath );
+
 	auto result = rapidobj::ParseFile(aPath);
 	if (result.error)
 		throw Error("Unable to load OBJ file ’%s’: %s", aPath, result.error.code.message().c_str());
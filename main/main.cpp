@@ -4,19 +4,34 @@
 
 #include <glad.h>
 #include <GLFW/glfw3.h>
+#include <stb_image_write.h>
 
 #include <typeinfo>
+#include <memory>
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
+#include <string>
+#include <cmath>
 #include <cstdio>
+#include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <mutex>
+#include <utility>
 namespace fs = std::filesystem;
 
 #include "../support/error.hpp"
 #include "../support/program.hpp"
 #include "../support/checkpoint.hpp"
 #include "../support/debug_output.hpp"
+#include "../support/jobs.hpp"
+#include "../support/profiler.hpp"
+#include "../support/gpu_profiler.hpp"
+#include "../support/gl_state.hpp"
+#include "../support/stream_buffer.hpp"
 
 #include "../vmlib/vec4.hpp"
 #include "../vmlib/mat44.hpp"
@@ -28,7 +43,27 @@ namespace fs = std::filesystem;
 #include "cylinder.hpp"
 #include "loadobj.hpp"
 #include "screenshot.hpp"
+#include "video_capture.hpp"
+#include "poster_capture.hpp"
+#include "simulation.hpp"
+#include "frame_snapshot.hpp"
+#include "render_thread.hpp"
 #include "skybox.hpp"
+#include "scene_graph.hpp"
+#include "ecs.hpp"
+#include "components.hpp"
+#include "systems.hpp"
+#include "rocket_field.hpp"
+#include "static_geometry.hpp"
+#include "multi_draw.hpp"
+#include "scene_description.hpp"
+#include "path_tracer.hpp"
+#include "soft_raster.hpp"
+#include "benchmark.hpp"
+#include "profiler_view.hpp"
+#include "render_stats.hpp"
+#include "instanced_mesh.hpp"
+#include "mesh_arena.hpp"
 using namespace std;
 
 namespace
@@ -75,6 +110,17 @@ namespace
 
 		} objControl;
 
+		struct PickCtrl_ //object picking with the mouse
+		{
+			bool requested = false;
+			float x, y;
+		} pickControl;
+
+		bool screenshotRequested = false; //F12, captured at the end of the frame
+		bool recordingToggled = false; //F10, starts or stops a video recording
+		bool posterRequested = false; //F11, high resolution capture at the end of the frame
+		bool shadersReloadRequested = false; //R, handled by the renderer
+
 	};
 	//end
 
@@ -82,8 +128,11 @@ namespace
 
 	void glfw_callback_key_( GLFWwindow*, int, int, int, int );
 	void glfw_callback_motion_(GLFWwindow*, double, double);
+	void glfw_callback_button_(GLFWwindow*, int, int, int);
 	State_ updateCamera(State_, float);
-	void lighting(float [3], float [4], float [4], float [4], float [3], GLuint, Vec3f [5]);
+	void lighting(float const [3], float const [4], float const [4], float const [4], float const [3], GLuint, std::vector<ScenePointLight> const&);
+	void path_trace_(JobSystem&, std::size_t, char const*);
+	void soft_raster_(JobSystem&, std::size_t, char const*);
 
 	struct GLFWCleanupHelper
 	{
@@ -96,7 +145,93 @@ namespace
 	};
 }
 
-int main() try{
+int main(int argc, char* argv[]) try{
+	// Command line
+	bool singleThreaded = false; //deterministic job execution, for debugging
+	bool pathTrace = false; //offline reference render instead of the viewer
+	bool softRaster = false; //CPU rasterizer instead of the viewer (no GPU needed)
+	bool benchmark = false; //hidden window, no vsync, scripted camera; writes frame times
+	std::size_t pathTraceSpp = 64;
+	std::size_t frames = 0; //0 = default for the mode
+	char const* outputPath = nullptr;
+	char const* tracePath = nullptr; //Chrome trace written at exit
+	char const* statsPath = nullptr; //per-frame render stats CSV
+	bool verifyGlState = false; //check the GL state cache against glGet*() (always on in debug builds)
+	char const* recordPath = nullptr; //record video from the first frame (.y4m file or PNG directory)
+	unsigned recordFps = 60; //simulation rate while recording
+	ImageFormat screenshotFormat = ImageFormat::png; //also used for recordings to a directory and posters
+	std::size_t posterWidth = 7680, posterHeight = 4320; //F11
+	std::size_t posterTile = 1024;
+	float simRate = 240.f; //fixed simulation steps per second
+	bool vsync = true;
+	bool renderOnThread = true; //GL calls on a dedicated thread (not with --benchmark)
+	for (int i = 1; i < argc; ++i)
+	{
+		if (0 == std::strcmp(argv[i], "--single-threaded"))
+			singleThreaded = true;
+		else if (0 == std::strcmp(argv[i], "--pathtrace"))
+			pathTrace = true;
+		else if (0 == std::strcmp(argv[i], "--softraster"))
+			softRaster = true;
+		else if (0 == std::strcmp(argv[i], "--benchmark"))
+			benchmark = true;
+		else if (0 == std::strcmp(argv[i], "--frames") && i+1 < argc)
+			frames = std::max(1l, std::strtol(argv[++i], nullptr, 10));
+		else if (0 == std::strcmp(argv[i], "--spp") && i+1 < argc)
+			pathTraceSpp = std::max(1l, std::strtol(argv[++i], nullptr, 10));
+		else if (0 == std::strcmp(argv[i], "--output") && i+1 < argc)
+			outputPath = argv[++i];
+		else if (0 == std::strcmp(argv[i], "--trace") && i+1 < argc)
+			tracePath = argv[++i];
+		else if (0 == std::strcmp(argv[i], "--stats-csv") && i+1 < argc)
+			statsPath = argv[++i];
+		else if (0 == std::strcmp(argv[i], "--verify-gl-state"))
+			verifyGlState = true;
+		else if (0 == std::strcmp(argv[i], "--record") && i+1 < argc)
+			recordPath = argv[++i];
+		else if (0 == std::strcmp(argv[i], "--record-fps") && i+1 < argc)
+			recordFps = unsigned(std::max(1l, std::strtol(argv[++i], nullptr, 10)));
+		else if (0 == std::strcmp(argv[i], "--poster-size") && i+1 < argc)
+		{
+			if (2 != std::sscanf(argv[++i], "%zux%zu", &posterWidth, &posterHeight) || 0 == posterWidth || 0 == posterHeight)
+				throw Error("Invalid poster size '%s' (expected WIDTHxHEIGHT)", argv[i]);
+		}
+		else if (0 == std::strcmp(argv[i], "--sim-rate") && i+1 < argc)
+			simRate = float(std::max(1l, std::strtol(argv[++i], nullptr, 10)));
+		else if (0 == std::strcmp(argv[i], "--no-vsync"))
+			vsync = false;
+		else if (0 == std::strcmp(argv[i], "--no-render-thread"))
+			renderOnThread = false;
+		else if (0 == std::strcmp(argv[i], "--poster-tile") && i+1 < argc)
+			posterTile = std::max(1l, std::strtol(argv[++i], nullptr, 10));
+		else if (0 == std::strcmp(argv[i], "--screenshot-format") && i+1 < argc)
+		{
+			if (!parse_image_format(argv[++i], screenshotFormat))
+				throw Error("Unknown image format '%s' (png, png-mt, qoi, ppm)", argv[i]);
+		}
+		else
+			throw Error("Unknown command line argument '%s'", argv[i]);
+	}
+
+	PROFILE_THREAD("main");
+
+	JobSystem jobs(JobSystem::kDefaultWorkers, singleThreaded);
+
+	if (pathTrace)
+	{
+		path_trace_(jobs, pathTraceSpp, outputPath ? outputPath : "pathtrace.png");
+		if (tracePath)
+			profiler::write_chrome_trace(tracePath);
+		return 0;
+	}
+	if (softRaster)
+	{
+		soft_raster_(jobs, frames ? frames : 1, outputPath ? outputPath : "softraster.png");
+		if (tracePath)
+			profiler::write_chrome_trace(tracePath);
+		return 0;
+	}
+
 	// Initialize GLFW
 	if( GLFW_TRUE != glfwInit() )
 	{
@@ -123,6 +258,10 @@ int main() try{
 
 	glfwWindowHint( GLFW_DEPTH_BITS, 24 );
 
+	//benchmark runs don't need to be seen (or interfered with)
+	if (benchmark)
+		glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );
+
 #	if !defined(NDEBUG)
 	// When building in debug mode, request an OpenGL debug context. This
 	// enables additional debugging features. However, this can carry extra
@@ -151,16 +290,21 @@ int main() try{
 
 	glfwSetKeyCallback(window, &glfw_callback_key_);
 	glfwSetCursorPosCallback(window, &glfw_callback_motion_);
+	glfwSetMouseButtonCallback(window, &glfw_callback_button_);
 
 	// Set up drawing stuff
 	glfwMakeContextCurrent( window );
-	glfwSwapInterval( 1 ); // V-Sync is on.
+	glfwSwapInterval( (benchmark || !vsync) ? 0 : 1 ); // V-Sync is on, except when benchmarking or disabled.
 
 	// Initialize GLAD
 	// This will load the OpenGL API. We mustn't make any OpenGL calls before this!
 	if( !gladLoadGLLoader( (GLADloadproc)&glfwGetProcAddress ) )
 		throw Error( "gladLoaDGLLoader() failed - cannot load GL API!" );
 
+	install_render_stats_hooks();
+	if (verifyGlState)
+		glstate::set_verify(true);
+
 	std::printf( "RENDERER %s\n", glGetString( GL_RENDERER ) );
 	std::printf( "VENDOR %s\n", glGetString( GL_VENDOR ) );
 	std::printf( "VERSION %s\n", glGetString( GL_VERSION ) );
@@ -175,10 +319,11 @@ int main() try{
 	OGL_CHECKPOINT_ALWAYS();
 
 	// TODO: global GL setup goes here
-	glEnable(GL_FRAMEBUFFER_SRGB);
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
+	glstate::enable(GL_FRAMEBUFFER_SRGB);
+	glstate::enable(GL_CULL_FACE);
+	glstate::enable(GL_DEPTH_TEST);
 	glClearColor(0.5f, 0.5f, 0.5f, 0.5f); //background color
+	glstate::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	OGL_CHECKPOINT_ALWAYS();
 
 	// Get actual framebuffer size.
@@ -188,7 +333,7 @@ int main() try{
 	int iwidth, iheight;
 	glfwGetFramebufferSize( window, &iwidth, &iheight );
 
-	glViewport( 0, 0, iwidth, iheight );
+	glstate::viewport( 0, 0, iwidth, iheight );
 
 	// Other initialization & loading
 	// Load shader program
@@ -204,61 +349,66 @@ int main() try{
 	state.prog = &prog;
 	state.skybox = &skybox; //link skybox to the state
 
+	//non-instanced draws read the default (identity) instance attributes
+	set_default_instance_attributes();
+
 	// Animation state
 	auto last = Clock::now();
 
-	float angle = 0.f;
-	float rktHeight = 0.f; //rocket height, used for animation
+	FixedTimestep simClock(simRate);
+	LaunchState launchState, launchStatePrev; //fan and rocket, at the last two simulation steps
 	OGL_CHECKPOINT_ALWAYS();
 
-    //5 Cylinders required for complex object
+	//load the OBJ files in the background while the procedural geometry is built
+	SceneDescription scene = make_scene_description();
+	JobCounter objLoads;
+	load_scene_meshes(scene, jobs, objLoads);
+
+	SimpleMeshData& rocket = scene.meshes[kSceneRocket].mesh;
+	SimpleMeshData& launch = scene.meshes[kSceneLaunch].mesh;
+	SimpleMeshData& fan_base = scene.meshes[kSceneFanBase].mesh;
+	SimpleMeshData& fan_motor = scene.meshes[kSceneFanMotor].mesh;
+	SimpleMeshData& fan_blade = scene.meshes[kSceneFanBlade].mesh;
+
+    //Complex object: a base cylinder, four arms and two screens
 	auto baseCyl = make_cylinder(true, 16, { 0.05f, 0.05f, 0.05f }, {0.1f, 0.1f, 0.1f }, {0.2f,0.2f,0.2f }, 12.8f, 1.f,
 		make_rotation_z(3.141592f / 2.f) *
 		make_scaling(0.1f, 0.02f, 0.02f) *
 		make_translation({ 0.f, 0.f, 0.f })
 	);
 
-
-	auto cylR = make_cylinder(true, 16, { 0.2f, 0.2f, 0.2f }, { 0.2f, 0.2f, 0.2f }, { 0.4f,0.4f,0.4f }, 12.8f, 1.f,
+	//the arms and the screens are instances of unit meshes
+	auto armCyl = make_cylinder(true, 16, { 0.2f, 0.2f, 0.2f }, { 0.2f, 0.2f, 0.2f }, { 0.4f,0.4f,0.4f }, 12.8f, 1.f);
+	Mat44f const armTransforms[] = {
 		make_rotation_z(45.f / (180.f / 3.141592f)) *
 		make_scaling(0.115f, 0.02f, 0.02f) *
-		make_translation({ 0.3f, 1.7f, 0.f })
+		make_translation({ 0.3f, 1.7f, 0.f }),
 
-	);
-
-
-	auto cylL = make_cylinder(true, 16, { 0.2f, 0.2f, 0.2f }, { 0.2f, 0.2f, 0.2f }, { 0.4f,0.4f,0.4f }, 12.8f, 1.f,
 		make_rotation_z(135.f/(180.f/3.141592f))*
 		make_scaling(0.115f, 0.02f, 0.02f)*
-		make_translation({ 0.3f, -1.7f, 0.f })
-	);
+		make_translation({ 0.3f, -1.7f, 0.f }),
 
-
-
-	auto cylR2 = make_cylinder(true, 16, { 0.2f, 0.2f, 0.2f }, { 0.2f, 0.2f, 0.2f }, { 0.4f,0.4f,0.4f }, 12.8f, 1.f,
 		make_rotation_y(270.f / (180.f / 3.141592f)) *
 		make_scaling(0.06f, 0.02f, 0.02f) *
-		make_translation({ 0.f, 5.7f, 3.3f })
-	);
-
+		make_translation({ 0.f, 5.7f, 3.3f }),
 
-
-	auto cylL2 = make_cylinder(true, 16, { 0.2f, 0.2f, 0.2f }, { 0.2f, 0.2f, 0.2f }, { 0.4f,0.4f,0.4f }, 12.8f, 1.f,
 		make_rotation_y(270.f / (180.f / 3.141592f))*
 		make_scaling(0.06f, 0.02f, 0.02f)*
 		make_translation({ 0.f, 5.7f, -3.3f })
-	);
+	};
 
     //Cubes for screens
-	auto cube = make_cube(1, { 0.f, 0.f, 0.f }, { 0.01f, 0.01f, 0.01f }, { 0.5f,0.5f,0.5f }, 50.f, 1.f,
+	auto cube = make_cube(1, { 0.f, 0.f, 0.f }, { 0.01f, 0.01f, 0.01f }, { 0.5f,0.5f,0.5f }, 50.f, 1.f);
+	Mat44f const screenTransforms[] = {
 		make_scaling(0.1f, 0.07f, 0.02f)*
-		make_translation({ -1.2f, 1.7f, 4.f })
-	);
+		make_translation({ -1.2f, 1.7f, 4.f }),
 
-	auto cube2 = make_cube(1, { 0.f, 0.f, 0.f }, { 0.01f, 0.01f, 0.01f }, { 0.5f,0.5f,0.5f }, 50.f, 1.f,
 		make_scaling(0.1f, 0.07f, 0.02f)*
 		make_translation({ 1.2f, 1.7f, 4.f })
-	);
+	};
+
+	InstancedMesh armInstances(armCyl);
+	InstancedMesh screenInstances(cube);
 
     //flat cubes for textures on screens
 	auto cubeFace = make_cube_tex(1, { 0.f, 1.f, 0.f }, { 1.0f, 0.5f, 0.31f }, { 0.5f,0.5f,0.5f }, 32.f, 1.f,
@@ -271,19 +421,14 @@ int main() try{
 		make_translation({ 1.2f, 1.7f, 5.01f })
 	);
 
-	//concatenate different parts of the complex object
-	auto RightArm = concatenate(baseCyl, cylR);
-	auto MonitorArms = concatenate(RightArm, cylL);
-	auto MonitorArms1 = concatenate(MonitorArms, cylR2);
-	auto MonitorArms2 = concatenate(MonitorArms1, cylL2);
-	auto MonitorScreen1 = concatenate(MonitorArms2, cube);
-	auto Monitors = concatenate(MonitorScreen1, cube2);
-	GLuint MonitorsVao = create_vao(Monitors);
-	GLuint ScreenVao = create_vao(cubeFace);
-	std::size_t MonitorsVert = Monitors.positions.size();
-	std::size_t ScreenVert = cubeFace.positions.size();
-	GLuint MultiTexVao = create_vao(multiTex);
-	std::size_t MultiVert = multiTex.positions.size();
+	//emissive meshes are drawn one by one, from a few shared buffers
+	MeshArena meshArena;
+
+	//non-emissive meshes share one set of buffers and are drawn with multi-draw indirect
+	StaticGeometry staticGeometry;
+	auto const MonitorsMesh = staticGeometry.add(baseCyl);
+	auto const ScreenMesh = staticGeometry.add(cubeFace);
+	auto const MultiTexMesh = staticGeometry.add(multiTex);
 
     //Multitexturing dirty glass
 	GLuint mTex0 = load_texture_2d("external/materials/glass/dirty_glass_43_92_opacity.jpg");
@@ -297,22 +442,15 @@ int main() try{
 	state.objControl.x1 = 0.f;
 	state.objControl.y1 = 0.f;
 	state.objControl.z1 = 0.f;
-	state.camControl.x = -3.5f;
-	state.camControl.y = -1.07f;
-	state.camControl.radius = 22.29f;
+	state.camControl.theta = scene.camera.theta;
+	state.camControl.phi = scene.camera.phi;
+	state.camControl.x = scene.camera.x;
+	state.camControl.y = scene.camera.y;
+	state.camControl.radius = scene.camera.radius;
 	state.camControl.mod = 1.f;
 	state.animControl.mod = 1.f;
 	state.animControl.animation = false;
 
-	//define pointlight positons
-	Vec3f pointLightPositions[] = {
-			Vec3f{ 2.7f, 10.f, 1.51f },
-			Vec3f{2.7f, 10.f, 2.5f},
-			Vec3f{19.7f, 17.7f, 23.8f},
-			Vec3f{1.7f, 1.63f, 22.21f},
-			Vec3f{6.1f, 1.63f, 22.21f}
-	};
-
 
     //Floodlight 1 - Red emissive light
 	auto redCone = make_cone(true, 16, { 1.f, 0.f, 0.f }, { 1.0f, 0.f, 0.f }, { 0.5f,0.f,0.f }, 32.f, 1.f,
@@ -321,8 +459,7 @@ int main() try{
 		make_rotation_z(3.141592f * 0.8f)
 	);
 
-	GLuint floodLight1Vao = create_vao(redCone);
-	std::size_t coneVertex = redCone.positions.size();
+	auto const floodLight1Mesh = meshArena.add(redCone);
 
     //Floodlight 2 - Blue emissive light
 	auto blueCone = make_cone(true, 16, { 0.f, 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f,0.f,0.5f }, 32.f, 1.f,
@@ -331,27 +468,17 @@ int main() try{
 		make_rotation_z(3.141592f * 0.8f)
 	);
 
-	GLuint floodLight2Vao = create_vao(blueCone);
-	std::size_t coneVertex2 = blueCone.positions.size();
-
-
-	//load rocket object
-	auto rocket = load_wavefront_obj("external/Rocket/rocket.obj",
-		make_scaling(0.005f, 0.005f, 0.005f) *
-		make_rotation_x(3.141592f / -2.f) *
-		make_translation({ 750.f, -400.f, 600.f })
-	);
+	auto const floodLight2Mesh = meshArena.add(blueCone);
 
 
-	GLuint rocketVAO = create_vao(rocket);
+	//rocket object
+	jobs.wait(objLoads);
+	auto const rocketMesh = staticGeometry.add(rocket, true, 4);
 	//load rocket texture
-	GLuint textureObjectId = load_texture_2d("external/Rocket/rocket.jpg");
-	std::size_t rocketVertex = rocket.positions.size();
+	GLuint textureObjectId = load_texture_2d(scene.meshes[kSceneRocket].texture);
 
-	//load scene object
-	auto launch = load_wavefront_obj("external/Scene/scene.obj", make_scaling(0.49f, 0.49f, 0.49f) * make_translation({4.09f, 0.f, 4.08f}));
-	GLuint launchVAO = create_vao(launch);
-	std::size_t launchVertex = launch.positions.size();
+	//scene object
+	auto const launchMesh = staticGeometry.add(launch, true, 4);
 
     //Glass Window - Transparent object
 	auto cube3 = make_cube(1, { 0.5f, 0.87f, 1.f }, { 0.5f, 0.87f, 1.f }, { 0.5f,0.5f,0.5f }, 32.f, 0.1f,
@@ -359,8 +486,7 @@ int main() try{
 		make_translation({ -0.19f, 0.58f, -2.56f })
 	);
 
-	GLuint windowGlass = create_vao(cube3);
-	std::size_t windowVertex = cube3.positions.size();
+	auto const windowGlassMesh = staticGeometry.add(cube3);
     
     //light source 1 in viewing box
 	auto cube4 = make_cube(1, { 1.f, 1.f, 1.f }, { 1.f, 1.f, 1.f }, { 1.f,1.f,1.f }, 2.f, 1.f,
@@ -368,8 +494,7 @@ int main() try{
 		make_translation({ 18.8f, 8.42f, 9.2f })
 	);
 
-	GLuint lightBox1 = create_vao(cube4);
-	std::size_t lightBoxVertex1 = cube4.positions.size();
+	auto const lightBox1Mesh = meshArena.add(cube4);
 
     //light source 2 in viewing box
 	auto cube5 = make_cube(1, { 1.f, 1.f, 1.f }, { 1.f, 1.f, 1.f }, { 1.f,1.f,1.f }, 2.f, 1.f,
@@ -377,50 +502,165 @@ int main() try{
 		make_translation({ -28.17f, 8.42f, 9.2f })
 	);
 
-	GLuint lightBox2 = create_vao(cube5);
-	std::size_t lightBoxVertex2 = cube5.positions.size();
+	auto const lightBox2Mesh = meshArena.add(cube5);
 
     //Creating Hierarchical Object
-	auto fan_base = load_wavefront_obj("external/Fan/fan_base.obj", make_scaling(0.1f, 0.1f, 0.1f));
-
-	GLuint fanBaseVAO = create_vao(fan_base);
-	std::size_t fanBaseVertex = fan_base.positions.size();
-
-	auto fan_motor = load_wavefront_obj("external/Fan/fan_motor.obj", make_scaling(0.1f, 0.1f, 0.1f));
-	GLuint fanMotorVAO = create_vao(fan_motor);
-	std::size_t fanMotorVertex = fan_motor.positions.size();
-
+	auto const fanBaseMesh = staticGeometry.add(fan_base, true, 4);
+	auto const fanMotorMesh = staticGeometry.add(fan_motor, true, 4);
+	auto const fanBladeMesh = staticGeometry.add(fan_blade, true, 4);
+	InstancedMesh rocketInstances(rocket);
 
-	auto fan_blade = load_wavefront_obj("external/Fan/fan_blade.obj", make_scaling(0.1f, 0.1f, 0.1f) * make_translation({ 0.f,-1.f,0.f }));
+	staticGeometry.upload();
 
-	GLuint fanBladeVAO = create_vao(fan_blade);
-	std::size_t fanBladeVertex = fan_blade.positions.size();
+	//per-frame data (draw records, indirect commands, instances)
+	StreamBuffer streamBuffer;
+	MultiDrawBatch drawBatch(staticGeometry, streamBuffer);
 
 
 	// skybox VAO
 	unsigned int skyboxVAO, skyboxVBO;
 	glGenVertexArrays(1, &skyboxVAO);
 	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
+	glstate::bind_vertex_array(skyboxVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
-	std::vector<std::string> faces =
-	{
-		"external/skybox/right.png",
-		"external/skybox/left.png",
-		"external/skybox/top.png",
-		"external/skybox/bottom.png",
-		"external/skybox/front.png",
-		"external/skybox/back.png"
-	};
-
-	GLuint cubemapTexture = load_cubemap(faces);
+	GLuint cubemapTexture = load_cubemap(scene.skyboxFaces);
 
 	OGL_CHECKPOINT_ALWAYS();
 
+	//scene graph; only the fan and the rocket are updated per frame
+	SceneGraph sceneGraph;
+	auto const launchNode = sceneGraph.add_node(SceneGraph::kNoParent, scene.meshes[kSceneLaunch].translation);
+	auto const fanBaseNode = sceneGraph.add_node(SceneGraph::kNoParent, scene.meshes[kSceneFanBase].translation);
+	auto const fanMotorNode = sceneGraph.add_node(fanBaseNode, scene.meshes[kSceneFanMotor].translation);
+	auto const fanBladeNode = sceneGraph.add_node(fanMotorNode, scene.meshes[kSceneFanBlade].translation);
+	auto const rocketNode = sceneGraph.add_node(SceneGraph::kNoParent, scene.meshes[kSceneRocket].translation);
+	//screens, interior lights and the window glass were modelled relative to the monitors
+	auto const monitorsNode = sceneGraph.add_node(SceneGraph::kNoParent, { 4.4f, 0.86f, 21.45f });
+	sceneGraph.update();
+
+	//renderable entities
+	Registry registry;
+	auto const add_renderable = [&registry, &meshArena](SceneGraph::NodeId aNode, MeshArena::MeshId aMeshId, SimpleMeshData const& aMesh, Material aMaterial) {
+		auto const e = registry.create();
+		registry.emplace<Transform>(e);
+		registry.emplace<SceneLink>(e, SceneLink{ aNode });
+		registry.emplace<MeshRef>(e, MeshRef{ aMeshId, meshArena.draw_range(aMeshId) });
+		registry.emplace<Material>(e, aMaterial);
+		registry.emplace<Bounds>(e, compute_bounds(aMesh));
+		registry.emplace<Visibility>(e);
+		return e;
+	};
+	auto const add_static_renderable = [&registry](SceneGraph::NodeId aNode, StaticGeometry::MeshId aMeshId, SimpleMeshData const& aMesh, Material aMaterial) {
+		auto const e = registry.create();
+		registry.emplace<Transform>(e);
+		registry.emplace<SceneLink>(e, SceneLink{ aNode });
+		registry.emplace<StaticMeshRef>(e, StaticMeshRef{ aMeshId });
+		registry.emplace<Material>(e, aMaterial);
+		registry.emplace<Bounds>(e, compute_bounds(aMesh));
+		registry.emplace<Visibility>(e);
+		return e;
+	};
+	auto const add_instance = [&registry](SceneGraph::NodeId aNode, Mat44f const& aOffset, InstancedMesh& aInstances, SimpleMeshData const& aUnitMesh, Material aMaterial) {
+		auto const e = registry.create();
+		registry.emplace<Transform>(e);
+		registry.emplace<SceneLink>(e, SceneLink{ aNode, aOffset });
+		registry.emplace<Instance>(e, Instance{ &aInstances });
+		registry.emplace<Material>(e, aMaterial);
+		registry.emplace<Bounds>(e, compute_bounds(aUnitMesh));
+		registry.emplace<Visibility>(e);
+		return e;
+	};
+
+	Material plain;
+	Material noCull;
+	noCull.cullFace = false;
+
+	Material rocketMat;
+	rocketMat.textured = true;
+	rocketMat.textures[0] = textureObjectId;
+
+	Material screenMat;
+	screenMat.textured = true;
+	screenMat.textures[0] = markusFace;
+
+	Material multiTexMat = screenMat;
+	multiTexMat.multiTextured = true;
+	multiTexMat.textures[1] = mTex0;
+
+	//the floodlights and interior lights are emissive
+	Material redLightMat;
+	redLightMat.emissive = true;
+	redLightMat.emissiveColor = { 1.f, 0.f, 0.f };
+	redLightMat.colorSelect = Material::ColorSelect::launchpad1;
+
+	Material blueLightMat = redLightMat;
+	blueLightMat.emissiveColor = { 0.f, 0.f, 1.f };
+	blueLightMat.colorSelect = Material::ColorSelect::launchpad2;
+
+	Material interiorLightMat = redLightMat;
+	interiorLightMat.emissiveColor = { 1.f, 1.f, 1.f };
+	interiorLightMat.colorSelect = Material::ColorSelect::interior;
+
+	Material glassMat;
+	glassMat.blend = true;
+
+	auto const launchEntity = add_static_renderable(launchNode, launchMesh, launch, noCull);
+	add_renderable(launchNode, floodLight1Mesh, redCone, redLightMat);
+	add_renderable(launchNode, floodLight2Mesh, blueCone, blueLightMat);
+	auto const fanBaseEntity = add_static_renderable(fanBaseNode, fanBaseMesh, fan_base, plain);
+	auto const fanMotorEntity = add_static_renderable(fanMotorNode, fanMotorMesh, fan_motor, noCull);
+	auto const fanBladeEntity = add_static_renderable(fanBladeNode, fanBladeMesh, fan_blade, plain);
+	auto const rocketEntity = add_static_renderable(rocketNode, rocketMesh, rocket, rocketMat);
+	add_static_renderable(monitorsNode, MonitorsMesh, baseCyl, plain);
+	for (auto const& xform : armTransforms)
+		add_instance(monitorsNode, xform, armInstances, armCyl, plain);
+	for (auto const& xform : screenTransforms)
+		add_instance(monitorsNode, xform, screenInstances, cube, plain);
+	add_static_renderable(monitorsNode, ScreenMesh, cubeFace, screenMat);
+	add_static_renderable(monitorsNode, MultiTexMesh, multiTex, multiTexMat);
+	add_renderable(monitorsNode, lightBox1Mesh, cube4, interiorLightMat);
+	add_renderable(monitorsNode, lightBox2Mesh, cube5, interiorLightMat);
+	add_static_renderable(monitorsNode, windowGlassMesh, cube3, glassMat);
+
+	//the walls and floors of the launch scene hide much of the rest
+	OccluderMesh const launchOccluder = make_occluder(launch.positions, 0.25f);
+	registry.emplace<Occluder>(launchEntity, Occluder{ &launchOccluder });
+
+	//ray queries (picking) against the loaded meshes
+	Bvh const launchBvh(launch.positions, jobs);
+	Bvh const rocketBvh(rocket.positions, jobs);
+	Bvh const fanBaseBvh(fan_base.positions, jobs);
+	Bvh const fanMotorBvh(fan_motor.positions, jobs);
+	Bvh const fanBladeBvh(fan_blade.positions, jobs);
+	registry.emplace<Collider>(launchEntity, Collider{ &launchBvh });
+	registry.emplace<Collider>(rocketEntity, Collider{ &rocketBvh });
+	registry.emplace<Collider>(fanBaseEntity, Collider{ &fanBaseBvh });
+	registry.emplace<Collider>(fanMotorEntity, Collider{ &fanMotorBvh });
+	registry.emplace<Collider>(fanBladeEntity, Collider{ &fanBladeBvh });
+
+	bool picked = false;
+	PickHit pickHit;
+
+	RocketField rocketField(rocketInstances, rocketMat, compute_bounds(rocket));
+	int rocketFieldSize = 0;
+
+	//view-frustum culling
+	bool frustumCulling = true;
+	CullScratch cullScratch;
+	CullStats cullStats;
+
+	//software occlusion culling
+	bool occlusionCulling = true;
+	OcclusionBuffer occlusionBuffer;
+
+	//level of detail
+	float lodPixelError = 1.f;
+	std::size_t lodReduced = 0;
+
 	//imgui
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -430,23 +670,280 @@ int main() try{
 	ImGui_ImplOpenGL3_Init("#version 430");
 	//intialise imgui variables
 	float colorBool[3] = {0.f,0.f,0.f};
-	float lightBrightness[3] = {0.5f, 0.3f, 0.3f};
+	float lightBrightness[3] = {1.f, 1.f, 1.f};
+	for (auto const& light : scene.lights)
+	{
+		if (light.control >= 0)
+			lightBrightness[light.control] = light.brightness;
+	}
 	float color[4] = { 0.8f, 0.3f, 0.02f, 1.0f };
 	float color1[4] = { 0.8f, 0.3f, 0.02f, 1.0f };
 	float color2[4] = { 0.8f, 0.3f, 0.02f, 1.0f };
 
 	//intialise variables for use in the loop
-	float rktLast = 1.f;
 	int tog = 0;
 	bool temp = false;
 	bool temp1 = false;
 	bool temp2 = false;
 
+	std::unique_ptr<BenchmarkRecorder> recorder;
+	if (benchmark)
+		recorder = std::make_unique<BenchmarkRecorder>(frames ? frames : 600);
+
+	ProfilerView profilerView;
+	GpuProfiler gpuProfiler;
+	RenderStatsLog renderStats;
+	ScreenshotQueue screenshots(jobs);
+
+	std::unique_ptr<VideoRecorder> videoRecorder;
+	if (recordPath)
+		videoRecorder = std::make_unique<VideoRecorder>(jobs, recordPath, recordFps, screenshotFormat);
+	bool recording = bool(videoRecorder); //the main thread's view; the render thread owns the recorder
+	if (statsPath)
+		renderStats.start_csv(statsPath);
+
+	//results of the renderer for the UI
+	std::mutex feedbackMutex;
+	RenderFeedback feedback; //guarded by feedbackMutex
+	RenderFeedback rendered; //main thread copy
+	bool recordingStopped = false; //guarded by feedbackMutex
+
+	//everything but the UI; also draws the tiles of poster captures
+	auto drawScene = [&](FrameSnapshot const& aFrame, RenderList const& aList, Mat44f const& aProjection) {
+		GLuint const progid = prog.programId();
+		glstate::use_program(progid);
+		glUniformMatrix4fv(0, 1, GL_TRUE, aProjection.v);
+
+		//opaque objects
+		{
+			GpuZone gpuZone(gpuProfiler, "opaque");
+			draw_renderables(aList, progid, drawBatch, streamBuffer, false);
+		}
+		OGL_CHECKPOINT_DEBUG();
+
+		//Drawing skybox
+		{
+			PROFILE_ZONE("draw skybox");
+			GpuZone gpuZone(gpuProfiler, "skybox");
+			glstate::depth_func(GL_LEQUAL);                     // change depth function so depth test passes when values are equal to depth buffer's content
+			glstate::use_program(skybox.programId());           //switching to skybox.vert and skybox.frag
+			Mat44f const model2world = make_scaling( 100.f, 100.f, 100.f );
+			glUniformMatrix4fv(1, 1, GL_TRUE, aFrame.world2camera.v);
+			glUniformMatrix4fv(0, 1, GL_TRUE, aProjection.v);
+			glUniformMatrix4fv(2, 1, GL_TRUE, model2world.v);
+			glstate::bind_vertex_array(skyboxVAO);
+			glstate::bind_texture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+			glDrawArrays(GL_TRIANGLES, 0, 36);
+			glstate::depth_func(GL_LESS);                       // set depth function back to default
+		}
+
+
+		OGL_CHECKPOINT_DEBUG();
+
+		//transparent objects (window)
+		glstate::use_program(progid);             //switching back to default shaders
+		{
+			GpuZone gpuZone(gpuProfiler, "transparent");
+			draw_renderables(aList, progid, drawBatch, streamBuffer, true);
+		}
+	};
+
+	//fences the stream buffer region; persistent writes bypass the GL, so count them here
+	auto endStreamFrame = [&]() {
+		if (streamBuffer.persistent())
+			count_render(kRenderBytesUploaded, streamBuffer.frame_bytes());
+		streamBuffer.end_frame();
+	};
+
+	//all GL calls of a frame; on the render thread, unless it is disabled
+	auto renderFrame = [&](FrameSnapshot const& aFrame) {
+		PROFILE_ZONE("render frame");
+
+		if (aFrame.reloadShaders)
+		{
+			try
+			{
+				prog.reload();
+				std::fprintf(stderr, "Shaders reloaded and recompiled.\n");
+			}
+			catch (std::exception const& eErr)
+			{
+				std::fprintf(stderr, "Error when reloading shader:\n");
+				std::fprintf(stderr, "%s\n", eErr.what());
+				std::fprintf(stderr, "Keeping old shader.\n");
+			}
+		}
+
+		if (aFrame.toggleRecording)
+		{
+			if (videoRecorder)
+				videoRecorder.reset();
+			else
+				videoRecorder = std::make_unique<VideoRecorder>(jobs, make_recording_path().c_str(), recordFps, aFrame.imageFormat);
+		}
+
+		count_render(kRenderObjectsTested, aFrame.cullStats.tested);
+		count_render(kRenderObjectsVisible, aFrame.cullStats.visible - aFrame.cullStats.occluded);
+		count_render(kRenderObjectsOccluded, aFrame.cullStats.occluded);
+
+		// Draw scene
+		streamBuffer.begin_frame();
+		glstate::viewport(0, 0, aFrame.width, aFrame.height);
+		gpuProfiler.begin_frame();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		if (aFrame.meshletCulling)
+			drawBatch.set_view(aFrame.frustum, aFrame.cameraPosition);
+		else
+			drawBatch.clear_view();
+
+		// Clear color buffer to specified clear color (glClearColor())
+		// We want to draw with our program..
+
+		glstate::use_program(prog.programId());
+		GLuint progid = prog.programId();
+
+		glUniformMatrix4fv(4, 1, GL_TRUE, aFrame.cameraTranslation.v);
+		glUniformMatrix4fv(6, 1, GL_TRUE, aFrame.world2camera.v);
+
+        //Blinn-Phong lighting
+		lighting(aFrame.colorBool, aFrame.color, aFrame.color1, aFrame.color2, aFrame.lightBrightness, progid, scene.lights);
+
+
+		OGL_CHECKPOINT_DEBUG();
+		//TODO: draw frame
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+		drawScene(aFrame, aFrame.renderables, aFrame.projection);
+		endStreamFrame();
+		MultiDrawBatch::MeshletStats const meshlets = drawBatch.meshlet_stats();
+
+		glUniform3f(glGetUniformLocation(prog.programId(), "colorBool"), aFrame.colorBool[0], aFrame.colorBool[1], aFrame.colorBool[2]);
+		glUniform4f(glGetUniformLocation(prog.programId(), "color"), aFrame.color[0], aFrame.color[1], aFrame.color[2], aFrame.color[3]);
+		glUniform4f(glGetUniformLocation(prog.programId(), "color1"), aFrame.color1[0], aFrame.color1[1], aFrame.color1[2], aFrame.color1[3]);
+		glUniform4f(glGetUniformLocation(prog.programId(), "color2"), aFrame.color2[0], aFrame.color2[1], aFrame.color2[2], aFrame.color2[3]);
+
+		// Renders the ImGUI elements
+		if (ImDrawData* uiData = aFrame.ui.draw_data())
+		{
+			PROFILE_ZONE("render UI");
+			GpuZone gpuZone(gpuProfiler, "ImGui");
+			ImGui_ImplOpenGL3_RenderDrawData(uiData);
+		}
+
+		glstate::use_program(0);
+		glstate::bind_vertex_array(0);
+
+		//readback is asynchronous; the PNG is written by a job
+		screenshots.set_format(aFrame.imageFormat);
+		if (aFrame.screenshot)
+			screenshots.capture(aFrame.width, aFrame.height);
+		screenshots.update();
+
+		//never drops frames; waits for the encoders when they fall behind
+		bool stopped = false;
+		if (videoRecorder)
+		{
+			if (!videoRecorder->capture(aFrame.width, aFrame.height))
+			{
+				std::fprintf(stderr, "Framebuffer size changed; recording stopped\n");
+				videoRecorder.reset();
+				stopped = true;
+			}
+			else
+				videoRecorder->update();
+		}
+
+		gpuProfiler.end_frame();
+
+		//poster: the scene (without UI) at a higher resolution, rendered in tiles
+		if (aFrame.poster)
+		{
+			std::error_code ec;
+			fs::create_directories("screenshots", ec);
+
+			try
+			{
+				ImageWriteStats const stats = capture_poster(jobs, aFrame.posterPath.c_str(), aFrame.imageFormat, posterWidth, posterHeight, aFrame.posterProjection, [&](Mat44f const& aProjection) {
+					//the poster list is not culled; meshlets are culled per tile
+					if (aFrame.meshletCulling)
+						drawBatch.set_view(extract_frustum_planes(aProjection * aFrame.world2camera), aFrame.cameraPosition);
+					streamBuffer.begin_frame(); //each tile is a frame of its own
+					drawScene(aFrame, aFrame.posterRenderables, aProjection);
+					endStreamFrame();
+				}, posterTile);
+
+				std::printf("Poster '%s': %zu x %zu, %.1f MB, encoded at %.0f MB/s\n", aFrame.posterPath.c_str(), posterWidth, posterHeight, stats.fileBytes * 1e-6, stats.throughput_mbps());
+			}
+			catch (std::exception const& eErr)
+			{
+				std::fprintf(stderr, "Poster '%s' failed: %s\n", aFrame.posterPath.c_str(), eErr.what());
+			}
+		}
+
+		if (recorder)
+			recorder->mark(kBenchmarkDraw);
+
+		// Display results
+		{
+			PROFILE_ZONE("swap buffers");
+			glfwSwapBuffers(window);
+		}
+		if (recorder)
+			recorder->mark(kBenchmarkSwap);
+
+		//ImGui restores the GL state it changes; check that the cache agrees
+		if (glstate::verify_enabled())
+			glstate::verify();
+
+		count_render(kRenderStateElided, glstate::take_stats().elided);
+
+		std::lock_guard<std::mutex> lock(feedbackMutex);
+		feedback.frames.emplace_back(std::exchange(render_stats(), RenderStats{}));
+		feedback.gpu = gpuProfiler.results();
+		feedback.meshlets = meshlets;
+		feedback.recording = bool(videoRecorder);
+		if (videoRecorder)
+		{
+			feedback.recordingPath = videoRecorder->path();
+			feedback.recordedFrames = videoRecorder->frame_count();
+			feedback.recordingStalls = videoRecorder->stall_count();
+		}
+		recordingStopped = recordingStopped || stopped;
+	};
+
+	//the font atlas is created by the renderer, and is needed to build the first UI frame
+	ImGui_ImplOpenGL3_NewFrame();
+
+	//benchmarks measure the phases of a frame one after another
+	FrameSnapshot serialFrame;
+	std::unique_ptr<RenderThread> renderThread;
+	if (renderOnThread && !benchmark)
+		renderThread = std::make_unique<RenderThread>(window, renderFrame, vsync ? 1 : 0);
+
+	std::uint64_t frameIndex = 0;
+
+	//MeshRefs hold draw ranges, which change when the arena moves meshes
+	std::uint64_t meshArenaGeneration = meshArena.generation();
+
 	// Main loop
 	while (!glfwWindowShouldClose(window))
 	{
+		PROFILE_FRAME();
+		PROFILE_ZONE("frame");
+
+		if (recorder)
+			recorder->begin_frame();
+
 		// Let GLFW process events
-		glfwPollEvents();
+		{
+			PROFILE_ZONE("poll events");
+			glfwPollEvents();
+
+			// Run work that background jobs queued for the main thread. The GL
+			// context may be on the render thread; these jobs must not use it.
+			jobs.pump_main_thread();
+		}
 
 		// Check if window was resized.
 		float fbwidth, fbheight;
@@ -467,29 +964,62 @@ int main() try{
 					glfwGetFramebufferSize(window, &nwidth, &nheight);
 				} while (0 == nwidth || 0 == nheight);
 			}
+		}
 
-			glViewport(0, 0, GLsizei(fbwidth), GLsizei(fbheight));
+		//results of the frames that were rendered in the meantime
+		{
+			std::lock_guard<std::mutex> lock(feedbackMutex);
+			for (auto const& frameStats : feedback.frames)
+				renderStats.end_frame(frameStats);
+			feedback.frames.clear();
+
+			rendered.gpu = feedback.gpu;
+			rendered.meshlets = feedback.meshlets;
+			rendered.recording = feedback.recording;
+			rendered.recordingPath = feedback.recordingPath;
+			rendered.recordedFrames = feedback.recordedFrames;
+			rendered.recordingStalls = feedback.recordingStalls;
+
+			if (std::exchange(recordingStopped, false))
+				recording = false;
 		}
 
 		// Update state
 		auto const now = Clock::now();
 		float dt = std::chrono::duration_cast<Secondsf>(now - last).count();
 		last = now;
-		
-		//calculate angle based on time
-		angle += dt * kPi_ * 0.3f;
-		if (angle >= 2.f * kPi_)
-			angle -= 2.f * kPi_;
-
-		//calculate rocket height for animation
-		float x = 1.1f;
-		if (state.animControl.animation) {
-			if (rktHeight < 8) {
-				x += 0.01f;
-			}
-			rktHeight += (rktLast / x) * (0.015f * state.animControl.mod);
-			rktLast = rktHeight;
+
+		//benchmark: fixed time step and scripted camera and launch
+		if (recorder)
+		{
+			dt = kBenchmarkTimestep;
+
+			SceneCamera const cam = benchmark_camera(scene.camera, recorder->time());
+			state.camControl.theta = cam.theta;
+			state.camControl.phi = cam.phi;
+			state.camControl.x = cam.x;
+			state.camControl.y = cam.y;
+			state.camControl.radius = cam.radius;
+			state.animControl.animation = benchmark_launch(recorder->time());
+		}
+
+		//recording: every frame advances the simulation by one video frame
+		bool const toggleRecording = std::exchange(state.recordingToggled, false);
+		if (toggleRecording)
+			recording = !recording;
+		if (recording)
+			dt = 1.f / float(recordFps);
+
+		//fixed-rate simulation; rendering interpolates between the last two steps
+		rocketField.resize(registry, std::size_t(rocketFieldSize));
+		std::size_t const simSteps = simClock.advance(dt);
+		for (std::size_t i = 0; i < simSteps; ++i)
+		{
+			launchStatePrev = launchState;
+			step_launch(launchState, simClock.step(), state.animControl.animation, state.animControl.mod);
+			animate(registry, jobs, simClock.step());
 		}
+		LaunchState const shown = interpolate(launchStatePrev, launchState, simClock.alpha());
 
 		//used for debugging and development
 		if (state.objControl.displayCoords == 1 && tog == 0) {
@@ -510,173 +1040,80 @@ int main() try{
 		Mat44f Rx = make_rotation_x(state.camControl.theta);
 		Mat44f Ry = make_rotation_y(state.camControl.phi);
 		Mat44f T = make_translation({ state.camControl.x, state.camControl.y, -state.camControl.radius });
-		Mat44f model2world = make_rotation_y(0);
 		Mat44f world2camera = Rx * Ry * T;
+		float const fovY = scene.camera.fovY;
 		Mat44f projection = make_perspective_projection(
-			60.f * 3.1415926f / 180.f,
+			fovY,
 			fbwidth / float(fbheight),
-			0.1f, 100.0f
+			scene.camera.zNear, scene.camera.zFar
 		);
-		Mat33f normalMatrix = mat44_to_mat33(transpose(invert(model2world)));
-
-		// Draw scene
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		//imgui
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
-
-
-		// Clear color buffer to specified clear color (glClearColor())
-		// We want to draw with our program..
-
-		glUseProgram(prog.programId());
-		GLuint progid = prog.programId();
-
-		glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);
-		glUniformMatrix4fv(0, 1, GL_TRUE, projection.v);
-		glUniformMatrix4fv(4, 1, GL_TRUE, T.v);
-		glUniformMatrix4fv(5, 1, GL_TRUE, model2world.v);
-		glUniformMatrix4fv(6, 1, GL_TRUE, world2camera.v);
-
-        //Blinn-Phong lighting
-		lighting(colorBool, color, color1, color2, lightBrightness, progid, pointLightPositions);
-
+		Vec4f const camPos4 = invert(world2camera) * Vec4f{ 0.f, 0.f, 0.f, 1.f };
+		Vec3f const camPos{ camPos4.x, camPos4.y, camPos4.z };
+
+		//update animated nodes
+		sceneGraph.set_translation(fanMotorNode, scene.meshes[kSceneFanMotor].translation + Vec3f{ 0.f, sin(shown.angle) / 16, 0.f });
+		sceneGraph.set_rotation(fanBladeNode, { shown.angle * 20.f, 0.f, 0.f });
+		sceneGraph.set_translation(rocketNode, { 0.f, shown.rocketHeight, 0.f });
+		sceneGraph.update();
+
+		//update entities
+		sync_scene_links(registry, sceneGraph);
+		interpolate_animators(registry, jobs, (1.f - simClock.alpha()) * simClock.step());
+		update_transforms(registry, jobs);
+		if (state.pickControl.requested)
+		{
+			state.pickControl.requested = false;
+
+			//unproject the cursor to a ray from the near to the far plane
+			int wwidth, wheight;
+			glfwGetWindowSize(window, &wwidth, &wheight);
+			float const nx = 2.f * state.pickControl.x / float(wwidth) - 1.f;
+			float const ny = 1.f - 2.f * state.pickControl.y / float(wheight);
+
+			Mat44f const invViewProj = invert(projection * world2camera);
+			Vec4f const n = invViewProj * Vec4f{ nx, ny, -1.f, 1.f };
+			Vec4f const f = invViewProj * Vec4f{ nx, ny, 1.f, 1.f };
+			Vec3f const nearPt{ n.x / n.w, n.y / n.w, n.z / n.w };
+			Vec3f const farPt{ f.x / f.w, f.y / f.w, f.z / f.w };
+
+			picked = pick(registry, nearPt, farPt - nearPt, 1.f, pickHit);
+			if (picked && state.objControl.displayCoords)
+				printf("P = %f %f %f\n", pickHit.position.x, pickHit.position.y, pickHit.position.z);
+		}
 
-		OGL_CHECKPOINT_DEBUG();
-		//TODO: draw frame
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		
-		glDisable(GL_CULL_FACE);
-		glBindVertexArray(launchVAO);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(launchVertex));
-		glEnable(GL_CULL_FACE);
-
-		//the objects are emissive
-		glUniform1f(8, 1.f); 
-		glBindVertexArray(floodLight1Vao);
-		glUniform1i(glGetUniformLocation(prog.programId(), "colorSel1"), true);
-		glUniform3f(glGetUniformLocation(prog.programId(), "emissive"), 1.f, 0.f, 0.f);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(coneVertex));
-		glUniform1i(glGetUniformLocation(prog.programId(), "colorSel1"), false);
-		glUniform1i(glGetUniformLocation(prog.programId(), "colorSel2"), true);
-		glUniform3f(glGetUniformLocation(prog.programId(), "emissive"), 0.f, 0.f, 1.f);
-		glBindVertexArray(floodLight2Vao);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(coneVertex2));
-		glUniform1i(glGetUniformLocation(prog.programId(), "colorSel2"), false);
-		glUniform3f(glGetUniformLocation(prog.programId(), "emissive"), 0.f, 0.f, 0.f);
-		glUniform1f(8, 0.f);
-
-		//fan
-		model2world = make_translation({ 5.1f, 0.715f, 21.6f });
-		glUniformMatrix4fv(5, 1, GL_TRUE, model2world.v);
-		normalMatrix = mat44_to_mat33(transpose(invert(model2world)));
-		glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);
-		glBindVertexArray(fanBaseVAO);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(fanBaseVertex));
-		glDisable(GL_CULL_FACE);
-		Mat44f motorTransform = make_translation({ 5.1f, 0.785f + (sin(angle)/16), 21.6f});
-		model2world = motorTransform;
-		glUniformMatrix4fv(5, 1, GL_TRUE, model2world.v);
-		normalMatrix = mat44_to_mat33(transpose(invert(model2world)));
-		glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);
-		glBindVertexArray(fanMotorVAO);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(fanMotorVertex));
-		glEnable(GL_CULL_FACE);
-		model2world = motorTransform * make_translation({ 0.f, 0.105f, 0.f }) * make_rotation_x(angle * 20.f);
-		glUniformMatrix4fv(5, 1, GL_TRUE, model2world.v);
-		normalMatrix = mat44_to_mat33(transpose(invert(model2world)));
-		glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);
-		glBindVertexArray(fanBladeVAO);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(fanBladeVertex));
-
-		//rocket
-		model2world = make_translation({ 0.f, rktHeight, 0.f });
-		glUniformMatrix4fv(5, 1, GL_TRUE, model2world.v);
-		normalMatrix = mat44_to_mat33(transpose(invert(model2world)));
-		glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);
-		glUniform1f(7, 1.f);        //telling shader that the object is textured
-		glBindVertexArray(rocketVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D,textureObjectId);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(rocketVertex));
-		model2world = make_rotation_x(0.f);
-		OGL_CHECKPOINT_DEBUG();
-		glUniform1f(7, 0.f);
-		glBindTexture(GL_TEXTURE_2D,0);
-
-		//monitors
-		model2world = make_translation({ 4.4f, 0.86f, 21.45f });
-		glUniformMatrix4fv(5, 1, GL_TRUE, model2world.v);
-		normalMatrix = mat44_to_mat33(transpose(invert(model2world)));
-		glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);
-		glBindVertexArray(MonitorsVao);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(MonitorsVert));
-
-		//Screen1
-		glUniform1f(7, 1.f);        //telling shader that the object is textured
-		glBindVertexArray(ScreenVao);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, markusFace);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(ScreenVert));
-		glUniform1f(7, 0.f);
-
-
-		//Screen2
-		glUniform1f(7, 1.f);        //telling shader that the object is textured
-		glUniform1f(9, 1.f);        //telling shader that the object has multiple textures
-		glUniform3f(glGetUniformLocation(prog.programId(), "specular"), 0.9f, 0.9f, 0.9f);
-		glBindVertexArray(MultiTexVao);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, markusFace);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, mTex0);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(MultiVert));
-		glUniform1f(9, 0.f);
-		glUniform1f(7, 0.f);
-        glUniform3f(glGetUniformLocation(prog.programId(), "specular"), 0.f, 0.f, 0.f);
-
-
-		//interior lights
-		glUniform1f(8, 1.f);        //the object is emissive
-		glUniform1i(glGetUniformLocation(prog.programId(), "colorSel"), true);
-		glUniform3f(glGetUniformLocation(prog.programId(), "emissive"), 1.f, 1.f, 1.f);
-		glBindVertexArray(lightBox1);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(lightBoxVertex1));
-		glBindVertexArray(lightBox2);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(lightBoxVertex2));
-		glUniform3f(glGetUniformLocation(prog.programId(), "emissive"), 0.f, 0.f, 0.f);
-		glUniform1f(8, 0.f);
-		glUniform1i(glGetUniformLocation(prog.programId(), "colorSel"), false);
-
-
-        //Drawing skybox 
-        glDepthFunc(GL_LEQUAL);                     // change depth function so depth test passes when values are equal to depth buffer's content
-		glUseProgram(skybox.programId());           //switching to skybox.vert and skybox.frag
-		model2world = make_scaling( 100.f, 100.f, 100.f );
-		glUniformMatrix4fv(1, 1, GL_TRUE, world2camera.v);
-		glUniformMatrix4fv(0, 1, GL_TRUE, projection.v);
-		glUniformMatrix4fv(2, 1, GL_TRUE, model2world.v);
-		glBindVertexArray(skyboxVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glDepthFunc(GL_LESS);                       // set depth function back to default
+		if (meshArena.generation() != meshArenaGeneration)
+		{
+			refresh_mesh_refs(registry, meshArena);
+			meshArenaGeneration = meshArena.generation();
+		}
 
+		lodReduced = select_lods(registry, staticGeometry, LodView{ camPos, fbheight / (2.f * std::tan(0.5f * fovY)), lodPixelError });
+		if (recorder)
+			recorder->mark(kBenchmarkUpdate);
 
-		OGL_CHECKPOINT_DEBUG();
+		FrameSnapshot& frame = renderThread ? renderThread->next_frame() : serialFrame;
+		frame.meshletCulling = frustumCulling;
+		if (frustumCulling)
+		{
+			Mat44f const viewProj = projection * world2camera;
+			frame.frustum = extract_frustum_planes(viewProj);
+			cullStats = cull_renderables(registry, jobs, frame.frustum, cullScratch);
 
-		//window
-		glUseProgram(prog.programId());             //switching back to default shaders
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glEnable(GL_BLEND);
-		glBindVertexArray(windowGlass);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(windowVertex));
-		glDisable(GL_BLEND);
-		glUniform1f(9, 0.f);
+			if (occlusionCulling)
+				cullStats.occluded = cull_occluded(registry, jobs, occlusionBuffer, viewProj);
+		}
+		else
+		{
+			reset_visibility(registry);
+			cullStats = CullStats{};
+		}
+		if (recorder)
+			recorder->mark(kBenchmarkCulling);
 
 		//imgui
+		ImGui_ImplGlfw_NewFrame();
+		ImGui::NewFrame();
+
 		// ImGUI window creation
 		ImGui::Begin("Light Color Selector");
 		// Text that appears in the window
@@ -690,9 +1127,49 @@ int main() try{
 		ImGui::Checkbox("Launchpad 2", &temp2);
 		ImGui::SliderFloat("Brightness 2", &lightBrightness[2], 0.1f, 5.0f);
 		ImGui::ColorEdit4("Color 2", color2);
+		ImGui::SliderInt("Rocket field", &rocketFieldSize, 0, 20000);
+		ImGui::Checkbox("Frustum culling", &frustumCulling);
+		if (frustumCulling)
+		{
+			ImGui::Text("Visible: %zu / %zu (%s)", cullStats.visible, cullStats.tested, cull_spheres_simd() ? "AVX" : "scalar");
+			ImGui::Text("Meshlets: %zu / %zu", rendered.meshlets.visible, rendered.meshlets.tested);
+			ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+			if (occlusionCulling)
+				ImGui::Text("Occluded: %zu (%zu occluder triangles)", cullStats.occluded, occlusionBuffer.triangle_count());
+		}
+		if (picked)
+			ImGui::Text("Picked: entity %u at (%.2f, %.2f, %.2f)", unsigned(entity_index(pickHit.entity)), pickHit.position.x, pickHit.position.y, pickHit.position.z);
+		else
+			ImGui::Text("Picked: nothing (left click to pick)");
+		ImGui::SliderFloat("LOD error (px)", &lodPixelError, 0.f, 8.f);
+		ImGui::Text("Simplified LODs: %zu", lodReduced);
+		ImGui::Text("Simulation: %.0f Hz, %zu steps this frame", 1.f / simClock.step(), simSteps);
+		ImGui::Text("Rendering: %s", renderThread ? "render thread" : "main thread");
+		{
+			BufferArena::Report const arena = meshArena.report();
+			ImGui::Text("Mesh arena: %zu meshes, %.1f / %.1f KB in %zu buffers (%.0f%% fragmented)", arena.allocations, arena.used / 1024.0, arena.capacity / 1024.0, arena.pages, arena.fragmentation * 100.f);
+		}
+		if (rendered.recording)
+			ImGui::Text("Recording '%s': %zu frames (%zu stalls)", rendered.recordingPath.c_str(), rendered.recordedFrames, rendered.recordingStalls);
+		else
+			ImGui::Text("Recording: off (F10)");
+		{
+			int format = int(screenshotFormat);
+			if (ImGui::Combo("Screenshot format (F12)", &format, "png\0png-mt\0qoi\0ppm\0"))
+				screenshotFormat = ImageFormat(format);
+			ImageWriteStats const shot = screenshots.last_stats();
+			if (shot.pixelBytes)
+				ImGui::Text("Last screenshot: %.1f ms, %.0f MB/s", shot.encodeSeconds * 1e3, shot.throughput_mbps());
+		}
+		if (ImGui::CollapsingHeader("Render stats"))
+			draw_render_stats_panel(renderStats);
+		if (ImGui::CollapsingHeader("Profiler"))
+			profilerView.draw(&rendered.gpu);
 		// Ends the window
 		ImGui::End();
-		OGL_CHECKPOINT_DEBUG();
+		ImGui::Render();
+		if (recorder)
+			recorder->mark(kBenchmarkUi);
 
 		if (temp)
 			colorBool[0] = 1.f;
@@ -707,22 +1184,86 @@ int main() try{
 		else
 			colorBool[2] = 0.f;
 
-		glUniform3f(glGetUniformLocation(prog.programId(), "colorBool"), colorBool[0],colorBool[1], colorBool[2]);
-		glUniform4f(glGetUniformLocation(prog.programId(), "color"), color[0], color[1], color[2], color[3]);
-		glUniform4f(glGetUniformLocation(prog.programId(), "color1"), color1[0], color1[1], color1[2], color1[3]);
-		glUniform4f(glGetUniformLocation(prog.programId(), "color2"), color2[0], color2[1], color2[2], color2[3]);
+		//everything the renderer needs is copied into the snapshot
+		{
+			PROFILE_ZONE("build snapshot");
+
+			frame.frame = frameIndex++;
+			frame.width = GLsizei(fbwidth);
+			frame.height = GLsizei(fbheight);
+			frame.projection = projection;
+			frame.world2camera = world2camera;
+			frame.cameraTranslation = T;
+			frame.cameraPosition = camPos;
+			frame.fovY = fovY;
+			std::copy(colorBool, colorBool + 3, frame.colorBool);
+			std::copy(color, color + 4, frame.color);
+			std::copy(color1, color1 + 4, frame.color1);
+			std::copy(color2, color2 + 4, frame.color2);
+			std::copy(lightBrightness, lightBrightness + 3, frame.lightBrightness);
+			collect_renderables(registry, frame.renderables);
+			frame.cullStats = cullStats;
+			frame.ui.assign(*ImGui::GetDrawData());
+
+			frame.imageFormat = screenshotFormat;
+			frame.screenshot = std::exchange(state.screenshotRequested, false);
+			frame.toggleRecording = toggleRecording;
+			frame.reloadShaders = std::exchange(state.shadersReloadRequested, false);
+
+			//poster: LODs for the poster resolution, and no culling
+			frame.poster = std::exchange(state.posterRequested, false);
+			frame.posterRenderables.clear();
+			if (frame.poster)
+			{
+				std::string const posterName = "poster_" + getScreenshotName();
+				frame.posterPath = (fs::path("screenshots") / posterName).replace_extension(image_format_extension(screenshotFormat)).string();
+				frame.posterProjection = make_perspective_projection(
+					fovY,
+					posterWidth / float(posterHeight),
+					scene.camera.zNear, scene.camera.zFar
+				);
+				//the registry keeps the interactive LODs
+				collect_renderables(registry, frame.posterRenderables, false, staticGeometry, LodView{ camPos, posterHeight / (2.f * std::tan(0.5f * fovY)), lodPixelError });
+			}
+		}
+		if (recorder)
+			recorder->mark(kBenchmarkSnapshot);
 
-		// Renders the ImGUI elements
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-		
-		glUseProgram(0);
-		glBindVertexArray(0);
+		//the main thread continues with the next frame while this one is drawn
+		if (renderThread)
+			renderThread->submit();
+		else
+			renderFrame(frame);
 
-		// Display results
-		glfwSwapBuffers(window);
+		if (recorder)
+		{
+			recorder->end_frame();
+			if (recorder->done())
+				glfwSetWindowShouldClose(window, GLFW_TRUE);
+		}
 	}
 
+	//the GL context is current on this thread again
+	if (renderThread)
+		renderThread->stop();
+
+	if (recorder)
+	{
+		recorder->finish();
+		recorder->print_summary();
+
+		std::string const csvPath = outputPath ? outputPath : "benchmark.csv";
+		std::string const jsonPath = fs::path(csvPath).replace_extension(".json").string();
+		recorder->write_csv(csvPath.c_str());
+		recorder->write_json(jsonPath.c_str());
+		recorder.reset();
+	}
+
+	videoRecorder.reset();
+
+	if (tracePath)
+		profiler::write_chrome_trace(tracePath);
+
 	// Cleanup.
 	//TODO: additional cleanup
 	ImGui_ImplOpenGL3_Shutdown();
@@ -779,24 +1320,9 @@ namespace
 			{
 				mod -= 1;
 			}
-			// R-key reloads shaders.
+			// R-key reloads shaders (on the thread that has the GL context).
 			if (GLFW_KEY_R == aKey && GLFW_PRESS == aAction)
-			{
-				if (state->prog)
-				{
-					try
-					{
-						state->prog->reload();
-						std::fprintf(stderr, "Shaders reloaded and recompiled.\n");
-					}
-					catch (std::exception const& eErr)
-					{
-						std::fprintf(stderr, "Error when reloading shader:\n");
-						std::fprintf(stderr, "%s\n", eErr.what());
-						std::fprintf(stderr, "Keeping old shader.\n");
-					}
-				}
-			}
+				state->shadersReloadRequested = true;
 
 			// Space toggles camera
 			if (GLFW_KEY_SPACE == aKey && GLFW_PRESS == aAction)
@@ -813,8 +1339,14 @@ namespace
 			if (GLFW_KEY_F12 == aKey && GLFW_PRESS == aAction)
 			{
 				if (GLFW_PRESS == aAction)
-					saveScreenshot();
+					state->screenshotRequested = true;
 			}
+			//video recording
+			if (GLFW_KEY_F10 == aKey && GLFW_PRESS == aAction)
+				state->recordingToggled = true;
+			//poster
+			if (GLFW_KEY_F11 == aKey && GLFW_PRESS == aAction)
+				state->posterRequested = true;
 			//animation controls
 			//slow down
 			if (GLFW_KEY_1 == aKey || GLFW_KEY_LEFT == aKey)
@@ -1060,6 +1592,23 @@ namespace
 			state->camControl.lastY = float(aY);
 		}
 	}
+
+	void glfw_callback_button_(GLFWwindow* aWindow, int aButton, int aAction, int)
+	{
+		if (auto* state = static_cast<State_*>(glfwGetWindowUserPointer(aWindow)))
+		{
+			//pick with the left button, unless the mouse controls the camera or the UI
+			if (GLFW_MOUSE_BUTTON_LEFT == aButton && GLFW_PRESS == aAction && !state->camControl.cameraActive && !ImGui::GetIO().WantCaptureMouse)
+			{
+				double x, y;
+				glfwGetCursorPos(aWindow, &x, &y);
+
+				state->pickControl.requested = true;
+				state->pickControl.x = float(x);
+				state->pickControl.y = float(y);
+			}
+		}
+	}
 	//...End
 }
 
@@ -1111,95 +1660,116 @@ namespace
 		return state;
 	}
 
-	void lighting(float colorBool[3], float color[4], float color1[4], float color2[4], float lightBrightness[3], GLuint prog, Vec3f pointLightPositions[]) {
-		//Blinn-Phong lighting
-		Vec3f lightColor = { 1.f, 0.f, 0.f };
-		if (colorBool[1] > 0.5f) {
-			lightColor = { color1[0], color1[1], color1[2] };
+	void lighting(float const colorBool[3], float const color[4], float const color1[4], float const color2[4], float const lightBrightness[3], GLuint prog, std::vector<ScenePointLight> const& lights) {
+		//Blinn-Phong lighting; the UI overrides the color and brightness of the controlled lights
+		assert(lights.size() <= 5); //NR_POINT_LIGHTS in default.frag
+		float const* const controlColor[] = { color, color1, color2 };
 
-		}
-		else {
-			lightColor = { 1.f, 0.f, 0.f };
-		}
-		Vec3f diffuseColor = lightColor * lightBrightness[1];
-		Vec3f ambientColor = diffuseColor * 0.01f;
-		Vec3f specularColor = 0.25f * lightColor;
-		glUniform1i(glGetUniformLocation(prog, "colorSel1"), true);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[0].position"), pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[0].ambient"), ambientColor.x, ambientColor.y, ambientColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[0].diffuse"), diffuseColor.x, diffuseColor.y, diffuseColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[0].specular"), specularColor.x, specularColor.y, specularColor.z);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[0].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[0].linear"), 0.09f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[0].quadratic"), 0.032f);
-		glUniform1i(glGetUniformLocation(prog, "colorSel1"), false);
-
-
-		if (colorBool[2] > 0.5f) {
-			lightColor = { color2[0], color2[1], color2[2] };
+		for (std::size_t i = 0; i < lights.size(); ++i)
+		{
+			auto const& light = lights[i];
+
+			Vec3f lightColor = light.color;
+			float brightness = light.brightness;
+			if (light.control >= 0)
+			{
+				if (colorBool[light.control] > 0.5f)
+					lightColor = { controlColor[light.control][0], controlColor[light.control][1], controlColor[light.control][2] };
+				brightness = lightBrightness[light.control];
+			}
 
+			Vec3f const diffuseColor = lightColor * brightness;
+			Vec3f const ambientColor = diffuseColor * 0.01f;
+			Vec3f const specularColor = light.specular * lightColor;
+
+			std::string const name = "pointLights[" + std::to_string(i) + "]";
+			glUniform3f(glGetUniformLocation(prog, (name + ".position").c_str()), light.position.x, light.position.y, light.position.z);
+			glUniform3f(glGetUniformLocation(prog, (name + ".ambient").c_str()), ambientColor.x, ambientColor.y, ambientColor.z);
+			glUniform3f(glGetUniformLocation(prog, (name + ".diffuse").c_str()), diffuseColor.x, diffuseColor.y, diffuseColor.z);
+			glUniform3f(glGetUniformLocation(prog, (name + ".specular").c_str()), specularColor.x, specularColor.y, specularColor.z);
+			glUniform1f(glGetUniformLocation(prog, (name + ".constant").c_str()), light.constant);
+			glUniform1f(glGetUniformLocation(prog, (name + ".linear").c_str()), light.linear);
+			glUniform1f(glGetUniformLocation(prog, (name + ".quadratic").c_str()), light.quadratic);
 		}
-		else {
-			lightColor = { 0.f, 0.f, 1.f };
+	}
+
+	void path_trace_(JobSystem& jobs, std::size_t spp, char const* outputPath) {
+		//offline reference render of the scene description, written progressively to outputPath
+		SceneDescription scene = make_scene_description();
+		JobCounter loads;
+		load_scene_meshes(scene, jobs, loads);
+		jobs.wait(loads);
+
+		auto const buildStart = Clock::now();
+		PathTracer tracer(scene, jobs);
+		std::printf("Path tracer: %zu triangles, BVH built in %.2f s\n", tracer.triangle_count(),
+			std::chrono::duration_cast<Secondsf>(Clock::now() - buildStart).count());
+
+		tracer.reset(1280, 720, scene.camera);
+
+		auto const start = Clock::now();
+		for (std::size_t pass = 1; pass <= spp; ++pass)
+		{
+			tracer.trace_pass(jobs);
+
+			//save at 1, 2, 4, ... samples per pixel, so that a partial render can be inspected
+			if (0 == (pass & (pass - 1)) || spp == pass)
+			{
+				float const seconds = std::chrono::duration_cast<Secondsf>(Clock::now() - start).count();
+				std::printf("%zu / %zu spp, %.1f s, %.2f Mrays/s\n", pass, spp, seconds, tracer.ray_count() / (1e6 * seconds));
+
+				auto const image = tracer.resolve();
+				stbi_flip_vertically_on_write(0);
+				if (!stbi_write_png(outputPath, int(tracer.width()), int(tracer.height()), 3, image.data(), 0))
+					throw Error("Unable to write '%s'", outputPath);
+			}
 		}
-		diffuseColor = lightColor * lightBrightness[2];
-		ambientColor = diffuseColor * 0.01f;
-		specularColor = 0.25f * lightColor;
-
-		glUniform1i(glGetUniformLocation(prog, "colorSel2"), true);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[1].position"), pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[1].ambient"), ambientColor.x, ambientColor.y, ambientColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[1].diffuse"), diffuseColor.x, diffuseColor.y, diffuseColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[1].specular"), specularColor.x, specularColor.y, specularColor.z);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[1].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[1].linear"), 0.09f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[1].quadratic"), 0.032f);
-		glUniform1i(glGetUniformLocation(prog, "colorSel2"), false);
-
-		//ambient moonlight
-		lightColor = { 1.f, 1.f, 1.f };
-		diffuseColor = lightColor * 1.f;
-		ambientColor = diffuseColor * 0.01f;
-		specularColor = 0.5f * lightColor;
-		glUniform3f(glGetUniformLocation(prog, "pointLights[2].position"), pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[2].ambient"), ambientColor.x, ambientColor.y, ambientColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[2].diffuse"), diffuseColor.x, diffuseColor.y, diffuseColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[2].specular"), specularColor.x, specularColor.y, specularColor.z);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[2].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[2].linear"), 0.09f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[2].quadratic"), 0.032f);
-
-
-		if (colorBool[0] > 0.5f) {
-			lightColor = { color[0], color[1], color[2] };
+	}
 
+	void soft_raster_(JobSystem& jobs, std::size_t frames, char const* outputPath) {
+		//render the scene description with the CPU rasterizer and write the last frame to outputPath
+		SceneDescription scene = make_scene_description();
+		JobCounter loads;
+		load_scene_meshes(scene, jobs, loads);
+
+		std::vector<std::unique_ptr<CpuTexture>> textures(scene.meshes.size());
+		for (std::size_t i = 0; i < scene.meshes.size(); ++i)
+		{
+			if (scene.meshes[i].texture)
+				textures[i] = std::make_unique<CpuTexture>(scene.meshes[i].texture);
 		}
-		else {
-			lightColor = { 1.f, 1.f, 1.f };
+		CpuCubemap skybox(scene.skyboxFaces);
+
+		jobs.wait(loads);
+
+		SoftRasterizer rasterizer(1280, 720);
+		rasterizer.set_skybox(&skybox);
+
+		float const aspect = float(rasterizer.width()) / float(rasterizer.height());
+		Mat44f const world2camera = scene_camera_world2camera(scene.camera);
+		Mat44f const projection = scene_camera_projection(scene.camera, aspect);
+
+		float total = 0.f, best = 0.f;
+		for (std::size_t frame = 0; frame < frames; ++frame)
+		{
+			auto const start = Clock::now();
+
+			rasterizer.begin(world2camera, projection, scene.lights);
+			for (std::size_t i = 0; i < scene.meshes.size(); ++i)
+				rasterizer.add_mesh(scene.meshes[i].mesh, scene_mesh_world(scene, i), textures[i].get(), scene.meshes[i].doubleSided);
+			rasterizer.render(jobs);
+
+			float const seconds = std::chrono::duration_cast<Secondsf>(Clock::now() - start).count();
+			total += seconds;
+			best = 0 == frame ? seconds : std::min(best, seconds);
 		}
-		diffuseColor = lightColor * lightBrightness[0];
-		ambientColor = diffuseColor * 0.01f;
-		specularColor = 0.f * lightColor;
-
-		glUniform1i(glGetUniformLocation(prog, "colorSel"), true);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[3].position"), pointLightPositions[3].x, pointLightPositions[3].y, pointLightPositions[3].z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[3].ambient"), ambientColor.x, ambientColor.y, ambientColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[3].diffuse"), diffuseColor.x, diffuseColor.y, diffuseColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[3].specular"), specularColor.x, specularColor.y, specularColor.z);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[3].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[3].linear"), 0.09f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[3].quadratic"), 0.032f);
-		glUniform1i(glGetUniformLocation(prog, "colorSel"), false);
-
-		specularColor = 0.1f * lightColor;
-		glUniform1i(glGetUniformLocation(prog, "colorSel"), true);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[4].position"), pointLightPositions[4].x, pointLightPositions[4].y, pointLightPositions[4].z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[4].ambient"), ambientColor.x, ambientColor.y, ambientColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[4].diffuse"), diffuseColor.x, diffuseColor.y, diffuseColor.z);
-		glUniform3f(glGetUniformLocation(prog, "pointLights[4].specular"), specularColor.x, specularColor.y, specularColor.z);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[4].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[4].linear"), 0.09f);
-		glUniform1f(glGetUniformLocation(prog, "pointLights[4].quadratic"), 0.032f);
-		glUniform1i(glGetUniformLocation(prog, "colorSel"), false);
+
+		std::printf("Software rasterizer: %zu triangles, %zu frames, %.2f ms avg, %.2f ms best (%zu threads)\n",
+			rasterizer.triangle_count(), frames, 1000.f * total / frames, 1000.f * best, jobs.thread_count());
+
+		auto const image = rasterizer.resolve();
+		stbi_flip_vertically_on_write(0);
+		if (!stbi_write_png(outputPath, int(rasterizer.width()), int(rasterizer.height()), 3, image.data(), 0))
+			throw Error("Unable to write '%s'", outputPath);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "mesh_arena.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#include "../support/profiler.hpp"
+#include "../support/gl_state.hpp"
+
+#include "static_geometry.hpp"
+
+namespace
+{
+	// remove() repacks the arena when its free space is split up beyond
+	// this (see BufferArena::Report::fragmentation), or when less than half
+	// of the capacity of several pages is in use.
+	constexpr float kMaxFragmentation_ = 0.5f;
+}
+
+MeshArena::MeshArena( std::size_t aPageBytes )
+	: mArena( sizeof(StaticVertex), aPageBytes )
+{}
+
+MeshArena::~MeshArena()
+{
+	for( auto const vao : mVaos )
+		glstate::forget_vertex_array( vao );
+	glDeleteVertexArrays( GLsizei(mVaos.size()), mVaos.data() );
+}
+
+MeshArena::MeshId MeshArena::add( SimpleMeshData const& aMesh )
+{
+	PROFILE_ZONE( "add arena mesh" );
+
+	std::vector<StaticVertex> vertices;
+	std::vector<GLuint> indices;
+	build_indexed_mesh( aMesh, vertices, indices );
+
+	// One allocation: vertices first (so that the offset is a base vertex),
+	// then the indices. The granularity keeps the indices 4-byte aligned.
+	auto const vertexBytes = vertices.size() * sizeof(StaticVertex);
+	auto const indexBytes = indices.size() * sizeof(GLuint);
+
+	std::vector<unsigned char> data( vertexBytes + indexBytes );
+	std::memcpy( data.data(), vertices.data(), vertexBytes );
+	std::memcpy( data.data() + vertexBytes, indices.data(), indexBytes );
+
+	auto const id = mArena.allocate( data.size(), data.data() );
+	if( id >= mMeshes.size() )
+		mMeshes.resize( id+1 );
+	mMeshes[id] = Mesh_{ GLsizei(indices.size()), vertices.size(), true };
+
+	update_vaos_();
+	return id;
+}
+
+void MeshArena::remove( MeshId aId )
+{
+	assert( aId < mMeshes.size() && mMeshes[aId].live );
+
+	mArena.free( aId );
+	mMeshes[aId] = Mesh_{};
+
+	// Ids index mMeshes; the arena reuses freed ones, so only trailing
+	// entries can go.
+	while( !mMeshes.empty() && !mMeshes.back().live )
+		mMeshes.pop_back();
+
+	auto const state = mArena.report();
+	if( state.pages > 1 && state.used*2 < state.capacity )
+		compact();
+	else if( state.fragmentation > kMaxFragmentation_ )
+		defragment();
+}
+
+void MeshArena::defragment()
+{
+	PROFILE_ZONE( "defragment mesh arena" );
+	mArena.defragment();
+	update_vaos_();
+}
+
+void MeshArena::compact()
+{
+	PROFILE_ZONE( "compact mesh arena" );
+	mArena.compact();
+	update_vaos_();
+}
+
+MeshArena::DrawRange MeshArena::draw_range( MeshId aId ) const noexcept
+{
+	assert( aId < mMeshes.size() && mMeshes[aId].live );
+
+	auto const range = mArena.range( aId );
+	auto const& mesh = mMeshes[aId];
+	return DrawRange{
+		mVaos[range.page],
+		mesh.indexCount,
+		range.offset + GLintptr(mesh.vertexCount * sizeof(StaticVertex)),
+		GLint(range.offset / GLintptr(sizeof(StaticVertex)))
+	};
+}
+
+std::uint64_t MeshArena::generation() const noexcept
+{
+	return mArena.generation();
+}
+
+BufferArena::Report MeshArena::report() const
+{
+	return mArena.report();
+}
+
+void MeshArena::update_vaos_()
+{
+	auto const pages = mArena.page_count();
+
+	// Pages released by compact()
+	while( mVaos.size() > pages )
+	{
+		glstate::forget_vertex_array( mVaos.back() );
+		glDeleteVertexArrays( 1, &mVaos.back() );
+		mVaos.pop_back();
+		mVaoBuffers.pop_back();
+	}
+
+	while( mVaos.size() < pages )
+	{
+		GLuint vao = 0;
+		glGenVertexArrays( 1, &vao );
+		mVaos.emplace_back( vao );
+		mVaoBuffers.emplace_back( 0 );
+	}
+
+	// New pages, and pages that were replaced by defragment()/compact()
+	for( std::size_t i = 0; i < pages; ++i )
+	{
+		auto const buffer = mArena.page_buffer( i );
+		if( buffer == mVaoBuffers[i] )
+			continue;
+
+		glstate::bind_vertex_array( mVaos[i] );
+		glBindBuffer( GL_ARRAY_BUFFER, buffer );
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, buffer );
+		setup_static_vertex_attributes();
+
+		mVaoBuffers[i] = buffer;
+	}
+
+	glstate::bind_vertex_array( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
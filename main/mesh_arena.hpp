@@ -0,0 +1,83 @@
+#ifndef MESH_ARENA_HPP
+#define MESH_ARENA_HPP
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../support/buffer_arena.hpp"
+
+#include "simple_mesh.hpp"
+
+/** MeshArena: individually drawn meshes in a few shared GL buffers
+ *
+ * Replaces create_vao(), which creates eight buffer objects per mesh. Each
+ * mesh added here is converted to an indexed mesh of StaticVertex, and its
+ * vertices and indices are stored together in a single BufferArena
+ * allocation (indices after the vertices). There is one VAO per arena page,
+ * with the page buffer as both vertex and index buffer, so a mesh is drawn
+ * from its page's VAO with glDrawElementsBaseVertex().
+ *
+ * Meshes can be removed again. remove() defragments or compacts the arena
+ * when too much of it is unused; both can also be requested explicitly. They
+ * move meshes and change their DrawRange; generation() changes when they do,
+ * and MeshRefs must then be refreshed (see refresh_mesh_refs()).
+ *
+ * add(), remove(), defragment() and compact() make GL calls.
+ */
+class MeshArena final
+{
+	public:
+		using MeshId = BufferArena::Handle;
+
+		struct DrawRange
+		{
+			GLuint vao;
+			GLsizei indexCount;
+			GLintptr indexOffset; // bytes, in the page buffer
+			GLint baseVertex;
+		};
+
+	public:
+		explicit MeshArena( std::size_t aPageBytes = std::size_t(4) << 20 );
+		~MeshArena();
+
+		MeshArena( MeshArena const& ) = delete;
+		MeshArena& operator= (MeshArena const&) = delete;
+
+	public:
+		MeshId add( SimpleMeshData const& );
+		void remove( MeshId );
+
+		void defragment();
+		void compact();
+
+	public:
+		DrawRange draw_range( MeshId ) const noexcept;
+
+		std::uint64_t generation() const noexcept;
+
+		BufferArena::Report report() const;
+
+	private:
+		struct Mesh_
+		{
+			GLsizei indexCount = 0;
+			std::size_t vertexCount = 0;
+			bool live = false;
+		};
+
+		void update_vaos_();
+
+	private:
+		BufferArena mArena;
+		std::vector<Mesh_> mMeshes; // by MeshId
+
+		std::vector<GLuint> mVaos; // by page
+		std::vector<GLuint> mVaoBuffers; // buffer that each VAO was set up with
+};
+
+#endif // MESH_ARENA_HPP
@@ -0,0 +1,159 @@
+#include "meshlets.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+namespace
+{
+	constexpr std::uint8_t kNotInMeshlet_ = 0xff;
+
+	void compute_bounds_( Meshlet& aMeshlet, MeshletData const& aData, Vec3f const* aPositions )
+	{
+		// Sphere around the box center
+		Vec3f bmin{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		Vec3f bmax = -bmin;
+		for( std::uint32_t i = 0; i < aMeshlet.vertexCount; ++i )
+		{
+			auto const& p = aPositions[aData.vertices[aMeshlet.vertexOffset + i]];
+			bmin = Vec3f{ std::min( bmin.x, p.x ), std::min( bmin.y, p.y ), std::min( bmin.z, p.z ) };
+			bmax = Vec3f{ std::max( bmax.x, p.x ), std::max( bmax.y, p.y ), std::max( bmax.z, p.z ) };
+		}
+
+		aMeshlet.center = 0.5f * (bmin + bmax);
+
+		float radius2 = 0.f;
+		for( std::uint32_t i = 0; i < aMeshlet.vertexCount; ++i )
+		{
+			auto const d = aPositions[aData.vertices[aMeshlet.vertexOffset + i]] - aMeshlet.center;
+			radius2 = std::max( radius2, dot( d, d ) );
+		}
+		aMeshlet.radius = std::sqrt( radius2 );
+
+		// Normal cone: average of the (unit) triangle normals, and the widest
+		// angle between the average and any triangle normal.
+		std::vector<Vec3f> normals;
+		normals.reserve( aMeshlet.triangleCount );
+
+		Vec3f axis{ 0.f, 0.f, 0.f };
+		for( std::uint32_t t = 0; t < aMeshlet.triangleCount; ++t )
+		{
+			auto const* tri = &aData.triangles[3*(aMeshlet.triangleOffset + t)];
+			auto const& a = aPositions[aData.vertices[aMeshlet.vertexOffset + tri[0]]];
+			auto const& b = aPositions[aData.vertices[aMeshlet.vertexOffset + tri[1]]];
+			auto const& c = aPositions[aData.vertices[aMeshlet.vertexOffset + tri[2]]];
+
+			auto const n = cross( b - a, c - a );
+			float const len = length( n );
+			if( len <= 0.f )
+				continue; // degenerate; does not affect visibility
+
+			normals.emplace_back( n / len );
+			axis += normals.back();
+		}
+
+		aMeshlet.coneAxis = Vec3f{ 0.f, 0.f, 0.f };
+		aMeshlet.coneCutoff = 1.f;
+
+		float const axisLen = length( axis );
+		if( normals.empty() || axisLen <= 0.f )
+			return;
+
+		axis = axis / axisLen;
+
+		float minDot = 1.f;
+		for( auto const& n : normals )
+			minDot = std::min( minDot, dot( n, axis ) );
+
+		aMeshlet.coneAxis = axis;
+
+		// Spread of 90 degrees or more: the cone test can never succeed
+		if( minDot <= 0.f )
+			return;
+
+		aMeshlet.coneCutoff = std::sqrt( 1.f - minDot*minDot );
+	}
+}
+
+MeshletData build_meshlets( Vec3f const* aPositions, std::size_t aVertexCount, std::uint32_t const* aIndices, std::size_t aIndexCount, std::size_t aMaxVertices, std::size_t aMaxTriangles )
+{
+	assert( aIndexCount % 3 == 0 );
+	assert( aMaxVertices >= 3 && aMaxVertices <= kNotInMeshlet_ );
+	assert( aMaxTriangles >= 1 );
+
+	MeshletData ret;
+
+	// Local index of each mesh vertex in the current meshlet
+	std::vector<std::uint8_t> local( aVertexCount, kNotInMeshlet_ );
+
+	Meshlet current{};
+
+	auto const finish = [&] {
+		if( 0 == current.triangleCount )
+			return;
+
+		compute_bounds_( current, ret, aPositions );
+		ret.meshlets.emplace_back( current );
+
+		for( std::uint32_t i = 0; i < current.vertexCount; ++i )
+			local[ret.vertices[current.vertexOffset + i]] = kNotInMeshlet_;
+
+		current = Meshlet{};
+		current.vertexOffset = std::uint32_t(ret.vertices.size());
+		current.triangleOffset = std::uint32_t(ret.triangles.size() / 3);
+	};
+
+	for( std::size_t i = 0; i < aIndexCount; i += 3 )
+	{
+		std::uint32_t const tri[3] = { aIndices[i+0], aIndices[i+1], aIndices[i+2] };
+		assert( tri[0] < aVertexCount && tri[1] < aVertexCount && tri[2] < aVertexCount );
+
+		std::size_t newVerts = 0;
+		for( int j = 0; j < 3; ++j )
+		{
+			if( kNotInMeshlet_ == local[tri[j]] )
+				++newVerts;
+		}
+		// (A triangle that references the same vertex twice is counted twice
+		// here; this only makes the limit slightly conservative.)
+
+		if( current.vertexCount + newVerts > aMaxVertices || current.triangleCount + 1 > aMaxTriangles )
+			finish();
+
+		for( int j = 0; j < 3; ++j )
+		{
+			if( kNotInMeshlet_ == local[tri[j]] )
+			{
+				local[tri[j]] = std::uint8_t(current.vertexCount++);
+				ret.vertices.emplace_back( tri[j] );
+			}
+
+			ret.triangles.emplace_back( local[tri[j]] );
+		}
+
+		++current.triangleCount;
+	}
+
+	finish();
+	return ret;
+}
+
+bool meshlet_visible( Frustum const& aFrustum, Vec3f aCamPos, Vec3f aCenter, float aRadius, Vec3f aConeAxis, float aConeCutoff, bool aConeCull ) noexcept
+{
+	for( auto const& p : aFrustum.planes )
+	{
+		if( p.x*aCenter.x + p.y*aCenter.y + p.z*aCenter.z + p.w < -aRadius )
+			return false;
+	}
+
+	if( aConeCull )
+	{
+		auto const d = aCenter - aCamPos;
+		if( dot( d, aConeAxis ) >= aConeCutoff * length( d ) + aRadius )
+			return false;
+	}
+
+	return true;
+}
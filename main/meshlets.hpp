@@ -0,0 +1,66 @@
+#ifndef MESHLETS_HPP
+#define MESHLETS_HPP
+
+// Partitioning of indexed meshes into small clusters ("meshlets") with
+// bounds for per-cluster culling. No OpenGL dependencies.
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec3.hpp"
+
+#include "culling.hpp"
+
+struct Meshlet
+{
+	// Ranges in MeshletData::vertices and MeshletData::triangles
+	std::uint32_t vertexOffset;
+	std::uint32_t triangleOffset; // in triangles, i.e., index into triangles is 3*triangleOffset
+	std::uint32_t vertexCount;
+	std::uint32_t triangleCount;
+
+	// Bounding sphere
+	Vec3f center;
+	float radius;
+
+	// Normal cone. All triangles of the meshlet face away from a viewer at
+	// position p if
+	//   dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius
+	// coneCutoff is 1 if the normals spread too much for this to ever hold.
+	Vec3f coneAxis;
+	float coneCutoff;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<std::uint32_t> vertices; // meshlet-local vertex -> mesh vertex
+	std::vector<std::uint8_t> triangles; // 3 meshlet-local vertices per triangle
+};
+
+constexpr std::size_t kMeshletMaxVertices = 64;
+constexpr std::size_t kMeshletMaxTriangles = 124;
+
+// Split an indexed triangle mesh into meshlets. Triangles are consumed in
+// index order, so meshes whose triangles are spatially coherent in the index
+// buffer (e.g., OBJ files and build_indexed_mesh() output) produce compact
+// meshlets. Counter-clockwise triangles are considered front-facing.
+MeshletData build_meshlets(
+	Vec3f const* aPositions, std::size_t aVertexCount,
+	std::uint32_t const* aIndices, std::size_t aIndexCount,
+	std::size_t aMaxVertices = kMeshletMaxVertices,
+	std::size_t aMaxTriangles = kMeshletMaxTriangles
+);
+
+// Test a meshlet whose bounds have been transformed to world space. Returns
+// false if it is outside the frustum or (if aConeCull is set) faces away from
+// the camera at aCamPos.
+bool meshlet_visible(
+	Frustum const&, Vec3f aCamPos,
+	Vec3f aCenter, float aRadius, Vec3f aConeAxis, float aConeCutoff,
+	bool aConeCull
+) noexcept;
+
+#endif // MESHLETS_HPP
@@ -0,0 +1,238 @@
+#include "multi_draw.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+#include "../support/profiler.hpp"
+#include "../support/gl_state.hpp"
+
+#include "meshlets.hpp"
+#include "render_stats.hpp"
+
+MultiDrawBatch::MultiDrawBatch( StaticGeometry& aGeometry, StreamBuffer& aStream )
+	: mGeometry( &aGeometry )
+	, mStream( &aStream )
+{
+	GLint align = 0;
+	glGetIntegerv( GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align );
+	mRecordAlignment = std::size_t(std::max( align, 16 ));
+}
+
+void MultiDrawBatch::set_view( Frustum const& aFrustum, Vec3f aCameraPosition ) noexcept
+{
+	mHasView = true;
+	mFrustum = aFrustum;
+	mCameraPosition = aCameraPosition;
+	mMeshletStats = MeshletStats{};
+}
+
+void MultiDrawBatch::clear_view() noexcept
+{
+	mHasView = false;
+	mMeshletStats = MeshletStats{};
+}
+
+void MultiDrawBatch::add( StaticGeometry::MeshId aMesh, Material const& aMaterial, Mat44f const& aWorld, Mat33f const& aNormal, std::uint32_t aLod )
+{
+	assert( !aMaterial.emissive );
+
+	auto const& mesh = mGeometry->mesh( aMesh );
+
+	Item_ item{};
+	item.state = state_index_( aMaterial );
+	item.record = std::uint32_t(mRecords.size());
+	item.baseVertex = mesh.baseVertex;
+
+	if( aLod > 0 )
+	{
+		assert( aLod < mesh.lodCount );
+		auto const& lod = mGeometry->lods( aMesh )[aLod];
+		item.firstIndex = lod.firstIndex;
+		item.indexCount = lod.indexCount;
+		mItems.emplace_back( item );
+	}
+	else if( 0 == mesh.meshletCount || !mHasView )
+	{
+		item.firstIndex = mesh.firstIndex;
+		item.indexCount = mesh.indexCount;
+		mItems.emplace_back( item );
+	}
+	else
+	{
+		auto const* meshlets = mGeometry->meshlets( aMesh );
+		std::size_t const firstItem = mItems.size();
+
+		for( std::uint32_t i = 0; i < mesh.meshletCount; ++i )
+		{
+			auto const& m = meshlets[i];
+
+			Vec3f center;
+			float radius;
+			transform_sphere( aWorld, m.center, m.radius, center, radius );
+
+			auto const axis = aNormal * m.coneAxis;
+			float const axisLen = length( axis );
+			bool const coneCull = aMaterial.cullFace && m.coneCutoff < 1.f && axisLen > 0.f;
+
+			if( !meshlet_visible( mFrustum, mCameraPosition, center, radius, coneCull ? axis / axisLen : axis, m.coneCutoff, coneCull ) )
+				continue;
+
+			// Merge with the previous meshlet if they are adjacent in the
+			// index buffer (they are, unless a meshlet was culled between)
+			if( mItems.size() > firstItem && mItems.back().firstIndex + mItems.back().indexCount == m.firstIndex )
+			{
+				mItems.back().indexCount += m.indexCount;
+			}
+			else
+			{
+				item.firstIndex = m.firstIndex;
+				item.indexCount = m.indexCount;
+				mItems.emplace_back( item );
+			}
+
+			++mMeshletStats.visible;
+		}
+
+		mMeshletStats.tested += mesh.meshletCount;
+
+		// Nothing visible; skip the record too
+		if( mItems.size() == firstItem )
+			return;
+	}
+
+	DrawRecord record{};
+	std::memcpy( record.model, aWorld.v, sizeof(record.model) );
+	for( std::size_t i = 0; i < 3; ++i )
+	{
+		for( std::size_t j = 0; j < 3; ++j )
+			record.normal[i*4+j] = aNormal( i, j );
+		record.normal[i*4+3] = 0.f;
+	}
+
+	record.flags[0] = aMaterial.textured ? 1.f : 0.f;
+	record.flags[1] = 0.f;
+	record.flags[2] = aMaterial.multiTextured ? 1.f : 0.f;
+	record.flags[3] = 0.f;
+
+	mRecords.emplace_back( record );
+}
+
+std::size_t MultiDrawBatch::submit()
+{
+	PROFILE_ZONE( "multi-draw submit" );
+
+	if( mItems.empty() )
+		return 0;
+
+	// Group the draws by state (counting sort; there are only a handful of
+	// distinct states). The baseInstance selects the record.
+	auto const stateCount = mStates.size();
+	mStateOffsets.assign( stateCount+1, 0 );
+	for( auto const& item : mItems )
+		++mStateOffsets[item.state+1];
+	for( std::size_t i = 0; i < stateCount; ++i )
+		mStateOffsets[i+1] += mStateOffsets[i];
+
+	mCommands.resize( mItems.size() );
+
+	std::vector<std::size_t> cursor( mStateOffsets.begin(), mStateOffsets.end()-1 );
+	std::uint64_t triangles = 0;
+	for( auto const& item : mItems )
+	{
+		triangles += item.indexCount / 3;
+
+		auto const index = cursor[item.state]++;
+		mCommands[index] = DrawElementsIndirectCommand{
+			item.indexCount,
+			1,
+			item.firstIndex,
+			item.baseVertex,
+			item.record
+		};
+	}
+
+	// Upload into this frame's region of the stream buffer. The SSBO range
+	// starts at the first record, so record indices stay zero-based.
+	auto const records = mStream->upload( mRecords.data(), mRecords.size() * sizeof(DrawRecord), mRecordAlignment );
+	glBindBufferRange( GL_SHADER_STORAGE_BUFFER, 0, records.buffer, records.offset, records.size );
+
+	auto const commands = mStream->upload( mCommands.data(), mCommands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint) );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, commands.buffer );
+
+	mGeometry->reserve_draw_ids( mRecords.size() );
+
+	// Draw. The commands are in a GL buffer, so count their triangles here.
+	count_render( kRenderPrimitives, triangles );
+
+	glstate::bind_vertex_array( mGeometry->vao() );
+	glUniform1f( 10, 1.f );
+
+	std::size_t calls = 0;
+	for( std::size_t i = 0; i < stateCount; ++i )
+	{
+		auto const first = mStateOffsets[i];
+		auto const count = mStateOffsets[i+1] - first;
+		if( 0 == count )
+			continue;
+
+		auto const& state = mStates[i];
+		glstate::set_enabled( GL_CULL_FACE, state.cullFace );
+		glstate::bind_texture( 1, GL_TEXTURE_2D, state.textures[1] );
+		glstate::bind_texture( 0, GL_TEXTURE_2D, state.textures[0] );
+
+		glMultiDrawElementsIndirect(
+			GL_TRIANGLES,
+			GL_UNSIGNED_INT,
+			reinterpret_cast<void const*>(commands.offset + first * sizeof(DrawElementsIndirectCommand)),
+			GLsizei(count),
+			0 // tightly packed
+		);
+		++calls;
+	}
+
+	glUniform1f( 10, 0.f );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+	glstate::enable( GL_CULL_FACE );
+
+	clear();
+	return calls;
+}
+
+void MultiDrawBatch::clear() noexcept
+{
+	mItems.clear();
+	mRecords.clear();
+}
+
+std::size_t MultiDrawBatch::size() const noexcept
+{
+	return mItems.size();
+}
+
+MultiDrawBatch::MeshletStats const& MultiDrawBatch::meshlet_stats() const noexcept
+{
+	return mMeshletStats;
+}
+
+std::uint32_t MultiDrawBatch::state_index_( Material const& aMaterial )
+{
+	State_ const state{
+		{
+			aMaterial.textured ? aMaterial.textures[0] : 0,
+			aMaterial.textured && aMaterial.multiTextured ? aMaterial.textures[1] : 0
+		},
+		aMaterial.cullFace
+	};
+
+	for( std::size_t i = 0; i < mStates.size(); ++i )
+	{
+		auto const& s = mStates[i];
+		if( s.textures[0] == state.textures[0] && s.textures[1] == state.textures[1] && s.cullFace == state.cullFace )
+			return std::uint32_t(i);
+	}
+
+	mStates.emplace_back( state );
+	return std::uint32_t(mStates.size()-1);
+}
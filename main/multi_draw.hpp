@@ -0,0 +1,138 @@
+#ifndef MULTI_DRAW_HPP
+#define MULTI_DRAW_HPP
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/mat33.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/stream_buffer.hpp"
+
+#include "culling.hpp"
+#include "components.hpp"
+#include "static_geometry.hpp"
+
+// Per-draw data, as read by default.vert from the DrawRecords SSBO (std430).
+// Matrices are stored row by row; the normal matrix rows are padded to vec4.
+struct DrawRecord
+{
+	float model[16];
+	float normal[12];
+	float flags[4]; // isTex, isEmi, isMulti, unused
+};
+
+static_assert( sizeof(DrawRecord) == 128, "DrawRecord must match the std430 layout in default.vert" );
+
+// Matches the layout expected by glMultiDrawElementsIndirect().
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/** MultiDrawBatch: draws StaticGeometry meshes with glMultiDrawElementsIndirect
+ *
+ * Draws are queued with add(). submit() sorts them by render state (textures
+ * and face culling) and issues one glMultiDrawElementsIndirect() per state.
+ * The model/normal matrices and material flags of each draw are written to
+ * an SSBO (binding 0); the vertex shader selects its record with the draw ID
+ * attribute set up by StaticGeometry (the command's baseInstance is the
+ * record index). Records and commands are written to a StreamBuffer, and
+ * are only valid for its current frame.
+ *
+ * Clustered meshes (see StaticGeometry) are culled per meshlet in add(),
+ * once a view has been given with set_view(): each meshlet that is outside
+ * of the frustum or that faces away from the camera is dropped, and the
+ * remaining meshlets become separate commands that share the object's
+ * record. The backface (normal cone) test is only used for materials that
+ * are drawn with face culling, and assumes that the world transform does not
+ * scale non-uniformly.
+ *
+ * Emissive materials are not supported, as they require per-object fragment
+ * shader uniforms; draw these with the classic path.
+ *
+ * submit() expects the default program to be bound. It sets the isBatched
+ * uniform (location 10) for the duration of the draws.
+ */
+class MultiDrawBatch final
+{
+	public:
+		MultiDrawBatch( StaticGeometry&, StreamBuffer& );
+
+		MultiDrawBatch( MultiDrawBatch const& ) = delete;
+		MultiDrawBatch& operator= (MultiDrawBatch const&) = delete;
+
+	public:
+		// Enable meshlet culling against the given (world space) frustum and
+		// camera position. Also resets the meshlet stats.
+		void set_view( Frustum const&, Vec3f aCameraPosition ) noexcept;
+		// Disable meshlet culling (clustered meshes are drawn whole)
+		void clear_view() noexcept;
+
+		// Meshlet culling only applies to LOD 0.
+		void add( StaticGeometry::MeshId, Material const&, Mat44f const& aWorld, Mat33f const& aNormal, std::uint32_t aLod = 0 );
+
+		// Issue all queued draws and clear the batch. Returns the number of
+		// glMultiDrawElementsIndirect() calls.
+		std::size_t submit();
+
+		void clear() noexcept;
+
+	public:
+		// Number of queued draws (commands)
+		std::size_t size() const noexcept;
+
+		// Meshlets tested/visible since the last set_view()
+		struct MeshletStats
+		{
+			std::size_t tested = 0;
+			std::size_t visible = 0;
+		};
+
+		MeshletStats const& meshlet_stats() const noexcept;
+
+	private:
+		struct State_
+		{
+			GLuint textures[2];
+			bool cullFace;
+		};
+		struct Item_
+		{
+			std::uint32_t state;
+			std::uint32_t record; // index into mRecords
+			GLuint firstIndex;
+			GLuint indexCount;
+			GLint baseVertex;
+		};
+
+		std::uint32_t state_index_( Material const& );
+
+	private:
+		StaticGeometry* mGeometry;
+		StreamBuffer* mStream;
+		std::size_t mRecordAlignment; // GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+
+		std::vector<State_> mStates;
+		std::vector<Item_> mItems;
+		std::vector<DrawRecord> mRecords;
+
+		bool mHasView = false;
+		Frustum mFrustum;
+		Vec3f mCameraPosition;
+		MeshletStats mMeshletStats;
+
+		// Scratch space for submit(), kept to avoid reallocations
+		std::vector<DrawElementsIndirectCommand> mCommands;
+		std::vector<std::size_t> mStateOffsets;
+};
+
+#endif // MULTI_DRAW_HPP
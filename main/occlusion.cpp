@@ -0,0 +1,346 @@
+#include "occlusion.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#if defined(__AVX__)
+#	include <immintrin.h>
+#endif
+
+#include "../vmlib/vec4.hpp"
+
+#include "../support/profiler.hpp"
+
+namespace
+{
+	// Rows per band in rasterize(). Small enough to keep all threads busy,
+	// large enough to amortize the per-band triangle loop.
+	constexpr int kBandHeight_ = 16;
+
+	// Stop building the pyramid at this size
+	constexpr std::size_t kMinLevelSize_ = 4;
+
+	// test() picks the pyramid level at which the object covers at most this
+	// many texels in each direction.
+	constexpr int kMaxTestTexels_ = 4;
+
+	float cross_area_( Vec3f const& aA, Vec3f const& aB, Vec3f const& aC ) noexcept
+	{
+		return 0.5f * length( cross( aB - aA, aC - aA ) );
+	}
+}
+
+OccluderMesh make_occluder( std::vector<Vec3f> const& aTriangleSoup, float aMinArea )
+{
+	OccluderMesh ret;
+	for( std::size_t i = 0; i+2 < aTriangleSoup.size(); i += 3 )
+	{
+		auto const& a = aTriangleSoup[i+0];
+		auto const& b = aTriangleSoup[i+1];
+		auto const& c = aTriangleSoup[i+2];
+
+		if( cross_area_( a, b, c ) < aMinArea )
+			continue;
+
+		auto const base = std::uint32_t(ret.positions.size());
+		ret.positions.insert( ret.positions.end(), { a, b, c } );
+		ret.indices.insert( ret.indices.end(), { base, base+1, base+2 } );
+	}
+
+	return ret;
+}
+
+
+OcclusionBuffer::OcclusionBuffer( std::size_t aWidth, std::size_t aHeight )
+	: mWidth( (std::max<std::size_t>( aWidth, 8 ) + 7) & ~std::size_t(7) )
+	, mHeight( std::max<std::size_t>( aHeight, 1 ) )
+	, mViewProj( kIdentity44f )
+{
+	auto w = mWidth, h = mHeight;
+	while( true )
+	{
+		mLevels.emplace_back( w*h, 1.f );
+		mLevelWidth.emplace_back( w );
+		mLevelHeight.emplace_back( h );
+
+		if( w <= kMinLevelSize_ && h <= kMinLevelSize_ )
+			break;
+
+		w = (w+1) / 2;
+		h = (h+1) / 2;
+	}
+}
+
+void OcclusionBuffer::begin( Mat44f const& aViewProj )
+{
+	mViewProj = aViewProj;
+	mTriangles.clear();
+}
+
+void OcclusionBuffer::add_occluder( OccluderMesh const& aMesh, Mat44f const& aWorld )
+{
+	auto const xform = mViewProj * aWorld;
+	auto const fw = float(mWidth), fh = float(mHeight);
+
+	for( std::size_t i = 0; i+2 < aMesh.indices.size(); i += 3 )
+	{
+		Triangle_ tri;
+		bool clipped = false;
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const& p = aMesh.positions[aMesh.indices[i+j]];
+			auto const c = xform * Vec4f{ p.x, p.y, p.z, 1.f };
+
+			// Drop triangles that reach behind the near plane
+			if( c.z < -c.w || c.w <= 0.f )
+			{
+				clipped = true;
+				break;
+			}
+
+			float const iw = 1.f / c.w;
+			tri.x[j] = (c.x * iw * 0.5f + 0.5f) * fw;
+			tri.y[j] = (c.y * iw * 0.5f + 0.5f) * fh;
+			tri.z[j] = std::min( 1.f, c.z * iw * 0.5f + 0.5f );
+		}
+
+		if( clipped )
+			continue;
+
+		// Pixel centers covered by the bounding box
+		tri.minX = std::max( 0, int(std::ceil( std::min( { tri.x[0], tri.x[1], tri.x[2] } ) - 0.5f )) );
+		tri.maxX = std::min( int(mWidth)-1, int(std::floor( std::max( { tri.x[0], tri.x[1], tri.x[2] } ) - 0.5f )) );
+		tri.minY = std::max( 0, int(std::ceil( std::min( { tri.y[0], tri.y[1], tri.y[2] } ) - 0.5f )) );
+		tri.maxY = std::min( int(mHeight)-1, int(std::floor( std::max( { tri.y[0], tri.y[1], tri.y[2] } ) - 0.5f )) );
+
+		if( tri.minX > tri.maxX || tri.minY > tri.maxY )
+			continue;
+
+		mTriangles.emplace_back( tri );
+	}
+}
+
+void OcclusionBuffer::rasterize( JobSystem& aJobs )
+{
+	PROFILE_ZONE( "rasterize occluders" );
+
+	auto& depth = mLevels[0];
+	std::fill( depth.begin(), depth.end(), 1.f );
+
+	auto const bands = (mHeight + kBandHeight_-1) / kBandHeight_;
+	aJobs.parallel_for( 0, bands, 1, [this] ( std::size_t aBegin, std::size_t aEnd ) {
+		for( auto b = aBegin; b < aEnd; ++b )
+		{
+			int const minY = int(b) * kBandHeight_;
+			int const maxY = std::min( int(mHeight), minY + kBandHeight_ ) - 1;
+			rasterize_band_( minY, maxY );
+		}
+	} );
+
+	build_pyramid_();
+}
+
+bool OcclusionBuffer::test( Vec3f aMin, Vec3f aMax, Mat44f const& aWorld ) const noexcept
+{
+	auto const xform = mViewProj * aWorld;
+
+	float minX = std::numeric_limits<float>::max(), maxX = -minX;
+	float minY = minX, maxY = -minX;
+	float minZ = 1.f;
+
+	for( int i = 0; i < 8; ++i )
+	{
+		Vec4f const p{
+			(i & 1) ? aMax.x : aMin.x,
+			(i & 2) ? aMax.y : aMin.y,
+			(i & 4) ? aMax.z : aMin.z,
+			1.f
+		};
+
+		auto const c = xform * p;
+
+		// Box reaches behind the near plane: can't say anything
+		if( c.z < -c.w || c.w <= 0.f )
+			return true;
+
+		float const iw = 1.f / c.w;
+		float const x = (c.x * iw * 0.5f + 0.5f) * float(mWidth);
+		float const y = (c.y * iw * 0.5f + 0.5f) * float(mHeight);
+		float const z = c.z * iw * 0.5f + 0.5f;
+
+		minX = std::min( minX, x ); maxX = std::max( maxX, x );
+		minY = std::min( minY, y ); maxY = std::max( maxY, y );
+		minZ = std::min( minZ, z );
+	}
+
+	// All pixels touched by the screen-space rectangle
+	int x0 = std::max( 0, int(std::floor( minX )) );
+	int x1 = std::min( int(mWidth)-1, int(std::floor( maxX )) );
+	int y0 = std::max( 0, int(std::floor( minY )) );
+	int y1 = std::min( int(mHeight)-1, int(std::floor( maxY )) );
+
+	if( x0 > x1 || y0 > y1 )
+		return true; // off-screen; leave that to frustum culling
+
+	std::size_t level = 0;
+	while( level+1 < mLevels.size() && ((x1 >> level) - (x0 >> level) >= kMaxTestTexels_ || (y1 >> level) - (y0 >> level) >= kMaxTestTexels_) )
+		++level;
+
+	x0 >>= level; x1 >>= level;
+	y0 >>= level; y1 >>= level;
+
+	auto const& data = mLevels[level];
+	auto const w = mLevelWidth[level];
+	for( int y = y0; y <= y1; ++y )
+	{
+		for( int x = x0; x <= x1; ++x )
+		{
+			if( data[y*w + x] >= minZ )
+				return true;
+		}
+	}
+
+	return false;
+}
+
+std::size_t OcclusionBuffer::width() const noexcept
+{
+	return mWidth;
+}
+std::size_t OcclusionBuffer::height() const noexcept
+{
+	return mHeight;
+}
+
+std::size_t OcclusionBuffer::triangle_count() const noexcept
+{
+	return mTriangles.size();
+}
+
+float OcclusionBuffer::depth( std::size_t aX, std::size_t aY ) const noexcept
+{
+	assert( aX < mWidth && aY < mHeight );
+	return mLevels[0][aY*mWidth + aX];
+}
+
+void OcclusionBuffer::rasterize_band_( int aMinY, int aMaxY ) noexcept
+{
+	auto* const depth = mLevels[0].data();
+
+	for( auto const& tri : mTriangles )
+	{
+		int const minY = std::max( tri.minY, aMinY );
+		int const maxY = std::min( tri.maxY, aMaxY );
+		if( minY > maxY )
+			continue;
+
+		// Edge functions e_i(x,y) = a_i*x + b_i*y + c_i, for the edge
+		// opposite of vertex i. Flip them for clockwise triangles, so that
+		// the inside is always where all three are non-negative.
+		float a[3], b[3], c[3];
+		for( int i = 0; i < 3; ++i )
+		{
+			int const j = (i+1) % 3, k = (i+2) % 3;
+			a[i] = tri.y[j] - tri.y[k];
+			b[i] = tri.x[k] - tri.x[j];
+			c[i] = tri.x[j]*tri.y[k] - tri.x[k]*tri.y[j];
+		}
+
+		float const area = c[0] + c[1] + c[2];
+		if( 0.f == area )
+			continue;
+
+		float const sign = area > 0.f ? 1.f : -1.f;
+		for( int i = 0; i < 3; ++i )
+		{
+			a[i] *= sign;
+			b[i] *= sign;
+			c[i] *= sign;
+		}
+
+		// Depth is affine in screen space: z(x,y) = za*x + zb*y + zc
+		float const ia = 1.f / std::abs( area );
+		float const za = (a[0]*tri.z[0] + a[1]*tri.z[1] + a[2]*tri.z[2]) * ia;
+		float const zb = (b[0]*tri.z[0] + b[1]*tri.z[1] + b[2]*tri.z[2]) * ia;
+		float const zc = (c[0]*tri.z[0] + c[1]*tri.z[1] + c[2]*tri.z[2]) * ia;
+
+		int const minX = tri.minX & ~7;
+
+		for( int y = minY; y <= maxY; ++y )
+		{
+			float const py = float(y) + 0.5f;
+			float* const row = depth + std::size_t(y)*mWidth;
+
+#			if defined(__AVX__)
+			__m256 const offs = _mm256_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f );
+			__m256 const zero = _mm256_setzero_ps();
+
+			__m256 const a0 = _mm256_set1_ps( a[0] ), a1 = _mm256_set1_ps( a[1] ), a2 = _mm256_set1_ps( a[2] );
+			__m256 const r0 = _mm256_set1_ps( b[0]*py + c[0] );
+			__m256 const r1 = _mm256_set1_ps( b[1]*py + c[1] );
+			__m256 const r2 = _mm256_set1_ps( b[2]*py + c[2] );
+			__m256 const za8 = _mm256_set1_ps( za );
+			__m256 const zr = _mm256_set1_ps( zb*py + zc );
+
+			for( int x = minX; x <= tri.maxX; x += 8 )
+			{
+				__m256 const px = _mm256_add_ps( _mm256_set1_ps( float(x) ), offs );
+
+				__m256 const e0 = _mm256_add_ps( _mm256_mul_ps( a0, px ), r0 );
+				__m256 const e1 = _mm256_add_ps( _mm256_mul_ps( a1, px ), r1 );
+				__m256 const e2 = _mm256_add_ps( _mm256_mul_ps( a2, px ), r2 );
+
+				__m256 const inside = _mm256_and_ps(
+					_mm256_cmp_ps( e0, zero, _CMP_GE_OQ ),
+					_mm256_and_ps( _mm256_cmp_ps( e1, zero, _CMP_GE_OQ ), _mm256_cmp_ps( e2, zero, _CMP_GE_OQ ) )
+				);
+
+				if( 0 == _mm256_movemask_ps( inside ) )
+					continue;
+
+				__m256 const z = _mm256_add_ps( _mm256_mul_ps( za8, px ), zr );
+				__m256 const old = _mm256_loadu_ps( row + x );
+				_mm256_storeu_ps( row + x, _mm256_blendv_ps( old, _mm256_min_ps( old, z ), inside ) );
+			}
+#			else // !__AVX__
+			for( int x = tri.minX; x <= tri.maxX; ++x )
+			{
+				float const px = float(x) + 0.5f;
+				if( a[0]*px + b[0]*py + c[0] < 0.f || a[1]*px + b[1]*py + c[1] < 0.f || a[2]*px + b[2]*py + c[2] < 0.f )
+					continue;
+
+				float const z = za*px + zb*py + zc;
+				row[x] = std::min( row[x], z );
+			}
+#			endif // ~ __AVX__
+		}
+	}
+}
+
+void OcclusionBuffer::build_pyramid_()
+{
+	for( std::size_t l = 1; l < mLevels.size(); ++l )
+	{
+		auto const& src = mLevels[l-1];
+		auto const sw = mLevelWidth[l-1], sh = mLevelHeight[l-1];
+
+		auto& dst = mLevels[l];
+		auto const dw = mLevelWidth[l], dh = mLevelHeight[l];
+
+		for( std::size_t y = 0; y < dh; ++y )
+		{
+			auto const y0 = 2*y, y1 = std::min( 2*y+1, sh-1 );
+			for( std::size_t x = 0; x < dw; ++x )
+			{
+				auto const x0 = 2*x, x1 = std::min( 2*x+1, sw-1 );
+				dst[y*dw + x] = std::max(
+					std::max( src[y0*sw + x0], src[y0*sw + x1] ),
+					std::max( src[y1*sw + x0], src[y1*sw + x1] )
+				);
+			}
+		}
+	}
+}
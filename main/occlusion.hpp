@@ -0,0 +1,95 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+// Software occlusion culling: occluders are rasterized into a small depth
+// buffer on the CPU, and objects are tested against a hierarchical (max)
+// depth pyramid built from it. Like culling.hpp, this only depends on vmlib
+// (and the job system) and makes no OpenGL calls.
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/jobs.hpp"
+
+// Low-poly occluder geometry (object space, indexed triangles).
+struct OccluderMesh
+{
+	std::vector<Vec3f> positions;
+	std::vector<std::uint32_t> indices;
+};
+
+// Build an occluder from a triangle soup (e.g., SimpleMeshData::positions) by
+// keeping only triangles with an area of at least aMinArea. Large triangles
+// (walls, floors) do most of the occluding; small ones mainly cost time.
+// Vertices are not shared between triangles.
+OccluderMesh make_occluder( std::vector<Vec3f> const& aTriangleSoup, float aMinArea );
+
+/** OcclusionBuffer: CPU depth buffer for occlusion culling
+ *
+ * Usage, per frame:
+ *   buf.begin( projection * world2camera );
+ *   buf.add_occluder( mesh, world ); // for each occluder
+ *   buf.rasterize( jobs );
+ *   visible = buf.test( bounds.min, bounds.max, world ); // for each object
+ *
+ * Occluders are rendered double-sided. Triangles that cross the near plane
+ * are dropped, which only makes the culling more conservative. rasterize()
+ * splits the buffer into horizontal bands that are filled in parallel; the
+ * inner loop handles eight pixels at a time with AVX if available.
+ *
+ * Depth is stored as NDC depth mapped to [0,1] (1 = far plane).
+ */
+class OcclusionBuffer final
+{
+	public:
+		explicit OcclusionBuffer( std::size_t aWidth = 320, std::size_t aHeight = 192 );
+
+	public:
+		void begin( Mat44f const& aViewProj );
+
+		void add_occluder( OccluderMesh const&, Mat44f const& aWorld );
+
+		// Rasterize all occluders and build the depth pyramid.
+		void rasterize( JobSystem& );
+
+		// True if an object with the object-space bounding box [aMin, aMax]
+		// placed at aWorld may be visible. Only valid after rasterize().
+		bool test( Vec3f aMin, Vec3f aMax, Mat44f const& aWorld ) const noexcept;
+
+	public:
+		std::size_t width() const noexcept;
+		std::size_t height() const noexcept;
+
+		// Number of triangles rasterized in the current frame
+		std::size_t triangle_count() const noexcept;
+
+		// Level 0 depth at pixel (aX, aY)
+		float depth( std::size_t aX, std::size_t aY ) const noexcept;
+
+	private:
+		struct Triangle_
+		{
+			float x[3], y[3], z[3]; // pixels; depth in [0,1]
+			int minX, maxX, minY, maxY;
+		};
+
+		void rasterize_band_( int aMinY, int aMaxY ) noexcept;
+		void build_pyramid_();
+
+	private:
+		std::size_t mWidth, mHeight; // mWidth is a multiple of 8
+		Mat44f mViewProj;
+
+		std::vector<Triangle_> mTriangles;
+
+		// Max-depth pyramid; level 0 is the full resolution depth buffer
+		std::vector<std::vector<float>> mLevels;
+		std::vector<std::size_t> mLevelWidth, mLevelHeight;
+};
+
+#endif // OCCLUSION_HPP
@@ -0,0 +1,388 @@
+#include "path_tracer.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat33.hpp"
+
+namespace
+{
+	constexpr float kPi_ = 3.1415926f;
+
+	constexpr std::size_t kTileSize_ = 32;
+
+	// Paths are terminated with Russian roulette after this many bounces, and
+	// unconditionally after kMaxBounces_.
+	constexpr std::size_t kMinBounces_ = 2;
+	constexpr std::size_t kMaxBounces_ = 8;
+
+	// Translucent surfaces do not count as bounces, but are limited too.
+	constexpr std::size_t kMaxPassThrough_ = 16;
+
+	// Secondary rays start this far (relative to the scene size) off the
+	// surface, to avoid self-intersection.
+	constexpr float kRayOffset_ = 1e-5f;
+
+	Vec3f mul_( Vec3f aLeft, Vec3f aRight ) noexcept
+	{
+		return Vec3f{ aLeft.x * aRight.x, aLeft.y * aRight.y, aLeft.z * aRight.z };
+	}
+
+	Vec3f transform_point_( Mat44f const& aMat, Vec3f aPoint ) noexcept
+	{
+		auto const p = aMat * Vec4f{ aPoint.x, aPoint.y, aPoint.z, 1.f };
+		return Vec3f{ p.x, p.y, p.z } / p.w;
+	}
+
+	// Any unit vector orthogonal to aNormal
+	Vec3f orthogonal_( Vec3f aNormal ) noexcept
+	{
+		return std::abs( aNormal.x ) > 0.5f
+			? normalize( Vec3f{ -aNormal.y, aNormal.x, 0.f } )
+			: normalize( Vec3f{ 0.f, -aNormal.z, aNormal.y } )
+		;
+	}
+
+	// Per-vertex material attributes may be missing; same defaults as
+	// build_indexed_mesh()
+	template< typename tType >
+	tType attribute_( std::vector<tType> const& aValues, std::size_t aIndex, tType const& aDefault ) noexcept
+	{
+		return aIndex < aValues.size() ? aValues[aIndex] : aDefault;
+	}
+}
+
+// PCG32 (O'Neill, "PCG: A Family of Simple Fast Space-Efficient
+// Statistically Good Algorithms for Random Number Generation")
+struct PathTracer::Rng_
+{
+	std::uint64_t state;
+	std::uint64_t inc;
+
+	Rng_( std::uint64_t aSeed, std::uint64_t aStream ) noexcept
+		: state( 0 )
+		, inc( (aStream << 1u) | 1u )
+	{
+		next();
+		state += aSeed;
+		next();
+	}
+
+	std::uint32_t next() noexcept
+	{
+		auto const old = state;
+		state = old * 6364136223846793005ull + inc;
+		auto const xorshifted = std::uint32_t(((old >> 18u) ^ old) >> 27u);
+		auto const rot = std::uint32_t(old >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((0u-rot) & 31u));
+	}
+
+	// Uniform in [0,1)
+	float uniform() noexcept
+	{
+		return (next() >> 8) * (1.f / 16777216.f);
+	}
+};
+
+PathTracer::PathTracer( SceneDescription const& aScene, JobSystem& aJobs )
+	: mLights( aScene.lights )
+{
+	std::vector<Vec3f> soup;
+
+	for( std::size_t i = 0; i < aScene.meshes.size(); ++i )
+	{
+		auto const& desc = aScene.meshes[i];
+		auto const& mesh = desc.mesh;
+
+		auto const world = scene_mesh_world( aScene, i );
+		auto const normalMat = mat44_to_mat33( transpose( invert( world ) ) );
+
+		auto texture = kNoTexture_;
+		bool const hasTexcoords = mesh.texcoords.size() == mesh.positions.size();
+		if( desc.texture && hasTexcoords )
+		{
+			texture = std::uint32_t(mTextures.size());
+			mTextures.emplace_back( desc.texture );
+		}
+
+		for( std::size_t v = 0; v+2 < mesh.positions.size(); v += 3 )
+		{
+			Triangle_ tri;
+
+			Vec3f p[3];
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				p[k] = transform_point_( world, mesh.positions[v+k] );
+				tri.normals[k] = normalize( normalMat * mesh.normals[v+k] );
+				tri.texcoords[k] = hasTexcoords ? mesh.texcoords[v+k] : Vec2f{ 0.f, 0.f };
+				soup.emplace_back( p[k] );
+			}
+
+			auto const n = cross( p[1] - p[0], p[2] - p[0] );
+			auto const len = length( n );
+			tri.geometricNormal = len > 0.f ? n / len : tri.normals[0];
+
+			// Materials are stored per vertex, but are constant per face.
+			auto const& material = mesh.material;
+			tri.diffuse = attribute_( material.diffuse, v, Vec3f{ 0.f, 0.f, 0.f } );
+			tri.specular = attribute_( material.specular, v, Vec3f{ 0.f, 0.f, 0.f } );
+			tri.shininess = attribute_( material.shininess, v, 1.f );
+			tri.alpha = attribute_( material.alpha, v, 1.f );
+			tri.texture = texture;
+
+			mTriangles.emplace_back( tri );
+		}
+	}
+
+	mBvh = Bvh( soup, aJobs );
+
+	if( !aScene.skyboxFaces.empty() )
+		mSkybox = CpuCubemap( aScene.skyboxFaces );
+}
+
+void PathTracer::reset( std::size_t aWidth, std::size_t aHeight, SceneCamera const& aCamera )
+{
+	assert( aWidth > 0 && aHeight > 0 );
+
+	mWidth = aWidth;
+	mHeight = aHeight;
+	mTilesX = (aWidth + kTileSize_ - 1) / kTileSize_;
+	mTilesY = (aHeight + kTileSize_ - 1) / kTileSize_;
+	mPasses = 0;
+	mRays = 0;
+
+	mCamera2World = invert( scene_camera_world2camera( aCamera ) );
+	mTanHalfFovY = std::tan( 0.5f * aCamera.fovY );
+
+	mAccum.assign( aWidth * aHeight, Vec3f{ 0.f, 0.f, 0.f } );
+}
+
+void PathTracer::trace_pass( JobSystem& aJobs )
+{
+	assert( !mAccum.empty() );
+
+	// One job per tile. Tiles take very different amounts of time (sky vs.
+	// geometry), so let the job system balance them.
+	aJobs.parallel_for( 0, mTilesX * mTilesY, 1, [this] (std::size_t aBegin, std::size_t aEnd) {
+		for( auto i = aBegin; i < aEnd; ++i )
+			trace_tile_( i );
+	} );
+
+	++mPasses;
+}
+
+std::vector<unsigned char> PathTracer::resolve() const
+{
+	std::vector<unsigned char> ret( mWidth * mHeight * 3 );
+
+	float const scale = mPasses ? 1.f / mPasses : 0.f;
+	for( std::size_t i = 0; i < mAccum.size(); ++i )
+	{
+		auto const c = mAccum[i] * scale;
+		ret[i*3+0] = linear_to_srgb8( c.x );
+		ret[i*3+1] = linear_to_srgb8( c.y );
+		ret[i*3+2] = linear_to_srgb8( c.z );
+	}
+
+	return ret;
+}
+
+std::size_t PathTracer::width() const noexcept
+{
+	return mWidth;
+}
+std::size_t PathTracer::height() const noexcept
+{
+	return mHeight;
+}
+
+std::size_t PathTracer::pass_count() const noexcept
+{
+	return mPasses;
+}
+
+std::uint64_t PathTracer::ray_count() const noexcept
+{
+	return mRays.load( std::memory_order_relaxed );
+}
+
+std::size_t PathTracer::triangle_count() const noexcept
+{
+	return mTriangles.size();
+}
+
+
+void PathTracer::trace_tile_( std::size_t aTile )
+{
+	auto const x0 = (aTile % mTilesX) * kTileSize_;
+	auto const y0 = (aTile / mTilesX) * kTileSize_;
+	auto const x1 = std::min( x0 + kTileSize_, mWidth );
+	auto const y1 = std::min( y0 + kTileSize_, mHeight );
+
+	auto const origin = transform_point_( mCamera2World, Vec3f{ 0.f, 0.f, 0.f } );
+	float const aspect = float(mWidth) / float(mHeight);
+
+	std::uint64_t rays = 0;
+	for( auto y = y0; y < y1; ++y )
+	{
+		for( auto x = x0; x < x1; ++x )
+		{
+			auto const pixel = y * mWidth + x;
+			Rng_ rng( pixel, mPasses );
+
+			// Jittered position in the pixel, in NDC (y up, row 0 at the top)
+			float const ndcX = 2.f * (x + rng.uniform()) / mWidth - 1.f;
+			float const ndcY = 1.f - 2.f * (y + rng.uniform()) / mHeight;
+
+			auto const target = transform_point_( mCamera2World, Vec3f{
+				ndcX * mTanHalfFovY * aspect,
+				ndcY * mTanHalfFovY,
+				-1.f
+			} );
+
+			mAccum[pixel] += trace_path_( origin, normalize( target - origin ), rng, rays );
+		}
+	}
+
+	mRays.fetch_add( rays, std::memory_order_relaxed );
+}
+
+Vec3f PathTracer::trace_path_( Vec3f aOrigin, Vec3f aDirection, Rng_& aRng, std::uint64_t& aRays ) const noexcept
+{
+	Vec3f radiance{ 0.f, 0.f, 0.f };
+	Vec3f throughput{ 1.f, 1.f, 1.f };
+
+	// Nothing to hit (and no bounds to derive the ray offset from)
+	if( mBvh.empty() )
+	{
+		++aRays;
+		if( !mSkybox.empty() )
+			radiance = mSkybox.sample( aDirection );
+		return radiance;
+	}
+
+	auto const sceneMin = mBvh.bounds_min(), sceneMax = mBvh.bounds_max();
+	float const offset = kRayOffset_ * (1.f + std::max( length( sceneMin ), length( sceneMax ) ));
+
+	auto origin = aOrigin, dir = aDirection;
+	std::size_t bounces = 0, passes = 0;
+	while( true )
+	{
+		++aRays;
+
+		BvhHit hit;
+		if( !mBvh.raycast( origin, dir, 1e30f, hit ) )
+		{
+			if( !mSkybox.empty() )
+				radiance += mul_( throughput, mSkybox.sample( dir ) );
+			break;
+		}
+
+		auto const& tri = mTriangles[hit.triangle];
+		float const w = 1.f - hit.u - hit.v;
+
+		auto diffuse = tri.diffuse, specular = tri.specular;
+		float alpha = tri.alpha;
+		if( kNoTexture_ != tri.texture )
+		{
+			auto const uv = w * tri.texcoords[0] + hit.u * tri.texcoords[1] + hit.v * tri.texcoords[2];
+			auto const tex = mTextures[tri.texture].sample( uv );
+			Vec3f const texColor{ tex.x, tex.y, tex.z };
+
+			// default.frag multiplies the whole lighting result by the texture
+			diffuse = mul_( diffuse, texColor );
+			specular = mul_( specular, texColor );
+			alpha *= tex.w;
+		}
+
+		auto const position = origin + hit.t * dir;
+
+		// Translucency: continue straight through the surface
+		if( alpha < 1.f && aRng.uniform() >= alpha )
+		{
+			if( ++passes > kMaxPassThrough_ )
+				break;
+
+			origin = position + offset * dir;
+			continue;
+		}
+
+		// Triangles are double-sided. Shade the side that faces the ray.
+		auto normal = normalize( w * tri.normals[0] + hit.u * tri.normals[1] + hit.v * tri.normals[2] );
+		auto geometric = tri.geometricNormal;
+		if( dot( geometric, dir ) > 0.f )
+			geometric = -geometric;
+		if( dot( normal, geometric ) < 0.f )
+			normal = -normal;
+
+		auto const surfaceOrigin = position + offset * geometric;
+
+		radiance += mul_( throughput, direct_light_( position, normal, surfaceOrigin, -dir, diffuse, specular, tri.shininess, aRays ) );
+
+		// Indirect light: diffuse bounce, cosine-weighted. The Lambertian
+		// BRDF (diffuse / pi) times the cosine over the pdf (cos / pi) leaves
+		// just the diffuse colour.
+		if( ++bounces > kMaxBounces_ )
+			break;
+
+		throughput = mul_( throughput, diffuse );
+
+		if( bounces > kMinBounces_ )
+		{
+			float const survive = std::min( 0.95f, std::max( throughput.x, std::max( throughput.y, throughput.z ) ) );
+			if( aRng.uniform() >= survive )
+				break;
+
+			throughput /= survive;
+		}
+
+		float const r = std::sqrt( aRng.uniform() );
+		float const phi = 2.f * kPi_ * aRng.uniform();
+		auto const tangent = orthogonal_( normal );
+		auto const bitangent = cross( normal, tangent );
+
+		origin = surfaceOrigin;
+		dir = normalize( (r * std::cos( phi )) * tangent + (r * std::sin( phi )) * bitangent + std::sqrt( std::max( 0.f, 1.f - r*r ) ) * normal );
+		passes = 0;
+	}
+
+	return radiance;
+}
+
+Vec3f PathTracer::direct_light_( Vec3f aPosition, Vec3f aNormal, Vec3f aOffset, Vec3f aView, Vec3f aDiffuse, Vec3f aSpecular, float aShininess, std::uint64_t& aRays ) const noexcept
+{
+	Vec3f ret{ 0.f, 0.f, 0.f };
+
+	for( auto const& light : mLights )
+	{
+		auto const toLight = light.position - aPosition;
+		float const distance = length( toLight );
+		if( distance <= 0.f )
+			continue;
+
+		auto const lightDir = toLight / distance;
+		float const diff = dot( aNormal, lightDir );
+		if( diff <= 0.f )
+			continue;
+
+		++aRays;
+		if( mBvh.occluded( aOffset, light.position - aOffset, 1.f ) )
+			continue;
+
+		// As in default.frag (see ScenePointLight)
+		float const attenuation = 1.f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+
+		auto const halfDir = normalize( lightDir + aView );
+		float const spec = std::pow( std::max( 0.f, dot( aNormal, halfDir ) ), aShininess );
+
+		auto const diffuseColor = light.color * light.brightness;
+		auto const specularColor = light.color * light.specular;
+
+		ret += attenuation * (diff * mul_( diffuseColor, aDiffuse ) + spec * mul_( specularColor, aSpecular ));
+	}
+
+	return ret;
+}
@@ -0,0 +1,112 @@
+#ifndef PATH_TRACER_HPP
+#define PATH_TRACER_HPP
+
+// Offline reference renderer: a CPU path tracer for the scene description.
+// Used to check the shading of the OpenGL viewer against a ground truth
+// that includes shadows and indirect light. No OpenGL dependencies.
+
+#include <atomic>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec2.hpp"
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/jobs.hpp"
+
+#include "bvh.hpp"
+#include "cpu_texture.hpp"
+#include "scene_description.hpp"
+
+/** PathTracer: progressive path tracer over a SceneDescription
+ *
+ * All meshes are merged into one world-space triangle soup (in their rest
+ * pose) with a single Bvh. Materials are those of the viewer: the MTL
+ * diffuse and specular colours and shininess, with the diffuse texture (if
+ * any) multiplied in. Missing per-vertex material attributes get the
+ * defaults of build_indexed_mesh(). An empty scene shows only the skybox.
+ *
+ * Direct light from the point lights is evaluated exactly as in
+ * default.frag (Blinn-Phong, same attenuation), but with a shadow ray per
+ * light. The ambient term of default.frag is replaced by indirect light:
+ * cosine-weighted diffuse bounces, terminated with Russian roulette. Rays
+ * that leave the scene pick up the skybox. Translucent materials are handled
+ * stochastically (a ray passes through with probability 1 - alpha).
+ *
+ * Each trace_pass() adds one sample per pixel, so the image converges as
+ * passes accumulate. The image is split into tiles that are traced in
+ * parallel with the job system.
+ */
+class PathTracer final
+{
+	public:
+		// The meshes in aScene must be loaded (see load_scene_meshes()).
+		// Throws Error if a texture cannot be loaded.
+		PathTracer( SceneDescription const& aScene, JobSystem& );
+
+	public:
+		// Resize and clear the image. Must be called before trace_pass().
+		void reset( std::size_t aWidth, std::size_t aHeight, SceneCamera const& );
+
+		// Add one sample per pixel.
+		void trace_pass( JobSystem& );
+
+		// Accumulated image as 8-bit sRGB, RGB interleaved, top row first.
+		std::vector<unsigned char> resolve() const;
+
+	public:
+		std::size_t width() const noexcept;
+		std::size_t height() const noexcept;
+
+		std::size_t pass_count() const noexcept;
+
+		// Rays cast since the last reset() (camera, bounce and shadow rays)
+		std::uint64_t ray_count() const noexcept;
+
+		std::size_t triangle_count() const noexcept;
+
+	private:
+		struct Triangle_
+		{
+			Vec3f normals[3]; // world space
+			Vec2f texcoords[3];
+			Vec3f geometricNormal; // normalized, world space
+
+			Vec3f diffuse;
+			Vec3f specular;
+			float shininess;
+			float alpha;
+
+			std::uint32_t texture; // index into mTextures, or kNoTexture_
+		};
+
+		static constexpr std::uint32_t kNoTexture_ = ~std::uint32_t(0);
+
+		struct Rng_;
+
+		void trace_tile_( std::size_t aTile );
+		Vec3f trace_path_( Vec3f aOrigin, Vec3f aDirection, Rng_&, std::uint64_t& aRays ) const noexcept;
+		Vec3f direct_light_( Vec3f aPosition, Vec3f aNormal, Vec3f aOffset, Vec3f aView, Vec3f aDiffuse, Vec3f aSpecular, float aShininess, std::uint64_t& aRays ) const noexcept;
+
+	private:
+		Bvh mBvh;
+		std::vector<Triangle_> mTriangles;
+		std::vector<CpuTexture> mTextures;
+		std::vector<ScenePointLight> mLights;
+		CpuCubemap mSkybox;
+
+		std::size_t mWidth = 0, mHeight = 0;
+		std::size_t mTilesX = 0, mTilesY = 0;
+		std::size_t mPasses = 0;
+
+		Mat44f mCamera2World = kIdentity44f;
+		float mTanHalfFovY = 1.f;
+
+		std::vector<Vec3f> mAccum; // sum of samples, linear RGB
+		std::atomic<std::uint64_t> mRays{ 0 };
+};
+
+#endif // PATH_TRACER_HPP
@@ -0,0 +1,252 @@
+#include "poster_capture.hpp"
+
+#include <glad.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <cstdio>
+
+#include "../support/error.hpp"
+#include "../support/jobs.hpp"
+#include "../support/profiler.hpp"
+#include "../support/gl_state.hpp"
+
+namespace
+{
+	constexpr std::size_t kMinTileSize_ = 64;
+
+	struct Tile_
+	{
+		std::size_t x, y; // top left, in image pixels
+		std::size_t width, height;
+	};
+
+	// Offscreen render target and readback buffers for one tile
+	class TileTarget_
+	{
+		public:
+			explicit TileTarget_( std::size_t aSize )
+			{
+				glGenFramebuffers( 1, &mFbo );
+				glGenRenderbuffers( 2, mRenderbuffers );
+
+				// sRGB, like the default framebuffer (GL_FRAMEBUFFER_SRGB is
+				// enabled), so that the pixels match a screenshot.
+				glBindRenderbuffer( GL_RENDERBUFFER, mRenderbuffers[0] );
+				glRenderbufferStorage( GL_RENDERBUFFER, GL_SRGB8_ALPHA8, GLsizei(aSize), GLsizei(aSize) );
+				glBindRenderbuffer( GL_RENDERBUFFER, mRenderbuffers[1] );
+				glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, GLsizei(aSize), GLsizei(aSize) );
+				glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+				glBindFramebuffer( GL_FRAMEBUFFER, mFbo );
+				glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mRenderbuffers[0] );
+				glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mRenderbuffers[1] );
+
+				auto const status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+				glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+				if( GL_FRAMEBUFFER_COMPLETE != status )
+				{
+					release_();
+					throw Error( "Poster framebuffer (%zu x %zu) is incomplete: %#x", aSize, aSize, unsigned(status) );
+				}
+
+				glGenBuffers( 2, mPbos );
+				for( auto pbo : mPbos )
+				{
+					glBindBuffer( GL_PIXEL_PACK_BUFFER, pbo );
+					glBufferData( GL_PIXEL_PACK_BUFFER, GLsizeiptr(aSize * aSize * 4), nullptr, GL_STREAM_READ );
+				}
+				glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+			}
+
+			~TileTarget_()
+			{
+				release_();
+			}
+
+			TileTarget_( TileTarget_ const& ) = delete;
+			TileTarget_& operator= (TileTarget_ const&) = delete;
+
+		public:
+			GLuint fbo() const noexcept { return mFbo; }
+			GLuint pbo( std::size_t aIndex ) const noexcept { return mPbos[aIndex % 2]; }
+
+		private:
+			void release_() noexcept
+			{
+				glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+				glDeleteFramebuffers( 1, &mFbo );
+				glDeleteRenderbuffers( 2, mRenderbuffers );
+				glDeleteBuffers( 2, mPbos );
+				mFbo = 0;
+				mRenderbuffers[0] = mRenderbuffers[1] = 0;
+				mPbos[0] = mPbos[1] = 0;
+			}
+
+		private:
+			GLuint mFbo = 0;
+			GLuint mRenderbuffers[2] = {};
+			GLuint mPbos[2] = {};
+	};
+
+	// Copy a tile (RGBA, bottom-up) into its place in a row of tiles (RGB,
+	// top-down).
+	void copy_tile_( unsigned char* aRow, std::size_t aRowWidth, Tile_ const& aTile, unsigned char const* aPixels )
+	{
+		for( std::size_t y = 0; y < aTile.height; ++y )
+		{
+			auto const* src = aPixels + (aTile.height-1-y) * aTile.width * 4;
+			auto* dst = aRow + (y * aRowWidth + aTile.x) * 3;
+			for( std::size_t x = 0; x < aTile.width; ++x )
+			{
+				dst[3*x+0] = src[4*x+0];
+				dst[3*x+1] = src[4*x+1];
+				dst[3*x+2] = src[4*x+2];
+			}
+		}
+	}
+}
+
+Mat44f make_tile_projection( Mat44f const& aProjection, std::size_t aWidth, std::size_t aHeight, std::size_t aX, std::size_t aY, std::size_t aTileWidth, std::size_t aTileHeight ) noexcept
+{
+	// The tile's extent in normalized device coordinates (y points up)
+	float const left = 2.f * float(aX) / float(aWidth) - 1.f;
+	float const right = 2.f * float(aX + aTileWidth) / float(aWidth) - 1.f;
+	float const top = 1.f - 2.f * float(aY) / float(aHeight);
+	float const bottom = 1.f - 2.f * float(aY + aTileHeight) / float(aHeight);
+
+	// Scale and translate that extent to [-1,1]. Applied after the
+	// projection, this is the same as an off-center sub-frustum.
+	Mat44f crop = kIdentity44f;
+	crop(0, 0) = 2.f / (right - left);
+	crop(0, 3) = -(right + left) / (right - left);
+	crop(1, 1) = 2.f / (top - bottom);
+	crop(1, 3) = -(top + bottom) / (top - bottom);
+
+	return crop * aProjection;
+}
+
+ImageWriteStats capture_poster( JobSystem& aJobs, char const* aPath, ImageFormat aFormat, std::size_t aWidth, std::size_t aHeight, Mat44f const& aProjection, PosterDrawFunc const& aDraw, std::size_t aTileSize )
+{
+	PROFILE_ZONE_TEXT( "capture poster", aPath );
+
+	if( 0 == aWidth || 0 == aHeight )
+		throw Error( "Poster size %zu x %zu is empty", aWidth, aHeight );
+
+	GLint maxRenderbuffer = 0, maxViewport[2] = {};
+	glGetIntegerv( GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer );
+	glGetIntegerv( GL_MAX_VIEWPORT_DIMS, maxViewport );
+
+	auto const tileSize = std::max( kMinTileSize_, std::min( { aTileSize, std::size_t(maxRenderbuffer), std::size_t(maxViewport[0]), std::size_t(maxViewport[1]) } ) );
+
+	GLint viewport[4];
+	glGetIntegerv( GL_VIEWPORT, viewport );
+
+	TileTarget_ target( tileSize );
+	ImageStreamWriter writer( aPath, aFormat, aWidth, aHeight, &aJobs );
+
+	// Two rows of tiles: one is filled while the other is being encoded.
+	// Encoder jobs are chained, since rows must be written in order.
+	std::vector<unsigned char> rows[2];
+	JobCounter encoded[2];
+
+	auto const tileRows = (aHeight + tileSize - 1) / tileSize;
+	auto const tileCols = (aWidth + tileSize - 1) / tileSize;
+
+	std::vector<Tile_> tiles;
+	for( std::size_t ty = 0; ty < tileRows; ++ty )
+	{
+		for( std::size_t tx = 0; tx < tileCols; ++tx )
+		{
+			auto const x = tx * tileSize, y = ty * tileSize;
+			tiles.push_back( Tile_{ x, y, std::min( tileSize, aWidth - x ), std::min( tileSize, aHeight - y ) } );
+		}
+	}
+
+	// Read back tile aIndex (rendered earlier) into its row, and hand the row
+	// to the encoder if it is complete.
+	auto const collect = [&] (std::size_t aIndex) {
+		auto const& tile = tiles[aIndex];
+		auto const tileRow = aIndex / tileCols;
+		auto& row = rows[tileRow % 2];
+
+		if( 0 == aIndex % tileCols )
+		{
+			aJobs.wait( encoded[tileRow % 2] );
+			row.resize( aWidth * tile.height * 3 );
+		}
+
+		{
+			PROFILE_ZONE( "read poster tile" );
+
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, target.pbo( aIndex ) );
+			auto const* pixels = static_cast<unsigned char const*>(glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(tile.width * tile.height * 4), GL_MAP_READ_BIT ));
+			if( !pixels )
+			{
+				glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+				throw Error( "Poster '%s': unable to map tile %zu", aPath, aIndex );
+			}
+
+			copy_tile_( row.data(), aWidth, tile, pixels );
+
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		}
+
+		if( tileCols-1 == aIndex % tileCols )
+		{
+			auto const rowCount = tile.height;
+			aJobs.run_after( encoded[(tileRow+1) % 2], [&writer, &row, rowCount] {
+				writer.write_rows( row.data(), rowCount );
+			}, &encoded[tileRow % 2] );
+		}
+	};
+
+	try
+	{
+		for( std::size_t i = 0; i < tiles.size(); ++i )
+		{
+			auto const& tile = tiles[i];
+
+			{
+				PROFILE_ZONE( "render poster tile" );
+
+				glBindFramebuffer( GL_FRAMEBUFFER, target.fbo() );
+				glstate::viewport( 0, 0, GLsizei(tile.width), GLsizei(tile.height) );
+				glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+				aDraw( make_tile_projection( aProjection, aWidth, aHeight, tile.x, tile.y, tile.width, tile.height ) );
+
+				glBindBuffer( GL_PIXEL_PACK_BUFFER, target.pbo( i ) );
+				glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+				glReadPixels( 0, 0, GLsizei(tile.width), GLsizei(tile.height), GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+				glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+			}
+
+			// The GPU works on this tile while the previous one is copied
+			if( i > 0 )
+				collect( i-1 );
+		}
+		collect( tiles.size()-1 );
+
+		aJobs.wait( encoded[0] );
+		aJobs.wait( encoded[1] );
+	}
+	catch( ... )
+	{
+		// Encoder jobs refer to the rows and the writer
+		for( auto& counter : encoded )
+		{
+			try { aJobs.wait( counter ); } catch( ... ) {}
+		}
+		glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+		glstate::viewport( viewport[0], viewport[1], viewport[2], viewport[3] );
+		throw;
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	glstate::viewport( viewport[0], viewport[1], viewport[2], viewport[3] );
+
+	return writer.finish();
+}
@@ -0,0 +1,40 @@
+#ifndef POSTER_CAPTURE_HPP
+#define POSTER_CAPTURE_HPP
+
+#include <functional>
+
+#include <cstddef>
+
+#include "../vmlib/mat44.hpp"
+
+#include "image_writer.hpp"
+
+class JobSystem;
+
+/* Tiled high-resolution ("poster") capture
+ *
+ * Renders an image larger than the window (e.g. 7680x4320 or 15360x8640) as
+ * a grid of tiles into an offscreen framebuffer. Each tile is drawn with a
+ * projection that covers only its part of the view (make_tile_projection()).
+ *
+ * Tiles are read back through two pixel pack buffers, so that the GPU
+ * renders one tile while the previous one is copied. Each completed row of
+ * tiles is handed to an encoder job (ImageStreamWriter) while the next row is
+ * rendered. Memory use is bounded by the tile size: two tile-sized pixel
+ * buffers, the framebuffer, and two rows of tiles on the CPU.
+ */
+
+// Draws the scene with the given projection (the view is unchanged). Called
+// once per tile, with the tile framebuffer bound and the viewport set.
+using PosterDrawFunc = std::function<void( Mat44f const& aProjection )>;
+
+// Restrict aProjection to the aTileWidth x aTileHeight region at (aX, aY),
+// measured in pixels from the top left, of an aWidth x aHeight image.
+Mat44f make_tile_projection( Mat44f const& aProjection, std::size_t aWidth, std::size_t aHeight, std::size_t aX, std::size_t aY, std::size_t aTileWidth, std::size_t aTileHeight ) noexcept;
+
+// aProjection covers the whole image and should have its aspect ratio. The
+// tile size is clamped to the GL limits. Restores the viewport and binds the
+// default framebuffer. Throws Error.
+ImageWriteStats capture_poster( JobSystem&, char const* aPath, ImageFormat, std::size_t aWidth, std::size_t aHeight, Mat44f const& aProjection, PosterDrawFunc const& aDraw, std::size_t aTileSize = 1024 );
+
+#endif // POSTER_CAPTURE_HPP
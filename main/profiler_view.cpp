@@ -0,0 +1,172 @@
+#include "profiler_view.hpp"
+
+#include "../third_party/imgui/imgui.h"
+
+#include "../support/gpu_profiler.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#include <cstdio>
+
+namespace
+{
+	constexpr float kRowHeight_ = 16.f;
+	constexpr float kThreadGap_ = 4.f;
+
+	// Stable color per zone name (names are string literals)
+	ImU32 zone_color_( char const* aName )
+	{
+		std::uint32_t hash = 2166136261u;
+		for( ; *aName; ++aName )
+			hash = (hash ^ std::uint8_t(*aName)) * 16777619u;
+
+		return IM_COL32( 80 + hash % 120, 80 + (hash >> 8) % 120, 80 + (hash >> 16) % 120, 255 );
+	}
+}
+
+void ProfilerView::draw( GpuProfiler::Results const* aGpu )
+{
+	if( aGpu )
+		draw_gpu_( *aGpu );
+
+#	if !PROFILER_ENABLED
+	ImGui::TextDisabled( "Profiler compiled out (--no-profiler)" );
+	return;
+#	endif // ~ PROFILER_ENABLED
+
+	ImGui::Checkbox( "Pause", &mPaused );
+	ImGui::SameLine();
+	if( ImGui::Button( "Save trace" ) )
+	{
+		try
+		{
+			profiler::write_chrome_trace( "trace.json" );
+			mTraceStatus = "Wrote trace.json";
+		}
+		catch( std::exception const& eErr )
+		{
+			std::fprintf( stderr, "%s\n", eErr.what() );
+			mTraceStatus = "Unable to write trace.json";
+		}
+	}
+	if( mTraceStatus )
+	{
+		ImGui::SameLine();
+		ImGui::TextUnformatted( mTraceStatus );
+	}
+
+	if( !mPaused )
+	{
+		// Wait for the GPU zones of the frame to arrive
+		std::size_t const framesAgo = aGpu ? GpuProfiler::kFrameLatency : 0;
+
+		profiler::Ticks begin, end;
+		if( profiler::last_frame( begin, end, framesAgo ) )
+		{
+			mFrameBegin = begin;
+			mFrameEnd = end;
+			mThreads = profiler::collect( begin, end );
+		}
+	}
+
+	if( mFrameEnd <= mFrameBegin )
+	{
+		ImGui::TextDisabled( "No frame captured yet" );
+		return;
+	}
+
+	double const frameUs = profiler::ticks_to_us( mFrameEnd - mFrameBegin );
+	ImGui::Text( "Frame: %.2f ms", frameUs / 1000.0 );
+
+	// Layout: a block of rows per thread
+	float height = 0.f;
+	for( auto const& te : mThreads )
+	{
+		std::uint32_t depth = 0;
+		for( auto const& ev : te.events )
+			depth = std::max( depth, ev.depth );
+
+		height += kRowHeight_ * (depth + 2) + kThreadGap_;
+	}
+
+	ImVec2 const origin = ImGui::GetCursorScreenPos();
+	float const width = std::max( ImGui::GetContentRegionAvail().x, 100.f );
+
+	ImGui::InvisibleButton( "flame", ImVec2( width, std::max( height, kRowHeight_ ) ) );
+	bool const hovered = ImGui::IsItemHovered();
+	ImVec2 const mouse = ImGui::GetIO().MousePos;
+
+	auto* const list = ImGui::GetWindowDrawList();
+	list->PushClipRect( origin, ImVec2( origin.x + width, origin.y + height ), true );
+
+	float const scale = width / float(mFrameEnd - mFrameBegin);
+
+	float y = origin.y;
+	for( auto const& te : mThreads )
+	{
+		list->AddText( ImVec2( origin.x + 2.f, y + 1.f ), IM_COL32( 200, 200, 200, 255 ), te.name );
+		y += kRowHeight_;
+
+		std::uint32_t depth = 0;
+		for( auto const& ev : te.events )
+		{
+			depth = std::max( depth, ev.depth );
+
+			float const x0 = origin.x + float(ev.begin - mFrameBegin) * scale;
+			float const x1 = std::max( origin.x + float(ev.end - mFrameBegin) * scale, x0 + 1.f );
+			float const y0 = y + ev.depth * kRowHeight_;
+			float const y1 = y0 + kRowHeight_ - 1.f;
+
+			list->AddRectFilled( ImVec2( x0, y0 ), ImVec2( x1, y1 ), zone_color_( ev.name ) );
+
+			// Label if there is enough space
+			if( x1 - x0 > 30.f )
+			{
+				ImVec4 const clip( x0, y0, x1 - 2.f, y1 );
+				list->AddText( nullptr, 0.f, ImVec2( x0 + 2.f, y0 + 1.f ), IM_COL32( 255, 255, 255, 255 ), ev.name, nullptr, 0.f, &clip );
+			}
+
+			if( hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1 )
+			{
+				if( ev.text[0] )
+					ImGui::SetTooltip( "%s (%s)\n%.3f ms", ev.name, ev.text, profiler::ticks_to_us( ev.end - ev.begin ) / 1000.0 );
+				else
+					ImGui::SetTooltip( "%s\n%.3f ms", ev.name, profiler::ticks_to_us( ev.end - ev.begin ) / 1000.0 );
+			}
+		}
+
+		y += kRowHeight_ * (depth + 1) + kThreadGap_;
+	}
+
+	list->PopClipRect();
+}
+
+void ProfilerView::draw_gpu_( GpuProfiler::Results const& aGpu )
+{
+	ImGui::Text( "GPU frame: %.2f ms", aGpu.frameMs );
+	if( aGpu.droppedFrames )
+	{
+		ImGui::SameLine();
+		ImGui::TextDisabled( "(%zu frames dropped)", aGpu.droppedFrames );
+	}
+
+	for( auto const& zone : aGpu.zones )
+		ImGui::Text( "%*s%-20s %7.3f ms", int(2 * (zone.depth+1)), "", zone.name, zone.ms );
+
+	if( aGpu.hasPipelineStatistics )
+	{
+		auto const& stats = aGpu.pipelineStatistics;
+		ImGui::Text( "Vertices: %llu (%llu VS invocations)",
+			(unsigned long long)stats.verticesSubmitted,
+			(unsigned long long)stats.vertexShaderInvocations
+		);
+		ImGui::Text( "Primitives: %llu submitted, %llu after clipping",
+			(unsigned long long)stats.primitivesSubmitted,
+			(unsigned long long)stats.clippingOutputPrimitives
+		);
+		ImGui::Text( "Fragments: %llu FS invocations", (unsigned long long)stats.fragmentShaderInvocations );
+	}
+
+	ImGui::Separator();
+}
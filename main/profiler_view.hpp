@@ -0,0 +1,39 @@
+#ifndef PROFILER_VIEW_HPP
+#define PROFILER_VIEW_HPP
+
+// ImGui flame view of the scope profiler (support/profiler.hpp).
+
+#include <vector>
+
+#include "../support/profiler.hpp"
+#include "../support/gpu_profiler.hpp"
+
+/** ProfilerView: flame graph of the most recent frame
+ *
+ * Shows one block of rows per thread, one row per nesting level, with the
+ * frame spanning the full width. Hover a zone to see its name, text and
+ * duration. draw() must be called between ImGui::Begin() and ImGui::End().
+ *
+ * While paused, the captured frame is kept, so that it can be inspected.
+ *
+ * With GpuProfiler results, the GPU times of the latest completed frame are
+ * listed as well. GPU zones are only known a few frames later, so the flame view
+ * then shows an older frame in which the CPU and GPU tracks line up.
+ */
+class ProfilerView final
+{
+	public:
+		void draw( GpuProfiler::Results const* aGpu = nullptr );
+
+	private:
+		void draw_gpu_( GpuProfiler::Results const& );
+
+	private:
+		bool mPaused = false;
+		char const* mTraceStatus = nullptr;
+
+		profiler::Ticks mFrameBegin = 0, mFrameEnd = 0;
+		std::vector<profiler::ThreadEvents> mThreads;
+};
+
+#endif // PROFILER_VIEW_HPP
@@ -0,0 +1,390 @@
+#include "render_stats.hpp"
+
+#include <glad.h>
+
+#include "../third_party/imgui/imgui.h"
+
+#include <algorithm>
+
+#include <cassert>
+#include <exception>
+
+#include "../support/error.hpp"
+
+namespace
+{
+	RenderStats gFrame_{};
+
+	char const* const kCounterNames_[kRenderCounterCount] = {
+		"draw_calls",
+		"primitives",
+		"program_binds",
+		"vao_binds",
+		"texture_binds",
+		"uniform_calls",
+		"state_elided",
+		"bytes_uploaded",
+		"objects_tested",
+		"objects_visible",
+		"objects_occluded"
+	};
+
+	std::uint64_t primitive_count_( GLenum aMode, GLsizei aCount ) noexcept
+	{
+		if( aCount <= 0 )
+			return 0;
+
+		switch( aMode )
+		{
+			case GL_TRIANGLES: return std::uint64_t(aCount) / 3;
+			case GL_TRIANGLE_STRIP: // fall-through
+			case GL_TRIANGLE_FAN: return aCount >= 3 ? std::uint64_t(aCount) - 2 : 0;
+			case GL_LINES: return std::uint64_t(aCount) / 2;
+			case GL_LINE_STRIP: return std::uint64_t(aCount) - 1;
+			case GL_LINE_LOOP: return std::uint64_t(aCount);
+			default: return std::uint64_t(aCount);
+		}
+	}
+
+	std::uint64_t pixel_bytes_( GLenum aFormat, GLenum aType ) noexcept
+	{
+		std::uint64_t components = 4;
+		switch( aFormat )
+		{
+			case GL_RED: components = 1; break;
+			case GL_RG: components = 2; break;
+			case GL_RGB: case GL_BGR: components = 3; break;
+			case GL_DEPTH_COMPONENT: components = 1; break;
+		}
+
+		switch( aType )
+		{
+			case GL_FLOAT: return 4 * components;
+			case GL_HALF_FLOAT: return 2 * components;
+			default: return components; // GL_UNSIGNED_BYTE and friends
+		}
+	}
+
+	// Original entry points
+	PFNGLDRAWARRAYSPROC gDrawArrays_ = nullptr;
+	PFNGLDRAWELEMENTSPROC gDrawElements_ = nullptr;
+	PFNGLDRAWELEMENTSBASEVERTEXPROC gDrawElementsBaseVertex_ = nullptr;
+	PFNGLDRAWARRAYSINSTANCEDPROC gDrawArraysInstanced_ = nullptr;
+	PFNGLDRAWELEMENTSINSTANCEDPROC gDrawElementsInstanced_ = nullptr;
+	PFNGLDRAWELEMENTSINSTANCEDBASEINSTANCEPROC gDrawElementsInstancedBaseInstance_ = nullptr;
+	PFNGLMULTIDRAWARRAYSINDIRECTPROC gMultiDrawArraysIndirect_ = nullptr;
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC gMultiDrawElementsIndirect_ = nullptr;
+
+	PFNGLUSEPROGRAMPROC gUseProgram_ = nullptr;
+	PFNGLBINDVERTEXARRAYPROC gBindVertexArray_ = nullptr;
+	PFNGLBINDTEXTUREPROC gBindTexture_ = nullptr;
+
+	PFNGLBUFFERDATAPROC gBufferData_ = nullptr;
+	PFNGLBUFFERSUBDATAPROC gBufferSubData_ = nullptr;
+	PFNGLTEXIMAGE2DPROC gTexImage2D_ = nullptr;
+	PFNGLTEXSUBIMAGE2DPROC gTexSubImage2D_ = nullptr;
+
+	// Counting wrappers
+	void APIENTRY draw_arrays_( GLenum aMode, GLint aFirst, GLsizei aCount )
+	{
+		count_render( kRenderDrawCalls );
+		count_render( kRenderPrimitives, primitive_count_( aMode, aCount ) );
+		gDrawArrays_( aMode, aFirst, aCount );
+	}
+	void APIENTRY draw_elements_( GLenum aMode, GLsizei aCount, GLenum aType, void const* aIndices )
+	{
+		count_render( kRenderDrawCalls );
+		count_render( kRenderPrimitives, primitive_count_( aMode, aCount ) );
+		gDrawElements_( aMode, aCount, aType, aIndices );
+	}
+	void APIENTRY draw_elements_base_vertex_( GLenum aMode, GLsizei aCount, GLenum aType, void const* aIndices, GLint aBaseVertex )
+	{
+		count_render( kRenderDrawCalls );
+		count_render( kRenderPrimitives, primitive_count_( aMode, aCount ) );
+		gDrawElementsBaseVertex_( aMode, aCount, aType, aIndices, aBaseVertex );
+	}
+	void APIENTRY draw_arrays_instanced_( GLenum aMode, GLint aFirst, GLsizei aCount, GLsizei aInstances )
+	{
+		count_render( kRenderDrawCalls );
+		count_render( kRenderPrimitives, primitive_count_( aMode, aCount ) * std::uint64_t(aInstances) );
+		gDrawArraysInstanced_( aMode, aFirst, aCount, aInstances );
+	}
+	void APIENTRY draw_elements_instanced_( GLenum aMode, GLsizei aCount, GLenum aType, void const* aIndices, GLsizei aInstances )
+	{
+		count_render( kRenderDrawCalls );
+		count_render( kRenderPrimitives, primitive_count_( aMode, aCount ) * std::uint64_t(aInstances) );
+		gDrawElementsInstanced_( aMode, aCount, aType, aIndices, aInstances );
+	}
+	void APIENTRY draw_elements_instanced_base_instance_( GLenum aMode, GLsizei aCount, GLenum aType, void const* aIndices, GLsizei aInstances, GLuint aBaseInstance )
+	{
+		count_render( kRenderDrawCalls );
+		count_render( kRenderPrimitives, primitive_count_( aMode, aCount ) * std::uint64_t(aInstances) );
+		gDrawElementsInstancedBaseInstance_( aMode, aCount, aType, aIndices, aInstances, aBaseInstance );
+	}
+
+	// The commands of indirect draws live in a GL buffer. Their primitives
+	// are counted by the code that builds the commands.
+	void APIENTRY multi_draw_arrays_indirect_( GLenum aMode, void const* aIndirect, GLsizei aDrawCount, GLsizei aStride )
+	{
+		count_render( kRenderDrawCalls );
+		gMultiDrawArraysIndirect_( aMode, aIndirect, aDrawCount, aStride );
+	}
+	void APIENTRY multi_draw_elements_indirect_( GLenum aMode, GLenum aType, void const* aIndirect, GLsizei aDrawCount, GLsizei aStride )
+	{
+		count_render( kRenderDrawCalls );
+		gMultiDrawElementsIndirect_( aMode, aType, aIndirect, aDrawCount, aStride );
+	}
+
+	void APIENTRY use_program_( GLuint aProgram )
+	{
+		count_render( kRenderProgramBinds );
+		gUseProgram_( aProgram );
+	}
+	void APIENTRY bind_vertex_array_( GLuint aVao )
+	{
+		count_render( kRenderVaoBinds );
+		gBindVertexArray_( aVao );
+	}
+	void APIENTRY bind_texture_( GLenum aTarget, GLuint aTexture )
+	{
+		count_render( kRenderTextureBinds );
+		gBindTexture_( aTarget, aTexture );
+	}
+
+	void APIENTRY buffer_data_( GLenum aTarget, GLsizeiptr aSize, void const* aData, GLenum aUsage )
+	{
+		if( aData )
+			count_render( kRenderBytesUploaded, std::uint64_t(aSize) );
+		gBufferData_( aTarget, aSize, aData, aUsage );
+	}
+	void APIENTRY buffer_sub_data_( GLenum aTarget, GLintptr aOffset, GLsizeiptr aSize, void const* aData )
+	{
+		count_render( kRenderBytesUploaded, std::uint64_t(aSize) );
+		gBufferSubData_( aTarget, aOffset, aSize, aData );
+	}
+	void APIENTRY tex_image_2d_( GLenum aTarget, GLint aLevel, GLint aInternal, GLsizei aWidth, GLsizei aHeight, GLint aBorder, GLenum aFormat, GLenum aType, void const* aPixels )
+	{
+		if( aPixels )
+			count_render( kRenderBytesUploaded, std::uint64_t(aWidth) * std::uint64_t(aHeight) * pixel_bytes_( aFormat, aType ) );
+		gTexImage2D_( aTarget, aLevel, aInternal, aWidth, aHeight, aBorder, aFormat, aType, aPixels );
+	}
+	void APIENTRY tex_sub_image_2d_( GLenum aTarget, GLint aLevel, GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight, GLenum aFormat, GLenum aType, void const* aPixels )
+	{
+		count_render( kRenderBytesUploaded, std::uint64_t(aWidth) * std::uint64_t(aHeight) * pixel_bytes_( aFormat, aType ) );
+		gTexSubImage2D_( aTarget, aLevel, aX, aY, aWidth, aHeight, aFormat, aType, aPixels );
+	}
+
+	// The uniform setters only differ in their parameters
+#	define RENDER_STATS_UNIFORM_( proc, name, params, args )                  \
+		PFNGL##proc##PROC g##name##_ = nullptr;                              \
+		void APIENTRY counted_##name##_ params                                \
+		{                                                                     \
+			count_render( kRenderUniformCalls );                              \
+			g##name##_ args;                                                  \
+		}                                                                     \
+		/*ENDM*/
+
+	RENDER_STATS_UNIFORM_( UNIFORM1F, Uniform1f, (GLint l, GLfloat x), (l, x) )
+	RENDER_STATS_UNIFORM_( UNIFORM2F, Uniform2f, (GLint l, GLfloat x, GLfloat y), (l, x, y) )
+	RENDER_STATS_UNIFORM_( UNIFORM3F, Uniform3f, (GLint l, GLfloat x, GLfloat y, GLfloat z), (l, x, y, z) )
+	RENDER_STATS_UNIFORM_( UNIFORM4F, Uniform4f, (GLint l, GLfloat x, GLfloat y, GLfloat z, GLfloat w), (l, x, y, z, w) )
+	RENDER_STATS_UNIFORM_( UNIFORM1I, Uniform1i, (GLint l, GLint x), (l, x) )
+	RENDER_STATS_UNIFORM_( UNIFORM1FV, Uniform1fv, (GLint l, GLsizei n, GLfloat const* v), (l, n, v) )
+	RENDER_STATS_UNIFORM_( UNIFORM3FV, Uniform3fv, (GLint l, GLsizei n, GLfloat const* v), (l, n, v) )
+	RENDER_STATS_UNIFORM_( UNIFORM4FV, Uniform4fv, (GLint l, GLsizei n, GLfloat const* v), (l, n, v) )
+	RENDER_STATS_UNIFORM_( UNIFORMMATRIX3FV, UniformMatrix3fv, (GLint l, GLsizei n, GLboolean t, GLfloat const* v), (l, n, t, v) )
+	RENDER_STATS_UNIFORM_( UNIFORMMATRIX4FV, UniformMatrix4fv, (GLint l, GLsizei n, GLboolean t, GLfloat const* v), (l, n, t, v) )
+
+#	undef RENDER_STATS_UNIFORM_
+
+	template< typename tProc >
+	void hook_( tProc& aEntry, tProc& aOriginal, tProc aHook )
+	{
+		assert( !aOriginal );
+		if( !aEntry )
+			return; // not provided by this context
+
+		aOriginal = aEntry;
+		aEntry = aHook;
+	}
+}
+
+void install_render_stats_hooks()
+{
+	hook_( glad_glDrawArrays, gDrawArrays_, &draw_arrays_ );
+	hook_( glad_glDrawElements, gDrawElements_, &draw_elements_ );
+	hook_( glad_glDrawElementsBaseVertex, gDrawElementsBaseVertex_, &draw_elements_base_vertex_ );
+	hook_( glad_glDrawArraysInstanced, gDrawArraysInstanced_, &draw_arrays_instanced_ );
+	hook_( glad_glDrawElementsInstanced, gDrawElementsInstanced_, &draw_elements_instanced_ );
+	hook_( glad_glDrawElementsInstancedBaseInstance, gDrawElementsInstancedBaseInstance_, &draw_elements_instanced_base_instance_ );
+	hook_( glad_glMultiDrawArraysIndirect, gMultiDrawArraysIndirect_, &multi_draw_arrays_indirect_ );
+	hook_( glad_glMultiDrawElementsIndirect, gMultiDrawElementsIndirect_, &multi_draw_elements_indirect_ );
+
+	hook_( glad_glUseProgram, gUseProgram_, &use_program_ );
+	hook_( glad_glBindVertexArray, gBindVertexArray_, &bind_vertex_array_ );
+	hook_( glad_glBindTexture, gBindTexture_, &bind_texture_ );
+
+	hook_( glad_glBufferData, gBufferData_, &buffer_data_ );
+	hook_( glad_glBufferSubData, gBufferSubData_, &buffer_sub_data_ );
+	hook_( glad_glTexImage2D, gTexImage2D_, &tex_image_2d_ );
+	hook_( glad_glTexSubImage2D, gTexSubImage2D_, &tex_sub_image_2d_ );
+
+	hook_( glad_glUniform1f, gUniform1f_, &counted_Uniform1f_ );
+	hook_( glad_glUniform2f, gUniform2f_, &counted_Uniform2f_ );
+	hook_( glad_glUniform3f, gUniform3f_, &counted_Uniform3f_ );
+	hook_( glad_glUniform4f, gUniform4f_, &counted_Uniform4f_ );
+	hook_( glad_glUniform1i, gUniform1i_, &counted_Uniform1i_ );
+	hook_( glad_glUniform1fv, gUniform1fv_, &counted_Uniform1fv_ );
+	hook_( glad_glUniform3fv, gUniform3fv_, &counted_Uniform3fv_ );
+	hook_( glad_glUniform4fv, gUniform4fv_, &counted_Uniform4fv_ );
+	hook_( glad_glUniformMatrix3fv, gUniformMatrix3fv_, &counted_UniformMatrix3fv_ );
+	hook_( glad_glUniformMatrix4fv, gUniformMatrix4fv_, &counted_UniformMatrix4fv_ );
+}
+
+RenderStats& render_stats() noexcept
+{
+	return gFrame_;
+}
+
+char const* render_counter_name( RenderCounter aCounter ) noexcept
+{
+	assert( aCounter < kRenderCounterCount );
+	return kCounterNames_[aCounter];
+}
+
+
+RenderStatsLog::RenderStatsLog( std::size_t aWindow )
+	: mWindow( std::max<std::size_t>( aWindow, 1 ) )
+{}
+
+RenderStatsLog::~RenderStatsLog()
+{
+	stop_csv();
+}
+
+void RenderStatsLog::end_frame()
+{
+	end_frame( render_stats() );
+	render_stats() = RenderStats{};
+}
+
+void RenderStatsLog::end_frame( RenderStats const& aFrame )
+{
+	auto const& frame = aFrame;
+
+	// Rolling sums over the window
+	auto& slot = mWindow[mNext];
+	for( std::size_t i = 0; i < kRenderCounterCount; ++i )
+	{
+		if( mCount == mWindow.size() )
+			mSums[i] -= slot.counters[i];
+		mSums[i] += frame.counters[i];
+	}
+
+	slot = frame;
+	mNext = (mNext+1) % mWindow.size();
+	mCount = std::min( mCount+1, mWindow.size() );
+
+	if( mCsv )
+	{
+		std::fprintf( mCsv, "%llu", (unsigned long long)mFrameIndex );
+		for( auto const value : frame.counters )
+			std::fprintf( mCsv, ",%llu", (unsigned long long)value );
+		std::fprintf( mCsv, "\n" );
+	}
+
+	++mFrameIndex;
+}
+
+RenderStats const& RenderStatsLog::last() const noexcept
+{
+	return mWindow[(mNext + mWindow.size() - 1) % mWindow.size()];
+}
+
+double RenderStatsLog::average( RenderCounter aCounter ) const noexcept
+{
+	assert( aCounter < kRenderCounterCount );
+	return mCount ? double(mSums[aCounter]) / double(mCount) : 0.0;
+}
+
+void RenderStatsLog::start_csv( char const* aPath )
+{
+	assert( aPath );
+	stop_csv();
+
+	mCsv = std::fopen( aPath, "w" );
+	if( !mCsv )
+		throw Error( "Unable to open '%s' for writing", aPath );
+
+	mCsvPath = aPath;
+
+	std::fprintf( mCsv, "frame" );
+	for( auto const* name : kCounterNames_ )
+		std::fprintf( mCsv, ",%s", name );
+	std::fprintf( mCsv, "\n" );
+}
+
+void RenderStatsLog::stop_csv()
+{
+	if( mCsv )
+	{
+		std::fclose( mCsv );
+		mCsv = nullptr;
+	}
+}
+
+bool RenderStatsLog::csv_active() const noexcept
+{
+	return nullptr != mCsv;
+}
+char const* RenderStatsLog::csv_path() const noexcept
+{
+	return mCsvPath.c_str();
+}
+
+
+void draw_render_stats_panel( RenderStatsLog& aLog )
+{
+	if( ImGui::BeginTable( "render stats", 3, ImGuiTableFlags_SizingFixedFit ) )
+	{
+		ImGui::TableSetupColumn( "counter" );
+		ImGui::TableSetupColumn( "last" );
+		ImGui::TableSetupColumn( "average" );
+		ImGui::TableHeadersRow();
+
+		auto const& last = aLog.last();
+		for( std::size_t i = 0; i < kRenderCounterCount; ++i )
+		{
+			auto const counter = RenderCounter(i);
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted( render_counter_name( counter ) );
+			ImGui::TableNextColumn();
+			ImGui::Text( "%llu", (unsigned long long)last.counters[i] );
+			ImGui::TableNextColumn();
+			ImGui::Text( "%.1f", aLog.average( counter ) );
+		}
+
+		ImGui::EndTable();
+	}
+
+	if( aLog.csv_active() )
+	{
+		if( ImGui::Button( "Stop CSV" ) )
+			aLog.stop_csv();
+		ImGui::SameLine();
+		ImGui::Text( "Writing %s", aLog.csv_path() );
+	}
+	else if( ImGui::Button( "Record CSV" ) )
+	{
+		try
+		{
+			aLog.start_csv( "render_stats.csv" );
+		}
+		catch( std::exception const& eErr )
+		{
+			std::fprintf( stderr, "%s\n", eErr.what() );
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef RENDER_STATS_HPP
+#define RENDER_STATS_HPP
+
+// Per-frame render statistics: draw calls, binds, uniform updates, uploads
+// and culling results, with rolling averages and an optional CSV log.
+
+#include <vector>
+#include <string>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+enum RenderCounter : std::size_t
+{
+	kRenderDrawCalls = 0,  // glDraw*() and glMultiDraw*() calls
+	kRenderPrimitives,     // triangles (lines, points) submitted, incl. instances
+	kRenderProgramBinds,   // glUseProgram()
+	kRenderVaoBinds,       // glBindVertexArray()
+	kRenderTextureBinds,   // glBindTexture()
+	kRenderUniformCalls,   // glUniform*()
+	kRenderStateElided,    // redundant state changes skipped (support/gl_state.hpp)
+	kRenderBytesUploaded,  // buffer and texture data
+	kRenderObjectsTested,  // culling
+	kRenderObjectsVisible,
+	kRenderObjectsOccluded,
+
+	kRenderCounterCount
+};
+
+struct RenderStats
+{
+	std::uint64_t counters[kRenderCounterCount];
+};
+
+// Route the counted GL entry points through counting wrappers. Call once,
+// after the GL API has been loaded. Only calls made through glad are seen;
+// ImGui's renderer uses its own loader and is not included.
+void install_render_stats_hooks();
+
+// Counters of the frame that is being rendered. Everything is counted on the
+// thread that makes the GL calls (see RenderThread).
+RenderStats& render_stats() noexcept;
+
+inline void count_render( RenderCounter aCounter, std::uint64_t aCount = 1 ) noexcept
+{
+	render_stats().counters[aCounter] += aCount;
+}
+
+char const* render_counter_name( RenderCounter ) noexcept;
+
+/** RenderStatsLog: history of per-frame render statistics
+ *
+ * end_frame() takes the current counters (render_stats()) and resets them.
+ * When the frames are rendered on another thread, that thread takes its
+ * counters instead and hands them over to end_frame( RenderStats ).
+ * Keeps the last aWindow frames for rolling averages. While a CSV log is
+ * open, each frame is also written as one row.
+ */
+class RenderStatsLog final
+{
+	public:
+		explicit RenderStatsLog( std::size_t aWindow = 120 );
+		~RenderStatsLog();
+
+		RenderStatsLog( RenderStatsLog const& ) = delete;
+		RenderStatsLog& operator= (RenderStatsLog const&) = delete;
+
+	public:
+		void end_frame();
+		void end_frame( RenderStats const& );
+
+		RenderStats const& last() const noexcept;
+		double average( RenderCounter ) const noexcept;
+
+	public:
+		// Throws Error if the file cannot be opened.
+		void start_csv( char const* aPath );
+		void stop_csv();
+
+		bool csv_active() const noexcept;
+		char const* csv_path() const noexcept;
+
+	private:
+		std::vector<RenderStats> mWindow; // ring buffer
+		std::size_t mNext = 0, mCount = 0;
+		std::uint64_t mSums[kRenderCounterCount] = {};
+
+		std::uint64_t mFrameIndex = 0;
+
+		std::FILE* mCsv = nullptr;
+		std::string mCsvPath;
+};
+
+// ImGui contents: last frame and rolling averages, plus a button to start or
+// stop the CSV log (render_stats.csv). Call between ImGui::Begin()/End().
+void draw_render_stats_panel( RenderStatsLog& );
+
+#endif // RENDER_STATS_HPP
@@ -0,0 +1,97 @@
+#include "render_thread.hpp"
+
+#include <utility>
+
+#include "../support/profiler.hpp"
+
+RenderThread::RenderThread( GLFWwindow* aWindow, RenderFunc aRender, int aSwapInterval )
+	: mWindow( aWindow )
+	, mRender( std::move(aRender) )
+	, mSwapInterval( aSwapInterval )
+{
+	glfwMakeContextCurrent( nullptr );
+	mThread = std::thread( [this] { run_(); } );
+}
+
+RenderThread::~RenderThread()
+{
+	try
+	{
+		stop();
+	}
+	catch( ... )
+	{}
+}
+
+FrameSnapshot& RenderThread::next_frame() noexcept
+{
+	return mFrames.write_buffer();
+}
+
+void RenderThread::submit()
+{
+	PROFILE_ZONE( "submit frame" );
+
+	std::unique_lock<std::mutex> lock( mMutex );
+	mWake.wait( lock, [this] { return !mFrames.pending() || mError || mStop; } );
+
+	if( mError )
+		std::rethrow_exception( std::exchange( mError, nullptr ) );
+
+	mFrames.publish();
+
+	lock.unlock();
+	mWake.notify_all();
+}
+
+void RenderThread::stop()
+{
+	if( !mThread.joinable() )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStop = true;
+	}
+	mWake.notify_all();
+
+	mThread.join();
+	glfwMakeContextCurrent( mWindow );
+
+	if( auto err = std::exchange( mError, nullptr ) )
+		std::rethrow_exception( err );
+}
+
+void RenderThread::run_()
+{
+	PROFILE_THREAD( "render" );
+
+	glfwMakeContextCurrent( mWindow );
+	glfwSwapInterval( mSwapInterval );
+
+	try
+	{
+		for( ;; )
+		{
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mWake.wait( lock, [this] { return mFrames.pending() || mStop; } );
+
+				// Frames that were submitted before stop() are still rendered
+				if( !mFrames.acquire() )
+					break;
+			}
+			mWake.notify_all();
+
+			mRender( mFrames.read_buffer() );
+		}
+	}
+	catch( ... )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mError = std::current_exception();
+	}
+	mWake.notify_all();
+
+	glfwMakeContextCurrent( nullptr );
+}
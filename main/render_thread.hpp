@@ -0,0 +1,78 @@
+#ifndef RENDER_THREAD_HPP
+#define RENDER_THREAD_HPP
+
+#include <glad.h>
+#include <GLFW/glfw3.h>
+
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include "../support/triple_buffer.hpp"
+
+#include "frame_snapshot.hpp"
+
+/** RenderThread: renders FrameSnapshots on a dedicated thread
+ *
+ * The render thread owns the window's GL context while it runs: the
+ * constructor releases the context on the calling (main) thread, and stop()
+ * makes it current there again. All GL calls, including swapping buffers,
+ * must be made by the render function in the meantime.
+ *
+ * Snapshots are handed over through a lock-free TripleBuffer: the main
+ * thread fills next_frame() and calls submit(); the render thread takes the
+ * latest one and calls the render function with it. The main thread can thus
+ * simulate frame N+1 while frame N is being submitted to the GPU.
+ *
+ * The main thread runs at most one frame ahead. submit() waits until the
+ * render thread has taken the previous snapshot, so that no frame is ever
+ * dropped (video recording relies on this). The mutex and condition variable
+ * are only used to sleep while there is nothing to do; the handoff itself
+ * does not lock.
+ *
+ * If the render function throws, the render thread stops, and the exception
+ * is rethrown from the next submit() or from stop().
+ */
+class RenderThread final
+{
+	public:
+		using RenderFunc = std::function<void( FrameSnapshot const& )>;
+
+	public:
+		RenderThread( GLFWwindow*, RenderFunc, int aSwapInterval );
+		~RenderThread();
+
+		RenderThread( RenderThread const& ) = delete;
+		RenderThread& operator= (RenderThread const&) = delete;
+
+	public:
+		// Main thread: the snapshot to fill in. It holds an older frame; all
+		// of it must be overwritten.
+		FrameSnapshot& next_frame() noexcept;
+		void submit();
+
+		// Render the last submitted frame, end the thread and make the GL
+		// context current on the calling thread.
+		void stop();
+
+	private:
+		void run_();
+
+	private:
+		GLFWwindow* mWindow;
+		RenderFunc mRender;
+		int mSwapInterval;
+
+		TripleBuffer<FrameSnapshot> mFrames;
+
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		bool mStop = false;
+		std::exception_ptr mError;
+
+		std::thread mThread;
+};
+
+#endif // RENDER_THREAD_HPP
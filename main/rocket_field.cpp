@@ -0,0 +1,80 @@
+#include "rocket_field.hpp"
+
+#include <cstdint>
+
+namespace
+{
+	constexpr std::size_t kColumns_ = 100;
+	constexpr float kSpacing_ = 1.5f; // units between rockets
+
+	// The rocket mesh is pretransformed onto the launch pad, so the field is
+	// offset from there.
+	constexpr Vec3f kFieldOrigin_{ -20.f, 0.f, -25.f };
+
+	// Cheap deterministic per-rocket variation, in [0,1)
+	float hash01_( std::uint32_t aX ) noexcept
+	{
+		aX ^= aX >> 16;
+		aX *= 0x7feb352du;
+		aX ^= aX >> 15;
+		aX *= 0x846ca68bu;
+		aX ^= aX >> 16;
+		return float(aX >> 8) / float(1u << 24);
+	}
+}
+
+RocketField::RocketField( InstancedMesh& aMesh, Material aMaterial, Bounds aBounds )
+	: mMesh( &aMesh )
+	, mMaterial( aMaterial )
+	, mBounds( aBounds )
+{}
+
+void RocketField::resize( Registry& aRegistry, std::size_t aCount )
+{
+	while( mRockets.size() > aCount )
+	{
+		aRegistry.destroy( mRockets.back() );
+		mRockets.pop_back();
+	}
+
+	while( mRockets.size() < aCount )
+	{
+		auto const i = mRockets.size();
+		auto const seed = std::uint32_t(i);
+
+		Vec3f const origin = kFieldOrigin_ + Vec3f{
+			float(i % kColumns_) * -kSpacing_,
+			0.f,
+			float(i / kColumns_) * -kSpacing_
+		};
+
+		Transform xform;
+		xform.translation = origin;
+
+		Animator anim;
+		anim.origin = origin;
+		anim.velocity = Vec3f{ 0.f, 0.5f + 2.f * hash01_( seed ), 0.f };
+		anim.range = 20.f + 30.f * hash01_( seed * 3u + 1u );
+
+		// Stagger the launches so that the field does not move in lockstep
+		xform.translation.y = anim.range * hash01_( seed * 7u + 5u );
+
+		// Slight variation in brightness between the rockets
+		float const shade = 0.8f + 0.2f * hash01_( seed * 11u + 3u );
+
+		auto const e = aRegistry.create();
+		aRegistry.emplace<Transform>( e, xform );
+		aRegistry.emplace<Animator>( e, anim );
+		aRegistry.emplace<Instance>( e, Instance{ mMesh, Vec4f{ shade, shade, shade, 1.f } } );
+		aRegistry.emplace<Material>( e, mMaterial );
+		aRegistry.emplace<Bounds>( e, mBounds );
+		aRegistry.emplace<Visibility>( e );
+
+		mRockets.emplace_back( e );
+	}
+}
+
+std::size_t RocketField::size() const noexcept
+{
+	return mRockets.size();
+}
@@ -0,0 +1,33 @@
+#ifndef ROCKET_FIELD_HPP
+#define ROCKET_FIELD_HPP
+
+#include <vector>
+
+#include <cstdlib>
+
+#include "ecs.hpp"
+#include "components.hpp"
+
+// A grid of rockets launching on a loop next to the launch pad. Used to
+// exercise the renderer with large numbers of objects. All rockets are
+// instances of the same InstancedMesh.
+class RocketField
+{
+	public:
+		RocketField( InstancedMesh&, Material, Bounds );
+
+	public:
+		// Spawn or destroy rockets until there are aCount of them.
+		void resize( Registry&, std::size_t aCount );
+
+		std::size_t size() const noexcept;
+
+	private:
+		InstancedMesh* mMesh;
+		Material mMaterial;
+		Bounds mBounds;
+
+		std::vector<Entity> mRockets;
+};
+
+#endif // ROCKET_FIELD_HPP
@@ -0,0 +1,111 @@
+#include "scene_description.hpp"
+
+#include <cassert>
+
+#include "loadobj.hpp"
+
+SceneDescription make_scene_description()
+{
+	SceneDescription ret;
+
+	ret.meshes.resize( kSceneMeshCount );
+
+	auto& launch = ret.meshes[kSceneLaunch];
+	launch.path = "external/Scene/scene.obj";
+	launch.preTransform = make_scaling( 0.49f, 0.49f, 0.49f ) * make_translation( { 4.09f, 0.f, 4.08f } );
+	launch.parent = kNoSceneParent;
+	launch.translation = { 0.f, 0.f, 0.f };
+	launch.doubleSided = true;
+
+	auto& rocket = ret.meshes[kSceneRocket];
+	rocket.path = "external/Rocket/rocket.obj";
+	rocket.preTransform = make_scaling( 0.005f, 0.005f, 0.005f ) *
+		make_rotation_x( 3.141592f / -2.f ) *
+		make_translation( { 750.f, -400.f, 600.f } );
+	rocket.parent = kNoSceneParent;
+	rocket.translation = { 0.f, 0.f, 0.f };
+	rocket.texture = "external/Rocket/rocket.jpg";
+
+	auto& fanBase = ret.meshes[kSceneFanBase];
+	fanBase.path = "external/Fan/fan_base.obj";
+	fanBase.preTransform = make_scaling( 0.1f, 0.1f, 0.1f );
+	fanBase.parent = kNoSceneParent;
+	fanBase.translation = { 5.1f, 0.715f, 21.6f };
+
+	auto& fanMotor = ret.meshes[kSceneFanMotor];
+	fanMotor.path = "external/Fan/fan_motor.obj";
+	fanMotor.preTransform = make_scaling( 0.1f, 0.1f, 0.1f );
+	fanMotor.parent = kSceneFanBase;
+	fanMotor.translation = { 0.f, 0.07f, 0.f };
+	fanMotor.doubleSided = true;
+
+	auto& fanBlade = ret.meshes[kSceneFanBlade];
+	fanBlade.path = "external/Fan/fan_blade.obj";
+	fanBlade.preTransform = make_scaling( 0.1f, 0.1f, 0.1f ) * make_translation( { 0.f, -1.f, 0.f } );
+	fanBlade.parent = kSceneFanMotor;
+	fanBlade.translation = { 0.f, 0.105f, 0.f };
+
+	ret.lights = {
+		// Launchpad floodlights (red, blue)
+		ScenePointLight{ { 2.7f, 10.f, 1.51f }, { 1.f, 0.f, 0.f }, 0.3f, 0.25f, 1 },
+		ScenePointLight{ { 2.7f, 10.f, 2.5f }, { 0.f, 0.f, 1.f }, 0.3f, 0.25f, 2 },
+		// Moonlight
+		ScenePointLight{ { 19.7f, 17.7f, 23.8f }, { 1.f, 1.f, 1.f }, 1.f, 0.5f, -1 },
+		// Interior lights
+		ScenePointLight{ { 1.7f, 1.63f, 22.21f }, { 1.f, 1.f, 1.f }, 0.5f, 0.f, 0 },
+		ScenePointLight{ { 6.1f, 1.63f, 22.21f }, { 1.f, 1.f, 1.f }, 0.5f, 0.1f, 0 }
+	};
+
+	ret.skyboxFaces = {
+		"external/skybox/right.png",
+		"external/skybox/left.png",
+		"external/skybox/top.png",
+		"external/skybox/bottom.png",
+		"external/skybox/front.png",
+		"external/skybox/back.png"
+	};
+
+	ret.camera.theta = 0.f;
+	ret.camera.phi = 0.f;
+	ret.camera.x = -3.5f;
+	ret.camera.y = -1.07f;
+	ret.camera.radius = 22.29f;
+	ret.camera.fovY = 60.f * 3.1415926f / 180.f;
+	ret.camera.zNear = 0.1f;
+	ret.camera.zFar = 100.f;
+
+	return ret;
+}
+
+void load_scene_meshes( SceneDescription& aScene, JobSystem& aJobs, JobCounter& aCounter )
+{
+	for( auto& mesh : aScene.meshes )
+	{
+		aJobs.run( [&mesh] {
+			mesh.mesh = load_wavefront_obj( mesh.path, mesh.preTransform );
+		}, &aCounter );
+	}
+}
+
+Mat44f scene_mesh_world( SceneDescription const& aScene, std::size_t aMesh ) noexcept
+{
+	Mat44f ret = kIdentity44f;
+	for( auto i = aMesh; kNoSceneParent != i; i = aScene.meshes[i].parent )
+	{
+		assert( i < aScene.meshes.size() );
+		ret = make_translation( aScene.meshes[i].translation ) * ret;
+	}
+	return ret;
+}
+
+Mat44f scene_camera_world2camera( SceneCamera const& aCamera ) noexcept
+{
+	return make_rotation_x( aCamera.theta ) *
+		make_rotation_y( aCamera.phi ) *
+		make_translation( { aCamera.x, aCamera.y, -aCamera.radius } );
+}
+
+Mat44f scene_camera_projection( SceneCamera const& aCamera, float aAspect ) noexcept
+{
+	return make_perspective_projection( aCamera.fovY, aAspect, aCamera.zNear, aCamera.zFar );
+}
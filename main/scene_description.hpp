@@ -0,0 +1,106 @@
+#ifndef SCENE_DESCRIPTION_HPP
+#define SCENE_DESCRIPTION_HPP
+
+// CPU-side description of the launch scene: the OBJ meshes and where they
+// are placed, the point lights, the skybox and the initial camera. Shared by
+// the OpenGL viewer and the offline (CPU) renderers, so that they all show
+// the same scene.
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat33.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/jobs.hpp"
+
+#include "simple_mesh.hpp"
+
+// Indices into SceneDescription::meshes
+enum SceneMeshIndex : std::size_t
+{
+	kSceneLaunch = 0,
+	kSceneRocket,
+	kSceneFanBase,
+	kSceneFanMotor,
+	kSceneFanBlade,
+
+	kSceneMeshCount
+};
+
+struct SceneMesh
+{
+	char const* path; // OBJ file
+	Mat44f preTransform; // applied when loading (see load_wavefront_obj())
+
+	SimpleMeshData mesh; // filled by load_scene_meshes()
+
+	// Placement: translation relative to the parent mesh (or the world, if
+	// parent is kNoSceneParent), as with SceneGraph nodes. This is the rest
+	// pose; the viewer animates the fan and the rocket.
+	std::size_t parent;
+	Vec3f translation;
+
+	char const* texture = nullptr; // diffuse texture, if any
+	bool doubleSided = false; // drawn without backface culling
+};
+
+constexpr std::size_t kNoSceneParent = ~std::size_t(0);
+
+// Point light, parameterized as in the viewer's lighting(). With the
+// default settings, the light's diffuse intensity is color * brightness, its
+// ambient intensity 1% of that, and its specular intensity color * specular.
+// Attenuation is 1 / (constant + linear*d + quadratic*d^2), see default.frag.
+struct ScenePointLight
+{
+	Vec3f position;
+	Vec3f color;
+	float brightness;
+	float specular;
+
+	// UI controls that may override color and brightness in the viewer
+	// (0 = interior, 1 = launchpad 1, 2 = launchpad 2), or -1.
+	int control;
+
+	float constant = 1.f;
+	float linear = 0.09f;
+	float quadratic = 0.032f;
+};
+
+// Camera as controlled by the viewer: world2camera = Rx(theta) * Ry(phi) *
+// T(x, y, -radius).
+struct SceneCamera
+{
+	float theta, phi;
+	float x, y, radius;
+
+	float fovY; // radians
+	float zNear, zFar;
+};
+
+struct SceneDescription
+{
+	std::vector<SceneMesh> meshes; // kSceneMeshCount, in SceneMeshIndex order
+	std::vector<ScenePointLight> lights;
+	std::vector<std::string> skyboxFaces; // +X, -X, +Y, -Y, +Z, -Z
+	SceneCamera camera;
+};
+
+// The launch scene. Meshes are not loaded yet.
+SceneDescription make_scene_description();
+
+// Load all meshes of the description in the background. Wait on aCounter
+// before accessing them.
+void load_scene_meshes( SceneDescription&, JobSystem&, JobCounter& aCounter );
+
+// World transform of a mesh in its rest pose.
+Mat44f scene_mesh_world( SceneDescription const&, std::size_t aMesh ) noexcept;
+
+Mat44f scene_camera_world2camera( SceneCamera const& ) noexcept;
+Mat44f scene_camera_projection( SceneCamera const&, float aAspect ) noexcept;
+
+#endif // SCENE_DESCRIPTION_HPP
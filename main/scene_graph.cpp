@@ -0,0 +1,110 @@
+#include "scene_graph.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "../support/error.hpp"
+
+SceneGraph::NodeId SceneGraph::add_node( NodeId aParent, Vec3f aTranslation, Vec3f aRotation, Vec3f aScale )
+{
+	auto const id = NodeId(mParent.size());
+	if( kNoParent != aParent && aParent >= id )
+		throw Error( "SceneGraph::add_node(): parent %u does not exist", unsigned(aParent) );
+
+	mParent.emplace_back( aParent );
+	mTranslation.emplace_back( aTranslation );
+	mRotation.emplace_back( aRotation );
+	mScale.emplace_back( aScale );
+	mWorld.emplace_back( kIdentity44f );
+	mNormal.emplace_back( kIdentity33f );
+	mDirty.emplace_back( std::uint8_t(0) );
+
+	mark_dirty_( id );
+	return id;
+}
+
+void SceneGraph::set_translation( NodeId aNode, Vec3f aTranslation )
+{
+	assert( aNode < mParent.size() );
+	mTranslation[aNode] = aTranslation;
+	mark_dirty_( aNode );
+}
+void SceneGraph::set_rotation( NodeId aNode, Vec3f aRotation )
+{
+	assert( aNode < mParent.size() );
+	mRotation[aNode] = aRotation;
+	mark_dirty_( aNode );
+}
+void SceneGraph::set_scale( NodeId aNode, Vec3f aScale )
+{
+	assert( aNode < mParent.size() );
+	mScale[aNode] = aScale;
+	mark_dirty_( aNode );
+}
+
+void SceneGraph::update()
+{
+	auto const count = NodeId(mParent.size());
+
+	// Parents precede their children, so a single forward sweep is enough.
+	// A recomputed node stays flagged until the end of the sweep, which is how
+	// the change propagates down to its descendants.
+	for( NodeId i = mFirstDirty; i < count; ++i )
+	{
+		auto const parent = mParent[i];
+		bool const parentDirty = kNoParent != parent && mDirty[parent];
+
+		if( !mDirty[i] && !parentDirty )
+			continue;
+
+		mDirty[i] = 1;
+
+		Mat44f const local = make_local_transform( mTranslation[i], mRotation[i], mScale[i] );
+
+		mWorld[i] = kNoParent != parent ? mWorld[parent] * local : local;
+		mNormal[i] = mat44_to_mat33( transpose( invert( mWorld[i] ) ) );
+	}
+
+	if( mFirstDirty < count )
+		std::fill( mDirty.begin() + mFirstDirty, mDirty.end(), std::uint8_t(0) );
+
+	mFirstDirty = count;
+}
+
+std::size_t SceneGraph::size() const noexcept
+{
+	return mParent.size();
+}
+
+SceneGraph::NodeId SceneGraph::parent( NodeId aNode ) const noexcept
+{
+	assert( aNode < mParent.size() );
+	return mParent[aNode];
+}
+
+Mat44f const& SceneGraph::world( NodeId aNode ) const noexcept
+{
+	assert( aNode < mWorld.size() );
+	return mWorld[aNode];
+}
+Mat33f const& SceneGraph::normal_matrix( NodeId aNode ) const noexcept
+{
+	assert( aNode < mNormal.size() );
+	return mNormal[aNode];
+}
+
+void SceneGraph::mark_dirty_( NodeId aNode )
+{
+	mDirty[aNode] = 1;
+	mFirstDirty = std::min( mFirstDirty, aNode );
+}
+
+Mat44f make_local_transform( Vec3f aTranslation, Vec3f aRotation, Vec3f aScale ) noexcept
+{
+	return make_translation( aTranslation )
+		* make_rotation_z( aRotation.z )
+		* make_rotation_y( aRotation.y )
+		* make_rotation_x( aRotation.x )
+		* make_scaling( aScale.x, aScale.y, aScale.z )
+	;
+}
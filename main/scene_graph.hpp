@@ -0,0 +1,77 @@
+#ifndef SCENE_GRAPH_HPP
+#define SCENE_GRAPH_HPP
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat33.hpp"
+#include "../vmlib/mat44.hpp"
+
+/** SceneGraph: retained transform hierarchy
+ *
+ * Each node stores a local translation/rotation/scale. World and normal
+ * matrices are cached and only recomputed when a node (or one of its
+ * ancestors) has been modified since the last update().
+ *
+ * Nodes live in flat arrays. A node's parent must exist when the node is
+ * added, so parents always come before their children. update() is therefore
+ * a single linear sweep over the arrays, starting at the first dirty node. If
+ * nothing has changed, update() returns immediately.
+ *
+ * Rotations are Euler angles in radians, applied around X, then Y, then Z.
+ */
+class SceneGraph
+{
+	public:
+		using NodeId = std::uint32_t;
+
+		static constexpr NodeId kNoParent = ~NodeId(0);
+
+	public:
+		NodeId add_node(
+			NodeId aParent = kNoParent,
+			Vec3f aTranslation = { 0.f, 0.f, 0.f },
+			Vec3f aRotation = { 0.f, 0.f, 0.f },
+			Vec3f aScale = { 1.f, 1.f, 1.f }
+		);
+
+		void set_translation( NodeId, Vec3f );
+		void set_rotation( NodeId, Vec3f );
+		void set_scale( NodeId, Vec3f );
+
+		// Recompute world/normal matrices of all dirty nodes and their
+		// descendants.
+		void update();
+
+	public:
+		std::size_t size() const noexcept;
+
+		NodeId parent( NodeId ) const noexcept;
+
+		Mat44f const& world( NodeId ) const noexcept;
+		Mat33f const& normal_matrix( NodeId ) const noexcept;
+
+	private:
+		void mark_dirty_( NodeId );
+
+	private:
+		std::vector<NodeId> mParent;
+
+		std::vector<Vec3f> mTranslation;
+		std::vector<Vec3f> mRotation;
+		std::vector<Vec3f> mScale;
+
+		std::vector<Mat44f> mWorld;
+		std::vector<Mat33f> mNormal;
+
+		std::vector<std::uint8_t> mDirty;
+		NodeId mFirstDirty = 0;
+};
+
+// Local transform from translation, rotation (as in SceneGraph) and scale.
+Mat44f make_local_transform( Vec3f aTranslation, Vec3f aRotation, Vec3f aScale ) noexcept;
+
+#endif // SCENE_GRAPH_HPP
@@ -1,32 +1,242 @@
 #include "screenshot.hpp"
 
-void saveScreenshot()
+#include <chrono>
+#include <filesystem>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "../support/profiler.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr char const* kScreenshotDir_ = "screenshots";
+}
+
+ScreenshotQueue::ScreenshotQueue( JobSystem& aJobs )
+	: mJobs( aJobs )
+{}
+
+ScreenshotQueue::~ScreenshotQueue()
+{
+	// Make sure everything that was captured ends up on disk
+	for( auto& slot : mSlots )
+	{
+		if( SlotState_::reading == slot->state )
+		{
+			glClientWaitSync( slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000) );
+			finish_( *slot );
+		}
+	}
+
+	mJobs.wait( mEncoders );
+
+	for( auto& slot : mSlots )
+	{
+		if( SlotState_::converting == slot->state )
+		{
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, slot->pbo );
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+		}
+		glDeleteBuffers( 1, &slot->pbo );
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+}
+
+void ScreenshotQueue::capture( GLsizei aWidth, GLsizei aHeight )
 {
-	GLint viewport[4];
-	char filepath[50];
+	PROFILE_ZONE( "capture screenshot" );
 
-	glGetIntegerv(GL_VIEWPORT, viewport);
-	int width = viewport[2];
-	int height = viewport[3];
+	if( aWidth <= 0 || aHeight <= 0 )
+		return;
 
-	char* data = (char*)malloc((size_t)(width * height * 3));
-	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data); //capture pixel data
-	stbi_flip_vertically_on_write(1);
-	const char* filename = getScreenshotName();
-	strcpy(filepath, "screenshots/");
-	strcat(filepath, filename);
-	stbi_write_png(filepath, width, height, 3, data, 0); //save stored pixels to png
-	
-	free(data);
+	Slot_* slot = nullptr;
+	for( auto& s : mSlots )
+	{
+		if( SlotState_::free == s->state )
+		{
+			slot = s.get();
+			break;
+		}
+	}
+	if( !slot )
+	{
+		mSlots.emplace_back( std::make_unique<Slot_>() );
+		slot = mSlots.back().get();
+		glGenBuffers( 1, &slot->pbo );
+	}
 
+	auto const bytes = std::size_t(aWidth) * std::size_t(aHeight) * 4;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, slot->pbo );
+	if( bytes > slot->capacity )
+	{
+		glBufferData( GL_PIXEL_PACK_BUFFER, GLsizeiptr(bytes), nullptr, GL_STREAM_READ );
+		slot->capacity = bytes;
+	}
+
+	// RGBA is the format that drivers can copy without conversion. With a
+	// pack buffer bound, glReadPixels() returns immediately.
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	glReadPixels( 0, 0, aWidth, aHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	slot->fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	slot->width = aWidth;
+	slot->height = aHeight;
+	slot->path = (fs::path(kScreenshotDir_) / getScreenshotName()).replace_extension( image_format_extension( mFormat ) ).string();
+	slot->format = mFormat;
+	slot->converted = false;
+	slot->state = SlotState_::reading;
 }
 
-const char* getScreenshotName() {
+void ScreenshotQueue::update()
+{
+	for( auto& slot : mSlots )
+	{
+		switch( slot->state )
+		{
+			case SlotState_::free:
+				break;
 
-	static char basename[30];
+			case SlotState_::reading:
+			{
+				// Poll; never wait
+				auto const status = glClientWaitSync( slot->fence, 0, 0 );
+				if( GL_ALREADY_SIGNALED == status || GL_CONDITION_SATISFIED == status )
+					finish_( *slot );
+			} break;
 
-	time_t t = time(NULL);
-	strftime(basename, 30, "%Y%m%d_%H%M%S.png", localtime(&t)); //contruct filename from time and date
+			case SlotState_::converting:
+			{
+				if( slot->converted.load( std::memory_order_acquire ) )
+				{
+					glBindBuffer( GL_PIXEL_PACK_BUFFER, slot->pbo );
+					glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+					glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+					slot->state = SlotState_::free;
+				}
+			} break;
+		}
+	}
+}
+
+void ScreenshotQueue::set_format( ImageFormat aFormat ) noexcept
+{
+	mFormat = aFormat;
+}
+ImageFormat ScreenshotQueue::format() const noexcept
+{
+	return mFormat;
+}
+
+ImageWriteStats ScreenshotQueue::last_stats() const
+{
+	std::lock_guard<std::mutex> lock( mStatsMutex );
+	return mLastStats;
+}
+
+std::size_t ScreenshotQueue::pending() const noexcept
+{
+	std::size_t count = 0;
+	for( auto const& slot : mSlots )
+	{
+		if( SlotState_::reading == slot->state )
+			++count;
+	}
+	return count;
+}
+
+void ScreenshotQueue::finish_( Slot_& aSlot )
+{
+	assert( SlotState_::reading == aSlot.state );
+
+	glDeleteSync( aSlot.fence );
+	aSlot.fence = nullptr;
+
+	auto const bytes = std::size_t(aSlot.width) * std::size_t(aSlot.height) * 4;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, aSlot.pbo );
+	auto const* pixels = static_cast<unsigned char const*>(glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(bytes), GL_MAP_READ_BIT ));
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	if( !pixels )
+	{
+		std::fprintf( stderr, "Screenshot '%s': unable to map pixel buffer\n", aSlot.path.c_str() );
+		aSlot.state = SlotState_::free;
+		return;
+	}
+
+	aSlot.state = SlotState_::converting;
+
+	mJobs.run( [this, slot = &aSlot, pixels] {
+		// Copy the slot's state first; once converted is set, the slot may be
+		// reused by the next capture(). The zone reads its text when it ends.
+		auto const width = std::size_t(slot->width);
+		auto const height = std::size_t(slot->height);
+		auto const path = slot->path;
+		auto const format = slot->format;
+
+		PROFILE_ZONE_TEXT( "encode screenshot", path.c_str() );
+
+		// Flip and drop alpha. After this, the pixel buffer may be reused.
+		std::vector<unsigned char> rgb( width * height * 3 );
+		for( std::size_t y = 0; y < height; ++y )
+		{
+			auto const* src = pixels + (height-1-y) * width * 4;
+			auto* dst = rgb.data() + y * width * 3;
+			for( std::size_t x = 0; x < width; ++x )
+			{
+				dst[3*x+0] = src[4*x+0];
+				dst[3*x+1] = src[4*x+1];
+				dst[3*x+2] = src[4*x+2];
+			}
+		}
+
+		slot->converted.store( true, std::memory_order_release );
+
+		std::error_code ec;
+		fs::create_directories( kScreenshotDir_, ec );
+
+		try
+		{
+			auto const stats = write_image( path.c_str(), format, width, height, rgb.data(), &mJobs );
+			std::printf( "Screenshot '%s' (%s): %.1f MB -> %.1f MB in %.1f ms, %.0f MB/s\n", path.c_str(), image_format_name( format ), stats.pixelBytes * 1e-6, stats.fileBytes * 1e-6, stats.encodeSeconds * 1e3, stats.throughput_mbps() );
+
+			std::lock_guard<std::mutex> lock( mStatsMutex );
+			mLastStats = stats;
+		}
+		catch( std::exception const& eErr )
+		{
+			std::fprintf( stderr, "Unable to write screenshot '%s': %s\n", path.c_str(), eErr.what() );
+		}
+	}, &mEncoders );
+}
+
+
+std::string getScreenshotName() {
+
+	//called by the render thread (screenshots) and the main thread (posters)
+	static std::atomic<unsigned> sequence{ 0 };
+
+	auto const now = std::chrono::system_clock::now();
+	time_t t = std::chrono::system_clock::to_time_t(now);
+	auto const ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+
+	struct tm local;
+#	if defined(_WIN32)
+	localtime_s(&local, &t);
+#	else
+	localtime_r(&t, &local);
+#	endif
+
+	//date and time, milliseconds, and a sequence number so that names never repeat
+	char basename[48];
+	std::size_t const len = strftime(basename, sizeof(basename), "%Y%m%d_%H%M%S", &local);
+	std::snprintf(basename + len, sizeof(basename) - len, "_%03d_%u.png", int(ms), sequence.fetch_add(1, std::memory_order_relaxed));
 
 	return basename;
-}
\ No newline at end of file
+}
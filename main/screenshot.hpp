@@ -3,16 +3,100 @@
 
 #include <glad.h>
 #include <GLFW/glfw3.h>
-#include <stb_image_write.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
 
-void saveScreenshot();
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
-const char* getScreenshotName();
+#include "../support/jobs.hpp"
 
-#endif // !SCREENSHOT_HPP
+#include "image_writer.hpp"
+
+/** ScreenshotQueue: asynchronous screenshots
+ *
+ * capture() copies the back buffer into a pixel pack buffer (PBO) and inserts
+ * a fence; it does not wait for the GPU. update(), called once per frame,
+ * checks the fences without blocking. Once a copy has completed, the PBO is
+ * mapped and a job converts the pixels (RGBA to RGB, bottom-up to top-down)
+ * and writes an image in the selected format (see image_writer.hpp) to
+ * screenshots/. The PBO is unmapped and reused as soon as the conversion is
+ * done, without waiting for the encoder. Each screenshot prints its encode
+ * throughput.
+ *
+ * The destructor waits for all outstanding screenshots.
+ */
+class ScreenshotQueue final
+{
+	public:
+		explicit ScreenshotQueue( JobSystem& );
+		~ScreenshotQueue();
+
+		ScreenshotQueue( ScreenshotQueue const& ) = delete;
+		ScreenshotQueue& operator= (ScreenshotQueue const&) = delete;
+
+	public:
+		// Capture the aWidth x aHeight lower left region of the back buffer.
+		// Call after rendering, before swapping buffers.
+		void capture( GLsizei aWidth, GLsizei aHeight );
+
+		void update();
+
+		// Screenshots that have not been handed to the encoder yet
+		std::size_t pending() const noexcept;
+
+		// Applies to subsequent captures
+		void set_format( ImageFormat ) noexcept;
+		ImageFormat format() const noexcept;
+
+		// Most recently written screenshot
+		ImageWriteStats last_stats() const;
+
+	private:
+		enum class SlotState_
+		{
+			free,
+			reading,    // glReadPixels() issued, waiting for the fence
+			converting  // mapped, the job is reading from it
+		};
+
+		struct Slot_
+		{
+			GLuint pbo = 0;
+			std::size_t capacity = 0; // bytes
 
+			SlotState_ state = SlotState_::free;
+			GLsync fence = nullptr;
+
+			GLsizei width = 0, height = 0;
+			std::string path;
+			ImageFormat format = ImageFormat::png;
+
+			std::atomic<bool> converted{ false };
+		};
+
+		void finish_( Slot_& );
+
+	private:
+		JobSystem& mJobs;
+		JobCounter mEncoders;
+
+		std::vector<std::unique_ptr<Slot_>> mSlots; // grows as needed
+
+		ImageFormat mFormat = ImageFormat::png;
+
+		mutable std::mutex mStatsMutex;
+		ImageWriteStats mLastStats;
+};
+
+// File name for a new screenshot, based on the current date and time. Unique
+// within the process; can be called from any thread.
+std::string getScreenshotName();
+
+#endif // !SCREENSHOT_HPP
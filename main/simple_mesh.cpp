@@ -1,6 +1,8 @@
 #include "simple_mesh.hpp"
 #include <iostream>
 #include <filesystem>
+#include "../support/profiler.hpp"
+#include "../support/gl_state.hpp"
 using namespace std;
 
 SimpleMeshData concatenate(SimpleMeshData aM, SimpleMeshData const& aN)
@@ -62,7 +64,7 @@ GLuint create_vao(SimpleMeshData const& aMeshData)
 
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	glstate::bind_vertex_array(vao);
 
 	glBindBuffer(GL_ARRAY_BUFFER, position);
 
@@ -146,7 +148,7 @@ GLuint create_vao(SimpleMeshData const& aMeshData)
 	);
 	glEnableVertexAttribArray(7);
 
-	glBindVertexArray(0);
+	glstate::bind_vertex_array(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glDeleteBuffers(1, &position);
 	glDeleteBuffers(1, &normals);
@@ -164,10 +166,11 @@ GLuint create_vao(SimpleMeshData const& aMeshData)
 //method to load textures using stbi_load
 GLuint load_texture_2d (char const* aPath) {
   assert(aPath);
+  PROFILE_ZONE_TEXT("load texture", aPath);
     
   GLuint tex = 0;
   glGenTextures(1, &tex);
-  glBindTexture(GL_TEXTURE_2D, tex);
+  glstate::edit_texture(GL_TEXTURE_2D, tex);
     
   stbi_set_flip_vertically_on_load(true);
 
@@ -199,9 +202,10 @@ GLuint load_texture_2d (char const* aPath) {
 
 //method to load cubemap textures using stbi_load
 GLuint load_cubemap(std::vector<std::string> faces) {
+	PROFILE_ZONE("load cubemap");
 	GLuint textureID = 0;
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	glstate::edit_texture(GL_TEXTURE_CUBE_MAP, textureID);
 	stbi_set_flip_vertically_on_load(0); //dont flip image on load
 	int width, height, nrComponents;
 	for (unsigned int i = 0; i < faces.size(); i++)
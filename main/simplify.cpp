@@ -0,0 +1,319 @@
+#include "simplify.hpp"
+
+#include <queue>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cmath>
+#include <cassert>
+
+namespace
+{
+	// Symmetric 4x4 error quadric (upper triangle)
+	struct Quadric_
+	{
+		double a2 = 0., ab = 0., ac = 0., ad = 0.;
+		double b2 = 0., bc = 0., bd = 0.;
+		double c2 = 0., cd = 0.;
+		double d2 = 0.;
+	};
+
+	Quadric_ make_plane_quadric_( double aA, double aB, double aC, double aD ) noexcept
+	{
+		Quadric_ q;
+		q.a2 = aA*aA; q.ab = aA*aB; q.ac = aA*aC; q.ad = aA*aD;
+		q.b2 = aB*aB; q.bc = aB*aC; q.bd = aB*aD;
+		q.c2 = aC*aC; q.cd = aC*aD;
+		q.d2 = aD*aD;
+		return q;
+	}
+
+	void accumulate_( Quadric_& aQ, Quadric_ const& aR ) noexcept
+	{
+		aQ.a2 += aR.a2; aQ.ab += aR.ab; aQ.ac += aR.ac; aQ.ad += aR.ad;
+		aQ.b2 += aR.b2; aQ.bc += aR.bc; aQ.bd += aR.bd;
+		aQ.c2 += aR.c2; aQ.cd += aR.cd;
+		aQ.d2 += aR.d2;
+	}
+
+	double evaluate_( Quadric_ const& aQ, Vec3f aP ) noexcept
+	{
+		double const x = aP.x, y = aP.y, z = aP.z;
+		double const e = aQ.a2*x*x + 2.*aQ.ab*x*y + 2.*aQ.ac*x*z + 2.*aQ.ad*x
+			+ aQ.b2*y*y + 2.*aQ.bc*y*z + 2.*aQ.bd*y
+			+ aQ.c2*z*z + 2.*aQ.cd*z
+			+ aQ.d2;
+		return std::max( e, 0. ); // rounding
+	}
+
+	struct Collapse_
+	{
+		double cost;
+		std::uint32_t from; // canonical vertex that is removed
+		std::uint32_t to; // vertex (index) that replaces it
+		std::uint32_t fromVersion, toVersion;
+
+		bool operator< (Collapse_ const& aOther) const noexcept
+		{
+			return cost > aOther.cost; // min-heap
+		}
+	};
+}
+
+std::vector<std::uint32_t> simplify_mesh( Vec3f const* aPositions, std::size_t aVertexCount, std::uint32_t const* aIndices, std::size_t aIndexCount, std::size_t aTargetIndexCount, float* aOutError )
+{
+	assert( aIndexCount % 3 == 0 );
+
+	std::vector<std::uint32_t> indices( aIndices, aIndices + aIndexCount );
+	if( aOutError )
+		*aOutError = 0.f;
+
+	if( aIndexCount <= aTargetIndexCount )
+		return indices;
+
+	// Weld vertices by position. canon[v] is the first vertex with the same
+	// position as v; copies[c] is the number of vertices welded to c.
+	std::vector<std::uint32_t> canon( aVertexCount );
+	std::vector<std::uint32_t> copies( aVertexCount, 0 );
+	{
+		std::vector<std::uint32_t> order( aVertexCount );
+		std::iota( order.begin(), order.end(), 0u );
+
+		auto const less = [&] ( std::uint32_t aX, std::uint32_t aY ) {
+			auto const& x = aPositions[aX];
+			auto const& y = aPositions[aY];
+			if( x.x != y.x ) return x.x < y.x;
+			if( x.y != y.y ) return x.y < y.y;
+			if( x.z != y.z ) return x.z < y.z;
+			return aX < aY;
+		};
+		std::sort( order.begin(), order.end(), less );
+
+		for( std::size_t i = 0; i < aVertexCount; )
+		{
+			auto const first = order[i];
+			auto const& p = aPositions[first];
+
+			std::size_t j = i;
+			for( ; j < aVertexCount; ++j )
+			{
+				auto const& q = aPositions[order[j]];
+				if( q.x != p.x || q.y != p.y || q.z != p.z )
+					break;
+
+				canon[order[j]] = first;
+			}
+
+			copies[first] = std::uint32_t(j - i);
+			i = j;
+		}
+	}
+
+	std::size_t const triCount = aIndexCount / 3;
+
+	// Lock vertices on open or non-manifold edges, and seam vertices
+	std::vector<std::uint8_t> locked( aVertexCount, 0 );
+	{
+		std::unordered_map<std::uint64_t, std::uint32_t> edges;
+		edges.reserve( aIndexCount );
+
+		for( std::size_t t = 0; t < triCount; ++t )
+		{
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				auto a = canon[indices[3*t+j]];
+				auto b = canon[indices[3*t+(j+1)%3]];
+				if( a > b )
+					std::swap( a, b );
+
+				++edges[(std::uint64_t(a) << 32) | b];
+			}
+		}
+
+		for( auto const& edge : edges )
+		{
+			if( 2 != edge.second )
+			{
+				locked[edge.first >> 32] = 1;
+				locked[edge.first & 0xffffffffu] = 1;
+			}
+		}
+
+		for( std::size_t v = 0; v < aVertexCount; ++v )
+		{
+			if( canon[v] == v && copies[v] > 1 )
+				locked[v] = 1;
+		}
+	}
+
+	// Per-vertex quadrics (sum of the planes of the adjacent triangles) and
+	// triangle adjacency, both on canonical vertices
+	std::vector<Quadric_> quadrics( aVertexCount );
+	std::vector<std::vector<std::uint32_t>> adjacent( aVertexCount );
+	std::vector<std::uint8_t> alive( triCount, 1 );
+
+	for( std::size_t t = 0; t < triCount; ++t )
+	{
+		auto const& a = aPositions[indices[3*t+0]];
+		auto const& b = aPositions[indices[3*t+1]];
+		auto const& c = aPositions[indices[3*t+2]];
+
+		auto const n = cross( b - a, c - a );
+		float const len = length( n );
+
+		if( len > 0.f )
+		{
+			auto const un = n / len;
+			auto const q = make_plane_quadric_( un.x, un.y, un.z, -dot( un, a ) );
+			for( std::size_t j = 0; j < 3; ++j )
+				accumulate_( quadrics[canon[indices[3*t+j]]], q );
+		}
+
+		for( std::size_t j = 0; j < 3; ++j )
+			adjacent[canon[indices[3*t+j]]].emplace_back( std::uint32_t(t) );
+	}
+
+	// Candidate collapses. Entries are validated lazily when popped: any
+	// change to either endpoint bumps its version.
+	std::vector<std::uint32_t> version( aVertexCount, 0 );
+	std::vector<std::uint8_t> removed( aVertexCount, 0 );
+	std::priority_queue<Collapse_> queue;
+
+	auto const push_candidate = [&] ( std::uint32_t aFrom, std::uint32_t aTo ) {
+		auto const to = canon[aTo];
+		if( locked[aFrom] || aFrom == to )
+			return;
+
+		Quadric_ q = quadrics[aFrom];
+		accumulate_( q, quadrics[to] );
+
+		queue.push( Collapse_{
+			evaluate_( q, aPositions[aTo] ),
+			aFrom, aTo,
+			version[aFrom], version[to]
+		} );
+	};
+
+	// Both directions of all edges at aVertex
+	auto const push_vertex = [&] ( std::uint32_t aVertex ) {
+		for( auto const t : adjacent[aVertex] )
+		{
+			if( !alive[t] )
+				continue;
+
+			std::uint32_t const* tri = &indices[3*t];
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				if( canon[tri[j]] != aVertex )
+					continue;
+
+				for( std::size_t k = 1; k < 3; ++k )
+				{
+					auto const w = tri[(j+k)%3];
+					push_candidate( aVertex, w );
+					push_candidate( canon[w], tri[j] );
+				}
+			}
+		}
+	};
+
+	for( std::size_t v = 0; v < aVertexCount; ++v )
+	{
+		if( canon[v] == v )
+			push_vertex( std::uint32_t(v) );
+	}
+
+	std::size_t liveTris = triCount;
+	double maxCost = 0.;
+
+	while( 3*liveTris > aTargetIndexCount && !queue.empty() )
+	{
+		auto const col = queue.top();
+		queue.pop();
+
+		auto const u = col.from;
+		auto const v = canon[col.to];
+		if( removed[u] || removed[v] || version[u] != col.fromVersion || version[v] != col.toVersion )
+			continue;
+
+		// Reject collapses that flip (or degenerate) any of the remaining
+		// triangles around u
+		auto const& target = aPositions[col.to];
+
+		bool flips = false;
+		for( auto const t : adjacent[u] )
+		{
+			if( !alive[t] )
+				continue;
+
+			std::uint32_t const* tri = &indices[3*t];
+			if( canon[tri[0]] == v || canon[tri[1]] == v || canon[tri[2]] == v )
+				continue; // removed by the collapse
+
+			Vec3f before[3], after[3];
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				before[j] = aPositions[tri[j]];
+				after[j] = canon[tri[j]] == u ? target : before[j];
+			}
+
+			auto const n0 = cross( before[1] - before[0], before[2] - before[0] );
+			auto const n1 = cross( after[1] - after[0], after[2] - after[0] );
+			if( dot( n0, n1 ) <= 0.f )
+			{
+				flips = true;
+				break;
+			}
+		}
+
+		if( flips )
+			continue;
+
+		// Collapse u into v
+		for( auto const t : adjacent[u] )
+		{
+			if( !alive[t] )
+				continue;
+
+			std::uint32_t* tri = &indices[3*t];
+			if( canon[tri[0]] == v || canon[tri[1]] == v || canon[tri[2]] == v )
+			{
+				alive[t] = 0;
+				--liveTris;
+				continue;
+			}
+
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				if( canon[tri[j]] == u )
+					tri[j] = col.to;
+			}
+
+			adjacent[v].emplace_back( t );
+		}
+
+		adjacent[u].clear();
+		removed[u] = 1;
+		accumulate_( quadrics[v], quadrics[u] );
+		++version[v];
+
+		maxCost = std::max( maxCost, col.cost );
+
+		// Costs of all edges at v have changed
+		push_vertex( v );
+	}
+
+	std::vector<std::uint32_t> ret;
+	ret.reserve( 3*liveTris );
+	for( std::size_t t = 0; t < triCount; ++t )
+	{
+		if( alive[t] )
+			ret.insert( ret.end(), indices.begin()+3*t, indices.begin()+3*t+3 );
+	}
+
+	if( aOutError )
+		*aOutError = float(std::sqrt( maxCost ));
+
+	return ret;
+}
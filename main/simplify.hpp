@@ -0,0 +1,36 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+// Mesh simplification for level-of-detail generation. No OpenGL
+// dependencies.
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec3.hpp"
+
+// Simplify an indexed triangle mesh with quadric error metric (Garland &
+// Heckbert) guided edge collapses, until at most aTargetIndexCount indices
+// remain or no further collapse is possible. Returns the new index list.
+//
+// Collapses are half-edge collapses: a vertex is merged into one of its
+// neighbours, so the result only references existing vertices, and can share
+// the vertex buffer with the original mesh. Vertices that have copies with
+// the same position (attribute seams, e.g., texture coordinate or normal
+// discontinuities) and vertices on open borders are never moved, which keeps
+// seams and silhouettes of open meshes intact at the cost of limiting how far
+// such meshes can be reduced.
+//
+// If aOutError is non-null, it receives the largest error introduced by a
+// collapse, as an object-space distance (the square root of the quadric
+// error, i.e., roughly how far the surface moved).
+std::vector<std::uint32_t> simplify_mesh(
+	Vec3f const* aPositions, std::size_t aVertexCount,
+	std::uint32_t const* aIndices, std::size_t aIndexCount,
+	std::size_t aTargetIndexCount,
+	float* aOutError = nullptr
+);
+
+#endif // SIMPLIFY_HPP
@@ -0,0 +1,108 @@
+#include "simulation.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include "../support/jobs.hpp"
+#include "../support/profiler.hpp"
+
+#include "components.hpp"
+#include "scene_graph.hpp"
+
+namespace
+{
+	constexpr float kPi_ = 3.1415926f;
+
+	constexpr float kFanSpeed_ = 0.3f * kPi_; // radians per second
+
+	// The ascent was a per-frame update, tuned at this rate
+	constexpr float kAscentReferenceRate_ = 60.f;
+	constexpr float kAscentRate_ = 0.015f;
+}
+
+FixedTimestep::FixedTimestep( float aRate, float aMaxFrameTime ) noexcept
+	: mStep( 1.0 / double(aRate) )
+	, mMaxSteps( double(aMaxFrameTime) * double(aRate) )
+{}
+
+std::size_t FixedTimestep::advance( float aFrameTime ) noexcept
+{
+	mAccumulator = std::min( mAccumulator + double(aFrameTime) / mStep, mMaxSteps );
+
+	// Tolerate rounding in aFrameTime / mStep, so that, e.g., 1/60 s at 240 Hz
+	// is always exactly four steps.
+	auto const steps = std::floor( mAccumulator + 1e-6 );
+	mAccumulator = std::max( 0.0, mAccumulator - steps );
+
+	mTotalSteps += std::uint64_t(steps);
+	return std::size_t(steps);
+}
+
+float FixedTimestep::step() const noexcept
+{
+	return float(mStep);
+}
+float FixedTimestep::alpha() const noexcept
+{
+	return float(std::min( mAccumulator, 1.0 - 1e-6 ));
+}
+
+std::uint64_t FixedTimestep::total_steps() const noexcept
+{
+	return mTotalSteps;
+}
+
+
+void step_launch( LaunchState& aState, float aDt, bool aAscending, float aSpeed ) noexcept
+{
+	aState.angle += aDt * kFanSpeed_;
+	if( aState.angle >= 2.f * kPi_ )
+		aState.angle -= 2.f * kPi_;
+
+	if( !aAscending )
+		return;
+
+	// Per reference frame, the height used to grow by a factor of (1+r). The
+	// very first frame moved the rocket by r off the pad.
+	float const rate = kAscentRate_ * aSpeed / (aState.rocketHeight < 8.f ? 1.11f : 1.1f);
+	float frames = aDt * kAscentReferenceRate_;
+
+	if( aState.liftoff < 1.f )
+	{
+		float const ramp = std::min( frames, 1.f - aState.liftoff );
+		aState.rocketHeight += rate * ramp;
+		aState.liftoff += ramp;
+		frames -= ramp;
+	}
+
+	aState.rocketHeight *= std::pow( 1.f + rate, frames );
+}
+
+LaunchState interpolate( LaunchState const& aPrevious, LaunchState const& aCurrent, float aAlpha ) noexcept
+{
+	// The fan angle wraps around
+	float dAngle = aCurrent.angle - aPrevious.angle;
+	if( dAngle < -kPi_ )
+		dAngle += 2.f * kPi_;
+
+	LaunchState ret;
+	ret.angle = aPrevious.angle + dAngle * aAlpha;
+	ret.rocketHeight = aPrevious.rocketHeight + (aCurrent.rocketHeight - aPrevious.rocketHeight) * aAlpha;
+	ret.liftoff = aCurrent.liftoff;
+	return ret;
+}
+
+void interpolate_animators( Registry& aRegistry, JobSystem& aJobs, float aLag )
+{
+	PROFILE_ZONE( "interpolate animators" );
+
+	aRegistry.each_parallel<Animator, Transform>( aJobs, [aLag] ( Entity, Animator const& aAnim, Transform& aXform ) {
+		auto const translation = aXform.translation - aAnim.velocity * aLag;
+		auto const rotation = aXform.rotation - aAnim.angularVelocity * aLag;
+
+		aXform.world = make_local_transform( translation, rotation, aXform.scale );
+		aXform.normal = mat44_to_mat33( transpose( invert( aXform.world ) ) );
+		aXform.dirty = false;
+	} );
+}
@@ -0,0 +1,66 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ecs.hpp"
+
+class JobSystem;
+
+/** FixedTimestep: run the simulation at a fixed rate, independent of the
+ * frame rate
+ *
+ * Each frame, advance() adds the frame time to an accumulator and returns
+ * the number of whole steps to simulate. The remainder, as a fraction of a
+ * step (alpha()), is used to interpolate between the last two simulated
+ * states for rendering.
+ *
+ * The accumulator counts steps in double precision, so that a fixed frame
+ * time that is a multiple of the step (e.g. 1/60 s at 240 Hz) always gives
+ * the same number of steps. At most aMaxFrameTime seconds are simulated per
+ * frame; if the simulation falls further behind, time is dropped rather than
+ * simulated in ever larger bursts.
+ */
+class FixedTimestep final
+{
+	public:
+		explicit FixedTimestep( float aRate = 240.f, float aMaxFrameTime = 0.25f ) noexcept;
+
+	public:
+		std::size_t advance( float aFrameTime ) noexcept;
+
+		float step() const noexcept; // seconds
+		float alpha() const noexcept; // in [0,1)
+
+		std::uint64_t total_steps() const noexcept;
+
+	private:
+		double mStep;
+		double mMaxSteps;
+		double mAccumulator = 0.0; // steps
+		std::uint64_t mTotalSteps = 0;
+};
+
+// State of the launch scene animation (fan and rocket)
+struct LaunchState
+{
+	float angle = 0.f; // fan, in [0, 2pi)
+	float rocketHeight = 0.f;
+	float liftoff = 0.f; // progress through the first (reference) frame of the ascent, in [0,1]
+};
+
+// Advance by aDt seconds. The ascent was originally tuned as a per-frame
+// update at 60 Hz; any step size gives the same trajectory.
+void step_launch( LaunchState&, float aDt, bool aAscending, float aSpeed ) noexcept;
+
+// State aAlpha of the way from aPrevious to aCurrent
+LaunchState interpolate( LaunchState const& aPrevious, LaunchState const& aCurrent, float aAlpha ) noexcept;
+
+// Compute the world transforms of entities with an Animator as they were
+// aLag seconds before their simulated state, i.e., interpolated between the
+// last two steps (motion is linear). Replaces update_transforms() for these
+// entities; call it every frame.
+void interpolate_animators( Registry&, JobSystem&, float aLag );
+
+#endif // SIMULATION_HPP
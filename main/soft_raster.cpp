@@ -0,0 +1,519 @@
+#include "soft_raster.hpp"
+
+#include <memory>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#if defined(__AVX__)
+#	include <immintrin.h>
+#endif
+
+namespace
+{
+	// Screen tiles are kTileSize_ x kTileSize_ pixels. A multiple of eight,
+	// so that the rasterizer's eight-pixel spans never straddle tiles.
+	constexpr int kTileSize_ = 64;
+
+	// Mesh triangles per setup chunk
+	constexpr std::size_t kChunkTriangles_ = 4096;
+
+	constexpr std::uint32_t kNoTriangle_ = ~std::uint32_t(0);
+
+	Vec3f mul_( Vec3f aLeft, Vec3f aRight ) noexcept
+	{
+		return Vec3f{ aLeft.x * aRight.x, aLeft.y * aRight.y, aLeft.z * aRight.z };
+	}
+
+	Vec4f lerp_( Vec4f aA, Vec4f aB, float aT ) noexcept
+	{
+		return aA + aT * (aB - aA);
+	}
+
+	// Per-vertex material attributes may be missing; same defaults as
+	// build_indexed_mesh()
+	template< typename tType >
+	tType attribute_( std::vector<tType> const& aValues, std::size_t aIndex, tType const& aDefault ) noexcept
+	{
+		return aIndex < aValues.size() ? aValues[aIndex] : aDefault;
+	}
+}
+
+// Tile-local depth and visibility buffers
+struct alignas(32) SoftRasterizer::Tile_
+{
+	float depth[kTileSize_*kTileSize_];
+	float l1[kTileSize_*kTileSize_], l2[kTileSize_*kTileSize_]; // screen-space barycentrics
+	std::uint32_t id[kTileSize_*kTileSize_]; // index into triangles, or kNoTriangle_
+
+	std::vector<Triangle_ const*> triangles;
+};
+
+SoftRasterizer::SoftRasterizer( std::size_t aWidth, std::size_t aHeight )
+	: mWidth( std::max<std::size_t>( aWidth, 1 ) )
+	, mHeight( std::max<std::size_t>( aHeight, 1 ) )
+	, mTilesX( (mWidth + kTileSize_-1) / kTileSize_ )
+	, mTilesY( (mHeight + kTileSize_-1) / kTileSize_ )
+	, mViewProj( kIdentity44f )
+	, mInvViewProj( kIdentity44f )
+	, mCameraPosition{ 0.f, 0.f, 0.f }
+	, mClearColor{ 0.5f, 0.5f, 0.5f } // glClearColor() in main()
+	, mColor( mWidth*mHeight )
+	, mDepth( mWidth*mHeight, 1.f )
+{}
+
+void SoftRasterizer::begin( Mat44f const& aWorld2Camera, Mat44f const& aProjection, std::vector<ScenePointLight> const& aLights )
+{
+	mViewProj = aProjection * aWorld2Camera;
+	mInvViewProj = invert( mViewProj );
+
+	auto const eye = invert( aWorld2Camera ) * Vec4f{ 0.f, 0.f, 0.f, 1.f };
+	mCameraPosition = Vec3f{ eye.x, eye.y, eye.z } / eye.w;
+
+	mLights = aLights;
+
+	mDraws.clear();
+	mChunks.clear();
+}
+
+void SoftRasterizer::add_mesh( SimpleMeshData const& aMesh, Mat44f const& aWorld, CpuTexture const* aTexture, bool aDoubleSided, Vec3f const* aEmissive )
+{
+	// Texturing needs texture coordinates for every vertex
+	if( aMesh.texcoords.size() != aMesh.positions.size() )
+		aTexture = nullptr;
+
+	auto const draw = std::uint32_t(mDraws.size());
+	mDraws.emplace_back( Draw_{
+		&aMesh,
+		aWorld,
+		mat44_to_mat33( transpose( invert( aWorld ) ) ),
+		aTexture,
+		aDoubleSided,
+		nullptr != aEmissive,
+		aEmissive ? *aEmissive : Vec3f{ 0.f, 0.f, 0.f }
+	} );
+
+	auto const triangles = aMesh.positions.size() / 3;
+	for( std::size_t b = 0; b < triangles; b += kChunkTriangles_ )
+	{
+		Chunk_ chunk;
+		chunk.draw = draw;
+		chunk.begin = b;
+		chunk.end = std::min( triangles, b + kChunkTriangles_ );
+		mChunks.emplace_back( std::move(chunk) );
+	}
+}
+
+void SoftRasterizer::render( JobSystem& aJobs )
+{
+	aJobs.parallel_for( 0, mChunks.size(), 1, [this] ( std::size_t aBegin, std::size_t aEnd ) {
+		for( auto i = aBegin; i < aEnd; ++i )
+			setup_chunk_( mChunks[i] );
+	} );
+
+	mTriangleCount = 0;
+	for( auto const& chunk : mChunks )
+		mTriangleCount += chunk.triangles.size();
+
+	aJobs.parallel_for( 0, mTilesX*mTilesY, 1, [this] ( std::size_t aBegin, std::size_t aEnd ) {
+		auto tile = std::make_unique<Tile_>();
+		for( auto i = aBegin; i < aEnd; ++i )
+		{
+			render_tile_( i, *tile );
+			shade_tile_( i, *tile );
+		}
+	} );
+}
+
+std::vector<unsigned char> SoftRasterizer::resolve() const
+{
+	std::vector<unsigned char> ret( mWidth * mHeight * 3 );
+
+	for( std::size_t y = 0; y < mHeight; ++y )
+	{
+		Vec3f const* src = mColor.data() + (mHeight-1-y) * mWidth;
+		unsigned char* dst = ret.data() + y * mWidth * 3;
+		for( std::size_t x = 0; x < mWidth; ++x, dst += 3 )
+		{
+			dst[0] = linear_to_srgb8( src[x].x );
+			dst[1] = linear_to_srgb8( src[x].y );
+			dst[2] = linear_to_srgb8( src[x].z );
+		}
+	}
+
+	return ret;
+}
+
+void SoftRasterizer::set_clear_color( Vec3f aColor ) noexcept
+{
+	mClearColor = aColor;
+}
+void SoftRasterizer::set_skybox( CpuCubemap const* aSkybox ) noexcept
+{
+	mSkybox = aSkybox;
+}
+
+std::size_t SoftRasterizer::width() const noexcept
+{
+	return mWidth;
+}
+std::size_t SoftRasterizer::height() const noexcept
+{
+	return mHeight;
+}
+
+std::size_t SoftRasterizer::triangle_count() const noexcept
+{
+	return mTriangleCount;
+}
+
+float SoftRasterizer::depth( std::size_t aX, std::size_t aY ) const noexcept
+{
+	assert( aX < mWidth && aY < mHeight );
+	return mDepth[aY*mWidth + aX];
+}
+
+
+void SoftRasterizer::setup_chunk_( Chunk_& aChunk )
+{
+	auto const& draw = mDraws[aChunk.draw];
+	auto const xform = mViewProj * draw.world;
+
+	aChunk.triangles.clear();
+	aChunk.bins.assign( mTilesX*mTilesY, {} );
+
+	static constexpr Vec3f kCorners[3] = {
+		{ 1.f, 0.f, 0.f },
+		{ 0.f, 1.f, 0.f },
+		{ 0.f, 0.f, 1.f }
+	};
+
+	for( auto t = aChunk.begin; t < aChunk.end; ++t )
+	{
+		auto const source = std::uint32_t(t*3);
+
+		Vec4f clip[3];
+		float dist[3]; // to the near plane (z >= -w); inside if >= 0
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const& p = draw.mesh->positions[source+j];
+			clip[j] = xform * Vec4f{ p.x, p.y, p.z, 1.f };
+			dist[j] = clip[j].z + clip[j].w;
+		}
+
+		if( dist[0] >= 0.f && dist[1] >= 0.f && dist[2] >= 0.f )
+		{
+			emit_triangle_( aChunk, clip, kCorners, source, draw.doubleSided );
+			continue;
+		}
+
+		if( dist[0] < 0.f && dist[1] < 0.f && dist[2] < 0.f )
+			continue;
+
+		// Clip against the near plane (Sutherland-Hodgman). This yields a
+		// triangle or a quad, which is split into two triangles.
+		Vec4f polyClip[4];
+		Vec3f polyBary[4];
+		std::size_t count = 0;
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const k = (j+1) % 3;
+			if( dist[j] >= 0.f )
+			{
+				polyClip[count] = clip[j];
+				polyBary[count] = kCorners[j];
+				++count;
+			}
+			if( (dist[j] >= 0.f) != (dist[k] >= 0.f) )
+			{
+				float const s = dist[j] / (dist[j] - dist[k]);
+				polyClip[count] = lerp_( clip[j], clip[k], s );
+				polyBary[count] = kCorners[j] + s * (kCorners[k] - kCorners[j]);
+				++count;
+			}
+		}
+
+		for( std::size_t j = 1; j+1 < count; ++j )
+		{
+			Vec4f const c[3] = { polyClip[0], polyClip[j], polyClip[j+1] };
+			Vec3f const b[3] = { polyBary[0], polyBary[j], polyBary[j+1] };
+			emit_triangle_( aChunk, c, b, source, draw.doubleSided );
+		}
+	}
+}
+
+void SoftRasterizer::emit_triangle_( Chunk_& aChunk, Vec4f const (&aClip)[3], Vec3f const (&aBary)[3], std::uint32_t aSource, bool aDoubleSided )
+{
+	auto const fw = float(mWidth), fh = float(mHeight);
+
+	Triangle_ tri;
+	for( std::size_t j = 0; j < 3; ++j )
+	{
+		float const iw = 1.f / aClip[j].w;
+		tri.x[j] = (aClip[j].x * iw * 0.5f + 0.5f) * fw;
+		tri.y[j] = (aClip[j].y * iw * 0.5f + 0.5f) * fh;
+		tri.z[j] = aClip[j].z * iw * 0.5f + 0.5f;
+		tri.invW[j] = iw;
+		tri.bary[j] = aBary[j];
+	}
+
+	// Counter-clockwise triangles face the camera (glFrontFace() default)
+	float const area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+	if( 0.f == area || (!aDoubleSided && area < 0.f) )
+		return;
+
+	// Pixel centers covered by the bounding box
+	tri.minX = std::max( 0, int(std::ceil( std::min( { tri.x[0], tri.x[1], tri.x[2] } ) - 0.5f )) );
+	tri.maxX = std::min( int(mWidth)-1, int(std::floor( std::max( { tri.x[0], tri.x[1], tri.x[2] } ) - 0.5f )) );
+	tri.minY = std::max( 0, int(std::ceil( std::min( { tri.y[0], tri.y[1], tri.y[2] } ) - 0.5f )) );
+	tri.maxY = std::min( int(mHeight)-1, int(std::floor( std::max( { tri.y[0], tri.y[1], tri.y[2] } ) - 0.5f )) );
+
+	if( tri.minX > tri.maxX || tri.minY > tri.maxY )
+		return;
+
+	tri.draw = aChunk.draw;
+	tri.source = aSource;
+
+	auto const index = std::uint32_t(aChunk.triangles.size());
+	aChunk.triangles.emplace_back( tri );
+
+	for( int ty = tri.minY / kTileSize_; ty <= tri.maxY / kTileSize_; ++ty )
+	{
+		for( int tx = tri.minX / kTileSize_; tx <= tri.maxX / kTileSize_; ++tx )
+			aChunk.bins[ty*mTilesX + tx].emplace_back( index );
+	}
+}
+
+void SoftRasterizer::render_tile_( std::size_t aIndex, Tile_& aOut ) const noexcept
+{
+	int const tileX = int(aIndex % mTilesX) * kTileSize_;
+	int const tileY = int(aIndex / mTilesX) * kTileSize_;
+	int const tileMaxX = std::min( tileX + kTileSize_, int(mWidth) ) - 1;
+	int const tileMaxY = std::min( tileY + kTileSize_, int(mHeight) ) - 1;
+
+	std::fill( std::begin( aOut.depth ), std::end( aOut.depth ), 1.f );
+	std::fill( std::begin( aOut.id ), std::end( aOut.id ), kNoTriangle_ );
+	aOut.triangles.clear();
+
+	for( auto const& chunk : mChunks )
+	{
+		for( auto const index : chunk.bins[aIndex] )
+		{
+			auto const& tri = chunk.triangles[index];
+			auto const id = std::uint32_t(aOut.triangles.size());
+			aOut.triangles.emplace_back( &tri );
+
+			int const minY = std::max( tri.minY, tileY );
+			int const maxY = std::min( tri.maxY, tileMaxY );
+			int const minX = std::max( tri.minX, tileX );
+			int const maxX = std::min( tri.maxX, tileMaxX );
+
+			// Edge functions e_i(x,y) = a_i*x + b_i*y + c_i, for the edge
+			// opposite of vertex i, as in OcclusionBuffer. Dividing by the
+			// area gives the screen-space barycentrics.
+			float a[3], b[3], c[3];
+			for( int i = 0; i < 3; ++i )
+			{
+				int const j = (i+1) % 3, k = (i+2) % 3;
+				a[i] = tri.y[j] - tri.y[k];
+				b[i] = tri.x[k] - tri.x[j];
+				c[i] = tri.x[j]*tri.y[k] - tri.x[k]*tri.y[j];
+			}
+
+			float const area = c[0] + c[1] + c[2];
+			if( 0.f == area )
+				continue;
+
+			float const ia = 1.f / area;
+			for( int i = 0; i < 3; ++i )
+			{
+				a[i] *= ia;
+				b[i] *= ia;
+				c[i] *= ia;
+			}
+
+			// Depth is affine in screen space: z(x,y) = za*x + zb*y + zc
+			float const za = a[0]*tri.z[0] + a[1]*tri.z[1] + a[2]*tri.z[2];
+			float const zb = b[0]*tri.z[0] + b[1]*tri.z[1] + b[2]*tri.z[2];
+			float const zc = c[0]*tri.z[0] + c[1]*tri.z[1] + c[2]*tri.z[2];
+
+			for( int y = minY; y <= maxY; ++y )
+			{
+				float const py = float(y) + 0.5f;
+				auto const row = std::size_t(y - tileY) * kTileSize_;
+
+#				if defined(__AVX__)
+				__m256 const offs = _mm256_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f );
+				__m256 const zero = _mm256_setzero_ps();
+
+				__m256 const a0 = _mm256_set1_ps( a[0] ), a1 = _mm256_set1_ps( a[1] ), a2 = _mm256_set1_ps( a[2] );
+				__m256 const r0 = _mm256_set1_ps( b[0]*py + c[0] );
+				__m256 const r1 = _mm256_set1_ps( b[1]*py + c[1] );
+				__m256 const r2 = _mm256_set1_ps( b[2]*py + c[2] );
+				__m256 const za8 = _mm256_set1_ps( za );
+				__m256 const zr = _mm256_set1_ps( zb*py + zc );
+				__m256 const id8 = _mm256_castsi256_ps( _mm256_set1_epi32( int(id) ) );
+
+				// Spans are aligned to eight pixels within the tile
+				for( int x = minX & ~7; x <= maxX; x += 8 )
+				{
+					__m256 const px = _mm256_add_ps( _mm256_set1_ps( float(x) ), offs );
+
+					__m256 const e0 = _mm256_add_ps( _mm256_mul_ps( a0, px ), r0 );
+					__m256 const e1 = _mm256_add_ps( _mm256_mul_ps( a1, px ), r1 );
+					__m256 const e2 = _mm256_add_ps( _mm256_mul_ps( a2, px ), r2 );
+
+					__m256 const inside = _mm256_and_ps(
+						_mm256_cmp_ps( e0, zero, _CMP_GE_OQ ),
+						_mm256_and_ps( _mm256_cmp_ps( e1, zero, _CMP_GE_OQ ), _mm256_cmp_ps( e2, zero, _CMP_GE_OQ ) )
+					);
+
+					if( 0 == _mm256_movemask_ps( inside ) )
+						continue;
+
+					auto const o = row + std::size_t(x - tileX);
+
+					__m256 const z = _mm256_add_ps( _mm256_mul_ps( za8, px ), zr );
+					__m256 const old = _mm256_load_ps( aOut.depth + o );
+					__m256 const pass = _mm256_and_ps( inside, _mm256_cmp_ps( z, old, _CMP_LT_OQ ) );
+
+					if( 0 == _mm256_movemask_ps( pass ) )
+						continue;
+
+					_mm256_store_ps( aOut.depth + o, _mm256_blendv_ps( old, z, pass ) );
+					_mm256_store_ps( aOut.l1 + o, _mm256_blendv_ps( _mm256_load_ps( aOut.l1 + o ), e1, pass ) );
+					_mm256_store_ps( aOut.l2 + o, _mm256_blendv_ps( _mm256_load_ps( aOut.l2 + o ), e2, pass ) );
+
+					auto* const ids = reinterpret_cast<float*>( aOut.id + o );
+					_mm256_store_ps( ids, _mm256_blendv_ps( _mm256_load_ps( ids ), id8, pass ) );
+				}
+#				else // !__AVX__
+				for( int x = minX; x <= maxX; ++x )
+				{
+					float const px = float(x) + 0.5f;
+					float const e0 = a[0]*px + b[0]*py + c[0];
+					float const e1 = a[1]*px + b[1]*py + c[1];
+					float const e2 = a[2]*px + b[2]*py + c[2];
+					if( e0 < 0.f || e1 < 0.f || e2 < 0.f )
+						continue;
+
+					auto const o = row + std::size_t(x - tileX);
+					float const z = za*px + zb*py + zc;
+					if( z >= aOut.depth[o] )
+						continue;
+
+					aOut.depth[o] = z;
+					aOut.l1[o] = e1;
+					aOut.l2[o] = e2;
+					aOut.id[o] = id;
+				}
+#				endif // ~ __AVX__
+			}
+		}
+	}
+}
+
+void SoftRasterizer::shade_tile_( std::size_t aIndex, Tile_ const& aTile ) noexcept
+{
+	int const tileX = int(aIndex % mTilesX) * kTileSize_;
+	int const tileY = int(aIndex / mTilesX) * kTileSize_;
+	int const tileMaxX = std::min( tileX + kTileSize_, int(mWidth) ) - 1;
+	int const tileMaxY = std::min( tileY + kTileSize_, int(mHeight) ) - 1;
+
+	for( int y = tileY; y <= tileMaxY; ++y )
+	{
+		for( int x = tileX; x <= tileMaxX; ++x )
+		{
+			auto const o = std::size_t(y - tileY) * kTileSize_ + std::size_t(x - tileX);
+			auto const pixel = std::size_t(y) * mWidth + std::size_t(x);
+
+			mDepth[pixel] = aTile.depth[o];
+
+			if( kNoTriangle_ == aTile.id[o] )
+			{
+				if( !mSkybox )
+				{
+					mColor[pixel] = mClearColor;
+					continue;
+				}
+
+				// View direction through the pixel center
+				float const ndcX = (float(x) + 0.5f) / mWidth * 2.f - 1.f;
+				float const ndcY = (float(y) + 0.5f) / mHeight * 2.f - 1.f;
+				auto const farPoint = mInvViewProj * Vec4f{ ndcX, ndcY, 1.f, 1.f };
+				mColor[pixel] = mSkybox->sample( Vec3f{ farPoint.x, farPoint.y, farPoint.z } / farPoint.w - mCameraPosition );
+				continue;
+			}
+
+			auto const& tri = *aTile.triangles[aTile.id[o]];
+			auto const& draw = mDraws[tri.draw];
+			auto const& mesh = *draw.mesh;
+
+			// Emissive meshes are flat and unlit; texturing takes precedence,
+			// as in default.frag
+			if( draw.emissive && !draw.texture )
+			{
+				mColor[pixel] = draw.emissiveColor;
+				continue;
+			}
+
+			// Perspective-correct barycentrics, first of the (possibly
+			// clipped) screen triangle and then of the mesh triangle
+			float const s1 = aTile.l1[o], s2 = aTile.l2[o];
+			float const p0 = (1.f - s1 - s2) * tri.invW[0], p1 = s1 * tri.invW[1], p2 = s2 * tri.invW[2];
+			float const ip = 1.f / (p0 + p1 + p2);
+			auto const bary = (p0 * ip) * tri.bary[0] + (p1 * ip) * tri.bary[1] + (p2 * ip) * tri.bary[2];
+
+			auto const v = tri.source;
+			auto const local = bary.x * mesh.positions[v] + bary.y * mesh.positions[v+1] + bary.z * mesh.positions[v+2];
+			auto const world4 = draw.world * Vec4f{ local.x, local.y, local.z, 1.f };
+			Vec3f const position{ world4.x, world4.y, world4.z };
+
+			// default.vert normalizes the normal per vertex
+			auto const normal = normalize(
+				bary.x * normalize( draw.normal * mesh.normals[v] ) +
+				bary.y * normalize( draw.normal * mesh.normals[v+1] ) +
+				bary.z * normalize( draw.normal * mesh.normals[v+2] )
+			);
+
+			// Material attributes are constant per face
+			auto const& material = mesh.material;
+			auto const ambient = attribute_( material.ambient, v, Vec3f{ 0.f, 0.f, 0.f } );
+			auto const diffuse = attribute_( material.diffuse, v, Vec3f{ 0.f, 0.f, 0.f } );
+			auto const specular = attribute_( material.specular, v, Vec3f{ 0.f, 0.f, 0.f } );
+			float const shininess = attribute_( material.shininess, v, 1.f );
+
+			// CalcPointLight() in default.frag
+			auto const viewDir = normalize( mCameraPosition - position );
+			Vec3f result{ 0.f, 0.f, 0.f };
+			for( auto const& light : mLights )
+			{
+				auto const toLight = light.position - position;
+				float const distance = length( toLight );
+				auto const lightDir = toLight / distance;
+				auto const halfDir = normalize( lightDir + viewDir );
+
+				float const diff = std::max( 0.f, dot( normal, lightDir ) );
+				float const spec = std::pow( std::max( 0.f, dot( normal, halfDir ) ), shininess );
+				float const attenuation = 1.f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+
+				// Light colours as set up by lighting() in main.cpp
+				auto const diffuseColor = light.color * light.brightness;
+				auto const ambientColor = diffuseColor * 0.01f;
+				auto const specularColor = light.color * light.specular;
+
+				result += attenuation * (mul_( ambientColor, ambient ) + diff * mul_( diffuseColor, diffuse ) + spec * mul_( specularColor, specular ));
+			}
+
+			if( draw.texture )
+			{
+				auto const uv = bary.x * mesh.texcoords[v] + bary.y * mesh.texcoords[v+1] + bary.z * mesh.texcoords[v+2];
+				auto const tex = draw.texture->sample( uv );
+				result = mul_( result, Vec3f{ tex.x, tex.y, tex.z } );
+			}
+
+			mColor[pixel] = result;
+		}
+	}
+}
@@ -0,0 +1,148 @@
+#ifndef SOFT_RASTER_HPP
+#define SOFT_RASTER_HPP
+
+// Software rasterizer: renders SimpleMeshData with the shading of
+// default.vert/default.frag on the CPU, for machines without a GPU
+// (regression and performance tests). Like occlusion.hpp, this only depends
+// on vmlib (and the job system) and makes no OpenGL calls.
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec2.hpp"
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat33.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/jobs.hpp"
+
+#include "cpu_texture.hpp"
+#include "simple_mesh.hpp"
+#include "scene_description.hpp"
+
+/** SoftRasterizer: tiled, multithreaded CPU rasterizer
+ *
+ * Usage, per frame:
+ *   rast.begin( world2camera, projection, lights );
+ *   rast.add_mesh( mesh, world, texture, doubleSided ); // for each mesh
+ *   rast.render( jobs );
+ *   image = rast.resolve();
+ *
+ * render() runs in three phases:
+ *  - setup: triangles are transformed, clipped against the near plane,
+ *    backface culled (unless double-sided) and binned into screen tiles.
+ *    Triangles are processed in parallel chunks; each chunk has its own bins,
+ *    so no locking is needed, and tiles visit chunks in order, so that
+ *    triangles are drawn in submission order.
+ *  - rasterization: each tile is rasterized into a tile-local depth buffer
+ *    and visibility buffer (triangle and barycentrics per pixel), eight
+ *    pixels at a time with AVX if available.
+ *  - shading: each visible pixel of the tile is shaded once, as in
+ *    default.frag (Blinn-Phong, diffuse texture, emissive colour).
+ *    Missing per-vertex material attributes get the defaults of
+ *    build_indexed_mesh().
+ * Tiles are rasterized and shaded in parallel with the job system.
+ *
+ * Pixels not covered by any triangle show the skybox (if set) or the clear
+ * colour. Meshes are treated as opaque, as in the viewer. The mesh data and
+ * textures passed to add_mesh() must stay alive until render() returns.
+ */
+class SoftRasterizer final
+{
+	public:
+		explicit SoftRasterizer( std::size_t aWidth = 1280, std::size_t aHeight = 720 );
+
+	public:
+		void begin( Mat44f const& aWorld2Camera, Mat44f const& aProjection, std::vector<ScenePointLight> const& aLights );
+
+		// With aEmissive and no texture, the mesh is drawn unlit in that
+		// colour. The viewer's UI colour overrides are not known here;
+		// pass the colour that is in effect.
+		void add_mesh( SimpleMeshData const&, Mat44f const& aWorld, CpuTexture const* aTexture = nullptr, bool aDoubleSided = false, Vec3f const* aEmissive = nullptr );
+
+		void render( JobSystem& );
+
+		// Colour buffer as 8-bit sRGB, RGB interleaved, top row first.
+		std::vector<unsigned char> resolve() const;
+
+	public:
+		void set_clear_color( Vec3f ) noexcept;
+		void set_skybox( CpuCubemap const* ) noexcept;
+
+	public:
+		std::size_t width() const noexcept;
+		std::size_t height() const noexcept;
+
+		// Triangles rasterized in the last render() (after clipping/culling)
+		std::size_t triangle_count() const noexcept;
+
+		// Depth in [0,1] (1 = far plane / nothing drawn) at pixel (aX, aY);
+		// row 0 is the bottom row, as in OpenGL.
+		float depth( std::size_t aX, std::size_t aY ) const noexcept;
+
+	private:
+		struct Draw_
+		{
+			SimpleMeshData const* mesh;
+			Mat44f world;
+			Mat33f normal;
+			CpuTexture const* texture;
+			bool doubleSided;
+			bool emissive;
+			Vec3f emissiveColor;
+		};
+
+		// Screen-space triangle. Clipping may split a mesh triangle in two;
+		// both pieces refer to the mesh triangle through 'source', with the
+		// barycentrics of their vertices relative to it.
+		struct Triangle_
+		{
+			float x[3], y[3], z[3]; // pixels; depth in [0,1]
+			float invW[3];
+			Vec3f bary[3];
+
+			std::uint32_t draw;
+			std::uint32_t source; // index of the first vertex in the mesh
+			int minX, maxX, minY, maxY;
+		};
+
+		struct Chunk_
+		{
+			std::uint32_t draw;
+			std::size_t begin, end; // mesh triangles
+
+			std::vector<Triangle_> triangles;
+			std::vector<std::vector<std::uint32_t>> bins; // per tile
+		};
+
+		struct Tile_;
+
+		void setup_chunk_( Chunk_& );
+		void emit_triangle_( Chunk_&, Vec4f const (&aClip)[3], Vec3f const (&aBary)[3], std::uint32_t aSource, bool aDoubleSided );
+		void render_tile_( std::size_t aIndex, Tile_& ) const noexcept;
+		void shade_tile_( std::size_t aIndex, Tile_ const& ) noexcept;
+
+	private:
+		std::size_t mWidth, mHeight;
+		std::size_t mTilesX, mTilesY;
+
+		Mat44f mViewProj;
+		Mat44f mInvViewProj;
+		Vec3f mCameraPosition;
+		std::vector<ScenePointLight> mLights;
+
+		Vec3f mClearColor;
+		CpuCubemap const* mSkybox = nullptr;
+
+		std::vector<Draw_> mDraws;
+		std::vector<Chunk_> mChunks;
+
+		std::vector<Vec3f> mColor; // linear RGB, row 0 at the bottom
+		std::vector<float> mDepth;
+		std::size_t mTriangleCount = 0;
+};
+
+#endif // SOFT_RASTER_HPP
@@ -0,0 +1,306 @@
+#include "static_geometry.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <cassert>
+#include <cstring>
+#include <cstddef>
+
+#include "../support/error.hpp"
+#include "../support/profiler.hpp"
+#include "../support/gl_state.hpp"
+
+#include "simplify.hpp"
+
+namespace
+{
+	static_assert( sizeof(StaticVertex) == 19*sizeof(float), "StaticVertex must not contain padding" );
+
+	// Each LOD aims for half the triangles of the previous one. Stop once a
+	// level no longer gets noticeably smaller (the remaining vertices are
+	// locked) or is tiny anyway.
+	constexpr float kLodReduction_ = 0.5f;
+	constexpr float kLodMinReduction_ = 0.8f;
+	constexpr std::size_t kLodMinTriangles_ = 32;
+
+	// Vertices are compared bitwise; they only need to be merged if they are
+	// exact copies of each other, which is the common case in triangle soups.
+	struct VertexHash_
+	{
+		std::size_t operator()( StaticVertex const& aVertex ) const noexcept
+		{
+			std::uint32_t words[sizeof(StaticVertex)/sizeof(std::uint32_t)];
+			std::memcpy( words, &aVertex, sizeof(StaticVertex) );
+
+			std::uint64_t hash = 14695981039346656037ull; // FNV-1a
+			for( auto const w : words )
+			{
+				hash ^= w;
+				hash *= 1099511628211ull;
+			}
+			return std::size_t(hash);
+		}
+	};
+	struct VertexEqual_
+	{
+		bool operator()( StaticVertex const& aX, StaticVertex const& aY ) const noexcept
+		{
+			return 0 == std::memcmp( &aX, &aY, sizeof(StaticVertex) );
+		}
+	};
+
+	template< typename tType >
+	tType attribute_( std::vector<tType> const& aValues, std::size_t aIndex, tType const& aDefault ) noexcept
+	{
+		return aIndex < aValues.size() ? aValues[aIndex] : aDefault;
+	}
+}
+
+StaticGeometry::~StaticGeometry()
+{
+	glstate::forget_vertex_array( mVao );
+	glDeleteVertexArrays( 1, &mVao );
+	glDeleteBuffers( 1, &mVertexBuffer );
+	glDeleteBuffers( 1, &mIndexBuffer );
+	glDeleteBuffers( 1, &mDrawIdBuffer );
+}
+
+StaticGeometry::MeshId StaticGeometry::add( SimpleMeshData const& aMesh, bool aClustered, std::size_t aMaxLods )
+{
+	PROFILE_ZONE( "add static mesh" );
+
+	assert( aMaxLods >= 1 );
+
+	std::vector<StaticVertex> vertices;
+	std::vector<GLuint> indices;
+	build_indexed_mesh( aMesh, vertices, indices );
+
+	std::vector<Vec3f> positions( vertices.size() );
+	for( std::size_t i = 0; i < vertices.size(); ++i )
+		positions[i] = vertices[i].position;
+
+	// Simplified levels; built from the original index order, which is
+	// more coherent than the meshlet order
+	std::vector<std::vector<GLuint>> lodIndices;
+	std::vector<float> lodErrors;
+	for( std::size_t level = 1; level < aMaxLods; ++level )
+	{
+		auto const& prev = lodIndices.empty() ? indices : lodIndices.back();
+		if( prev.size() / 3 < 2*kLodMinTriangles_ )
+			break;
+
+		float error = 0.f;
+		auto lod = simplify_mesh( positions.data(), positions.size(), prev.data(), prev.size(), std::size_t(kLodReduction_ * prev.size()), &error );
+		if( float(lod.size()) > kLodMinReduction_ * prev.size() )
+			break;
+
+		lodErrors.emplace_back( std::max( error, lodErrors.empty() ? 0.f : lodErrors.back() ) );
+		lodIndices.emplace_back( std::move(lod) );
+	}
+
+	StaticMesh mesh{};
+	mesh.firstIndex = GLuint(mIndices.size());
+	mesh.indexCount = GLuint(indices.size());
+	mesh.baseVertex = GLint(mVertices.size());
+	mesh.vertexCount = GLuint(vertices.size());
+	mesh.firstMeshlet = std::uint32_t(mMeshlets.size());
+	mesh.meshletCount = 0;
+	mesh.firstLod = std::uint32_t(mLods.size());
+	mesh.lodCount = std::uint32_t(1 + lodIndices.size());
+
+	if( aClustered )
+	{
+		auto const clusters = build_meshlets( positions.data(), positions.size(), indices.data(), indices.size() );
+
+		// Re-emit the indices meshlet by meshlet
+		indices.clear();
+		for( auto const& m : clusters.meshlets )
+		{
+			StaticMeshlet meshlet{};
+			meshlet.firstIndex = mesh.firstIndex + GLuint(indices.size());
+			meshlet.indexCount = 3*m.triangleCount;
+			meshlet.center = m.center;
+			meshlet.radius = m.radius;
+			meshlet.coneAxis = m.coneAxis;
+			meshlet.coneCutoff = m.coneCutoff;
+			mMeshlets.emplace_back( meshlet );
+
+			for( std::uint32_t i = 0; i < 3*m.triangleCount; ++i )
+			{
+				auto const local = clusters.triangles[3*m.triangleOffset + i];
+				indices.emplace_back( clusters.vertices[m.vertexOffset + local] );
+			}
+		}
+
+		mesh.meshletCount = std::uint32_t(clusters.meshlets.size());
+		assert( indices.size() == mesh.indexCount );
+	}
+
+	mVertices.insert( mVertices.end(), vertices.begin(), vertices.end() );
+	mIndices.insert( mIndices.end(), indices.begin(), indices.end() );
+
+	mLods.emplace_back( StaticLod{ mesh.firstIndex, mesh.indexCount, 0.f } );
+	for( std::size_t i = 0; i < lodIndices.size(); ++i )
+	{
+		mLods.emplace_back( StaticLod{ GLuint(mIndices.size()), GLuint(lodIndices[i].size()), lodErrors[i] } );
+		mIndices.insert( mIndices.end(), lodIndices[i].begin(), lodIndices[i].end() );
+	}
+
+	auto const id = MeshId(mMeshes.size());
+	mMeshes.emplace_back( mesh );
+	return id;
+}
+
+void StaticGeometry::upload()
+{
+	PROFILE_ZONE( "upload static geometry" );
+
+	if( 0 == mVao )
+	{
+		glGenVertexArrays( 1, &mVao );
+		glGenBuffers( 1, &mVertexBuffer );
+		glGenBuffers( 1, &mIndexBuffer );
+		glGenBuffers( 1, &mDrawIdBuffer );
+	}
+
+	glstate::bind_vertex_array( mVao );
+
+	glBindBuffer( GL_ARRAY_BUFFER, mVertexBuffer );
+	glBufferData( GL_ARRAY_BUFFER, mVertices.size() * sizeof(StaticVertex), mVertices.data(), GL_STATIC_DRAW );
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint), mIndices.data(), GL_STATIC_DRAW );
+
+	setup_static_vertex_attributes();
+
+	// Draw ID: one value per instance. With instanceCount = 1, the value
+	// fetched is the one at baseInstance.
+	glBindBuffer( GL_ARRAY_BUFFER, mDrawIdBuffer );
+	glVertexAttribIPointer( 8, 1, GL_UNSIGNED_INT, 0, nullptr );
+	glVertexAttribDivisor( 8, 1 );
+	glEnableVertexAttribArray( 8 );
+
+	glstate::bind_vertex_array( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+	mDrawIdCount = 0;
+	reserve_draw_ids( 1024 );
+}
+
+void StaticGeometry::reserve_draw_ids( std::size_t aCount )
+{
+	assert( mDrawIdBuffer );
+	if( aCount <= mDrawIdCount )
+		return;
+
+	auto count = mDrawIdCount ? mDrawIdCount : 1;
+	while( count < aCount )
+		count *= 2;
+
+	std::vector<GLuint> ids( count );
+	for( std::size_t i = 0; i < count; ++i )
+		ids[i] = GLuint(i);
+
+	// The VAO refers to the buffer object, not its storage, so reallocating
+	// does not require the VAO to be updated.
+	glBindBuffer( GL_ARRAY_BUFFER, mDrawIdBuffer );
+	glBufferData( GL_ARRAY_BUFFER, count * sizeof(GLuint), ids.data(), GL_STATIC_DRAW );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	mDrawIdCount = count;
+}
+
+GLuint StaticGeometry::vao() const noexcept
+{
+	return mVao;
+}
+
+StaticMesh const& StaticGeometry::mesh( MeshId aId ) const noexcept
+{
+	assert( aId < mMeshes.size() );
+	return mMeshes[aId];
+}
+std::size_t StaticGeometry::mesh_count() const noexcept
+{
+	return mMeshes.size();
+}
+
+StaticMeshlet const* StaticGeometry::meshlets( MeshId aId ) const noexcept
+{
+	assert( aId < mMeshes.size() );
+	return mMeshlets.data() + mMeshes[aId].firstMeshlet;
+}
+
+StaticLod const* StaticGeometry::lods( MeshId aId ) const noexcept
+{
+	assert( aId < mMeshes.size() );
+	return mLods.data() + mMeshes[aId].firstLod;
+}
+
+std::size_t StaticGeometry::vertex_count() const noexcept
+{
+	return mVertices.size();
+}
+std::size_t StaticGeometry::index_count() const noexcept
+{
+	return mIndices.size();
+}
+
+
+void setup_static_vertex_attributes()
+{
+	// Same attribute locations as create_vao()
+	struct Attrib_ { GLuint location; GLint size; std::size_t offset; };
+	Attrib_ const attribs[] = {
+		{ 0, 3, offsetof(StaticVertex, position) },
+		{ 1, 3, offsetof(StaticVertex, ambient) },
+		{ 2, 3, offsetof(StaticVertex, normal) },
+		{ 3, 2, offsetof(StaticVertex, texcoord) },
+		{ 4, 3, offsetof(StaticVertex, diffuse) },
+		{ 5, 3, offsetof(StaticVertex, specular) },
+		{ 6, 1, offsetof(StaticVertex, shininess) },
+		{ 7, 1, offsetof(StaticVertex, alpha) }
+	};
+
+	for( auto const& attrib : attribs )
+	{
+		glVertexAttribPointer( attrib.location, attrib.size, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), reinterpret_cast<void const*>(attrib.offset) );
+		glEnableVertexAttribArray( attrib.location );
+	}
+}
+
+void build_indexed_mesh( SimpleMeshData const& aMesh, std::vector<StaticVertex>& aVertices, std::vector<GLuint>& aIndices )
+{
+	auto const count = aMesh.positions.size();
+	if( aMesh.normals.size() != count )
+		throw Error( "build_indexed_mesh(): mesh has %zu positions but %zu normals", count, aMesh.normals.size() );
+
+	aVertices.clear();
+	aIndices.clear();
+	aIndices.reserve( count );
+
+	std::unordered_map<StaticVertex, GLuint, VertexHash_, VertexEqual_> known;
+	known.reserve( count );
+
+	auto const& mat = aMesh.material;
+	for( std::size_t i = 0; i < count; ++i )
+	{
+		StaticVertex vert{};
+		vert.position = aMesh.positions[i];
+		vert.normal = aMesh.normals[i];
+		vert.texcoord = attribute_( aMesh.texcoords, i, Vec2f{ 0.f, 0.f } );
+		vert.ambient = attribute_( mat.ambient, i, Vec3f{ 0.f, 0.f, 0.f } );
+		vert.diffuse = attribute_( mat.diffuse, i, Vec3f{ 0.f, 0.f, 0.f } );
+		vert.specular = attribute_( mat.specular, i, Vec3f{ 0.f, 0.f, 0.f } );
+		vert.shininess = attribute_( mat.shininess, i, 1.f );
+		vert.alpha = attribute_( mat.alpha, i, 1.f );
+
+		auto const [it, inserted] = known.emplace( vert, GLuint(aVertices.size()) );
+		if( inserted )
+			aVertices.emplace_back( vert );
+
+		aIndices.emplace_back( it->second );
+	}
+}
@@ -0,0 +1,153 @@
+#ifndef STATIC_GEOMETRY_HPP
+#define STATIC_GEOMETRY_HPP
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../vmlib/vec2.hpp"
+#include "../vmlib/vec3.hpp"
+
+#include "simple_mesh.hpp"
+#include "meshlets.hpp"
+
+// Interleaved vertex with the same attributes as create_vao() provides.
+struct StaticVertex
+{
+	Vec3f position;
+	Vec3f ambient;
+	Vec3f normal;
+	Vec2f texcoord;
+	Vec3f diffuse;
+	Vec3f specular;
+	float shininess;
+	float alpha;
+};
+
+// Location of a mesh inside the shared buffers. Matches the fields of a
+// DrawElementsIndirectCommand.
+struct StaticMesh
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLint baseVertex;
+	GLuint vertexCount;
+
+	// Clustered meshes only (see StaticGeometry::add()); meshletCount is zero
+	// otherwise. The meshlets cover LOD 0.
+	std::uint32_t firstMeshlet;
+	std::uint32_t meshletCount;
+
+	// Levels of detail; LOD 0 is the full mesh (firstIndex, indexCount).
+	std::uint32_t firstLod;
+	std::uint32_t lodCount;
+};
+
+// A level of detail of a mesh: a range of the index buffer that uses the
+// same vertices as the full mesh. error is the object-space geometric error
+// of the level (see simplify_mesh()); it increases with the level.
+struct StaticLod
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	float error;
+};
+
+// A cluster of a clustered mesh: a contiguous range of the index buffer, with
+// object-space bounds (see Meshlet).
+struct StaticMeshlet
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+
+	Vec3f center;
+	float radius;
+	Vec3f coneAxis;
+	float coneCutoff;
+};
+
+/** StaticGeometry: all static meshes in one vertex and one index buffer
+ *
+ * Meshes are added on the CPU with add(), which converts the triangle soup
+ * of a SimpleMeshData to an indexed mesh (identical vertices are merged).
+ * Large meshes can optionally be clustered: their triangles are split into
+ * meshlets (see build_meshlets()), and the index buffer is ordered by
+ * meshlet, so that each meshlet can be drawn (or culled) individually.
+ * Meshes can also be given a chain of simplified levels of detail (see
+ * simplify_mesh()), each of which has about half the triangles of the
+ * previous one.
+ * upload() then creates a single vertex buffer, index buffer and VAO for all
+ * of them. Meshes are drawn with base-vertex draws, typically through a
+ * MultiDrawBatch.
+ *
+ * The VAO additionally contains a per-instance draw ID attribute (location 8)
+ * that reads the draw's baseInstance. OpenGL 4.3 has no gl_DrawID, so this is
+ * how the vertex shader finds the per-draw data of a multi-draw.
+ */
+class StaticGeometry final
+{
+	public:
+		using MeshId = std::uint32_t;
+
+	public:
+		StaticGeometry() = default;
+		~StaticGeometry();
+
+		StaticGeometry( StaticGeometry const& ) = delete;
+		StaticGeometry& operator= (StaticGeometry const&) = delete;
+
+	public:
+		MeshId add( SimpleMeshData const&, bool aClustered = false, std::size_t aMaxLods = 1 );
+
+		// Create/replace the GL buffers. Meshes added afterwards require
+		// another upload().
+		void upload();
+
+		// Ensure that draw IDs [0, aCount) are available.
+		void reserve_draw_ids( std::size_t aCount );
+
+	public:
+		GLuint vao() const noexcept;
+
+		StaticMesh const& mesh( MeshId ) const noexcept;
+		std::size_t mesh_count() const noexcept;
+
+		// Meshlets of a clustered mesh (mesh( id ).meshletCount of them)
+		StaticMeshlet const* meshlets( MeshId ) const noexcept;
+
+		// Levels of detail of a mesh (mesh( id ).lodCount of them)
+		StaticLod const* lods( MeshId ) const noexcept;
+
+		std::size_t vertex_count() const noexcept;
+		std::size_t index_count() const noexcept;
+
+	private:
+		std::vector<StaticVertex> mVertices;
+		std::vector<GLuint> mIndices;
+		std::vector<StaticMesh> mMeshes;
+		std::vector<StaticMeshlet> mMeshlets;
+		std::vector<StaticLod> mLods;
+
+		GLuint mVao = 0;
+		GLuint mVertexBuffer = 0;
+		GLuint mIndexBuffer = 0;
+
+		GLuint mDrawIdBuffer = 0;
+		std::size_t mDrawIdCount = 0;
+};
+
+// Set up attributes 0-7 of the bound VAO for StaticVertex data in the bound
+// GL_ARRAY_BUFFER.
+void setup_static_vertex_attributes();
+
+// Convert a triangle soup to an indexed mesh.
+void build_indexed_mesh(
+	SimpleMeshData const&,
+	std::vector<StaticVertex>& aVertices,
+	std::vector<GLuint>& aIndices
+);
+
+#endif // STATIC_GEOMETRY_HPP
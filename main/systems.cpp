@@ -0,0 +1,412 @@
+#include "systems.hpp"
+
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <algorithm>
+
+#include <cmath>
+
+#include "../support/profiler.hpp"
+#include "../support/gl_state.hpp"
+
+namespace
+{
+	// Fraction of the limit that the next coarser level must reach
+	constexpr float kLodHysteresis_ = 0.75f;
+
+	// Level of detail for aView, starting from aCurrent (see select_lods())
+	std::uint32_t choose_lod_( StaticGeometry const& aGeometry, StaticGeometry::MeshId aMesh, std::uint32_t aCurrent, Transform const& aXform, Bounds const& aBounds, LodView const& aView )
+	{
+		auto const& mesh = aGeometry.mesh( aMesh );
+		if( mesh.lodCount <= 1 )
+			return 0;
+
+		Vec3f center;
+		float radius;
+		transform_sphere( aXform.world, aBounds.center, aBounds.radius, center, radius );
+
+		// Object-space errors are scaled like the radius
+		float const scale = aBounds.radius > 0.f ? radius / aBounds.radius : 1.f;
+		float const distance = std::max( length( center - aView.cameraPosition ) - radius, 1e-3f );
+		float const pixelsPerError = scale * aView.pixelsPerUnit / distance;
+
+		auto const* lods = aGeometry.lods( aMesh );
+		auto lod = std::min( aCurrent, mesh.lodCount-1 );
+
+		while( lod+1 < mesh.lodCount && lods[lod+1].error * pixelsPerError <= kLodHysteresis_ * aView.maxPixelError )
+			++lod;
+		while( lod > 0 && lods[lod].error * pixelsPerError > aView.maxPixelError )
+			--lod;
+
+		return lod;
+	}
+
+	void collect_renderables_( Registry& aRegistry, RenderList& aList, bool aVisibleOnly, StaticGeometry const* aGeometry, LodView const* aView )
+	{
+		PROFILE_ZONE( "collect renderables" );
+
+		aList.clear();
+
+		aRegistry.each<MeshRef, Material, Transform, Visibility>( [&] ( Entity, MeshRef const& aMesh, Material const& aMat, Transform const& aXform, Visibility const& aVis ) {
+			if( aVis.visible || !aVisibleOnly )
+				aList.meshes.emplace_back( RenderList::MeshDraw{ aMesh.range, aMat, aXform.world, aXform.normal } );
+		} );
+
+		aRegistry.each<StaticMeshRef, Material, Transform, Visibility>( [&] ( Entity aEntity, StaticMeshRef const& aMesh, Material const& aMat, Transform const& aXform, Visibility const& aVis ) {
+			if( !aVis.visible && aVisibleOnly )
+				return;
+
+			// For a separate view, start at the coarsest level and refine
+			auto lod = aMesh.lod;
+			if( aView && aRegistry.has<Bounds>( aEntity ) )
+				lod = choose_lod_( *aGeometry, aMesh.mesh, ~std::uint32_t(0), aXform, aRegistry.get<Bounds>( aEntity ), *aView );
+
+			aList.statics.emplace_back( RenderList::StaticDraw{ aMesh.mesh, lod, aMat, aXform.world, aXform.normal } );
+		} );
+
+		// Instances hold world-space transforms. There are only a few
+		// InstancedMeshes, so the batch is found by a linear search.
+		aRegistry.each<Instance, Material, Transform, Visibility>( [&] ( Entity, Instance const& aInst, Material const& aMat, Transform const& aXform, Visibility const& aVis ) {
+			if( !aInst.mesh || (!aVis.visible && aVisibleOnly) )
+				return;
+
+			auto const begin = aList.instanced.begin();
+			auto const end = begin + aList.instanceBatches;
+			auto batch = std::find_if( begin, end, [&] ( RenderList::InstanceBatch const& aBatch ) {
+				return aBatch.mesh == aInst.mesh && aBatch.material.blend == aMat.blend;
+			} );
+
+			if( end == batch )
+			{
+				if( aList.instanced.size() == aList.instanceBatches )
+					aList.instanced.emplace_back();
+				batch = aList.instanced.begin() + aList.instanceBatches++;
+				batch->mesh = aInst.mesh;
+				batch->material = aMat;
+			}
+
+			batch->instances.emplace_back( make_instance_data( aXform.world, aXform.normal, aInst.tint ) );
+		} );
+	}
+}
+
+void animate( Registry& aRegistry, JobSystem& aJobs, float aDt )
+{
+	PROFILE_ZONE( "animate" );
+
+	aRegistry.each_parallel<Animator, Transform>( aJobs, [aDt] ( Entity, Animator const& aAnim, Transform& aXform ) {
+		aXform.translation += aAnim.velocity * aDt;
+		aXform.rotation += aAnim.angularVelocity * aDt;
+
+		if( aAnim.range > 0.f && length( aXform.translation - aAnim.origin ) > aAnim.range )
+			aXform.translation = aAnim.origin;
+
+		aXform.dirty = true;
+	} );
+}
+
+void update_transforms( Registry& aRegistry, JobSystem& aJobs )
+{
+	PROFILE_ZONE( "update transforms" );
+
+	aRegistry.each_parallel<Transform>( aJobs, [] ( Entity, Transform& aXform ) {
+		if( !aXform.dirty )
+			return;
+
+		aXform.world = make_local_transform( aXform.translation, aXform.rotation, aXform.scale );
+		aXform.normal = mat44_to_mat33( transpose( invert( aXform.world ) ) );
+		aXform.dirty = false;
+	} );
+}
+
+void sync_scene_links( Registry& aRegistry, SceneGraph const& aGraph )
+{
+	aRegistry.each<SceneLink, Transform>( [&aGraph] ( Entity, SceneLink const& aLink, Transform& aXform ) {
+		aXform.world = aGraph.world( aLink.node ) * aLink.offset;
+		aXform.normal = aGraph.normal_matrix( aLink.node ) * mat44_to_mat33( transpose( invert( aLink.offset ) ) );
+		aXform.dirty = false;
+	} );
+}
+
+void refresh_mesh_refs( Registry& aRegistry, MeshArena const& aArena )
+{
+	aRegistry.each<MeshRef>( [&aArena] ( Entity, MeshRef& aMesh ) {
+		aMesh.range = aArena.draw_range( aMesh.mesh );
+	} );
+}
+
+void RenderList::clear() noexcept
+{
+	meshes.clear();
+	statics.clear();
+
+	for( std::size_t i = 0; i < instanceBatches; ++i )
+		instanced[i].instances.clear();
+	instanceBatches = 0;
+}
+
+void collect_renderables( Registry& aRegistry, RenderList& aList, bool aVisibleOnly )
+{
+	collect_renderables_( aRegistry, aList, aVisibleOnly, nullptr, nullptr );
+}
+
+void collect_renderables( Registry& aRegistry, RenderList& aList, bool aVisibleOnly, StaticGeometry const& aGeometry, LodView const& aView )
+{
+	collect_renderables_( aRegistry, aList, aVisibleOnly, &aGeometry, &aView );
+}
+
+std::size_t draw_renderables( RenderList const& aList, GLuint aProgram, MultiDrawBatch& aBatch, StreamBuffer& aStream, bool aBlended )
+{
+	PROFILE_ZONE( "draw renderables" );
+
+	GLint const emissiveLoc = glGetUniformLocation( aProgram, "emissive" );
+	GLint const colorSelLoc[] = {
+		glGetUniformLocation( aProgram, "colorSel" ),
+		glGetUniformLocation( aProgram, "colorSel1" ),
+		glGetUniformLocation( aProgram, "colorSel2" )
+	};
+
+	auto const apply_material = [&] ( Material const& aMat ) {
+		glstate::set_enabled( GL_CULL_FACE, aMat.cullFace );
+
+		glUniform1f( 7, aMat.textured ? 1.f : 0.f );
+		glUniform1f( 8, aMat.emissive ? 1.f : 0.f );
+		glUniform1f( 9, aMat.multiTextured ? 1.f : 0.f );
+
+		if( aMat.textured )
+		{
+			glstate::bind_texture( 0, GL_TEXTURE_2D, aMat.textures[0] );
+			if( aMat.multiTextured )
+				glstate::bind_texture( 1, GL_TEXTURE_2D, aMat.textures[1] );
+		}
+
+		if( aMat.emissive )
+		{
+			glUniform3f( emissiveLoc, aMat.emissiveColor.x, aMat.emissiveColor.y, aMat.emissiveColor.z );
+			for( int i = 0; i < 3; ++i )
+				glUniform1i( colorSelLoc[i], int(aMat.colorSelect) == i );
+		}
+	};
+	auto const reset_emissive = [&] ( Material const& aMat ) {
+		if( aMat.emissive )
+		{
+			glUniform3f( emissiveLoc, 0.f, 0.f, 0.f );
+			for( int i = 0; i < 3; ++i )
+				glUniform1i( colorSelLoc[i], false );
+		}
+	};
+
+	if( aBlended )
+		glstate::enable( GL_BLEND );
+
+	std::size_t draws = 0;
+	for( auto const& item : aList.meshes )
+	{
+		if( item.material.blend != aBlended )
+			continue;
+
+		glUniformMatrix4fv( 5, 1, GL_TRUE, item.world.v );
+		glUniformMatrix3fv( 1, 1, GL_TRUE, item.normal.v );
+
+		apply_material( item.material );
+
+		glstate::bind_vertex_array( item.range.vao );
+		glDrawElementsBaseVertex( GL_TRIANGLES, item.range.indexCount, GL_UNSIGNED_INT, reinterpret_cast<void const*>(item.range.indexOffset), item.range.baseVertex );
+		++draws;
+
+		reset_emissive( item.material );
+	}
+
+	for( auto const& item : aList.statics )
+	{
+		if( item.material.blend == aBlended )
+			aBatch.add( item.mesh, item.material, item.world, item.normal, item.lod );
+	}
+
+	draws += aBatch.submit();
+
+	bool identity = false;
+	for( std::size_t i = 0; i < aList.instanceBatches; ++i )
+	{
+		auto const& batch = aList.instanced[i];
+		if( batch.material.blend != aBlended )
+			continue;
+
+		if( !identity )
+		{
+			glUniformMatrix4fv( 5, 1, GL_TRUE, kIdentity44f.v );
+			glUniformMatrix3fv( 1, 1, GL_TRUE, kIdentity33f.v );
+			identity = true;
+		}
+
+		apply_material( batch.material );
+
+		batch.mesh->clear();
+		batch.mesh->add( batch.instances.data(), batch.instances.size() );
+		batch.mesh->upload( aStream );
+		batch.mesh->draw();
+		batch.mesh->clear();
+		++draws;
+
+		reset_emissive( batch.material );
+	}
+
+	// Restore defaults expected by the rest of the frame
+	glUniform1f( 7, 0.f );
+	glUniform1f( 8, 0.f );
+	glUniform1f( 9, 0.f );
+	glstate::bind_texture( 1, GL_TEXTURE_2D, 0 );
+	glstate::bind_texture( 0, GL_TEXTURE_2D, 0 );
+	glstate::enable( GL_CULL_FACE );
+
+	if( aBlended )
+		glstate::disable( GL_BLEND );
+
+	return draws;
+}
+
+CullStats cull_renderables( Registry& aRegistry, JobSystem& aJobs, Frustum const& aFrustum, CullScratch& aScratch )
+{
+	PROFILE_ZONE( "frustum culling" );
+
+	// Gather world-space spheres
+	aScratch.spheres.clear();
+	aScratch.targets.clear();
+
+	aRegistry.each<Bounds, Transform, Visibility>( [&aScratch] ( Entity, Bounds const& aBounds, Transform const& aXform, Visibility& aVis ) {
+		Vec3f center;
+		float radius;
+		transform_sphere( aXform.world, aBounds.center, aBounds.radius, center, radius );
+
+		aScratch.spheres.push_back( center, radius );
+		aScratch.targets.emplace_back( &aVis );
+	} );
+
+	// Test. Chunks are a multiple of eight, so that only the last one has a
+	// scalar tail.
+	auto const count = aScratch.spheres.size();
+	aScratch.visible.resize( count );
+
+	std::atomic<std::size_t> visible{ 0 };
+	aJobs.parallel_for( 0, count, 2048, [&] ( std::size_t aBegin, std::size_t aEnd ) {
+		auto const vis = cull_spheres( aFrustum, aScratch.spheres, aBegin, aEnd, aScratch.visible.data() );
+		visible.fetch_add( vis, std::memory_order_relaxed );
+	} );
+
+	for( std::size_t i = 0; i < count; ++i )
+		aScratch.targets[i]->visible = 0 != aScratch.visible[i];
+
+	CullStats stats;
+	stats.tested = count;
+	stats.visible = visible.load();
+	return stats;
+}
+
+std::size_t cull_occluded( Registry& aRegistry, JobSystem& aJobs, OcclusionBuffer& aBuffer, Mat44f const& aViewProj )
+{
+	PROFILE_ZONE( "occlusion culling" );
+
+	aBuffer.begin( aViewProj );
+
+	aRegistry.each<Occluder, Transform, Visibility>( [&aBuffer] ( Entity, Occluder const& aOcc, Transform const& aXform, Visibility const& aVis ) {
+		if( aVis.visible && aOcc.mesh )
+			aBuffer.add_occluder( *aOcc.mesh, aXform.world );
+	} );
+
+	aBuffer.rasterize( aJobs );
+
+	std::atomic<std::size_t> occluded{ 0 };
+	aRegistry.each_parallel<Visibility, Bounds, Transform>( aJobs, [&] ( Entity, Visibility& aVis, Bounds const& aBounds, Transform const& aXform ) {
+		if( !aVis.visible )
+			return;
+
+		if( !aBuffer.test( aBounds.min, aBounds.max, aXform.world ) )
+		{
+			aVis.visible = false;
+			occluded.fetch_add( 1, std::memory_order_relaxed );
+		}
+	} );
+
+	return occluded.load();
+}
+
+void reset_visibility( Registry& aRegistry )
+{
+	aRegistry.each<Visibility>( [] ( Entity, Visibility& aVis ) {
+		aVis.visible = true;
+	} );
+}
+
+bool pick( Registry& aRegistry, Vec3f aOrigin, Vec3f aDirection, float aMaxT, PickHit& aHit )
+{
+	PROFILE_ZONE( "pick" );
+
+	bool found = false;
+	float best = aMaxT;
+
+	aRegistry.each<Collider, Transform>( [&] ( Entity aEntity, Collider const& aCollider, Transform const& aXform ) {
+		if( !aCollider.bvh || aCollider.bvh->empty() )
+			return;
+
+		// Affine transform, so t is the same in object space
+		auto const toObject = invert( aXform.world );
+		auto const o = toObject * Vec4f{ aOrigin.x, aOrigin.y, aOrigin.z, 1.f };
+		auto const d = toObject * Vec4f{ aDirection.x, aDirection.y, aDirection.z, 0.f };
+
+		BvhHit hit;
+		if( !aCollider.bvh->raycast( Vec3f{ o.x, o.y, o.z }, Vec3f{ d.x, d.y, d.z }, best, hit ) )
+			return;
+
+		best = hit.t;
+		found = true;
+
+		aHit.entity = aEntity;
+		aHit.t = hit.t;
+		aHit.position = aOrigin + hit.t * aDirection;
+		aHit.triangle = hit.triangle;
+	} );
+
+	return found;
+}
+
+std::size_t select_lods( Registry& aRegistry, StaticGeometry const& aGeometry, LodView const& aView )
+{
+	PROFILE_ZONE( "select LODs" );
+
+	std::size_t reduced = 0;
+	aRegistry.each<StaticMeshRef, Transform, Bounds>( [&] ( Entity, StaticMeshRef& aMesh, Transform const& aXform, Bounds const& aBounds ) {
+		aMesh.lod = choose_lod_( aGeometry, aMesh.mesh, aMesh.lod, aXform, aBounds, aView );
+		if( aMesh.lod > 0 )
+			++reduced;
+	} );
+
+	return reduced;
+}
+
+Bounds compute_bounds( SimpleMeshData const& aMesh )
+{
+	if( aMesh.positions.empty() )
+		return Bounds{};
+
+	Bounds ret{ aMesh.positions.front(), aMesh.positions.front() };
+	for( auto const& p : aMesh.positions )
+	{
+		ret.min = Vec3f{ std::min( ret.min.x, p.x ), std::min( ret.min.y, p.y ), std::min( ret.min.z, p.z ) };
+		ret.max = Vec3f{ std::max( ret.max.x, p.x ), std::max( ret.max.y, p.y ), std::max( ret.max.z, p.z ) };
+	}
+
+	// Sphere around the box center. Not the tightest possible sphere, but
+	// cheap and usually close.
+	ret.center = 0.5f * (ret.min + ret.max);
+
+	float radius2 = 0.f;
+	for( auto const& p : aMesh.positions )
+	{
+		auto const d = p - ret.center;
+		radius2 = std::max( radius2, d.x*d.x + d.y*d.y + d.z*d.z );
+	}
+	ret.radius = std::sqrt( radius2 );
+
+	return ret;
+}
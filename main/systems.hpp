@@ -0,0 +1,146 @@
+#ifndef SYSTEMS_HPP
+#define SYSTEMS_HPP
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../support/jobs.hpp"
+#include "../support/stream_buffer.hpp"
+
+#include "ecs.hpp"
+#include "components.hpp"
+#include "culling.hpp"
+#include "occlusion.hpp"
+#include "mesh_arena.hpp"
+#include "multi_draw.hpp"
+#include "scene_graph.hpp"
+#include "simple_mesh.hpp"
+
+// Advance all Animator-driven entities by aDt seconds.
+void animate( Registry&, JobSystem&, float aDt );
+
+// Recompute world/normal matrices of Transforms that changed.
+void update_transforms( Registry&, JobSystem& );
+
+// Copy world/normal matrices of entities with a SceneLink from the graph.
+void sync_scene_links( Registry&, SceneGraph const& );
+
+// Update the draw ranges of all MeshRefs, after aArena has moved meshes
+// (i.e., its generation() changed).
+void refresh_mesh_refs( Registry&, MeshArena const& aArena );
+
+// Drawable state of the entities, copied out of the Registry, so that it can
+// be drawn (e.g., on the render thread) while the Registry is already being
+// updated for the next frame. Containers are reused between frames.
+struct RenderList
+{
+	struct MeshDraw
+	{
+		MeshArena::DrawRange range;
+		Material material;
+		Mat44f world;
+		Mat33f normal;
+	};
+	struct StaticDraw
+	{
+		StaticGeometry::MeshId mesh;
+		std::uint32_t lod;
+		Material material;
+		Mat44f world;
+		Mat33f normal;
+	};
+	struct InstanceBatch // all instances of one InstancedMesh
+	{
+		InstancedMesh* mesh;
+		Material material;
+		std::vector<InstanceData> instances;
+	};
+
+	std::vector<MeshDraw> meshes;
+	std::vector<StaticDraw> statics;
+
+	std::vector<InstanceBatch> instanced; // first instanceBatches are in use
+	std::size_t instanceBatches = 0;
+
+	void clear() noexcept;
+};
+
+// Collect all entities with a Transform, Material and either a MeshRef, a
+// StaticMeshRef or an Instance into aList (which is cleared first). With
+// aVisibleOnly, entities that were culled (Visibility) are skipped.
+void collect_renderables( Registry&, RenderList&, bool aVisibleOnly = true );
+
+// Draw the contents of aList using the currently bound default program.
+// MeshRef entities are drawn individually (base-vertex draws from the
+// MeshArena pages); StaticMeshRef entities are
+// collected into aBatch and drawn with multi-draw indirect; Instance entities
+// are drawn with one instanced draw per InstancedMesh, with the instance
+// data written to aStream (as are the batch's records). Either draws the
+// opaque entities or (if aBlended is set) the blended ones. Returns the number
+// of draw calls issued.
+std::size_t draw_renderables( RenderList const&, GLuint aProgram, MultiDrawBatch& aBatch, StreamBuffer& aStream, bool aBlended );
+
+// Scratch space for cull_renderables(); reused between frames.
+struct CullScratch
+{
+	SphereSoA spheres;
+	std::vector<Visibility*> targets;
+	std::vector<std::uint8_t> visible;
+};
+
+// Test the world-space bounding spheres of all entities with Bounds, a
+// Transform and a Visibility against the frustum, and update their
+// Visibility accordingly.
+CullStats cull_renderables( Registry&, JobSystem&, Frustum const&, CullScratch& );
+
+// Rasterize the (visible) Occluders into aBuffer, and mark visible entities
+// that are hidden behind them as invisible. Run after cull_renderables().
+// Returns the number of entities that were culled.
+std::size_t cull_occluded( Registry&, JobSystem&, OcclusionBuffer&, Mat44f const& aViewProj );
+
+// Mark all entities as visible (i.e., disable culling).
+void reset_visibility( Registry& );
+
+struct PickHit
+{
+	Entity entity = kNullEntity;
+	float t = 0.f;
+	Vec3f position{ 0.f, 0.f, 0.f }; // world space
+	std::uint32_t triangle = 0; // in the entity's Collider
+};
+
+// Closest hit of the (world space) ray aOrigin + t * aDirection, with t in
+// (0, aMaxT), with the Colliders of all entities with a Transform. Culled
+// entities are included.
+bool pick( Registry&, Vec3f aOrigin, Vec3f aDirection, float aMaxT, PickHit& );
+
+// Parameters for select_lods().
+struct LodView
+{
+	Vec3f cameraPosition;
+	float pixelsPerUnit; // viewport height / (2 tan(fovY/2))
+	float maxPixelError = 1.f;
+};
+
+// Choose the level of detail of all entities with a StaticMeshRef, a
+// Transform and Bounds: the coarsest level whose error, projected at the
+// closest point of the bounding sphere, is at most maxPixelError pixels.
+// Switching to a coarser level requires the error to be somewhat below the
+// limit, so that objects near a threshold do not flicker between levels.
+// Returns the number of entities that use a simplified level.
+std::size_t select_lods( Registry&, StaticGeometry const&, LodView const& );
+
+// As collect_renderables(), but StaticMeshRef entities are drawn at the level
+// of detail that select_lods() would choose for aView from scratch (without
+// hysteresis). The StaticMeshRefs are not changed; use this for one-off views
+// such as poster captures, so that the interactive view keeps its state.
+void collect_renderables( Registry&, RenderList&, bool aVisibleOnly, StaticGeometry const&, LodView const& );
+
+// Object-space bounding box and bounding sphere of a mesh.
+Bounds compute_bounds( SimpleMeshData const& );
+
+#endif // SYSTEMS_HPP
@@ -0,0 +1,404 @@
+#include "video_capture.hpp"
+
+#include <filesystem>
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+#include <ctime>
+
+#include "../support/error.hpp"
+#include "../support/profiler.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr std::size_t kMinRingSize_ = 3;
+
+	constexpr GLuint64 kWaitTimeout_ = 1000000000; // ns
+
+	bool ends_with_( std::string const& aString, char const* aSuffix )
+	{
+		auto const len = std::strlen( aSuffix );
+		return aString.size() >= len && 0 == aString.compare( aString.size()-len, len, aSuffix );
+	}
+
+	// BT.601, limited range, 8 bit fixed point
+	inline unsigned char luma_( int aR, int aG, int aB ) noexcept
+	{
+		return static_cast<unsigned char>(((66*aR + 129*aG + 25*aB + 128) >> 8) + 16);
+	}
+	inline unsigned char cb_( int aR, int aG, int aB ) noexcept
+	{
+		return static_cast<unsigned char>(((-38*aR - 74*aG + 112*aB + 128) >> 8) + 128);
+	}
+	inline unsigned char cr_( int aR, int aG, int aB ) noexcept
+	{
+		return static_cast<unsigned char>(((112*aR - 94*aG - 18*aB + 128) >> 8) + 128);
+	}
+}
+
+VideoRecorder::VideoRecorder( JobSystem& aJobs, char const* aPath, unsigned aFps, ImageFormat aImageFormat, std::size_t aRingSize )
+	: mJobs( aJobs )
+	, mPath( aPath )
+	, mY4m( ends_with_( mPath, ".y4m" ) )
+	, mFps( std::max( 1u, aFps ) )
+	, mImageFormat( aImageFormat )
+{
+	std::error_code ec;
+	if( mY4m )
+	{
+		auto const parent = fs::path( mPath ).parent_path();
+		if( !parent.empty() )
+			fs::create_directories( parent, ec );
+
+		mFile = std::fopen( aPath, "wb" );
+		if( !mFile )
+			throw Error( "Unable to open '%s' for writing", aPath );
+	}
+	else
+	{
+		fs::create_directories( mPath, ec );
+		if( !fs::is_directory( mPath ) )
+			throw Error( "Unable to create directory '%s'", aPath );
+	}
+
+	// Enough slots to keep every thread busy encoding while the GPU works on
+	// the next frames.
+	auto const ringSize = aRingSize ? aRingSize : std::max( kMinRingSize_, mJobs.thread_count() + 2 );
+	for( std::size_t i = 0; i < ringSize; ++i )
+	{
+		mSlots.emplace_back( std::make_unique<Slot_>() );
+		glGenBuffers( 1, &mSlots.back()->pbo );
+	}
+}
+
+VideoRecorder::~VideoRecorder()
+{
+	// Oldest first, so that readbacks complete in order
+	try
+	{
+		for( std::size_t i = 0; i < mSlots.size(); ++i )
+			wait_( *mSlots[(mNext + i) % mSlots.size()] );
+	}
+	catch( std::exception const& eErr )
+	{
+		std::fprintf( stderr, "%s\n", eErr.what() );
+		mWriteError = true;
+	}
+
+	for( auto& slot : mSlots )
+	{
+		if( SlotState_::encoding == slot->state )
+			mJobs.wait( slot->job );
+		if( slot->pixels )
+		{
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, slot->pbo );
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+		}
+		if( slot->fence )
+			glDeleteSync( slot->fence );
+		glDeleteBuffers( 1, &slot->pbo );
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	if( mFile )
+	{
+		if( 0 != std::fclose( mFile ) )
+			mWriteError = true;
+	}
+
+	if( mWriteError )
+		std::fprintf( stderr, "Recording '%s': write error, output is incomplete\n", mPath.c_str() );
+	else
+		std::printf( "Recorded %zu frames to '%s' (%zu stalls)\n", mFrames, mPath.c_str(), mStalls );
+}
+
+bool VideoRecorder::capture( GLsizei aWidth, GLsizei aHeight )
+{
+	PROFILE_ZONE( "capture video frame" );
+
+	if( 0 == mFrames )
+	{
+		if( aWidth <= 0 || aHeight <= 0 )
+			return false;
+
+		mWidth = aWidth;
+		mHeight = aHeight;
+
+		auto const bytes = std::size_t(mWidth) * std::size_t(mHeight) * 4;
+		for( auto& slot : mSlots )
+		{
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, slot->pbo );
+			glBufferData( GL_PIXEL_PACK_BUFFER, GLsizeiptr(bytes), nullptr, GL_STREAM_READ );
+		}
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+		if( mY4m )
+		{
+			if( std::fprintf( mFile, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n", int(mWidth), int(mHeight), mFps ) < 0 )
+				mWriteError = true;
+		}
+	}
+	else if( aWidth != mWidth || aHeight != mHeight )
+	{
+		return false;
+	}
+
+	// Backpressure: rather than dropping the frame, wait for the oldest one.
+	auto& slot = *mSlots[mNext];
+	if( SlotState_::free != slot.state )
+	{
+		PROFILE_ZONE( "video backpressure" );
+		++mStalls;
+		wait_( slot );
+	}
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, slot.pbo );
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	glReadPixels( 0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	slot.frame = mFrames++;
+	slot.state = SlotState_::reading;
+
+	mNext = (mNext + 1) % mSlots.size();
+	return true;
+}
+
+void VideoRecorder::update()
+{
+	for( auto& slot : mSlots )
+	{
+		switch( slot->state )
+		{
+			case SlotState_::free:
+				break;
+
+			case SlotState_::reading:
+			{
+				auto const status = glClientWaitSync( slot->fence, 0, 0 );
+				if( GL_ALREADY_SIGNALED == status || GL_CONDITION_SATISFIED == status )
+					encode_( *slot );
+			} break;
+
+			case SlotState_::encoding:
+			{
+				if( slot->job.done() )
+					recycle_( *slot );
+			} break;
+		}
+	}
+}
+
+float VideoRecorder::timestep() const noexcept
+{
+	return 1.f / float(mFps);
+}
+
+std::size_t VideoRecorder::frame_count() const noexcept
+{
+	return mFrames;
+}
+std::size_t VideoRecorder::stall_count() const noexcept
+{
+	return mStalls;
+}
+char const* VideoRecorder::path() const noexcept
+{
+	return mPath.c_str();
+}
+
+void VideoRecorder::encode_( Slot_& aSlot )
+{
+	assert( SlotState_::reading == aSlot.state );
+
+	glDeleteSync( aSlot.fence );
+	aSlot.fence = nullptr;
+
+	auto const bytes = std::size_t(mWidth) * std::size_t(mHeight) * 4;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, aSlot.pbo );
+	aSlot.pixels = static_cast<unsigned char const*>(glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(bytes), GL_MAP_READ_BIT ));
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	if( !aSlot.pixels )
+		throw Error( "Recording '%s': unable to map pixel buffer for frame %zu", mPath.c_str(), aSlot.frame );
+
+	aSlot.state = SlotState_::encoding;
+
+	mJobs.run( [this, frame = aSlot.frame, pixels = aSlot.pixels] {
+		if( mY4m )
+			encode_y4m_( frame, pixels );
+		else
+			encode_image_( frame, pixels );
+	}, &aSlot.job );
+}
+
+void VideoRecorder::recycle_( Slot_& aSlot )
+{
+	assert( SlotState_::encoding == aSlot.state );
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, aSlot.pbo );
+	glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	aSlot.pixels = nullptr;
+	aSlot.state = SlotState_::free;
+}
+
+void VideoRecorder::wait_( Slot_& aSlot )
+{
+	if( SlotState_::reading == aSlot.state )
+	{
+		GLenum status;
+		do
+		{
+			status = glClientWaitSync( aSlot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, kWaitTimeout_ );
+		} while( GL_TIMEOUT_EXPIRED == status );
+
+		if( GL_WAIT_FAILED == status )
+			throw Error( "Recording '%s': glClientWaitSync() failed", mPath.c_str() );
+
+		encode_( aSlot );
+	}
+
+	if( SlotState_::encoding == aSlot.state )
+	{
+		mJobs.wait( aSlot.job );
+		recycle_( aSlot );
+	}
+}
+
+void VideoRecorder::encode_image_( std::size_t aFrame, unsigned char const* aPixels )
+{
+	PROFILE_ZONE( "encode video frame (image)" );
+
+	auto const width = std::size_t(mWidth);
+	auto const height = std::size_t(mHeight);
+
+	std::vector<unsigned char> rgb( width * height * 3 );
+	for( std::size_t y = 0; y < height; ++y )
+	{
+		auto const* src = aPixels + (height-1-y) * width * 4;
+		auto* dst = rgb.data() + y * width * 3;
+		for( std::size_t x = 0; x < width; ++x )
+		{
+			dst[3*x+0] = src[4*x+0];
+			dst[3*x+1] = src[4*x+1];
+			dst[3*x+2] = src[4*x+2];
+		}
+	}
+
+	char name[32];
+	std::snprintf( name, sizeof(name), "frame_%06zu%s", aFrame, image_format_extension( mImageFormat ) );
+	auto const path = (fs::path( mPath ) / name).string();
+
+	try
+	{
+		write_image( path.c_str(), mImageFormat, width, height, rgb.data(), &mJobs );
+	}
+	catch( std::exception const& eErr )
+	{
+		std::fprintf( stderr, "Unable to write video frame '%s': %s\n", path.c_str(), eErr.what() );
+		mWriteError = true;
+	}
+}
+
+void VideoRecorder::encode_y4m_( std::size_t aFrame, unsigned char const* aPixels )
+{
+	// Convert (in parallel with other frames)
+	{
+		PROFILE_ZONE( "encode video frame (Y4M)" );
+
+		auto const width = std::size_t(mWidth);
+		auto const height = std::size_t(mHeight);
+		auto const cw = (width + 1) / 2;
+		auto const ch = (height + 1) / 2;
+
+		std::vector<unsigned char> yuv( width * height + 2 * cw * ch );
+		auto* yPlane = yuv.data();
+		auto* uPlane = yPlane + width * height;
+		auto* vPlane = uPlane + cw * ch;
+
+		// Rows are bottom-up in the pixel buffer. Chroma is the average of
+		// each 2x2 block (edge pixels repeat for odd sizes).
+		auto const row = [&] (std::size_t aY) {
+			return aPixels + (height-1-std::min( aY, height-1 )) * width * 4;
+		};
+
+		for( std::size_t cy = 0; cy < ch; ++cy )
+		{
+			auto const* r0 = row( 2*cy );
+			auto const* r1 = row( 2*cy+1 );
+
+			auto* y0 = yPlane + (2*cy) * width;
+			auto* y1 = yPlane + std::min( 2*cy+1, height-1 ) * width;
+
+			for( std::size_t cx = 0; cx < cw; ++cx )
+			{
+				auto const x0 = 2*cx;
+				auto const x1 = std::min( 2*cx+1, width-1 );
+
+				unsigned char const* p[4] = { r0 + 4*x0, r0 + 4*x1, r1 + 4*x0, r1 + 4*x1 };
+
+				int sr = 0, sg = 0, sb = 0;
+				for( auto const* px : p )
+				{
+					sr += px[0];
+					sg += px[1];
+					sb += px[2];
+				}
+
+				// For odd sizes, the second column/row aliases the first
+				// and is simply written twice.
+				y0[x0] = luma_( p[0][0], p[0][1], p[0][2] );
+				y0[x1] = luma_( p[1][0], p[1][1], p[1][2] );
+				y1[x0] = luma_( p[2][0], p[2][1], p[2][2] );
+				y1[x1] = luma_( p[3][0], p[3][1], p[3][2] );
+
+				uPlane[cy*cw + cx] = cb_( (sr+2) >> 2, (sg+2) >> 2, (sb+2) >> 2 );
+				vPlane[cy*cw + cx] = cr_( (sr+2) >> 2, (sg+2) >> 2, (sb+2) >> 2 );
+			}
+		}
+
+		std::unique_lock<std::mutex> lock( mWriteMutex );
+		mReady.emplace( aFrame, std::move(yuv) );
+
+		if( mWriting )
+			return; // the current writer will pick it up
+
+		mWriting = true;
+	}
+
+	// Write, in order, all frames that are ready. The lock is not held while
+	// writing, so other jobs can keep converting and queueing frames.
+	PROFILE_ZONE( "write video frames" );
+
+	std::unique_lock<std::mutex> lock( mWriteMutex );
+	for( auto it = mReady.find( mNextWrite ); mReady.end() != it; it = mReady.find( mNextWrite ) )
+	{
+		auto const data = std::move(it->second);
+		mReady.erase( it );
+		lock.unlock();
+
+		if( std::fputs( "FRAME\n", mFile ) < 0 || std::fwrite( data.data(), 1, data.size(), mFile ) != data.size() )
+			mWriteError = true;
+
+		lock.lock();
+		++mNextWrite;
+	}
+
+	mWriting = false;
+}
+
+
+std::string make_recording_path()
+{
+	char name[40];
+	std::time_t const t = std::time( nullptr );
+	std::strftime( name, sizeof(name), "recordings/%Y%m%d_%H%M%S.y4m", std::localtime( &t ) );
+	return name;
+}
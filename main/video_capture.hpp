@@ -0,0 +1,118 @@
+#ifndef VIDEO_CAPTURE_HPP
+#define VIDEO_CAPTURE_HPP
+
+#include <glad.h>
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "../support/jobs.hpp"
+
+#include "image_writer.hpp"
+
+/** VideoRecorder: capture every frame to disk
+ *
+ * Frames are read back through a ring of pixel pack buffers (PBOs), each
+ * guarded by a fence, and encoded by jobs:
+ *  - a path ending in .y4m produces a raw YUV 4:2:0 stream (YUV4MPEG2,
+ *    BT.601 limited range) that, e.g., ffmpeg reads directly;
+ *  - any other path is a directory that receives numbered images
+ *    (frame_000000.png, ...) in the given image format.
+ *
+ * Frames are never dropped. If the oldest slot of the ring is still being
+ * read back or encoded when the next frame is captured, capture() waits for
+ * it (and helps with the encoding). Together with a fixed simulation time
+ * step (timestep()), this slows the simulation down instead.
+ *
+ * Y4M frames are converted in parallel and written in order.
+ */
+class VideoRecorder final
+{
+	public:
+		// aRingSize = 0 picks a size based on the number of job threads.
+		// Throws Error if the output cannot be created.
+		VideoRecorder( JobSystem&, char const* aPath, unsigned aFps = 60, ImageFormat = ImageFormat::png, std::size_t aRingSize = 0 );
+		~VideoRecorder();
+
+		VideoRecorder( VideoRecorder const& ) = delete;
+		VideoRecorder& operator= (VideoRecorder const&) = delete;
+
+	public:
+		// Capture the aWidth x aHeight lower left region of the back buffer.
+		// Call after rendering, before swapping buffers. All frames must
+		// have the size of the first one; returns false otherwise.
+		bool capture( GLsizei aWidth, GLsizei aHeight );
+
+		// Start encoding frames whose readback has completed, and recycle
+		// slots. Never waits.
+		void update();
+
+		float timestep() const noexcept;
+
+		std::size_t frame_count() const noexcept;
+		std::size_t stall_count() const noexcept; // captures that had to wait
+		char const* path() const noexcept;
+
+	private:
+		enum class SlotState_
+		{
+			free,
+			reading,  // glReadPixels() issued, waiting for the fence
+			encoding  // mapped, a job is reading from it
+		};
+
+		struct Slot_
+		{
+			GLuint pbo = 0;
+			SlotState_ state = SlotState_::free;
+			GLsync fence = nullptr;
+			unsigned char const* pixels = nullptr; // mapped
+			std::size_t frame = 0;
+
+			JobCounter job;
+		};
+
+		void encode_( Slot_& );
+		void recycle_( Slot_& );
+		void wait_( Slot_& );
+
+		void encode_image_( std::size_t aFrame, unsigned char const* aPixels );
+		void encode_y4m_( std::size_t aFrame, unsigned char const* aPixels );
+
+	private:
+		JobSystem& mJobs;
+
+		std::string mPath;
+		bool mY4m;
+		unsigned mFps;
+		ImageFormat mImageFormat;
+
+		GLsizei mWidth = 0, mHeight = 0;
+
+		std::vector<std::unique_ptr<Slot_>> mSlots;
+		std::size_t mNext = 0; // oldest slot = next to be used
+
+		std::size_t mFrames = 0;
+		std::size_t mStalls = 0;
+
+		// Y4M output. Whichever job finds the next frame in mReady writes it
+		// (and any that follow); mWriting marks that someone is doing so.
+		std::FILE* mFile = nullptr;
+		std::mutex mWriteMutex;
+		std::map<std::size_t, std::vector<unsigned char>> mReady;
+		std::size_t mNextWrite = 0;
+		bool mWriting = false;
+		std::atomic<bool> mWriteError{ false };
+};
+
+// recordings/<date>_<time>.y4m
+std::string make_recording_path();
+
+#endif // VIDEO_CAPTURE_HPP
@@ -1,3 +1,8 @@
+newoption {
+	trigger = "no-profiler",
+	description = "Compile out the scope profiler (PROFILE_*() macros)"
+}
+
 workspace "COMP3811-cw2"
 	language "C++"
 	cppdialect "C++17"
@@ -62,6 +67,9 @@ workspace "COMP3811-cw2"
 		optimize "On"
 		defines { "NDEBUG=1" }
 
+	filter "options:no-profiler"
+		defines { "PROFILER_ENABLED=0" }
+
 	filter "*"
 
 
@@ -91,6 +99,32 @@ project "main"
 
 	files( sources )
 
+project "tests"
+	local sources = { 
+		"tests/**.cpp",
+		"tests/**.hpp"
+	}
+
+	-- Headless tests; only the CPU-side sources of main/ that they exercise
+	-- are compiled in (these make no OpenGL calls).
+	local tested = {
+		"main/bvh.cpp",
+		"main/bvh.hpp",
+		"main/culling.cpp",
+		"main/culling.hpp",
+		"main/occlusion.cpp",
+		"main/occlusion.hpp"
+	}
+
+	kind "ConsoleApp"
+	location "tests"
+
+	files( sources )
+	files( tested )
+
+	links "vmlib"
+	links "support"
+
 project "main-shaders"
 	local shaders = { 
 		"assets/*.vert",
@@ -0,0 +1,260 @@
+#include "buffer_arena.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+
+BufferArena::BufferArena( std::size_t aGranularity, std::size_t aPageBytes )
+	: mGranularity( aGranularity )
+	, mPageUnits( std::max<std::size_t>( aPageBytes / std::max<std::size_t>( aGranularity, 1 ), 1 ) )
+{
+	if( 0 == aGranularity )
+		throw Error( "BufferArena: granularity must not be zero" );
+}
+
+BufferArena::~BufferArena()
+{
+	for( auto const& page : mPages )
+		glDeleteBuffers( 1, &page.buffer );
+}
+
+BufferArena::Handle BufferArena::allocate( std::size_t aBytes, void const* aData )
+{
+	auto const units = std::max<std::size_t>( (aBytes + mGranularity - 1) / mGranularity, 1 );
+
+	std::size_t page = 0;
+	auto block = TlsfAllocator::kInvalid;
+	for( ; page < mPages.size(); ++page )
+	{
+		block = mPages[page].allocator.allocate( units );
+		if( TlsfAllocator::kInvalid != block )
+			break;
+	}
+
+	if( TlsfAllocator::kInvalid == block )
+	{
+		page = mPages.size();
+		mPages.emplace_back( create_page_( std::max( mPageUnits, units ) ) );
+		block = mPages.back().allocator.allocate( units );
+		assert( TlsfAllocator::kInvalid != block );
+	}
+
+	Handle handle;
+	if( !mUnusedHandles.empty() )
+	{
+		handle = mUnusedHandles.back();
+		mUnusedHandles.pop_back();
+	}
+	else
+	{
+		handle = Handle(mAllocations.size());
+		mAllocations.emplace_back();
+	}
+
+	mAllocations[handle] = Allocation_{ std::uint32_t(page), block, aBytes, true };
+
+	if( aData && aBytes )
+	{
+		auto const r = range( handle );
+		glBindBuffer( GL_COPY_WRITE_BUFFER, r.buffer );
+		glBufferSubData( GL_COPY_WRITE_BUFFER, r.offset, r.size, aData );
+		glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+	}
+
+	return handle;
+}
+
+void BufferArena::free( Handle aHandle )
+{
+	assert( aHandle < mAllocations.size() && mAllocations[aHandle].live );
+
+	auto& alloc = mAllocations[aHandle];
+	mPages[alloc.page].allocator.free( alloc.block );
+	alloc.live = false;
+
+	mUnusedHandles.emplace_back( aHandle );
+}
+
+void BufferArena::defragment()
+{
+	repack_( false );
+}
+
+void BufferArena::compact()
+{
+	repack_( true );
+}
+
+BufferArena::Range BufferArena::range( Handle aHandle ) const noexcept
+{
+	assert( aHandle < mAllocations.size() && mAllocations[aHandle].live );
+
+	auto const& alloc = mAllocations[aHandle];
+	auto const& page = mPages[alloc.page];
+	return Range{
+		page.buffer,
+		GLintptr(page.allocator.offset( alloc.block ) * mGranularity),
+		GLsizeiptr(alloc.bytes),
+		alloc.page
+	};
+}
+
+std::size_t BufferArena::granularity() const noexcept
+{
+	return mGranularity;
+}
+std::size_t BufferArena::page_count() const noexcept
+{
+	return mPages.size();
+}
+GLuint BufferArena::page_buffer( std::size_t aPage ) const noexcept
+{
+	assert( aPage < mPages.size() );
+	return mPages[aPage].buffer;
+}
+
+std::uint64_t BufferArena::generation() const noexcept
+{
+	return mGeneration;
+}
+
+BufferArena::Report BufferArena::report() const
+{
+	Report ret;
+	ret.pages = mPages.size();
+	ret.allocations = mAllocations.size() - mUnusedHandles.size();
+
+	std::size_t largestSum = 0;
+	for( auto const& page : mPages )
+	{
+		auto const& alloc = page.allocator;
+		auto const largest = alloc.largest_free_block() * mGranularity;
+
+		ret.capacity += alloc.capacity() * mGranularity;
+		ret.used += alloc.used() * mGranularity;
+		ret.freeBlocks += alloc.free_block_count();
+		ret.largestFree = std::max( ret.largestFree, largest );
+		largestSum += largest;
+	}
+
+	ret.free = ret.capacity - ret.used;
+	if( ret.free )
+		ret.fragmentation = 1.f - float(largestSum) / float(ret.free);
+
+	return ret;
+}
+
+BufferArena::Page_ BufferArena::create_page_( std::size_t aUnits )
+{
+	Page_ ret{ 0, TlsfAllocator( aUnits ) };
+
+	glGenBuffers( 1, &ret.buffer );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, ret.buffer );
+	glBufferData( GL_COPY_WRITE_BUFFER, GLsizeiptr(aUnits * mGranularity), nullptr, GL_STATIC_DRAW );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+	return ret;
+}
+
+void BufferArena::repack_( bool aAcrossPages )
+{
+	// Pages to rebuild. Per page, only those whose free space is split.
+	std::vector<bool> rebuild( mPages.size(), aAcrossPages );
+	if( !aAcrossPages )
+	{
+		for( std::size_t i = 0; i < mPages.size(); ++i )
+			rebuild[i] = mPages[i].allocator.free_block_count() > 1;
+	}
+
+	if( std::find( rebuild.begin(), rebuild.end(), true ) == rebuild.end() )
+		return;
+
+	// Live allocations in address order, so that packing keeps their order
+	std::vector<Handle> order;
+	for( Handle h = 0; h < mAllocations.size(); ++h )
+	{
+		auto const& alloc = mAllocations[h];
+		if( alloc.live && rebuild[alloc.page] )
+			order.emplace_back( h );
+	}
+
+	std::sort( order.begin(), order.end(), [this] ( Handle aA, Handle aB ) {
+		auto const& a = mAllocations[aA];
+		auto const& b = mAllocations[aB];
+		if( a.page != b.page )
+			return a.page < b.page;
+		return mPages[a.page].allocator.offset( a.block ) < mPages[b.page].allocator.offset( b.block );
+	} );
+
+	// New pages: across pages, filled in order; otherwise, a replacement for
+	// each page that is rebuilt, with the same capacity.
+	std::vector<Page_> pages;
+	if( !aAcrossPages )
+	{
+		pages.reserve( mPages.size() );
+		for( std::size_t i = 0; i < mPages.size(); ++i )
+		{
+			if( rebuild[i] )
+				pages.emplace_back( create_page_( mPages[i].allocator.capacity() ) );
+			else
+				pages.emplace_back( Page_{ 0, TlsfAllocator() } ); // moved over below
+		}
+	}
+
+	for( auto const h : order )
+	{
+		auto& alloc = mAllocations[h];
+		auto const& src = mPages[alloc.page];
+		auto const units = src.allocator.size( alloc.block );
+
+		std::size_t dst = alloc.page;
+		auto block = TlsfAllocator::kInvalid;
+		if( aAcrossPages )
+		{
+			if( !pages.empty() )
+				block = pages.back().allocator.allocate( units );
+
+			if( TlsfAllocator::kInvalid == block )
+			{
+				pages.emplace_back( create_page_( std::max( mPageUnits, units ) ) );
+				block = pages.back().allocator.allocate( units );
+			}
+			dst = pages.size()-1;
+		}
+		else
+		{
+			block = pages[dst].allocator.allocate( units );
+		}
+
+		assert( TlsfAllocator::kInvalid != block );
+
+		glBindBuffer( GL_COPY_READ_BUFFER, src.buffer );
+		glBindBuffer( GL_COPY_WRITE_BUFFER, pages[dst].buffer );
+		glCopyBufferSubData(
+			GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+			GLintptr(src.allocator.offset( alloc.block ) * mGranularity),
+			GLintptr(pages[dst].allocator.offset( block ) * mGranularity),
+			GLsizeiptr(units * mGranularity)
+		);
+
+		alloc.page = std::uint32_t(dst);
+		alloc.block = block;
+	}
+
+	glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+	// Release the old pages; keep those that were not rebuilt
+	for( std::size_t i = 0; i < mPages.size(); ++i )
+	{
+		if( rebuild[i] )
+			glDeleteBuffers( 1, &mPages[i].buffer );
+		else
+			pages[i] = std::move( mPages[i] );
+	}
+
+	mPages = std::move( pages );
+	++mGeneration;
+}
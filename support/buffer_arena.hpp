@@ -0,0 +1,123 @@
+#ifndef BUFFER_ARENA_HPP_E61B9F03_42C7_4A5D_9D8E_0F7A3C52B1D6
+#define BUFFER_ARENA_HPP_E61B9F03_42C7_4A5D_9D8E_0F7A3C52B1D6
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "tlsf_allocator.hpp"
+
+/** BufferArena: sub-allocates long-lived data from a few large GL buffers
+ *
+ * Each page is one GL buffer, managed by a TlsfAllocator. allocate() places
+ * the data in the first page with a large enough free block, and creates a
+ * new page when there is none. Sizes and offsets are multiples of the
+ * granularity; with the vertex size as granularity, offset / granularity is
+ * a base vertex.
+ *
+ * Allocations are referred to by stable handles. defragment() and compact()
+ * move the data of live allocations (on the GPU, with glCopyBufferSubData)
+ * and therefore change their ranges, and possibly their buffers; generation()
+ * changes whenever that happens, and cached ranges must then be re-queried.
+ *
+ * Pages are created with glBufferData() and filled with glBufferSubData();
+ * any buffer target can use them. The arena binds GL_COPY_READ_BUFFER and
+ * GL_COPY_WRITE_BUFFER.
+ */
+class BufferArena final
+{
+	public:
+		using Handle = std::uint32_t;
+		static constexpr Handle kInvalid = ~Handle(0);
+
+		struct Range
+		{
+			GLuint buffer;
+			GLintptr offset;
+			GLsizeiptr size; // as requested
+			std::size_t page;
+		};
+
+		struct Report
+		{
+			std::size_t pages = 0;
+			std::size_t allocations = 0;
+
+			std::size_t capacity = 0; // bytes
+			std::size_t used = 0; // bytes, incl. rounding to the granularity
+			std::size_t free = 0;
+
+			std::size_t freeBlocks = 0;
+			std::size_t largestFree = 0; // bytes, over all pages
+
+			// 1 - (largest free block / free space) of the pages, weighted by
+			// their free space: 0 if each page's free space is in one block,
+			// towards 1 as it is split into many small ones.
+			float fragmentation = 0.f;
+		};
+
+	public:
+		explicit BufferArena( std::size_t aGranularity = 16, std::size_t aPageBytes = std::size_t(16) << 20 );
+		~BufferArena();
+
+		BufferArena( BufferArena const& ) = delete;
+		BufferArena& operator= (BufferArena const&) = delete;
+
+	public:
+		// Allocations larger than a page get a page of their own. aData may
+		// be null (contents are then undefined).
+		Handle allocate( std::size_t aBytes, void const* aData = nullptr );
+		void free( Handle );
+
+		// Move the allocations of each page to its start, so that the page's
+		// free space forms one block. Pages whose free space is already in
+		// one block are left alone.
+		void defragment();
+
+		// Pack all allocations into as few pages as possible, and release the
+		// rest of the pages.
+		void compact();
+
+	public:
+		Range range( Handle ) const noexcept;
+
+		std::size_t granularity() const noexcept;
+		std::size_t page_count() const noexcept;
+		GLuint page_buffer( std::size_t ) const noexcept;
+
+		std::uint64_t generation() const noexcept;
+
+		Report report() const;
+
+	private:
+		struct Page_
+		{
+			GLuint buffer;
+			TlsfAllocator allocator; // in units of mGranularity
+		};
+		struct Allocation_
+		{
+			std::uint32_t page;
+			TlsfAllocator::Block block;
+			std::size_t bytes;
+			bool live;
+		};
+
+		Page_ create_page_( std::size_t aUnits );
+		void repack_( bool aAcrossPages );
+
+	private:
+		std::size_t mGranularity;
+		std::size_t mPageUnits;
+
+		std::vector<Page_> mPages;
+		std::vector<Allocation_> mAllocations;
+		std::vector<Handle> mUnusedHandles;
+
+		std::uint64_t mGeneration = 0;
+};
+
+#endif // BUFFER_ARENA_HPP_E61B9F03_42C7_4A5D_9D8E_0F7A3C52B1D6
@@ -0,0 +1,368 @@
+#include "gl_state.hpp"
+
+#include <cassert>
+
+#include "error.hpp"
+
+namespace glstate
+{
+	namespace
+	{
+		constexpr GLuint kUnknown_ = ~GLuint(0);
+
+		constexpr GLuint kUnits_ = 16; // texture units that are shadowed
+
+		constexpr GLenum kTextureTargets_[] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP };
+		constexpr GLenum kTextureBindings_[] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_CUBE_MAP };
+		constexpr std::size_t kTargetCount_ = sizeof(kTextureTargets_) / sizeof(kTextureTargets_[0]);
+
+		constexpr GLenum kCaps_[] = { GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_FRAMEBUFFER_SRGB };
+		constexpr std::size_t kCapCount_ = sizeof(kCaps_) / sizeof(kCaps_[0]);
+
+		// kUnknown_ marks state that has not been set through the cache
+		struct State_
+		{
+			GLuint program = kUnknown_;
+			GLuint vao = kUnknown_;
+
+			GLuint activeUnit = kUnknown_;
+			GLuint textures[kUnits_][kTargetCount_];
+
+			GLuint caps[kCapCount_]; // 0, 1 or kUnknown_
+
+			GLuint blendSrc = kUnknown_, blendDst = kUnknown_;
+			GLuint depthFunc = kUnknown_;
+			GLuint depthMask = kUnknown_;
+			GLuint cullFace = kUnknown_;
+
+			GLint viewport[4] = {};
+			bool viewportKnown = false;
+
+			State_() noexcept
+			{
+				for( auto& unit : textures )
+				{
+					for( auto& binding : unit )
+						binding = kUnknown_;
+				}
+				for( auto& cap : caps )
+					cap = kUnknown_;
+			}
+		};
+
+		State_ gState_;
+		Stats gStats_{};
+
+#		if defined(NDEBUG)
+		bool gVerify_ = false;
+#		else
+		bool gVerify_ = true;
+#		endif
+
+		std::size_t target_index_( GLenum aTarget ) noexcept
+		{
+			for( std::size_t i = 0; i < kTargetCount_; ++i )
+			{
+				if( kTextureTargets_[i] == aTarget )
+					return i;
+			}
+			return kTargetCount_;
+		}
+		std::size_t cap_index_( GLenum aCap ) noexcept
+		{
+			for( std::size_t i = 0; i < kCapCount_; ++i )
+			{
+				if( kCaps_[i] == aCap )
+					return i;
+			}
+			return kCapCount_;
+		}
+
+		// Returns true if the call is redundant and can be skipped
+		bool same_( GLuint aShadow, GLuint aValue ) noexcept
+		{
+			++gStats_.calls;
+			if( aShadow == aValue )
+			{
+				++gStats_.elided;
+				return true;
+			}
+			return false;
+		}
+
+		void check_( char const* aWhat, GLuint aShadow, GLint aActual )
+		{
+			if( kUnknown_ != aShadow && GLint(aShadow) != aActual )
+				throw Error( "GL state cache: %s is %d, but the cache says %d", aWhat, int(aActual), int(aShadow) );
+		}
+
+		GLint get_( GLenum aName )
+		{
+			GLint value = 0;
+			glGetIntegerv( aName, &value );
+			return value;
+		}
+
+		void verify_program_() { check_( "GL_CURRENT_PROGRAM", gState_.program, get_( GL_CURRENT_PROGRAM ) ); }
+		void verify_vao_() { check_( "GL_VERTEX_ARRAY_BINDING", gState_.vao, get_( GL_VERTEX_ARRAY_BINDING ) ); }
+		void verify_active_unit_()
+		{
+			check_( "GL_ACTIVE_TEXTURE", gState_.activeUnit, get_( GL_ACTIVE_TEXTURE ) - GL_TEXTURE0 );
+		}
+		void verify_texture_( GLuint aUnit, std::size_t aTarget )
+		{
+			auto const shadow = gState_.textures[aUnit][aTarget];
+			if( kUnknown_ == shadow )
+				return;
+
+			// Querying a unit's bindings requires making it active
+			auto const active = get_( GL_ACTIVE_TEXTURE );
+			glActiveTexture( GL_TEXTURE0 + aUnit );
+			auto const actual = get_( kTextureBindings_[aTarget] );
+			glActiveTexture( GLenum(active) );
+
+			if( GLint(shadow) != actual )
+				throw Error( "GL state cache: texture unit %u binding (target %#x) is %d, but the cache says %d", unsigned(aUnit), unsigned(kTextureTargets_[aTarget]), int(actual), int(shadow) );
+		}
+		void verify_cap_( std::size_t aIndex )
+		{
+			check_( "glIsEnabled()", gState_.caps[aIndex], glIsEnabled( kCaps_[aIndex] ) ? 1 : 0 );
+		}
+		void verify_blend_()
+		{
+			check_( "GL_BLEND_SRC_RGB", gState_.blendSrc, get_( GL_BLEND_SRC_RGB ) );
+			check_( "GL_BLEND_DST_RGB", gState_.blendDst, get_( GL_BLEND_DST_RGB ) );
+		}
+		void verify_depth_func_() { check_( "GL_DEPTH_FUNC", gState_.depthFunc, get_( GL_DEPTH_FUNC ) ); }
+		void verify_depth_mask_()
+		{
+			GLboolean mask = GL_FALSE;
+			glGetBooleanv( GL_DEPTH_WRITEMASK, &mask );
+			check_( "GL_DEPTH_WRITEMASK", gState_.depthMask, mask );
+		}
+		void verify_cull_face_() { check_( "GL_CULL_FACE_MODE", gState_.cullFace, get_( GL_CULL_FACE_MODE ) ); }
+		void verify_viewport_()
+		{
+			if( !gState_.viewportKnown )
+				return;
+
+			GLint actual[4];
+			glGetIntegerv( GL_VIEWPORT, actual );
+			for( int i = 0; i < 4; ++i )
+				check_( "GL_VIEWPORT", GLuint(gState_.viewport[i]), actual[i] );
+		}
+
+		void set_active_unit_( GLuint aUnit )
+		{
+			if( gVerify_ )
+				verify_active_unit_();
+
+			if( !same_( gState_.activeUnit, aUnit ) )
+			{
+				glActiveTexture( GL_TEXTURE0 + aUnit );
+				gState_.activeUnit = aUnit;
+			}
+		}
+	}
+
+	void use_program( GLuint aProgram )
+	{
+		if( gVerify_ )
+			verify_program_();
+
+		if( same_( gState_.program, aProgram ) )
+			return;
+
+		glUseProgram( aProgram );
+		gState_.program = aProgram;
+	}
+
+	void bind_vertex_array( GLuint aVao )
+	{
+		if( gVerify_ )
+			verify_vao_();
+
+		if( same_( gState_.vao, aVao ) )
+			return;
+
+		glBindVertexArray( aVao );
+		gState_.vao = aVao;
+	}
+
+	void bind_texture( GLuint aUnit, GLenum aTarget, GLuint aTexture )
+	{
+		auto const target = target_index_( aTarget );
+		if( aUnit >= kUnits_ || target >= kTargetCount_ )
+		{
+			// Not shadowed
+			glActiveTexture( GL_TEXTURE0 + aUnit );
+			glBindTexture( aTarget, aTexture );
+			gState_.activeUnit = aUnit;
+			return;
+		}
+
+		if( gVerify_ )
+			verify_texture_( aUnit, target );
+
+		if( same_( gState_.textures[aUnit][target], aTexture ) )
+			return;
+
+		set_active_unit_( aUnit );
+		glBindTexture( aTarget, aTexture );
+		gState_.textures[aUnit][target] = aTexture;
+	}
+
+	void edit_texture( GLenum aTarget, GLuint aTexture )
+	{
+		bind_texture( 0, aTarget, aTexture );
+		set_active_unit_( 0 );
+	}
+
+	void enable( GLenum aCap )
+	{
+		set_enabled( aCap, true );
+	}
+	void disable( GLenum aCap )
+	{
+		set_enabled( aCap, false );
+	}
+	void set_enabled( GLenum aCap, bool aEnabled )
+	{
+		auto const index = cap_index_( aCap );
+		if( index < kCapCount_ )
+		{
+			if( gVerify_ )
+				verify_cap_( index );
+
+			if( same_( gState_.caps[index], aEnabled ? 1 : 0 ) )
+				return;
+
+			gState_.caps[index] = aEnabled ? 1 : 0;
+		}
+
+		if( aEnabled )
+			glEnable( aCap );
+		else
+			glDisable( aCap );
+	}
+
+	void blend_func( GLenum aSrc, GLenum aDst )
+	{
+		if( gVerify_ )
+			verify_blend_();
+
+		++gStats_.calls;
+		if( gState_.blendSrc == aSrc && gState_.blendDst == aDst )
+		{
+			++gStats_.elided;
+			return;
+		}
+
+		glBlendFunc( aSrc, aDst );
+		gState_.blendSrc = aSrc;
+		gState_.blendDst = aDst;
+	}
+
+	void depth_func( GLenum aFunc )
+	{
+		if( gVerify_ )
+			verify_depth_func_();
+
+		if( same_( gState_.depthFunc, aFunc ) )
+			return;
+
+		glDepthFunc( aFunc );
+		gState_.depthFunc = aFunc;
+	}
+
+	void depth_mask( GLboolean aMask )
+	{
+		if( gVerify_ )
+			verify_depth_mask_();
+
+		if( same_( gState_.depthMask, aMask ? GL_TRUE : GL_FALSE ) )
+			return;
+
+		glDepthMask( aMask );
+		gState_.depthMask = aMask ? GL_TRUE : GL_FALSE;
+	}
+
+	void cull_face( GLenum aFace )
+	{
+		if( gVerify_ )
+			verify_cull_face_();
+
+		if( same_( gState_.cullFace, aFace ) )
+			return;
+
+		glCullFace( aFace );
+		gState_.cullFace = aFace;
+	}
+
+	void viewport( GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight )
+	{
+		if( gVerify_ )
+			verify_viewport_();
+
+		++gStats_.calls;
+		auto const& vp = gState_.viewport;
+		if( gState_.viewportKnown && vp[0] == aX && vp[1] == aY && vp[2] == aWidth && vp[3] == aHeight )
+		{
+			++gStats_.elided;
+			return;
+		}
+
+		glViewport( aX, aY, aWidth, aHeight );
+		gState_.viewport[0] = aX;
+		gState_.viewport[1] = aY;
+		gState_.viewport[2] = aWidth;
+		gState_.viewport[3] = aHeight;
+		gState_.viewportKnown = true;
+	}
+
+	void forget_vertex_array( GLuint aVao )
+	{
+		if( gState_.vao == aVao )
+			gState_.vao = 0;
+	}
+
+	void invalidate() noexcept
+	{
+		gState_ = State_{};
+	}
+
+	void verify()
+	{
+		verify_program_();
+		verify_vao_();
+		verify_active_unit_();
+		for( GLuint unit = 0; unit < kUnits_; ++unit )
+		{
+			for( std::size_t target = 0; target < kTargetCount_; ++target )
+				verify_texture_( unit, target );
+		}
+		for( std::size_t i = 0; i < kCapCount_; ++i )
+			verify_cap_( i );
+		verify_blend_();
+		verify_depth_func_();
+		verify_depth_mask_();
+		verify_cull_face_();
+		verify_viewport_();
+	}
+
+	void set_verify( bool aVerify ) noexcept
+	{
+		gVerify_ = aVerify;
+	}
+	bool verify_enabled() noexcept
+	{
+		return gVerify_;
+	}
+
+	Stats take_stats() noexcept
+	{
+		auto const ret = gStats_;
+		gStats_ = Stats{};
+		return ret;
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef GL_STATE_HPP_1B7E5D30_C4A2_4F86_9D13_7E60A8F2B594
+#define GL_STATE_HPP_1B7E5D30_C4A2_4F86_9D13_7E60A8F2B594
+
+#include <glad.h>
+
+#include <cstdint>
+#include <cstdlib>
+
+/* GL state cache
+ *
+ * Shadows a subset of the GL state (bound program, VAO, texture bindings,
+ * blend/depth/cull state, viewport) and skips calls that would not change
+ * it. All state changes of this kind must go through these functions, or the
+ * shadow becomes stale. After code that changes the state behind our back
+ * (and does not restore it), call invalidate().
+ *
+ * There is a single GL context, and all functions must be called from the
+ * thread that has it current.
+ *
+ * In verify mode (default in debug builds), each call first checks the
+ * shadowed value against glGet*() and throws Error if they differ.
+ */
+namespace glstate
+{
+	struct Stats
+	{
+		std::uint64_t calls;  // state changes requested
+		std::uint64_t elided; // ... of which were redundant and skipped
+	};
+
+	void use_program( GLuint );
+	void bind_vertex_array( GLuint );
+
+	// Bind aTexture to aTarget (GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP) of
+	// texture unit aUnit. This may leave any unit active.
+	void bind_texture( GLuint aUnit, GLenum aTarget, GLuint aTexture );
+
+	// Bind aTexture on unit 0 and make unit 0 active, so that glTex*() calls
+	// apply to it.
+	void edit_texture( GLenum aTarget, GLuint aTexture );
+
+	// GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST and GL_FRAMEBUFFER_SRGB are
+	// cached; other capabilities are passed through.
+	void enable( GLenum aCap );
+	void disable( GLenum aCap );
+	void set_enabled( GLenum aCap, bool aEnabled );
+
+	void blend_func( GLenum aSrc, GLenum aDst );
+	void depth_func( GLenum );
+	void depth_mask( GLboolean );
+	void cull_face( GLenum );
+	void viewport( GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight );
+
+	// Deleting a bound VAO resets the binding to zero.
+	void forget_vertex_array( GLuint );
+
+	// Forget all shadowed state; the next call of each kind goes through.
+	void invalidate() noexcept;
+
+	// Compare all known shadowed state with glGet*(). Throws Error.
+	void verify();
+	void set_verify( bool ) noexcept;
+	bool verify_enabled() noexcept;
+
+	// Counts since the last call
+	Stats take_stats() noexcept;
+}
+
+#endif // GL_STATE_HPP_1B7E5D30_C4A2_4F86_9D13_7E60A8F2B594
@@ -0,0 +1,246 @@
+#include "gpu_profiler.hpp"
+
+#include <numeric>
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+	constexpr std::size_t kNoQuery_ = ~std::size_t(0);
+
+	GLenum const kStatTargets_[] = {
+		GL_VERTICES_SUBMITTED,
+		GL_PRIMITIVES_SUBMITTED,
+		GL_VERTEX_SHADER_INVOCATIONS,
+		GL_CLIPPING_OUTPUT_PRIMITIVES,
+		GL_FRAGMENT_SHADER_INVOCATIONS
+	};
+
+	bool has_extension_( char const* aName )
+	{
+		GLint count = 0;
+		glGetIntegerv( GL_NUM_EXTENSIONS, &count );
+		for( GLint i = 0; i < count; ++i )
+		{
+			auto const* ext = reinterpret_cast<char const*>(glGetStringi( GL_EXTENSIONS, GLuint(i) ));
+			if( ext && 0 == std::strcmp( ext, aName ) )
+				return true;
+		}
+		return false;
+	}
+}
+
+GpuProfiler::GpuProfiler()
+	: mTrack( profiler::create_track( "GPU" ) )
+{
+	static_assert( sizeof(kStatTargets_)/sizeof(kStatTargets_[0]) == kStatCount_ );
+
+	// The ARB extension uses the same enums as GL 4.6
+	mPipelineStatistics = GLAD_GL_VERSION_4_6 || has_extension_( "GL_ARB_pipeline_statistics_query" );
+
+	if( mPipelineStatistics )
+	{
+		for( auto& frame : mFrames )
+			glGenQueries( GLsizei(kStatCount_), frame.stats );
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	for( auto& frame : mFrames )
+	{
+		if( !frame.queries.empty() )
+			glDeleteQueries( GLsizei(frame.queries.size()), frame.queries.data() );
+		if( mPipelineStatistics )
+			glDeleteQueries( GLsizei(kStatCount_), frame.stats );
+	}
+}
+
+void GpuProfiler::begin_frame()
+{
+	assert( !mInFrame );
+
+	// Collect completed frames, oldest first. The GPU finishes frames in
+	// order, so stop at the first one that is still pending.
+	for( std::size_t i = 0; i < kFrameLatency; ++i )
+	{
+		auto& frame = mFrames[(mCurrent + i) % kFrameLatency];
+		if( frame.pending && !try_collect_( frame ) )
+			break;
+	}
+
+	auto& frame = mFrames[mCurrent];
+	if( frame.pending )
+	{
+		// Still not done after kFrameLatency frames. Reuse the queries
+		// rather than waiting for them.
+		frame.pending = false;
+		++mDropped;
+	}
+
+	frame.usedQueries = 0;
+	frame.zones.clear();
+
+	glGetInteger64v( GL_TIMESTAMP, &frame.syncNs );
+	frame.syncTicks = profiler::now();
+
+	if( mPipelineStatistics )
+	{
+		for( std::size_t i = 0; i < kStatCount_; ++i )
+			glBeginQuery( kStatTargets_[i], frame.stats[i] );
+	}
+
+	mInFrame = true;
+	begin_zone( "frame" );
+}
+
+void GpuProfiler::end_frame()
+{
+	assert( mInFrame );
+
+	end_zone();
+	assert( mOpen.empty() );
+
+	if( mPipelineStatistics )
+	{
+		for( auto const target : kStatTargets_ )
+			glEndQuery( target );
+	}
+
+	mFrames[mCurrent].pending = true;
+	mCurrent = (mCurrent+1) % kFrameLatency;
+	mInFrame = false;
+}
+
+void GpuProfiler::begin_zone( char const* aName )
+{
+	// Zones outside of begin_frame()/end_frame() are ignored
+	if( !mInFrame )
+		return;
+
+	auto& frame = mFrames[mCurrent];
+	mOpen.emplace_back( frame.zones.size() );
+	frame.zones.emplace_back( Zone_{ aName, std::uint32_t(mOpen.size()-1), timestamp_( frame ), kNoQuery_ } );
+}
+
+void GpuProfiler::end_zone()
+{
+	if( !mInFrame )
+		return;
+
+	assert( !mOpen.empty() );
+
+	auto& frame = mFrames[mCurrent];
+	frame.zones[mOpen.back()].endQuery = timestamp_( frame );
+	mOpen.pop_back();
+}
+
+float GpuProfiler::frame_ms() const noexcept
+{
+	return mFrameMs;
+}
+std::vector<GpuProfiler::ZoneTime> const& GpuProfiler::zones() const noexcept
+{
+	return mZones;
+}
+
+bool GpuProfiler::has_pipeline_statistics() const noexcept
+{
+	return mPipelineStatistics;
+}
+GpuProfiler::PipelineStatistics const& GpuProfiler::pipeline_statistics() const noexcept
+{
+	return mStats;
+}
+
+std::size_t GpuProfiler::dropped_frames() const noexcept
+{
+	return mDropped;
+}
+
+GpuProfiler::Results GpuProfiler::results() const
+{
+	return Results{ mFrameMs, mZones, mPipelineStatistics, mStats, mDropped };
+}
+
+
+std::size_t GpuProfiler::timestamp_( FrameSet_& aFrame )
+{
+	if( aFrame.usedQueries == aFrame.queries.size() )
+	{
+		GLuint query = 0;
+		glGenQueries( 1, &query );
+		aFrame.queries.emplace_back( query );
+	}
+
+	glQueryCounter( aFrame.queries[aFrame.usedQueries], GL_TIMESTAMP );
+	return aFrame.usedQueries++;
+}
+
+bool GpuProfiler::try_collect_( FrameSet_& aFrame )
+{
+	assert( aFrame.pending && aFrame.usedQueries > 0 );
+
+	// The frame's end timestamp is the last query that was issued; the
+	// statistics queries ended after it.
+	GLuint available = 0;
+	glGetQueryObjectuiv( aFrame.queries[aFrame.usedQueries-1], GL_QUERY_RESULT_AVAILABLE, &available );
+	if( available && mPipelineStatistics )
+		glGetQueryObjectuiv( aFrame.stats[kStatCount_-1], GL_QUERY_RESULT_AVAILABLE, &available );
+
+	if( !available )
+		return false;
+
+	std::vector<GLuint64> ns( aFrame.usedQueries );
+	for( std::size_t i = 0; i < aFrame.usedQueries; ++i )
+		glGetQueryObjectui64v( aFrame.queries[i], GL_QUERY_RESULT, &ns[i] );
+
+	// The first zone is the whole frame
+	auto const& frameZone = aFrame.zones.front();
+	mFrameMs = float(ns[frameZone.endQuery] - ns[frameZone.beginQuery]) * 1e-6f;
+
+	mZones.clear();
+	for( std::size_t i = 1; i < aFrame.zones.size(); ++i )
+	{
+		auto const& zone = aFrame.zones[i];
+		mZones.emplace_back( ZoneTime{ zone.name, zone.depth-1, float(ns[zone.endQuery] - ns[zone.beginQuery]) * 1e-6f } );
+	}
+
+	if( mPipelineStatistics )
+	{
+		GLuint64 values[kStatCount_];
+		for( std::size_t i = 0; i < kStatCount_; ++i )
+			glGetQueryObjectui64v( aFrame.stats[i], GL_QUERY_RESULT, &values[i] );
+
+		mStats = PipelineStatistics{ values[0], values[1], values[2], values[3], values[4] };
+	}
+
+#	if PROFILER_ENABLED
+	// Place the zones on the CPU timeline. Tracks expect events in order of
+	// their end times.
+	auto const to_ticks = [&] ( GLuint64 aNs ) {
+		double const us = (double(aNs) - double(aFrame.syncNs)) * 1e-3;
+		return us >= 0.0
+			? aFrame.syncTicks + profiler::us_to_ticks( us )
+			: aFrame.syncTicks - profiler::us_to_ticks( -us )
+		;
+	};
+
+	std::vector<std::size_t> order( aFrame.zones.size() );
+	std::iota( order.begin(), order.end(), std::size_t(0) );
+	std::stable_sort( order.begin(), order.end(), [&] ( std::size_t aX, std::size_t aY ) {
+		return aFrame.zones[aX].endQuery < aFrame.zones[aY].endQuery;
+	} );
+
+	for( auto const index : order )
+	{
+		auto const& zone = aFrame.zones[index];
+		profiler::record( mTrack, zone.name, to_ticks( ns[zone.beginQuery] ), to_ticks( ns[zone.endQuery] ), zone.depth );
+	}
+#	endif // ~ PROFILER_ENABLED
+
+	aFrame.pending = false;
+	return true;
+}
@@ -0,0 +1,156 @@
+#ifndef GPU_PROFILER_HPP_8C1F4E62_2B7A_4D95_B3E0_6A9D52F1C047
+#define GPU_PROFILER_HPP_8C1F4E62_2B7A_4D95_B3E0_6A9D52F1C047
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "profiler.hpp"
+
+/** GpuProfiler: GPU timings from timer queries
+ *
+ * Usage, per frame:
+ *	gpu.begin_frame();
+ *	{
+ *		GpuZone zone( gpu, "draw scene" ); // name must be a string literal
+ *		...
+ *	}
+ *	gpu.end_frame(); // before swapping buffers
+ *
+ * Zones are delimited by GL_TIMESTAMP queries, so they may nest. The queries
+ * of a frame are read back kFrameLatency frames later, and only if they are
+ * available, so that the CPU never waits for the GPU. Frames whose queries
+ * are still pending when their query set is needed again are dropped.
+ *
+ * Completed frames are also recorded on a "GPU" track of the scope profiler
+ * (support/profiler.hpp). GPU timestamps are converted to profiler ticks via
+ * a CPU/GPU clock pair that is sampled at the start of each frame.
+ *
+ * If GL 4.6 or GL_ARB_pipeline_statistics_query is available, a few pipeline
+ * statistics are gathered for the whole frame as well.
+ */
+class GpuProfiler final
+{
+	public:
+		static constexpr std::size_t kFrameLatency = 4;
+
+		struct ZoneTime
+		{
+			char const* name;
+			std::uint32_t depth; // 0 = outermost zone in the frame
+			float ms;
+		};
+
+		struct PipelineStatistics
+		{
+			GLuint64 verticesSubmitted;
+			GLuint64 primitivesSubmitted;
+			GLuint64 vertexShaderInvocations;
+			GLuint64 clippingOutputPrimitives;
+			GLuint64 fragmentShaderInvocations;
+		};
+
+		// Copy of the results, e.g., for display on another thread
+		struct Results
+		{
+			float frameMs = 0.f;
+			std::vector<ZoneTime> zones;
+			bool hasPipelineStatistics = false;
+			PipelineStatistics pipelineStatistics{};
+			std::size_t droppedFrames = 0;
+		};
+
+	public:
+		GpuProfiler();
+		~GpuProfiler();
+
+		GpuProfiler( GpuProfiler const& ) = delete;
+		GpuProfiler& operator= (GpuProfiler const&) = delete;
+
+	public:
+		void begin_frame();
+		void end_frame();
+
+		void begin_zone( char const* aName );
+		void end_zone();
+
+	public:
+		// Results of the most recent completed frame
+		float frame_ms() const noexcept;
+		std::vector<ZoneTime> const& zones() const noexcept;
+
+		bool has_pipeline_statistics() const noexcept;
+		PipelineStatistics const& pipeline_statistics() const noexcept;
+
+		std::size_t dropped_frames() const noexcept;
+
+		Results results() const;
+
+	private:
+		static constexpr std::size_t kStatCount_ = 5;
+
+		struct Zone_
+		{
+			char const* name;
+			std::uint32_t depth;
+			std::size_t beginQuery, endQuery;
+		};
+
+		struct FrameSet_
+		{
+			std::vector<GLuint> queries; // GL_TIMESTAMP; grows as needed
+			std::size_t usedQueries = 0;
+
+			std::vector<Zone_> zones; // in order of begin_zone()
+			GLuint stats[kStatCount_] = {};
+
+			profiler::Ticks syncTicks = 0; // CPU and GPU clocks at the start
+			GLint64 syncNs = 0;
+
+			bool pending = false;
+		};
+
+		std::size_t timestamp_( FrameSet_& );
+		bool try_collect_( FrameSet_& );
+
+	private:
+		FrameSet_ mFrames[kFrameLatency];
+		std::size_t mCurrent = 0;
+		bool mInFrame = false;
+
+		std::vector<std::size_t> mOpen; // open zones of the current frame
+
+		bool mPipelineStatistics = false;
+		profiler::Track mTrack;
+
+		float mFrameMs = 0.f;
+		std::vector<ZoneTime> mZones;
+		PipelineStatistics mStats{};
+		std::size_t mDropped = 0;
+};
+
+/** GpuZone: RAII helper for GpuProfiler::begin_zone()/end_zone() */
+class GpuZone final
+{
+	public:
+		GpuZone( GpuProfiler& aProfiler, char const* aName )
+			: mProfiler( aProfiler )
+		{
+			mProfiler.begin_zone( aName );
+		}
+		~GpuZone()
+		{
+			mProfiler.end_zone();
+		}
+
+		GpuZone( GpuZone const& ) = delete;
+		GpuZone& operator= (GpuZone const&) = delete;
+
+	private:
+		GpuProfiler& mProfiler;
+};
+
+#endif // GPU_PROFILER_HPP_8C1F4E62_2B7A_4D95_B3E0_6A9D52F1C047
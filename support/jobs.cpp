@@ -0,0 +1,410 @@
+#include "jobs.hpp"
+
+#include <chrono>
+#include <utility>
+
+#include <cstdio>
+#include <cassert>
+
+#include "profiler.hpp"
+
+namespace detail
+{
+	struct Job
+	{
+		JobSystem::Func func;
+		JobCounter* counter;
+	};
+
+	// Chase-Lev work-stealing deque, following
+	//   N. M. Lê et al., "Correct and Efficient Work-Stealing for Weak Memory
+	//   Models", PPoPP 2013.
+	// The owning thread pushes and pops at the bottom; other threads steal
+	// from the top. The capacity is fixed; push() fails when the deque is
+	// full, in which case the caller runs the job inline.
+	class WorkStealingDeque
+	{
+		public:
+			static constexpr std::int64_t kCapacity = 4096;
+
+		public:
+			bool push( Job* aJob ) noexcept
+			{
+				auto const b = mBottom.load( std::memory_order_relaxed );
+				auto const t = mTop.load( std::memory_order_acquire );
+				if( b - t >= kCapacity )
+					return false;
+
+				mBuffer[b & (kCapacity-1)].store( aJob, std::memory_order_release );
+				std::atomic_thread_fence( std::memory_order_release );
+				mBottom.store( b+1, std::memory_order_relaxed );
+				return true;
+			}
+
+			Job* pop() noexcept
+			{
+				auto const b = mBottom.load( std::memory_order_relaxed ) - 1;
+				mBottom.store( b, std::memory_order_relaxed );
+				std::atomic_thread_fence( std::memory_order_seq_cst );
+				auto t = mTop.load( std::memory_order_relaxed );
+
+				if( t > b )
+				{
+					mBottom.store( b+1, std::memory_order_relaxed );
+					return nullptr;
+				}
+
+				Job* job = mBuffer[b & (kCapacity-1)].load( std::memory_order_relaxed );
+				if( t == b )
+				{
+					// Last element: race against thieves
+					if( !mTop.compare_exchange_strong( t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+						job = nullptr;
+
+					mBottom.store( b+1, std::memory_order_relaxed );
+				}
+
+				return job;
+			}
+
+			Job* steal() noexcept
+			{
+				auto t = mTop.load( std::memory_order_acquire );
+				std::atomic_thread_fence( std::memory_order_seq_cst );
+				auto const b = mBottom.load( std::memory_order_acquire );
+
+				if( t >= b )
+					return nullptr;
+
+				Job* job = mBuffer[t & (kCapacity-1)].load( std::memory_order_acquire );
+				if( !mTop.compare_exchange_strong( t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+					return nullptr;
+
+				return job;
+			}
+
+		private:
+			alignas(64) std::atomic<std::int64_t> mTop{ 0 };
+			alignas(64) std::atomic<std::int64_t> mBottom{ 0 };
+			std::atomic<Job*> mBuffer[kCapacity] = {};
+	};
+}
+
+namespace
+{
+	// Index of the deque owned by the current thread, or kNoDeque_ for
+	// threads that do not belong to the JobSystem.
+	constexpr std::size_t kNoDeque_ = ~std::size_t(0);
+	thread_local std::size_t tDequeIndex_ = kNoDeque_;
+	thread_local JobSystem const* tOwner_ = nullptr;
+}
+
+bool JobCounter::done() const noexcept
+{
+	return 0 == mPending.load( std::memory_order_acquire );
+}
+
+JobSystem::JobSystem( std::size_t aWorkers, bool aSingleThreaded )
+	: mSingleThreaded( aSingleThreaded )
+	, mMainThread( std::this_thread::get_id() )
+{
+	if( kDefaultWorkers == aWorkers )
+	{
+		auto const hw = std::thread::hardware_concurrency();
+		aWorkers = hw > 1 ? hw-1 : 0;
+	}
+
+	if( mSingleThreaded )
+		aWorkers = 0;
+
+	mDeques.reserve( aWorkers+1 );
+	for( std::size_t i = 0; i < aWorkers+1; ++i )
+		mDeques.emplace_back( std::make_unique<detail::WorkStealingDeque>() );
+
+	tDequeIndex_ = 0;
+	tOwner_ = this;
+
+	mWorkers.reserve( aWorkers );
+	for( std::size_t i = 0; i < aWorkers; ++i )
+		mWorkers.emplace_back( &JobSystem::worker_, this, i+1 );
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock( mSleepMutex );
+		mStop.store( true );
+	}
+	mWake.notify_all();
+
+	for( auto& worker : mWorkers )
+		worker.join();
+
+	// Anything that is still queued at this point is dropped.
+	while( auto* job = find_job_( 0 ) )
+		delete job;
+	for( auto* job : mMainJobs )
+		delete job;
+	for( auto* job : mInjected )
+		delete job;
+
+	if( tOwner_ == this )
+	{
+		tDequeIndex_ = kNoDeque_;
+		tOwner_ = nullptr;
+	}
+}
+
+void JobSystem::run( Func aFunc, JobCounter* aCounter )
+{
+	if( aCounter )
+		aCounter->mPending.fetch_add( 1, std::memory_order_relaxed );
+
+	submit_( new detail::Job{ std::move(aFunc), aCounter } );
+}
+
+void JobSystem::run_after( JobCounter& aDependency, Func aFunc, JobCounter* aCounter )
+{
+	if( aCounter )
+		aCounter->mPending.fetch_add( 1, std::memory_order_relaxed );
+
+	auto* job = new detail::Job{ std::move(aFunc), aCounter };
+
+	{
+		std::lock_guard<std::mutex> lock( aDependency.mMutex );
+		if( !aDependency.done() )
+		{
+			aDependency.mContinuations.emplace_back( job );
+			return;
+		}
+	}
+
+	submit_( job );
+}
+
+void JobSystem::run_on_main( Func aFunc, JobCounter* aCounter )
+{
+	if( aCounter )
+		aCounter->mPending.fetch_add( 1, std::memory_order_relaxed );
+
+	auto* job = new detail::Job{ std::move(aFunc), aCounter };
+
+	if( mSingleThreaded && is_main_thread() )
+	{
+		execute_( job );
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock( mMainMutex );
+	mMainJobs.emplace_back( job );
+}
+
+void JobSystem::wait( JobCounter& aCounter )
+{
+	auto const self = tOwner_ == this ? tDequeIndex_ : kNoDeque_;
+
+	while( !aCounter.done() )
+	{
+		if( is_main_thread() && run_main_job_() )
+			continue;
+
+		if( auto* job = find_job_( self ) )
+		{
+			execute_( job );
+			continue;
+		}
+
+		std::this_thread::yield();
+	}
+
+	std::unique_lock<std::mutex> lock( aCounter.mMutex );
+	if( auto err = std::exchange( aCounter.mError, nullptr ) )
+	{
+		lock.unlock();
+		std::rethrow_exception( err );
+	}
+}
+
+void JobSystem::pump_main_thread()
+{
+	assert( is_main_thread() );
+	while( run_main_job_() )
+		;
+}
+
+bool JobSystem::single_threaded() const noexcept
+{
+	return mSingleThreaded;
+}
+bool JobSystem::is_main_thread() const noexcept
+{
+	return std::this_thread::get_id() == mMainThread;
+}
+std::size_t JobSystem::thread_count() const noexcept
+{
+	return mDeques.size();
+}
+
+void JobSystem::submit_( detail::Job* aJob )
+{
+	if( mSingleThreaded )
+	{
+		execute_( aJob );
+		return;
+	}
+
+	bool queued = false;
+	if( tOwner_ == this && kNoDeque_ != tDequeIndex_ )
+	{
+		queued = mDeques[tDequeIndex_]->push( aJob );
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock( mInjectMutex );
+		mInjected.emplace_back( aJob );
+		queued = true;
+	}
+
+	if( !queued )
+	{
+		// Deque is full; run the job right away instead.
+		execute_( aJob );
+		return;
+	}
+
+	mWorkEpoch.fetch_add( 1, std::memory_order_release );
+	mWake.notify_one();
+}
+
+void JobSystem::execute_( detail::Job* aJob )
+{
+	auto* counter = aJob->counter;
+
+	try
+	{
+		aJob->func();
+	}
+	catch( std::exception const& eErr )
+	{
+		if( !counter )
+			std::fprintf( stderr, "Unhandled exception in job: %s\n", eErr.what() );
+		else
+			store_error_( *counter );
+	}
+	catch( ... )
+	{
+		if( !counter )
+			std::fprintf( stderr, "Unhandled exception in job\n" );
+		else
+			store_error_( *counter );
+	}
+
+	delete aJob;
+	finish_( counter );
+}
+
+void JobSystem::store_error_( JobCounter& aCounter )
+{
+	std::lock_guard<std::mutex> lock( aCounter.mMutex );
+	if( !aCounter.mError )
+		aCounter.mError = std::current_exception();
+}
+
+void JobSystem::finish_( JobCounter* aCounter )
+{
+	if( !aCounter )
+		return;
+
+	// The decrement happens under the counter's lock, and wait() takes the
+	// lock before returning. This way, the counter is not touched anymore
+	// once a waiter has been released (it might be destroyed immediately).
+	std::vector<detail::Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock( aCounter->mMutex );
+		if( 1 != aCounter->mPending.fetch_sub( 1, std::memory_order_acq_rel ) )
+			return;
+
+		// Counter reached zero: release jobs that were waiting on it.
+		ready.swap( aCounter->mContinuations );
+	}
+
+	for( auto* job : ready )
+		submit_( job );
+}
+
+detail::Job* JobSystem::find_job_( std::size_t aSelf )
+{
+	if( kNoDeque_ != aSelf )
+	{
+		if( auto* job = mDeques[aSelf]->pop() )
+			return job;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mInjectMutex );
+		if( !mInjected.empty() )
+		{
+			auto* job = mInjected.front();
+			mInjected.pop_front();
+			return job;
+		}
+	}
+
+	// Steal, starting with the neighbour to spread contention
+	auto const count = mDeques.size();
+	auto const start = kNoDeque_ != aSelf ? aSelf+1 : 0;
+	for( std::size_t i = 0; i < count; ++i )
+	{
+		auto const victim = (start + i) % count;
+		if( victim == aSelf )
+			continue;
+
+		if( auto* job = mDeques[victim]->steal() )
+			return job;
+	}
+
+	return nullptr;
+}
+
+bool JobSystem::run_main_job_()
+{
+	detail::Job* job = nullptr;
+	{
+		std::lock_guard<std::mutex> lock( mMainMutex );
+		if( mMainJobs.empty() )
+			return false;
+
+		job = mMainJobs.front();
+		mMainJobs.pop_front();
+	}
+
+	execute_( job );
+	return true;
+}
+
+void JobSystem::worker_( std::size_t aIndex )
+{
+	tDequeIndex_ = aIndex;
+	tOwner_ = this;
+
+	PROFILE_THREAD( "job worker" );
+
+	while( !mStop.load( std::memory_order_acquire ) )
+	{
+		auto const epoch = mWorkEpoch.load( std::memory_order_acquire );
+
+		if( auto* job = find_job_( aIndex ) )
+		{
+			execute_( job );
+			continue;
+		}
+
+		// Nothing to do. Sleep until new work is submitted. The timeout
+		// guards against a wake-up that is lost between the check above and
+		// the wait below.
+		std::unique_lock<std::mutex> lock( mSleepMutex );
+		mWake.wait_for( lock, std::chrono::milliseconds( 1 ), [&] {
+			return mStop.load() || epoch != mWorkEpoch.load( std::memory_order_acquire );
+		} );
+	}
+}
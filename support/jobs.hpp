@@ -0,0 +1,171 @@
+#ifndef JOBS_HPP_CAC6DFD4_0088_4709_A26A_6C31D25C1F3E
+#define JOBS_HPP_CAC6DFD4_0088_4709_A26A_6C31D25C1F3E
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include <cstdint>
+#include <cstdlib>
+
+class JobSystem;
+
+namespace detail
+{
+	struct Job;
+	class WorkStealingDeque;
+}
+
+// Tracks a group of jobs. A counter is incremented when a job is submitted
+// against it, and decremented when that job finishes. Jobs can be made to
+// depend on a counter (JobSystem::run_after()); they are only started once
+// the counter reaches zero. If a job throws, the first exception is stored
+// and rethrown from JobSystem::wait(). Always wait() on a counter before it is
+// destroyed.
+class JobCounter
+{
+	public:
+		JobCounter() = default;
+
+		JobCounter( JobCounter const& ) = delete;
+		JobCounter& operator= (JobCounter const&) = delete;
+
+	public:
+		bool done() const noexcept;
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<int> mPending{ 0 };
+
+		std::mutex mMutex;
+		std::vector<detail::Job*> mContinuations;
+		std::exception_ptr mError;
+};
+
+/** JobSystem: work-stealing task scheduler
+ *
+ * Each worker thread (and the thread that created the JobSystem, referred to
+ * as the main thread) owns a Chase-Lev deque. Jobs submitted from one of
+ * these threads are pushed onto its own deque. Idle threads steal from the
+ * other deques. Jobs submitted from any other thread go through a shared
+ * injection queue.
+ *
+ * Jobs submitted with run_on_main() only ever execute on the main thread.
+ * Use this for work that is tied to that thread, such as GLFW window and
+ * event functions. They run when the main thread calls pump_main_thread() or
+ * waits on a counter. This does not imply a current OpenGL context: when the
+ * context has been handed to another thread (see main/render_thread.hpp),
+ * GL work must be passed to that thread instead.
+ *
+ * In single-threaded mode, no worker threads are created and jobs are
+ * executed immediately (in submission order) on the calling thread, unless
+ * they are waiting on a dependency. This makes execution deterministic,
+ * which is useful for debugging.
+ */
+class JobSystem final
+{
+	public:
+		using Func = std::function<void()>;
+
+		static constexpr std::size_t kDefaultWorkers = ~std::size_t(0);
+
+	public:
+		// aWorkers = number of worker threads in addition to the main thread.
+		// The default is one less than the number of hardware threads.
+		explicit JobSystem( std::size_t aWorkers = kDefaultWorkers, bool aSingleThreaded = false );
+		~JobSystem();
+
+		JobSystem( JobSystem const& ) = delete;
+		JobSystem& operator= (JobSystem const&) = delete;
+
+	public:
+		void run( Func, JobCounter* = nullptr );
+		void run_after( JobCounter& aDependency, Func, JobCounter* = nullptr );
+		void run_on_main( Func, JobCounter* = nullptr );
+
+		// Wait for all jobs of a counter to finish. The calling thread helps
+		// by executing pending jobs in the meantime.
+		void wait( JobCounter& );
+
+		// Execute all pending main-thread jobs. Must be called on the main
+		// thread.
+		void pump_main_thread();
+
+		// Call aFunc( begin, end ) over [aBegin, aEnd) in chunks of at most
+		// aGrain elements and wait for completion.
+		template< typename tFunc >
+		void parallel_for( std::size_t aBegin, std::size_t aEnd, std::size_t aGrain, tFunc&& aFunc );
+
+	public:
+		bool single_threaded() const noexcept;
+		bool is_main_thread() const noexcept;
+
+		// Number of threads that execute jobs (workers + main thread)
+		std::size_t thread_count() const noexcept;
+
+	private:
+		void submit_( detail::Job* );
+		void execute_( detail::Job* );
+		void finish_( JobCounter* );
+
+		static void store_error_( JobCounter& );
+
+		detail::Job* find_job_( std::size_t aSelf );
+		bool run_main_job_();
+
+		void worker_( std::size_t aIndex );
+
+	private:
+		bool mSingleThreaded;
+		std::thread::id mMainThread;
+
+		std::vector<std::unique_ptr<detail::WorkStealingDeque>> mDeques; // [0] = main thread
+		std::vector<std::thread> mWorkers;
+
+		std::mutex mInjectMutex;
+		std::deque<detail::Job*> mInjected;
+
+		std::mutex mMainMutex;
+		std::deque<detail::Job*> mMainJobs;
+
+		std::mutex mSleepMutex;
+		std::condition_variable mWake;
+		std::atomic<std::uint32_t> mWorkEpoch{ 0 };
+		std::atomic<bool> mStop{ false };
+};
+
+template< typename tFunc > inline
+void JobSystem::parallel_for( std::size_t aBegin, std::size_t aEnd, std::size_t aGrain, tFunc&& aFunc )
+{
+	if( aBegin >= aEnd )
+		return;
+
+	if( 0 == aGrain )
+		aGrain = 1;
+
+	if( mSingleThreaded || aEnd - aBegin <= aGrain )
+	{
+		for( auto b = aBegin; b < aEnd; b += aGrain )
+			aFunc( b, std::min( aEnd, b + aGrain ) );
+		return;
+	}
+
+	JobCounter counter;
+	for( auto b = aBegin; b < aEnd; b += aGrain )
+	{
+		auto const e = std::min( aEnd, b + aGrain );
+		run( [&aFunc, b, e] { aFunc( b, e ); }, &counter );
+	}
+
+	wait( counter );
+}
+
+#endif // JOBS_HPP_CAC6DFD4_0088_4709_A26A_6C31D25C1F3E
@@ -0,0 +1,331 @@
+#include "profiler.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#	define PROFILER_RDTSC_ 1
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#	else
+#		include <x86intrin.h>
+#	endif
+#else
+#	define PROFILER_RDTSC_ 0
+#endif
+
+#include "error.hpp"
+
+namespace profiler
+{
+	namespace
+	{
+		// Events per thread; a power of two
+		constexpr std::size_t kRingSize_ = std::size_t(1) << 15;
+
+		// When copying, stay this far away from the writer, which may be
+		// overwriting the oldest events.
+		constexpr std::uint64_t kRingGuard_ = 64;
+
+		// Single producer (the owning thread), any number of readers. The
+		// writer fills the slot and then publishes it by advancing head.
+		// Readers copy and then check that the writer has not lapped them.
+		struct ThreadBuffer_
+		{
+			std::uint32_t id;
+			char name[32];
+
+			std::unique_ptr<Event[]> ring{ new Event[kRingSize_] };
+			std::atomic<std::uint64_t> head{ 0 };
+		};
+
+		struct Registry_
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<ThreadBuffer_>> threads; // never shrinks
+		};
+
+		Registry_& registry_()
+		{
+			static Registry_ registry;
+			return registry;
+		}
+
+		thread_local ThreadBuffer_* tBuffer_ = nullptr;
+		thread_local std::uint32_t tDepth_ = 0;
+
+		// Frame marks; written by one thread only
+		std::atomic<Ticks> gFrameMarks_[kFrameHistory] = {};
+		std::atomic<std::uint64_t> gFrameCount_{ 0 };
+
+		// Requires the registry mutex
+		ThreadBuffer_& add_buffer_( Registry_& aReg )
+		{
+			auto buffer = std::make_unique<ThreadBuffer_>();
+			buffer->id = std::uint32_t(aReg.threads.size());
+			std::snprintf( buffer->name, sizeof(buffer->name), "thread %u", unsigned(buffer->id) );
+
+			aReg.threads.emplace_back( std::move(buffer) );
+			return *aReg.threads.back();
+		}
+
+		ThreadBuffer_& thread_buffer_()
+		{
+			if( !tBuffer_ )
+			{
+				auto& reg = registry_();
+				std::lock_guard<std::mutex> lock( reg.mutex );
+				tBuffer_ = &add_buffer_( reg );
+			}
+
+			return *tBuffer_;
+		}
+
+		void push_( ThreadBuffer_& aBuffer, char const* aName, char const* aText, Ticks aBegin, Ticks aEnd, std::uint32_t aDepth ) noexcept
+		{
+			auto const head = aBuffer.head.load( std::memory_order_relaxed );
+
+			auto& ev = aBuffer.ring[head & (kRingSize_-1)];
+			ev.name = aName;
+			ev.begin = aBegin;
+			ev.end = aEnd;
+			ev.depth = aDepth;
+			if( aText )
+				std::snprintf( ev.text, sizeof(ev.text), "%s", aText );
+			else
+				ev.text[0] = '\0';
+
+			aBuffer.head.store( head+1, std::memory_order_release );
+		}
+
+		// Reference points for converting ticks to time
+		struct Epoch_
+		{
+			Ticks ticks;
+			std::chrono::steady_clock::time_point time;
+		};
+
+		Epoch_ const gEpoch_{ now(), std::chrono::steady_clock::now() };
+
+		void write_json_string_( std::FILE* aOut, char const* aStr )
+		{
+			std::fputc( '"', aOut );
+			for( ; *aStr; ++aStr )
+			{
+				auto const c = *aStr;
+				if( '"' == c || '\\' == c )
+					std::fprintf( aOut, "\\%c", c );
+				else if( (unsigned char)c < 0x20 )
+					std::fprintf( aOut, "\\u%04x", unsigned(c) );
+				else
+					std::fputc( c, aOut );
+			}
+			std::fputc( '"', aOut );
+		}
+	}
+
+	Ticks now() noexcept
+	{
+#		if PROFILER_RDTSC_
+		return __rdtsc();
+#		else
+		return Ticks(std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count());
+#		endif
+	}
+
+	namespace
+	{
+		double us_per_tick_() noexcept
+		{
+#			if PROFILER_RDTSC_
+			// Calibrate the TSC against the steady clock, over at least 10ms.
+			// The TSC is assumed to be invariant (true for all recent x86-64
+			// CPUs).
+			static double const usPerTick = [] {
+				auto elapsed = std::chrono::steady_clock::now() - gEpoch_.time;
+				if( elapsed < std::chrono::milliseconds( 10 ) )
+				{
+					std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) - elapsed );
+					elapsed = std::chrono::steady_clock::now() - gEpoch_.time;
+				}
+
+				auto const ticks = now() - gEpoch_.ticks;
+				return std::chrono::duration<double, std::micro>( elapsed ).count() / double(ticks);
+			}();
+
+			return usPerTick;
+#			else
+			return 1e-3;
+#			endif
+		}
+	}
+
+	double ticks_to_us( Ticks aTicks ) noexcept
+	{
+		return double(aTicks) * us_per_tick_();
+	}
+	Ticks us_to_ticks( double aUs ) noexcept
+	{
+		return Ticks(aUs / us_per_tick_());
+	}
+
+	void frame_mark() noexcept
+	{
+		auto const count = gFrameCount_.load( std::memory_order_relaxed );
+		gFrameMarks_[count % kFrameHistory].store( now(), std::memory_order_relaxed );
+		gFrameCount_.store( count+1, std::memory_order_release );
+	}
+
+	bool last_frame( Ticks& aBegin, Ticks& aEnd, std::size_t aFramesAgo ) noexcept
+	{
+		auto const count = gFrameCount_.load( std::memory_order_acquire );
+		if( aFramesAgo + 2 > kFrameHistory || aFramesAgo + 2 > count )
+			return false;
+
+		auto const last = count - 1 - aFramesAgo;
+		aBegin = gFrameMarks_[(last-1) % kFrameHistory].load( std::memory_order_relaxed );
+		aEnd = gFrameMarks_[last % kFrameHistory].load( std::memory_order_relaxed );
+		return aBegin < aEnd;
+	}
+
+	void set_thread_name( char const* aName ) noexcept
+	{
+		auto& buffer = thread_buffer_();
+
+		std::lock_guard<std::mutex> lock( registry_().mutex );
+		std::snprintf( buffer.name, sizeof(buffer.name), "%s", aName );
+	}
+
+	Track create_track( char const* aName )
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		auto& buffer = add_buffer_( reg );
+		std::snprintf( buffer.name, sizeof(buffer.name), "%s", aName );
+		return buffer.id;
+	}
+
+	void record( Track aTrack, char const* aName, Ticks aBegin, Ticks aEnd, std::uint32_t aDepth ) noexcept
+	{
+		ThreadBuffer_* buffer;
+		{
+			auto& reg = registry_();
+			std::lock_guard<std::mutex> lock( reg.mutex );
+			buffer = reg.threads[aTrack].get();
+		}
+
+		push_( *buffer, aName, nullptr, aBegin, aEnd, aDepth );
+	}
+
+	std::vector<ThreadEvents> collect( Ticks aBegin, Ticks aEnd )
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		std::vector<ThreadEvents> ret;
+		for( auto const& buffer : reg.threads )
+		{
+			ThreadEvents te;
+			te.thread = buffer->id;
+			te.name = buffer->name;
+
+			auto const head = buffer->head.load( std::memory_order_acquire );
+			auto const first = head > kRingSize_ - kRingGuard_ ? head - (kRingSize_ - kRingGuard_) : 0;
+
+			// Events are ordered by end time, so walk backwards from the newest
+			// one until the events end before aBegin.
+			std::vector<Event> copied;
+			for( auto i = head; i > first; --i )
+			{
+				copied.emplace_back( buffer->ring[(i-1) & (kRingSize_-1)] );
+				if( copied.back().end < aBegin )
+					break;
+			}
+
+			// Event i is overwritten by event i+kRingSize_. Drop anything that
+			// the writer may have reached while we were copying.
+			auto const after = buffer->head.load( std::memory_order_acquire );
+			auto const valid = after + 1 > kRingSize_ ? after + 1 - kRingSize_ : 0;
+
+			for( std::size_t j = copied.size(); j > 0; --j )
+			{
+				auto const index = head - j;
+				auto const& ev = copied[j-1];
+				if( index >= valid && ev.begin >= aBegin && ev.end <= aEnd )
+					te.events.emplace_back( ev );
+			}
+
+			if( !te.events.empty() )
+				ret.emplace_back( std::move(te) );
+		}
+
+		return ret;
+	}
+
+	void write_chrome_trace( char const* aPath )
+	{
+		auto const threads = collect( 0, ~Ticks(0) );
+
+		std::FILE* fout = std::fopen( aPath, "w" );
+		if( !fout )
+			throw Error( "Unable to open '%s' for writing", aPath );
+
+		std::fprintf( fout, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+		bool first = true;
+		for( auto const& te : threads )
+		{
+			std::fprintf( fout, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", first ? "" : ",\n", unsigned(te.thread) );
+			write_json_string_( fout, te.name );
+			std::fprintf( fout, "}}" );
+			first = false;
+
+			for( auto const& ev : te.events )
+			{
+				std::fprintf( fout, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+					unsigned(te.thread),
+					ticks_to_us( ev.begin - gEpoch_.ticks ),
+					ticks_to_us( ev.end - ev.begin )
+				);
+				write_json_string_( fout, ev.name );
+				if( ev.text[0] )
+				{
+					std::fprintf( fout, ",\"args\":{\"text\":" );
+					write_json_string_( fout, ev.text );
+					std::fprintf( fout, "}" );
+				}
+				std::fprintf( fout, "}" );
+			}
+		}
+
+		std::fprintf( fout, "\n]}\n" );
+
+		if( std::fclose( fout ) )
+			throw Error( "Error while writing '%s'", aPath );
+	}
+
+
+	Zone::Zone( char const* aName, char const* aText ) noexcept
+		: mName( aName )
+		, mText( aText )
+		, mBegin( now() )
+	{
+		++tDepth_;
+	}
+
+	Zone::~Zone()
+	{
+		auto const end = now();
+		--tDepth_;
+
+		push_( thread_buffer_(), mName, mText, mBegin, end, tDepth_ );
+	}
+}
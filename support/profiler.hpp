@@ -0,0 +1,128 @@
+#ifndef PROFILER_HPP_5E2A7C41_93B8_4F0D_A6E1_2C8B4D17F390
+#define PROFILER_HPP_5E2A7C41_93B8_4F0D_A6E1_2C8B4D17F390
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+/* Scope profiler
+ *
+ * Mark a scope with PROFILE_ZONE( "name" ). The zone is recorded when the
+ * scope is left. Names must be string literals. PROFILE_ZONE_TEXT() adds a
+ * run-time string (e.g., a file name) that is copied, and may be truncated.
+ *
+ *	void load_stuff( char const* aPath )
+ *	{
+ *		PROFILE_ZONE_TEXT( "load stuff", aPath );
+ *		...
+ *	}
+ *
+ * Each thread records into its own ring buffer, without locks; old events are
+ * overwritten. Call PROFILE_FRAME() once per frame on the main thread, so that
+ * the last frame can be inspected (profiler::last_frame()).
+ *
+ * Timestamps are read with rdtsc on x86-64 and with std::chrono::steady_clock
+ * elsewhere. Use profiler::ticks_to_us() to convert.
+ *
+ * Building with PROFILER_ENABLED=0 (premake option --no-profiler) compiles
+ * all PROFILE_*() macros out. The functions in the profiler namespace remain
+ * available, but there will be no events.
+ */
+
+#if !defined(PROFILER_ENABLED)
+#	define PROFILER_ENABLED 1
+#endif
+
+#define PROFILER_CONCAT_IMPL_( a, b ) a##b
+#define PROFILER_CONCAT_( a, b ) PROFILER_CONCAT_IMPL_( a, b )
+
+#if PROFILER_ENABLED
+#	define PROFILE_ZONE( aName )                                          \
+		::profiler::Zone PROFILER_CONCAT_( profilerZone_, __LINE__ )( "" aName ) \
+		/*ENDM*/
+#	define PROFILE_ZONE_TEXT( aName, aText )                              \
+		::profiler::Zone PROFILER_CONCAT_( profilerZone_, __LINE__ )( "" aName, aText ) \
+		/*ENDM*/
+#	define PROFILE_FRAME()               ::profiler::frame_mark()
+#	define PROFILE_THREAD( aName )       ::profiler::set_thread_name( aName )
+#else // !PROFILER_ENABLED
+#	define PROFILE_ZONE( aName )         do {} while(0)
+#	define PROFILE_ZONE_TEXT( aName, aText ) do {} while(0)
+#	define PROFILE_FRAME()               do {} while(0)
+#	define PROFILE_THREAD( aName )       do {} while(0)
+#endif // ~ PROFILER_ENABLED
+
+namespace profiler
+{
+	using Ticks = std::uint64_t;
+
+	constexpr std::size_t kTextLength = 48;
+
+	struct Event
+	{
+		char const* name; // string literal
+		Ticks begin, end;
+		std::uint32_t depth; // nesting level on its thread, 0 = outermost
+		char text[kTextLength]; // optional, zero-terminated
+	};
+
+	struct ThreadEvents
+	{
+		std::uint32_t thread; // small integer, in order of registration
+		char const* name; // owned by the profiler
+		std::vector<Event> events; // ordered by end time
+	};
+
+	Ticks now() noexcept;
+
+	// Convert a duration (or difference of timestamps) to microseconds and back
+	double ticks_to_us( Ticks ) noexcept;
+	Ticks us_to_ticks( double ) noexcept;
+
+	// Start of the current frame, and the most recent complete frames. With
+	// aFramesAgo > 0, returns an earlier frame (up to kFrameHistory-2 back),
+	// e.g., to match GPU events that are only known a few frames later.
+	constexpr std::size_t kFrameHistory = 16;
+
+	void frame_mark() noexcept;
+	bool last_frame( Ticks& aBegin, Ticks& aEnd, std::size_t aFramesAgo = 0 ) noexcept;
+
+	// Name shown for the calling thread (copied)
+	void set_thread_name( char const* ) noexcept;
+
+	// Additional timelines for events that are not measured by a CPU thread,
+	// e.g., GPU timer queries. Events are recorded after the fact, and must be
+	// submitted in order of their end times. A track must only be written by
+	// one thread at a time.
+	using Track = std::uint32_t;
+
+	Track create_track( char const* aName );
+	void record( Track, char const* aName, Ticks aBegin, Ticks aEnd, std::uint32_t aDepth ) noexcept;
+
+	// Copy the events that lie completely in [aBegin, aEnd] from all threads.
+	// Events that are overwritten while copying are skipped.
+	std::vector<ThreadEvents> collect( Ticks aBegin, Ticks aEnd );
+
+	// Write all events that are still held by the ring buffers in the Chrome
+	// trace event format (chrome://tracing, https://ui.perfetto.dev).
+	// Throws Error on failure.
+	void write_chrome_trace( char const* aPath );
+
+	class Zone
+	{
+		public:
+			explicit Zone( char const* aName, char const* aText = nullptr ) noexcept;
+			~Zone();
+
+			Zone( Zone const& ) = delete;
+			Zone& operator= (Zone const&) = delete;
+
+		private:
+			char const* mName;
+			char const* mText;
+			Ticks mBegin;
+	};
+}
+
+#endif // PROFILER_HPP_5E2A7C41_93B8_4F0D_A6E1_2C8B4D17F390
@@ -10,6 +10,7 @@
 
 #include "error.hpp"
 #include "checkpoint.hpp"
+#include "profiler.hpp"
 
 namespace
 {
@@ -68,6 +69,8 @@ GLuint ShaderProgram::programId() const noexcept
 
 void ShaderProgram::reload()
 {
+	PROFILE_ZONE( "build shader program" );
+
 	// Space to hold the shaders when we load them
 	std::vector<GLuint> shaders;
 	shaders.reserve( mSources.size() );
@@ -142,6 +145,8 @@ namespace
 {
 	GLuint load_shader_( GLenum aShaderType, char const* aSourcePath )
 	{
+		PROFILE_ZONE_TEXT( "load shader", aSourcePath );
+
 		// Load the shader source code from file
 		std::vector<GLchar> source;
 
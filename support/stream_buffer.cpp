@@ -0,0 +1,184 @@
+#include "stream_buffer.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+#include "error.hpp"
+
+namespace
+{
+	constexpr GLuint64 kWaitTimeout_ = 1000000; // ns
+	constexpr std::size_t kRegionGranularity_ = 256; // >= any buffer offset alignment
+
+	constexpr GLbitfield kPersistentFlags_ = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	std::size_t align_up_( std::size_t aValue, std::size_t aAlignment ) noexcept
+	{
+		return (aValue + aAlignment - 1) / aAlignment * aAlignment;
+	}
+}
+
+StreamBuffer::StreamBuffer( std::size_t aRegionBytes )
+{
+	create_( aRegionBytes );
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for( auto& fence : mFences )
+	{
+		if( fence )
+			glDeleteSync( fence );
+	}
+
+	// Deleting a mapped buffer unmaps it
+	mRetired.emplace_back( mBuffer );
+	glDeleteBuffers( GLsizei(mRetired.size()), mRetired.data() );
+}
+
+void StreamBuffer::begin_frame()
+{
+	mRegion = (mRegion+1) % kRegionCount;
+	mHead = 0;
+	mFrameBytes = 0;
+
+	auto& fence = mFences[mRegion];
+	if( !fence )
+		return;
+
+	// Commands of kRegionCount frames ago
+	auto status = glClientWaitSync( fence, 0, 0 );
+	if( GL_TIMEOUT_EXPIRED == status )
+	{
+		++mStalls;
+		do
+		{
+			status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, kWaitTimeout_ );
+		} while( GL_TIMEOUT_EXPIRED == status );
+	}
+
+	glDeleteSync( fence );
+	fence = nullptr;
+
+	if( GL_WAIT_FAILED == status )
+		throw Error( "StreamBuffer: glClientWaitSync() failed" );
+}
+
+void StreamBuffer::end_frame()
+{
+	auto& fence = mFences[mRegion];
+	if( fence )
+		glDeleteSync( fence );
+	fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+	// Commands that use the replaced buffers have been issued
+	if( !mRetired.empty() )
+	{
+		glDeleteBuffers( GLsizei(mRetired.size()), mRetired.data() );
+		mRetired.clear();
+	}
+}
+
+StreamBuffer::Range StreamBuffer::upload( void const* aData, std::size_t aBytes, std::size_t aAlignment )
+{
+	assert( aAlignment > 0 );
+
+	// Align the offset in the buffer, not in the region
+	auto base = mRegion * mRegionSize;
+	auto offset = align_up_( base + mHead, aAlignment );
+	if( offset + aBytes > base + mRegionSize )
+	{
+		grow_( aBytes + aAlignment );
+
+		base = mRegion * mRegionSize;
+		offset = align_up_( base + mHead, aAlignment );
+	}
+
+	if( mPersistent )
+		std::memcpy( mMapped + offset, aData, aBytes );
+	else
+	{
+		glBindBuffer( GL_COPY_WRITE_BUFFER, mBuffer );
+		glBufferSubData( GL_COPY_WRITE_BUFFER, GLintptr(offset), GLsizeiptr(aBytes), aData );
+		glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+	}
+
+	mHead = offset + aBytes - base;
+	mFrameBytes += aBytes;
+	return Range{ mBuffer, GLintptr(offset), GLsizeiptr(aBytes) };
+}
+
+bool StreamBuffer::persistent() const noexcept
+{
+	return mPersistent;
+}
+std::size_t StreamBuffer::region_size() const noexcept
+{
+	return mRegionSize;
+}
+
+std::size_t StreamBuffer::frame_bytes() const noexcept
+{
+	return mFrameBytes;
+}
+std::size_t StreamBuffer::stall_count() const noexcept
+{
+	return mStalls;
+}
+std::size_t StreamBuffer::grow_count() const noexcept
+{
+	return mGrows;
+}
+
+void StreamBuffer::create_( std::size_t aRegionBytes )
+{
+	mRegionSize = align_up_( std::max<std::size_t>( aRegionBytes, 1 ), kRegionGranularity_ );
+	auto const bytes = GLsizeiptr(mRegionSize * kRegionCount);
+
+	glGenBuffers( 1, &mBuffer );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, mBuffer );
+
+	mPersistent = GLAD_GL_VERSION_4_4 && glBufferStorage;
+	if( mPersistent )
+	{
+		glBufferStorage( GL_COPY_WRITE_BUFFER, bytes, nullptr, kPersistentFlags_ );
+		mMapped = static_cast<unsigned char*>(glMapBufferRange( GL_COPY_WRITE_BUFFER, 0, bytes, kPersistentFlags_ ));
+		if( !mMapped )
+		{
+			glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+			glDeleteBuffers( 1, &mBuffer );
+			mBuffer = 0;
+			throw Error( "StreamBuffer: unable to map %zu bytes persistently", std::size_t(bytes) );
+		}
+	}
+	else
+	{
+		glBufferData( GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STREAM_DRAW );
+		mMapped = nullptr;
+	}
+
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+}
+
+void StreamBuffer::grow_( std::size_t aMinBytes )
+{
+	// Ranges of this frame may still be referenced by commands that have not
+	// been issued yet; keep the old buffer until end_frame().
+	mRetired.emplace_back( mBuffer );
+
+	// The fences guard the old buffer; the new one is not in use at all
+	for( auto& fence : mFences )
+	{
+		if( fence )
+			glDeleteSync( fence );
+		fence = nullptr;
+	}
+
+	create_( std::max( 2 * mRegionSize, aMinBytes ) );
+
+	mRegion = 0;
+	mHead = 0;
+	++mGrows;
+}
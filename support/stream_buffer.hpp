@@ -0,0 +1,89 @@
+#ifndef STREAM_BUFFER_HPP_9A4E2C71_6B38_4D1F_8E05_C3F6A27D19B4
+#define STREAM_BUFFER_HPP_9A4E2C71_6B38_4D1F_8E05_C3F6A27D19B4
+
+#include <glad.h>
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+/** StreamBuffer: ring buffer for data that changes every frame
+ *
+ * One GL buffer, split into kRegionCount regions. Each frame sub-allocates
+ * from one region with a bump pointer; end_frame() puts a fence behind the
+ * frame's commands, and begin_frame() moves on to the next region, waiting
+ * for its fence first. With three regions the fence has normally long been
+ * signalled, so the CPU never waits for the GPU, and the driver never has to
+ * synchronize (or orphan storage) on our behalf.
+ *
+ * With GL 4.4 (glBufferStorage), the buffer is mapped once, persistently and
+ * coherently, and upload() is a single memcpy. Otherwise, upload() falls back
+ * to glBufferSubData() into the same ring.
+ *
+ * If a frame needs more than a region, the buffer is replaced by one with
+ * larger regions. Ranges handed out earlier remain valid until end_frame();
+ * the old buffer is deleted then. Always use the buffer of the returned
+ * Range, as it can change between calls.
+ *
+ * Can be used with any buffer target; upload() binds GL_COPY_WRITE_BUFFER.
+ */
+class StreamBuffer final
+{
+	public:
+		static constexpr std::size_t kRegionCount = 3;
+
+		struct Range
+		{
+			GLuint buffer;
+			GLintptr offset; // bytes from the start of the buffer
+			GLsizeiptr size;
+		};
+
+	public:
+		explicit StreamBuffer( std::size_t aRegionBytes = std::size_t(4) << 20 );
+		~StreamBuffer();
+
+		StreamBuffer( StreamBuffer const& ) = delete;
+		StreamBuffer& operator= (StreamBuffer const&) = delete;
+
+	public:
+		void begin_frame();
+		// Call after the last command that reads this frame's ranges.
+		void end_frame();
+
+		// Copy aBytes to a new range. aAlignment applies to the offset in the
+		// buffer and need not be a power of two (e.g., an element size, so
+		// that offset / aAlignment is an element index).
+		Range upload( void const* aData, std::size_t aBytes, std::size_t aAlignment = 16 );
+
+	public:
+		bool persistent() const noexcept;
+		std::size_t region_size() const noexcept;
+
+		std::size_t frame_bytes() const noexcept; // uploaded in the current frame
+		std::size_t stall_count() const noexcept; // begin_frame() had to wait for the GPU
+		std::size_t grow_count() const noexcept;
+
+	private:
+		void create_( std::size_t aRegionBytes );
+		void grow_( std::size_t aMinBytes );
+
+	private:
+		GLuint mBuffer = 0;
+		unsigned char* mMapped = nullptr; // persistent mapping, or null
+		bool mPersistent = false;
+
+		std::size_t mRegionSize = 0;
+		std::size_t mRegion = 0;
+		std::size_t mHead = 0; // offset in the current region
+		std::size_t mFrameBytes = 0;
+
+		GLsync mFences[kRegionCount] = {};
+		std::vector<GLuint> mRetired; // replaced buffers, deleted at end_frame()
+
+		std::size_t mStalls = 0;
+		std::size_t mGrows = 0;
+};
+
+#endif // STREAM_BUFFER_HPP_9A4E2C71_6B38_4D1F_8E05_C3F6A27D19B4
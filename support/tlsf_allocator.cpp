@@ -0,0 +1,282 @@
+#include "tlsf_allocator.hpp"
+
+#include <cassert>
+
+namespace
+{
+	unsigned lowest_bit_( std::uint64_t aMask ) noexcept
+	{
+		assert( aMask );
+#		if defined(__GNUC__)
+		return unsigned(__builtin_ctzll( aMask ));
+#		else
+		unsigned ret = 0;
+		while( !(aMask & 1) )
+		{
+			aMask >>= 1;
+			++ret;
+		}
+		return ret;
+#		endif
+	}
+
+	unsigned floor_log2_( std::uint64_t aValue ) noexcept
+	{
+		assert( aValue );
+#		if defined(__GNUC__)
+		return 63u - unsigned(__builtin_clzll( aValue ));
+#		else
+		unsigned ret = 0;
+		while( aValue >>= 1 )
+			++ret;
+		return ret;
+#		endif
+	}
+}
+
+TlsfAllocator::TlsfAllocator( std::size_t aCapacity )
+	: mCapacity( aCapacity )
+{
+	for( auto& bins : mBins )
+	{
+		for( auto& bin : bins )
+			bin = kInvalid;
+	}
+
+	if( 0 == aCapacity )
+		return;
+
+	auto const block = new_node_();
+	mNodes[block] = Node_{ 0, aCapacity, kInvalid, kInvalid, kInvalid, kInvalid, true };
+	insert_free_( block );
+}
+
+TlsfAllocator::Block TlsfAllocator::allocate( std::size_t aUnits )
+{
+	if( 0 == aUnits )
+		aUnits = 1;
+
+	auto const block = find_free_( aUnits );
+	if( kInvalid == block )
+		return kInvalid;
+
+	remove_free_( block );
+
+	// Split off the remainder
+	if( mNodes[block].size > aUnits )
+	{
+		auto const rest = new_node_();
+
+		auto& node = mNodes[block];
+		mNodes[rest] = Node_{ node.offset + aUnits, node.size - aUnits, block, node.nextPhys, kInvalid, kInvalid, true };
+		if( kInvalid != node.nextPhys )
+			mNodes[node.nextPhys].prevPhys = rest;
+
+		node.nextPhys = rest;
+		node.size = aUnits;
+
+		insert_free_( rest );
+	}
+
+	mNodes[block].free = false;
+	mUsed += aUnits;
+	return block;
+}
+
+void TlsfAllocator::free( Block aBlock )
+{
+	assert( aBlock < mNodes.size() && !mNodes[aBlock].free );
+
+	mUsed -= mNodes[aBlock].size;
+	mNodes[aBlock].free = true;
+
+	// Merge with the following block
+	auto const next = mNodes[aBlock].nextPhys;
+	if( kInvalid != next && mNodes[next].free )
+	{
+		remove_free_( next );
+
+		auto& node = mNodes[aBlock];
+		node.size += mNodes[next].size;
+		node.nextPhys = mNodes[next].nextPhys;
+		if( kInvalid != node.nextPhys )
+			mNodes[node.nextPhys].prevPhys = aBlock;
+
+		release_node_( next );
+	}
+
+	// Merge into the preceding block
+	auto const prev = mNodes[aBlock].prevPhys;
+	if( kInvalid != prev && mNodes[prev].free )
+	{
+		remove_free_( prev );
+
+		auto& node = mNodes[prev];
+		node.size += mNodes[aBlock].size;
+		node.nextPhys = mNodes[aBlock].nextPhys;
+		if( kInvalid != node.nextPhys )
+			mNodes[node.nextPhys].prevPhys = prev;
+
+		release_node_( aBlock );
+		aBlock = prev;
+	}
+
+	insert_free_( aBlock );
+}
+
+std::size_t TlsfAllocator::offset( Block aBlock ) const noexcept
+{
+	assert( aBlock < mNodes.size() );
+	return mNodes[aBlock].offset;
+}
+std::size_t TlsfAllocator::size( Block aBlock ) const noexcept
+{
+	assert( aBlock < mNodes.size() );
+	return mNodes[aBlock].size;
+}
+
+std::size_t TlsfAllocator::capacity() const noexcept
+{
+	return mCapacity;
+}
+std::size_t TlsfAllocator::used() const noexcept
+{
+	return mUsed;
+}
+
+std::size_t TlsfAllocator::free_block_count() const noexcept
+{
+	return mFreeBlocks;
+}
+
+std::size_t TlsfAllocator::largest_free_block() const noexcept
+{
+	if( !mFirstLevel )
+		return 0;
+
+	// Blocks in the highest non-empty bin vary in size; check all of them
+	auto const fl = floor_log2_( mFirstLevel );
+	auto const sl = floor_log2_( mSecondLevel[fl] );
+
+	std::size_t ret = 0;
+	for( auto block = mBins[fl][sl]; kInvalid != block; block = mNodes[block].nextFree )
+	{
+		if( mNodes[block].size > ret )
+			ret = mNodes[block].size;
+	}
+	return ret;
+}
+
+void TlsfAllocator::map_size_( std::size_t aSize, unsigned& aFl, unsigned& aSl ) noexcept
+{
+	if( aSize < kSecondLevelCount_ )
+	{
+		aFl = 0;
+		aSl = unsigned(aSize);
+		return;
+	}
+
+	auto const log2 = floor_log2_( aSize );
+	aFl = log2 - kSecondLevelLog2_ + 1;
+	aSl = unsigned((aSize >> (log2 - kSecondLevelLog2_)) - kSecondLevelCount_);
+}
+
+TlsfAllocator::Block TlsfAllocator::new_node_()
+{
+	if( !mUnusedNodes.empty() )
+	{
+		auto const ret = mUnusedNodes.back();
+		mUnusedNodes.pop_back();
+		return ret;
+	}
+
+	mNodes.emplace_back();
+	return Block(mNodes.size()-1);
+}
+
+void TlsfAllocator::release_node_( Block aBlock ) noexcept
+{
+	mUnusedNodes.emplace_back( aBlock );
+}
+
+void TlsfAllocator::insert_free_( Block aBlock ) noexcept
+{
+	unsigned fl, sl;
+	map_size_( mNodes[aBlock].size, fl, sl );
+
+	auto& head = mBins[fl][sl];
+	mNodes[aBlock].prevFree = kInvalid;
+	mNodes[aBlock].nextFree = head;
+	if( kInvalid != head )
+		mNodes[head].prevFree = aBlock;
+	head = aBlock;
+
+	mFirstLevel |= std::uint64_t(1) << fl;
+	mSecondLevel[fl] |= std::uint32_t(1) << sl;
+	++mFreeBlocks;
+}
+
+void TlsfAllocator::remove_free_( Block aBlock ) noexcept
+{
+	unsigned fl, sl;
+	map_size_( mNodes[aBlock].size, fl, sl );
+
+	auto const& node = mNodes[aBlock];
+	if( kInvalid != node.prevFree )
+		mNodes[node.prevFree].nextFree = node.nextFree;
+	else
+		mBins[fl][sl] = node.nextFree;
+
+	if( kInvalid != node.nextFree )
+		mNodes[node.nextFree].prevFree = node.prevFree;
+
+	if( kInvalid == mBins[fl][sl] )
+	{
+		mSecondLevel[fl] &= ~(std::uint32_t(1) << sl);
+		if( !mSecondLevel[fl] )
+			mFirstLevel &= ~(std::uint64_t(1) << fl);
+	}
+	--mFreeBlocks;
+}
+
+TlsfAllocator::Block TlsfAllocator::find_free_( std::size_t aUnits ) const noexcept
+{
+	unsigned fl, sl;
+	map_size_( aUnits, fl, sl );
+
+	// Round up to the next bin, so that every block of the bin fits
+	unsigned goodFl = fl, goodSl = sl;
+	if( aUnits >= kSecondLevelCount_ )
+	{
+		auto const round = (std::size_t(1) << (floor_log2_( aUnits ) - kSecondLevelLog2_)) - 1;
+		if( aUnits + round > aUnits )
+			map_size_( aUnits + round, goodFl, goodSl );
+	}
+
+	std::uint32_t slMask = mSecondLevel[goodFl] & (~std::uint32_t(0) << goodSl);
+	if( !slMask && goodFl+1 < kFirstLevelCount_ )
+	{
+		auto const flMask = mFirstLevel & (~std::uint64_t(0) << (goodFl+1));
+		if( flMask )
+		{
+			goodFl = lowest_bit_( flMask );
+			slMask = mSecondLevel[goodFl];
+		}
+	}
+
+	if( slMask )
+		return mBins[goodFl][lowest_bit_( slMask )];
+
+	// Only blocks of the request's own bin are left; some of them may still
+	// be large enough (e.g., a block of exactly the requested size).
+	if( goodFl != fl || goodSl != sl )
+	{
+		for( auto block = mBins[fl][sl]; kInvalid != block; block = mNodes[block].nextFree )
+		{
+			if( mNodes[block].size >= aUnits )
+				return block;
+		}
+	}
+
+	return kInvalid;
+}
@@ -0,0 +1,89 @@
+#ifndef TLSF_ALLOCATOR_HPP_3C8E51A2_07D4_4B96_A1F3_6E29D8B40C57
+#define TLSF_ALLOCATOR_HPP_3C8E51A2_07D4_4B96_A1F3_6E29D8B40C57
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+/** TlsfAllocator: two-level segregated fit allocator for an external range
+ *
+ * Manages the units [0, capacity) of some memory that the allocator does not
+ * touch itself (e.g., a GL buffer), so all bookkeeping is kept on the side.
+ * Free blocks are binned by size: the first level is the power of two, the
+ * second level splits each power of two into kSecondLevelCount linear
+ * classes. Two bitmaps locate a non-empty bin that is large enough in
+ * constant time; allocate() and free() are O(1), and free() merges the block
+ * with its free neighbours immediately.
+ *
+ * Requests are rounded up to the next bin boundary when searching, so any
+ * block in the found bin fits ("good fit"). The block is split, and the
+ * remainder is returned to the free lists.
+ */
+class TlsfAllocator final
+{
+	public:
+		using Block = std::uint32_t;
+		static constexpr Block kInvalid = ~Block(0);
+
+	public:
+		explicit TlsfAllocator( std::size_t aCapacity = 0 );
+
+	public:
+		// Returns kInvalid if there is no free block that is large enough.
+		Block allocate( std::size_t aUnits );
+		void free( Block );
+
+		std::size_t offset( Block ) const noexcept;
+		std::size_t size( Block ) const noexcept;
+
+	public:
+		std::size_t capacity() const noexcept;
+		std::size_t used() const noexcept;
+
+		std::size_t free_block_count() const noexcept;
+		std::size_t largest_free_block() const noexcept;
+
+	private:
+		static constexpr unsigned kSecondLevelLog2_ = 4;
+		static constexpr unsigned kSecondLevelCount_ = 1u << kSecondLevelLog2_;
+		static constexpr unsigned kFirstLevelCount_ = 64 - kSecondLevelLog2_ + 1;
+
+		struct Node_
+		{
+			std::size_t offset;
+			std::size_t size;
+
+			Block prevPhys, nextPhys; // neighbours in the range
+			Block prevFree, nextFree; // bin list (free blocks only)
+
+			bool free;
+		};
+
+		// Bin of a block size. Sizes below kSecondLevelCount_ get a bin each
+		// (first level 0); above, each power of two has kSecondLevelCount_
+		// bins.
+		static void map_size_( std::size_t aSize, unsigned& aFl, unsigned& aSl ) noexcept;
+
+		Block new_node_();
+		void release_node_( Block ) noexcept;
+
+		void insert_free_( Block ) noexcept;
+		void remove_free_( Block ) noexcept;
+
+		Block find_free_( std::size_t aUnits ) const noexcept;
+
+	private:
+		std::vector<Node_> mNodes;
+		std::vector<Block> mUnusedNodes;
+
+		std::uint64_t mFirstLevel = 0;
+		std::uint32_t mSecondLevel[kFirstLevelCount_] = {};
+		Block mBins[kFirstLevelCount_][kSecondLevelCount_];
+
+		std::size_t mCapacity;
+		std::size_t mUsed = 0;
+		std::size_t mFreeBlocks = 0;
+};
+
+#endif // TLSF_ALLOCATOR_HPP_3C8E51A2_07D4_4B96_A1F3_6E29D8B40C57
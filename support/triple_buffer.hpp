@@ -0,0 +1,82 @@
+#ifndef TRIPLE_BUFFER_HPP_5D2A7C14_93E1_4B0F_A6C8_2F47E91B3D60
+#define TRIPLE_BUFFER_HPP_5D2A7C14_93E1_4B0F_A6C8_2F47E91B3D60
+
+#include <atomic>
+
+#include <cstdint>
+
+/** TripleBuffer: lock-free handoff of the latest value between two threads
+ *
+ * One producer and one consumer each own one of three buffers; the third
+ * ("middle") buffer is exchanged atomically. The producer fills
+ * write_buffer() and calls publish(), which swaps it with the middle buffer.
+ * The consumer calls acquire(), which swaps its read_buffer() with the
+ * middle buffer if that holds a newer value than the one it has.
+ *
+ * Neither side ever waits for the other. If the producer publishes twice
+ * before the consumer acquires, the older value is overwritten; use
+ * pending() to avoid that (see RenderThread). Buffers are reused, so the
+ * producer finds an old value in write_buffer() and should overwrite (or
+ * clear) all of it; keeping container capacity this way avoids per-frame
+ * allocations.
+ */
+template< typename tValue >
+class TripleBuffer final
+{
+	public:
+		TripleBuffer() = default;
+
+		TripleBuffer( TripleBuffer const& ) = delete;
+		TripleBuffer& operator= (TripleBuffer const&) = delete;
+
+	public: // producer
+		tValue& write_buffer() noexcept
+		{
+			return mBuffers[mWrite];
+		}
+
+		void publish() noexcept
+		{
+			// Release: the contents of the write buffer must be visible before
+			// the consumer can swap it in. Acquire: the consumer has finished
+			// with the buffer that is handed back.
+			auto const old = mMiddle.exchange( mWrite | kFresh_, std::memory_order_acq_rel );
+			mWrite = old & kIndexMask_;
+		}
+
+		// True if the last published value has not been acquired yet
+		bool pending() const noexcept
+		{
+			return 0 != (mMiddle.load( std::memory_order_acquire ) & kFresh_);
+		}
+
+	public: // consumer
+		// Returns false (and keeps the current read buffer) if nothing new
+		// was published since the last call.
+		bool acquire() noexcept
+		{
+			if( 0 == (mMiddle.load( std::memory_order_relaxed ) & kFresh_) )
+				return false;
+
+			auto const old = mMiddle.exchange( mRead, std::memory_order_acq_rel );
+			mRead = old & kIndexMask_;
+			return true;
+		}
+
+		tValue const& read_buffer() const noexcept
+		{
+			return mBuffers[mRead];
+		}
+
+	private:
+		static constexpr std::uint32_t kIndexMask_ = 0x3;
+		static constexpr std::uint32_t kFresh_ = 0x4;
+
+		tValue mBuffers[3];
+
+		std::uint32_t mWrite = 0; // producer only
+		std::uint32_t mRead = 1;  // consumer only
+		std::atomic<std::uint32_t> mMiddle{ 2 };
+};
+
+#endif // TRIPLE_BUFFER_HPP_5D2A7C14_93E1_4B0F_A6C8_2F47E91B3D60
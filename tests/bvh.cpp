@@ -0,0 +1,255 @@
+#include "tests.hpp"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+
+#include "../support/jobs.hpp"
+#include "../support/error.hpp"
+
+#include "../main/bvh.hpp"
+
+namespace
+{
+	constexpr std::size_t kRandomTriangles_ = 1200;
+	constexpr std::size_t kGridSize_ = 20; // quads per side
+	constexpr std::size_t kRayCount_ = 20000;
+
+	// Rays that pass this close (in barycentric coordinates) to a triangle's
+	// edge, or hits within this (relative) distance of each other, may be
+	// resolved differently in float and double precision.
+	constexpr double kEdgeEps_ = 1e-4;
+	constexpr double kTieEps_ = 1e-4;
+
+	// Tolerance when comparing t, u and v of the same hit
+	constexpr double kHitEps_ = 1e-3;
+
+	struct Reference_
+	{
+		bool hit = false;
+		double t = 0.0, u = 0.0, v = 0.0;
+		std::uint32_t triangle = 0;
+
+		// The result may legitimately differ from the Bvh's (see kEdgeEps_)
+		bool ambiguous = false;
+	};
+
+	struct DVec3_
+	{
+		double x, y, z;
+
+		DVec3_( Vec3f aVec ) noexcept
+			: x( aVec.x ), y( aVec.y ), z( aVec.z )
+		{}
+		DVec3_( double aX, double aY, double aZ ) noexcept
+			: x( aX ), y( aY ), z( aZ )
+		{}
+	};
+
+	DVec3_ sub_( DVec3_ aA, DVec3_ aB ) noexcept
+	{
+		return DVec3_{ aA.x-aB.x, aA.y-aB.y, aA.z-aB.z };
+	}
+	double dot_( DVec3_ aA, DVec3_ aB ) noexcept
+	{
+		return aA.x*aB.x + aA.y*aB.y + aA.z*aB.z;
+	}
+	DVec3_ cross_( DVec3_ aA, DVec3_ aB ) noexcept
+	{
+		return DVec3_{ aA.y*aB.z - aA.z*aB.y, aA.z*aB.x - aA.x*aB.z, aA.x*aB.y - aA.y*aB.x };
+	}
+
+	// Brute-force closest hit with t in (0, aMaxT): Möller-Trumbore against
+	// every triangle, in double precision.
+	Reference_ brute_force_( std::vector<Vec3f> const& aSoup, Vec3f aOrigin, Vec3f aDirection, double aMaxT )
+	{
+		DVec3_ const o( aOrigin ), d( aDirection );
+
+		Reference_ ret;
+		ret.t = aMaxT;
+
+		for( std::size_t i = 0; i+2 < aSoup.size(); i += 3 )
+		{
+			DVec3_ const v0( aSoup[i] );
+			auto const e1 = sub_( aSoup[i+1], v0 );
+			auto const e2 = sub_( aSoup[i+2], v0 );
+
+			auto const p = cross_( d, e2 );
+			double const det = dot_( e1, p );
+
+			// Degenerate triangles and rays in the triangle's plane never hit
+			double const scale = std::sqrt( dot_( e1, e1 ) * dot_( e2, e2 ) * dot_( d, d ) );
+			if( std::abs( det ) <= 1e-9 * scale )
+				continue;
+
+			double const inv = 1.0 / det;
+			auto const s = sub_( o, v0 );
+			double const u = dot_( s, p ) * inv;
+			auto const q = cross_( s, e1 );
+			double const v = dot_( d, q ) * inv;
+			double const t = dot_( e2, q ) * inv;
+
+			double const edge = std::min( { u, v, 1.0 - u - v } );
+			if( edge < -kEdgeEps_ || t <= 0.0 || t >= aMaxT * (1.0 + kTieEps_) )
+				continue;
+
+			// Near an edge, at the origin or at aMaxT: may go either way
+			if( edge < kEdgeEps_ || t < kTieEps_ || t > aMaxT * (1.0 - kTieEps_) )
+			{
+				ret.ambiguous = true;
+				if( edge < 0.0 || t >= aMaxT )
+					continue;
+			}
+
+			if( ret.hit && std::abs( t - ret.t ) <= kTieEps_ * (1.0 + t) )
+				ret.ambiguous = true;
+
+			if( t < ret.t )
+			{
+				ret.hit = true;
+				ret.t = t;
+				ret.u = u;
+				ret.v = v;
+				ret.triangle = std::uint32_t(i / 3);
+			}
+		}
+
+		return ret;
+	}
+
+	bool close_( double aA, double aB ) noexcept
+	{
+		return std::abs( aA - aB ) <= kHitEps_ * (1.0 + std::abs( aA ));
+	}
+
+	void compare_( char const* aWhat, std::size_t aRay, Reference_ const& aRef, bool aHit, BvhHit const& aBvhHit )
+	{
+		if( aRef.ambiguous )
+			return;
+
+		if( aRef.hit != aHit )
+			throw Error( "ray %zu: %s %s, brute force %s (t = %g)", aRay, aWhat, aHit ? "hits" : "misses", aRef.hit ? "hits" : "misses", aRef.hit ? aRef.t : double(aBvhHit.t) );
+
+		if( !aHit )
+			return;
+
+		if( aRef.triangle != aBvhHit.triangle )
+			throw Error( "ray %zu: %s hits triangle %u (t = %g), brute force %u (t = %g)", aRay, aWhat, unsigned(aBvhHit.triangle), double(aBvhHit.t), unsigned(aRef.triangle), aRef.t );
+
+		if( !close_( aRef.t, aBvhHit.t ) || !close_( aRef.u, aBvhHit.u ) || !close_( aRef.v, aBvhHit.v ) )
+			throw Error( "ray %zu: %s hit (t,u,v) = (%g,%g,%g), brute force (%g,%g,%g)", aRay, aWhat, double(aBvhHit.t), double(aBvhHit.u), double(aBvhHit.v), aRef.t, aRef.u, aRef.v );
+	}
+
+	// Random triangles of varying size, a sheared height-field grid (many
+	// shared edges) and a few degenerate triangles.
+	std::vector<Vec3f> make_soup_( std::mt19937& aRng )
+	{
+		std::uniform_real_distribution<float> coord( -10.f, 10.f );
+		std::uniform_real_distribution<float> offset( -2.f, 2.f );
+		std::uniform_real_distribution<float> height( -0.5f, 0.5f );
+
+		std::vector<Vec3f> soup;
+		for( std::size_t i = 0; i < kRandomTriangles_; ++i )
+		{
+			float const size = (i % 10) ? 0.5f : 4.f;
+			Vec3f const c{ coord( aRng ), coord( aRng ), coord( aRng ) };
+			for( std::size_t k = 0; k < 3; ++k )
+				soup.emplace_back( c + size * Vec3f{ offset( aRng ), offset( aRng ), offset( aRng ) } );
+		}
+
+		std::vector<float> heights( (kGridSize_+1) * (kGridSize_+1) );
+		for( auto& h : heights )
+			h = height( aRng );
+
+		auto const grid = [&] (std::size_t aX, std::size_t aZ) {
+			float const x = -10.f + 20.f * aX / kGridSize_;
+			float const z = -10.f + 20.f * aZ / kGridSize_;
+			return Vec3f{ x, -6.f + 0.2f * x + heights[aZ*(kGridSize_+1) + aX], z };
+		};
+		for( std::size_t z = 0; z < kGridSize_; ++z )
+		{
+			for( std::size_t x = 0; x < kGridSize_; ++x )
+			{
+				soup.insert( soup.end(), { grid( x, z ), grid( x+1, z ), grid( x+1, z+1 ) } );
+				soup.insert( soup.end(), { grid( x, z ), grid( x+1, z+1 ), grid( x, z+1 ) } );
+			}
+		}
+
+		for( std::size_t i = 0; i < 8; ++i )
+		{
+			Vec3f const a{ coord( aRng ), coord( aRng ), coord( aRng ) };
+			Vec3f const b{ coord( aRng ), coord( aRng ), coord( aRng ) };
+			soup.insert( soup.end(), { a, a, b } ); // zero area
+			soup.insert( soup.end(), { a, 0.5f * (a+b), b } ); // collinear
+		}
+
+		return soup;
+	}
+}
+
+void test_bvh()
+{
+	std::mt19937 rng( 3811 );
+	auto const soup = make_soup_( rng );
+
+	JobSystem jobs( 3 );
+	Bvh const bvh( soup, jobs );
+
+	if( soup.size() / 3 != bvh.triangle_count() )
+		throw Error( "Bvh has %zu triangles, expected %zu", bvh.triangle_count(), soup.size() / 3 );
+
+	std::uniform_real_distribution<float> origin( -15.f, 15.f );
+	std::uniform_real_distribution<float> target( -10.f, 10.f );
+	std::uniform_real_distribution<float> scale( 0.1f, 10.f );
+	std::uniform_real_distribution<float> fraction( 0.25f, 1.5f );
+	std::normal_distribution<float> normal( 0.f, 1.f );
+
+	std::size_t hits = 0, ambiguous = 0;
+	for( std::size_t ray = 0; ray < kRayCount_; ++ray )
+	{
+		// Half of the rays aim into the scene, the others go anywhere. The
+		// directions are not normalized (t is in units of their length).
+		Vec3f const o{ origin( rng ), origin( rng ), origin( rng ) };
+		auto const dir = (ray % 2)
+			? normalize( Vec3f{ target( rng ), target( rng ), target( rng ) } - o )
+			: normalize( Vec3f{ normal( rng ), normal( rng ), normal( rng ) } )
+		;
+		auto const d = scale( rng ) * dir;
+
+		auto const ref = brute_force_( soup, o, d, 1e30 );
+		hits += ref.hit;
+		ambiguous += ref.ambiguous;
+
+		BvhHit hit{}, scalarHit{};
+		bool const didHit = bvh.raycast( o, d, 1e30f, hit );
+		bool const didHitScalar = bvh.raycast_scalar( o, d, 1e30f, scalarHit );
+
+		compare_( "raycast()", ray, ref, didHit, hit );
+		compare_( "raycast_scalar()", ray, ref, didHitScalar, scalarHit );
+
+		// AVX vs. scalar leaves, directly. Both are in float, so a hit on the
+		// same triangle must have the same t even for ambiguous rays.
+		if( !ref.ambiguous && didHit != didHitScalar )
+			throw Error( "ray %zu: raycast() (%s leaves) and raycast_scalar() disagree", ray, Bvh::simd() ? "AVX" : "scalar" );
+		if( didHit && didHitScalar && hit.triangle == scalarHit.triangle && !close_( hit.t, scalarHit.t ) )
+			throw Error( "ray %zu: raycast() (%s leaves) t = %g, raycast_scalar() t = %g", ray, Bvh::simd() ? "AVX" : "scalar", double(hit.t), double(scalarHit.t) );
+
+		// Any-hit queries, with a limit before or after the closest hit
+		float const maxT = ref.hit ? fraction( rng ) * float(ref.t) : 1e30f;
+		auto const limited = brute_force_( soup, o, d, maxT );
+		if( !limited.ambiguous && limited.hit != bvh.occluded( o, d, maxT ) )
+			throw Error( "ray %zu: occluded( maxT = %g ) is %s, brute force %s", ray, double(maxT), limited.hit ? "false" : "true", limited.hit ? "hits" : "misses" );
+
+		if( !limited.ambiguous && limited.hit != bvh.intersects_segment( o, o + maxT * d ) )
+			throw Error( "ray %zu: intersects_segment() disagrees with brute force", ray );
+	}
+
+	// Guard against degenerate inputs that would make the comparison vacuous.
+	if( hits < kRayCount_ / 4 || hits > kRayCount_ * 9 / 10 || ambiguous > kRayCount_ / 100 )
+		throw Error( "%zu of %zu rays hit (%zu ambiguous); expected a mix", hits, kRayCount_, ambiguous );
+}
@@ -0,0 +1,155 @@
+#include "tests.hpp"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/error.hpp"
+
+#include "../main/culling.hpp"
+
+namespace
+{
+	constexpr std::size_t kSphereCount_ = 1003;
+
+	// Written to aVisible before culling, to detect writes outside of the
+	// range or missing writes inside of it.
+	constexpr std::uint8_t kUntouched_ = 0xaa;
+
+	// The AVX and scalar paths may round differently (e.g., if the compiler
+	// contracts one of them to FMAs), so spheres that touch a plane to within
+	// this distance may legitimately be classified differently.
+	constexpr double kBoundaryEps_ = 1e-3;
+
+	Frustum random_camera_frustum_( std::mt19937& aRng )
+	{
+		std::uniform_real_distribution<float> angle( -3.14159f, 3.14159f );
+		std::uniform_real_distribution<float> pos( -30.f, 30.f );
+		std::uniform_real_distribution<float> fov( 0.3f, 2.f );
+
+		auto const world2camera = make_rotation_x( angle( aRng ) )
+			* make_rotation_y( angle( aRng ) )
+			* make_translation( Vec3f{ pos( aRng ), pos( aRng ), pos( aRng ) } )
+		;
+		auto const proj = make_perspective_projection( fov( aRng ), 16.f/9.f, 0.1f, 60.f );
+		return extract_frustum_planes( proj * world2camera );
+	}
+
+	// Six arbitrary planes; the "frustum" need not be bounded or non-empty.
+	Frustum random_planes_( std::mt19937& aRng )
+	{
+		std::normal_distribution<float> normal( 0.f, 1.f );
+		std::uniform_real_distribution<float> offset( -20.f, 40.f );
+
+		Frustum ret{};
+		for( auto& p : ret.planes )
+		{
+			auto const n = normalize( Vec3f{ normal( aRng ), normal( aRng ), normal( aRng ) } );
+			p = Vec4f{ n.x, n.y, n.z, offset( aRng ) };
+		}
+		return ret;
+	}
+
+	// Signed distance of the sphere's surface to the closest plane, in double
+	// precision: < 0 is outside, > 0 inside.
+	double sphere_margin_( Frustum const& aFrustum, SphereSoA const& aSpheres, std::size_t aIndex )
+	{
+		double margin = 1e30;
+		for( auto const& p : aFrustum.planes )
+		{
+			double const dist = double(p.x)*aSpheres.x[aIndex] + double(p.y)*aSpheres.y[aIndex] + double(p.z)*aSpheres.z[aIndex] + p.w;
+			margin = std::min( margin, dist + aSpheres.radius[aIndex] );
+		}
+		return margin;
+	}
+
+	void compare_range_( Frustum const& aFrustum, SphereSoA const& aSpheres, std::size_t aBegin, std::size_t aEnd, std::size_t& aVisibleTotal )
+	{
+		std::vector<std::uint8_t> simd( aSpheres.size(), kUntouched_ );
+		std::vector<std::uint8_t> scalar( aSpheres.size(), kUntouched_ );
+
+		auto const simdCount = cull_spheres( aFrustum, aSpheres, aBegin, aEnd, simd.data() );
+		auto const scalarCount = cull_spheres_scalar( aFrustum, aSpheres, aBegin, aEnd, scalar.data() );
+
+		std::size_t simdSum = 0, scalarSum = 0, boundary = 0;
+		for( std::size_t i = 0; i < aSpheres.size(); ++i )
+		{
+			bool const inRange = i >= aBegin && i < aEnd;
+			if( !inRange )
+			{
+				if( kUntouched_ != simd[i] || kUntouched_ != scalar[i] )
+					throw Error( "[%zu,%zu): sphere %zu outside of the range was written", aBegin, aEnd, i );
+				continue;
+			}
+
+			if( simd[i] > 1 || scalar[i] > 1 )
+				throw Error( "[%zu,%zu): sphere %zu has flags %u (AVX) and %u (scalar)", aBegin, aEnd, i, unsigned(simd[i]), unsigned(scalar[i]) );
+
+			simdSum += simd[i];
+			scalarSum += scalar[i];
+
+			if( simd[i] != scalar[i] )
+			{
+				auto const margin = sphere_margin_( aFrustum, aSpheres, i );
+				if( std::abs( margin ) > kBoundaryEps_ )
+					throw Error( "[%zu,%zu): sphere %zu is %s with AVX but %s with the scalar path (margin %g)", aBegin, aEnd, i, simd[i] ? "visible" : "culled", scalar[i] ? "visible" : "culled", margin );
+				++boundary;
+			}
+		}
+
+		if( simdCount != simdSum || scalarCount != scalarSum )
+			throw Error( "[%zu,%zu): returned counts %zu (AVX) and %zu (scalar) do not match the flags (%zu and %zu)", aBegin, aEnd, simdCount, scalarCount, simdSum, scalarSum );
+
+		auto const diff = simdCount > scalarCount ? simdCount - scalarCount : scalarCount - simdCount;
+		if( diff > boundary )
+			throw Error( "[%zu,%zu): %zu visible with AVX, %zu with the scalar path", aBegin, aEnd, simdCount, scalarCount );
+
+		aVisibleTotal += scalarCount;
+	}
+}
+
+void test_cull_spheres()
+{
+	std::mt19937 rng( 3811 );
+	std::uniform_real_distribution<float> coord( -50.f, 50.f );
+	std::uniform_real_distribution<float> radius( 0.01f, 10.f );
+
+	SphereSoA spheres;
+	spheres.reserve( kSphereCount_ );
+	for( std::size_t i = 0; i < kSphereCount_; ++i )
+		spheres.push_back( Vec3f{ coord( rng ), coord( rng ), coord( rng ) }, radius( rng ) );
+
+	// Range starts and lengths around the batch size of eight, so that both
+	// the batched loop and the scalar remainder are exercised.
+	std::size_t const begins[] = { 0, 1, 3, 8, 13 };
+	std::size_t const counts[] = { 0, 1, 7, 8, 9, 15, 16, 17, 100, 990 };
+
+	std::size_t tested = 0, visible = 0;
+	for( std::size_t f = 0; f < 16; ++f )
+	{
+		auto const frustum = (f % 2) ? random_planes_( rng ) : random_camera_frustum_( rng );
+
+		for( auto const begin : begins )
+		{
+			for( auto const count : counts )
+			{
+				compare_range_( frustum, spheres, begin, begin + count, visible );
+				tested += count;
+			}
+		}
+
+		compare_range_( frustum, spheres, 0, spheres.size(), visible );
+		tested += spheres.size();
+	}
+
+	// Guard against degenerate inputs that would make the comparison vacuous.
+	if( 0 == visible || tested == visible )
+		throw Error( "%zu of %zu spheres visible; expected a mix", visible, tested );
+}
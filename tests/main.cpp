@@ -0,0 +1,52 @@
+#include <typeinfo>
+#include <iterator>
+#include <exception>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "tests.hpp"
+
+namespace
+{
+	struct Test_
+	{
+		char const* name;
+		void (*run)();
+	};
+
+	Test_ const kTests_[] = {
+		{ "cull_spheres", &test_cull_spheres },
+		{ "occlusion_buffer", &test_occlusion_buffer },
+		{ "bvh", &test_bvh },
+	};
+}
+
+int main() try
+{
+	std::size_t failed = 0;
+	for( auto const& test : kTests_ )
+	{
+		try
+		{
+			test.run();
+			std::printf( "%-24s ok\n", test.name );
+		}
+		catch( std::exception const& eErr )
+		{
+			std::printf( "%-24s FAILED (%s)\n", test.name, typeid(eErr).name() );
+			std::printf( "  %s\n", eErr.what() );
+			++failed;
+		}
+	}
+
+	std::printf( "%zu of %zu tests passed\n", std::size(kTests_) - failed, std::size(kTests_) );
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "Top-level Exception (%s):\n", typeid(eErr).name() );
+	std::fprintf( stderr, "%s\n", eErr.what() );
+	std::fprintf( stderr, "Bye.\n" );
+	return 1;
+}
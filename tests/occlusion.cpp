@@ -0,0 +1,126 @@
+#include "tests.hpp"
+
+#include <vector>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/jobs.hpp"
+#include "../support/error.hpp"
+
+#include "../main/occlusion.hpp"
+
+namespace
+{
+	// Camera at the origin looking down -z. The occluder is a wall of 8x8
+	// units, 10 units in front of the camera; it covers |x/z|, |y/z| <= 0.4.
+	constexpr float kWallDistance_ = 10.f;
+	constexpr float kWallHalfSize_ = 4.f;
+
+	struct BoxCase_
+	{
+		char const* name;
+		Vec3f center;
+		float halfSize;
+		bool expectVisible;
+	};
+
+	BoxCase_ const kCases_[] = {
+		{ "behind the wall", Vec3f{ 0.f, 0.f, -20.f }, 1.f, false },
+		{ "behind the wall, off-centre", Vec3f{ -3.f, 2.f, -30.f }, 1.f, false },
+		{ "far behind the wall", Vec3f{ 1.f, -1.f, -90.f }, 5.f, false },
+		{ "beside the wall", Vec3f{ 12.f, 0.f, -20.f }, 1.f, true },
+		{ "above the wall", Vec3f{ 0.f, 10.f, -20.f }, 1.f, true },
+		{ "in front of the wall", Vec3f{ 0.f, 0.f, -5.f }, 1.f, true },
+		{ "through the wall", Vec3f{ 0.f, 0.f, -10.f }, 1.f, true },
+		{ "partly behind the wall", Vec3f{ 8.f, 0.f, -20.f }, 1.f, true },
+		{ "around the camera", Vec3f{ 0.f, 0.f, 0.f }, 1.f, true },
+	};
+
+	// Wall in object space (z = 0), as a triangle soup with one front- and
+	// one back-facing triangle; occluders are double-sided.
+	OccluderMesh make_wall_()
+	{
+		float const s = kWallHalfSize_;
+		std::vector<Vec3f> const soup{
+			Vec3f{ -s, -s, 0.f }, Vec3f{ s, -s, 0.f }, Vec3f{ s, s, 0.f },
+			Vec3f{ -s, -s, 0.f }, Vec3f{ -s, s, 0.f }, Vec3f{ s, s, 0.f }
+		};
+
+		// Also checks that make_occluder() drops small triangles
+		auto soupWithSliver = soup;
+		soupWithSliver.insert( soupWithSliver.end(), { Vec3f{ 0.f, 0.f, 0.f }, Vec3f{ 1e-3f, 0.f, 0.f }, Vec3f{ 0.f, 1e-3f, 0.f } } );
+
+		auto ret = make_occluder( soupWithSliver, 0.01f );
+		if( 6 != ret.indices.size() )
+			throw Error( "make_occluder() kept %zu indices, expected 6", ret.indices.size() );
+
+		return ret;
+	}
+
+	std::vector<float> run_case_( JobSystem& aJobs, char const* aJobsName )
+	{
+		auto const proj = make_perspective_projection( 1.0472f, 320.f/192.f, 0.1f, 100.f );
+		auto const wallWorld = make_translation( Vec3f{ 0.f, 0.f, -kWallDistance_ } );
+		auto const wall = make_wall_();
+
+		OcclusionBuffer buffer( 320, 192 );
+
+		// Without occluders, everything in front of the camera is visible.
+		buffer.begin( proj );
+		buffer.rasterize( aJobs );
+		for( auto const& c : kCases_ )
+		{
+			Vec3f const half{ c.halfSize, c.halfSize, c.halfSize };
+			if( !buffer.test( c.center - half, c.center + half, kIdentity44f ) )
+				throw Error( "%s: box %s is culled with no occluders", aJobsName, c.name );
+		}
+
+		buffer.begin( proj );
+		buffer.add_occluder( wall, wallWorld );
+		buffer.rasterize( aJobs );
+
+		if( 2 != buffer.triangle_count() )
+			throw Error( "%s: %zu occluder triangles rasterized, expected 2", aJobsName, buffer.triangle_count() );
+
+		auto const cx = buffer.width() / 2, cy = buffer.height() / 2;
+		if( !(buffer.depth( cx, cy ) < 1.f) )
+			throw Error( "%s: no depth written at the centre of the wall", aJobsName );
+		if( !(buffer.depth( 0, 0 ) == 1.f) )
+			throw Error( "%s: depth %g written outside of the wall", aJobsName, buffer.depth( 0, 0 ) );
+
+		for( auto const& c : kCases_ )
+		{
+			Vec3f const half{ c.halfSize, c.halfSize, c.halfSize };
+			if( c.expectVisible != buffer.test( c.center - half, c.center + half, kIdentity44f ) )
+				throw Error( "%s: box %s is %s", aJobsName, c.name, c.expectVisible ? "culled" : "visible" );
+
+			// Same box, with the placement in the world matrix instead
+			if( c.expectVisible != buffer.test( -half, half, make_translation( c.center ) ) )
+				throw Error( "%s: box %s (placed with aWorld) is %s", aJobsName, c.name, c.expectVisible ? "culled" : "visible" );
+		}
+
+		std::vector<float> depth;
+		depth.reserve( buffer.width() * buffer.height() );
+		for( std::size_t y = 0; y < buffer.height(); ++y )
+		{
+			for( std::size_t x = 0; x < buffer.width(); ++x )
+				depth.emplace_back( buffer.depth( x, y ) );
+		}
+		return depth;
+	}
+}
+
+void test_occlusion_buffer()
+{
+	JobSystem serial( 0, true );
+	auto const serialDepth = run_case_( serial, "single-threaded" );
+
+	JobSystem parallel( 3 );
+	auto const parallelDepth = run_case_( parallel, "multi-threaded" );
+
+	// Bands are rasterized independently, so the result must not depend on
+	// how they were scheduled.
+	if( serialDepth != parallelDepth )
+		throw Error( "depth buffers differ between single- and multi-threaded rasterization" );
+}
@@ -0,0 +1,14 @@
+#ifndef TESTS_HPP
+#define TESTS_HPP
+
+// Headless tests of the CPU-side systems in main/. They make no OpenGL calls
+// and need no window, so they also run on machines without a GPU.
+//
+// Each test throws Error with a description of the first mismatch it finds.
+// Random inputs use fixed seeds, so failures are reproducible.
+
+void test_cull_spheres();
+void test_occlusion_buffer();
+void test_bvh();
+
+#endif // TESTS_HPP
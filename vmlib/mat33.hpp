@@ -53,6 +53,20 @@ constexpr Mat33f kIdentity33f = { {
 
 // Common operators for Mat33f.
 
+constexpr
+Mat33f operator*(Mat33f const& aLeft, Mat33f const& aRight) noexcept
+{
+	Mat33f ret{};
+	for (std::size_t i = 0; i < 3; ++i)
+		for (std::size_t j = 0; j < 3; ++j)
+			for (std::size_t k = 0; k < 3; ++k)
+			{
+				ret(i, j) += aLeft(i, k) * aRight(k, j);
+			}
+
+	return ret;
+}
+
 constexpr
 Vec3f operator*(Mat33f const& aLeft, Vec3f const& aRight) noexcept
 {